@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "nes6502.h"
+
+class Cartridge;
+
+// Lockstep 6502 for running many copies of one program at once, e.g.
+// the same ROM under different inputs. The registers of every copy
+// (a lane) are stored as one array per register, and system RAM is
+// interleaved so that the lanes' copies of a byte sit next to each
+// other. While all lanes are at the same pc the instr there is decoded
+// once and executed for every lane with loops over those arrays, which
+// the hot loads, logic, arithmetic and compares run with AVX2 when the
+// file is compiled for it. Lanes that have diverged are grouped by pc
+// and each group runs on its own, down to single lanes.
+//
+// Every lane sees the same fixed cartridge, read once when the batch is
+// created, so mappers that switch banks are not supported and writes to
+// cartridge space are dropped. The I/O registers read as zero and
+// ignore writes. Instrs behave and take the cycles they do on the
+// FUSED engine with PER_INSTR accuracy, and no interrupts are raised.
+class Batch6502
+{
+public:
+  Batch6502(size_t nLanes, const std::shared_ptr<Cartridge> &cart);
+  ~Batch6502() = default;
+
+public:
+  // CPU core registers, one entry per lane
+  std::vector<uint8_t> a;
+  std::vector<uint8_t> x;
+  std::vector<uint8_t> y;
+  std::vector<uint8_t> stkp;
+  std::vector<uint16_t> pc;
+  std::vector<uint64_t> cycles;// Cycles run by each lane since it was created
+
+  // Status register of a lane, N and Z are lazy like in nes6502
+  uint8_t GetStatus(size_t lane) const;
+  void SetStatus(size_t lane, uint8_t p);
+
+  // Memory as a lane's CPU sees it
+  uint8_t Read(size_t lane, uint16_t addr) const;
+  void Write(size_t lane, uint16_t addr, uint8_t data);
+  void ClearRam();
+
+  size_t Lanes() const { return nLanes; }
+
+  void reset();// Resets every lane
+  void step();// Every lane performs one instr
+  void stepLane(size_t lane);// Only the given lane performs one instr
+  void run(uint32_t nSteps);
+
+  struct STATS
+  {
+    uint64_t nSteps = 0;// Calls of step()
+    uint64_t nUniformSteps = 0;// Steps all lanes executed together
+    uint64_t nGroups = 0;// Lane groups executed in the other steps
+    uint64_t nLaneInstrs = 0;// Instrs executed, summed over lanes
+  };
+
+  STATS Stats() const { return stats; }
+
+private:
+  using ADDRMODE = nes6502::ADDRMODE;
+
+  // Lanes an instr is executed for. All lanes are one contiguous run
+  // of every array, which lets the per-lane loops vectorize
+  struct ALL_LANES
+  {
+    size_t n;
+    template <typename F>
+    void ForEach(F f) const
+    {
+      for (size_t l = 0; l < n; l++)
+        f(l);
+    }
+  };
+
+  struct LANE_LIST
+  {
+    const uint32_t *p;
+    size_t n;
+    template <typename F>
+    void ForEach(F f) const
+    {
+      for (size_t i = 0; i < n; i++)
+        f(p[i]);
+    }
+  };
+
+  // Operand of an instr whose addr is the same in every lane, which
+  // is either a row of RAM holding each lane's byte or one value
+  // shared by all of them
+  struct SOURCE
+  {
+    const uint8_t *row = nullptr;
+    uint8_t value = 0x00;
+    uint8_t at(size_t l) const { return row ? row[l] : value; }
+  };
+
+  enum ALU {
+    ORA,
+    AND,
+    EOR,
+    ADC,
+    SBC,
+    CMP,
+    CPX,
+    CPY,
+    BIT,
+    LDA,
+    LDX,
+    LDY,
+  };
+
+  enum RMW {
+    ASL,
+    LSR,
+    ROL,
+    ROR,
+    INC,
+    DEC,
+  };
+
+  struct DECODED
+  {
+    uint8_t opcode = 0x00;
+    uint16_t operand = 0x0000;
+    uint16_t next = 0x0000;// Addr following the instr
+  };
+
+  DECODED Decode(size_t lane) const;
+
+  template <typename LANES>
+  void execute(const LANES &lanes, const DECODED &d);
+
+  uint8_t *Row(uint16_t addr) { return &vRam[(addr & 0x07FF) * nLanes]; }
+  SOURCE Source(ADDRMODE mode, uint16_t operand);
+  template <ADDRMODE M>
+  uint16_t Address(size_t l, uint16_t operand, uint8_t &crossed) const;
+
+  template <ALU OP>
+  uint8_t *Reg();
+  template <ALU OP>
+  void AluLane(size_t l, uint8_t v);
+  template <ALU OP>
+  void AluAll(const SOURCE &s);
+  template <ALU OP, ADDRMODE M, typename LANES>
+  void Alu(const LANES &lanes, uint16_t operand);
+
+  template <RMW OP>
+  uint8_t Modify(size_t l, uint8_t v);
+  template <RMW OP, ADDRMODE M, typename LANES>
+  void Rmw(const LANES &lanes, uint16_t operand);
+
+  template <ADDRMODE M, typename LANES>
+  void Store(const LANES &lanes, uint16_t operand, const uint8_t *reg);
+
+  void SetNZ(size_t l, uint8_t v)
+  {
+    lazy_z[l] = v;
+    lazy_n[l] = v;
+  }
+
+private:
+  size_t nLanes = 0;
+  std::vector<uint8_t> vRam;// 2KB per lane, byte addr of lane l at addr * nLanes + l
+  std::vector<uint8_t> vPRG;// $8000-$FFFF as the cartridge mapped it
+
+  // Status register apart from N and Z, and the lazy N and Z
+  std::vector<uint8_t> status;
+  std::vector<uint8_t> lazy_z;
+  std::vector<uint8_t> lazy_n;
+
+  // Scratch lists for grouping diverged lanes
+  std::vector<uint32_t> vPending;
+  std::vector<uint32_t> vGroup;
+  std::vector<uint32_t> vRest;
+
+  STATS stats;
+};
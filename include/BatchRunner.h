@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "nes6502.h"
+
+class Bus;
+
+// Headless runner for large numbers of independent emulator jobs. A
+// job boots a ROM, runs it for a number of frames while feeding the
+// first controller from an input stream, and hashes the machine state
+// it ends in. Jobs are spread over a pool of worker threads, one per
+// core by default and each pinned to its core, which keep a deque of
+// jobs each and steal from the others once theirs runs dry. A worker
+// reuses one Bus for all of its jobs, powered up anew for each.
+class BatchRunner
+{
+public:
+  // nWorkers of 0 starts one worker per hardware thread
+  BatchRunner(size_t nWorkers = 0, bool bPinCores = true, nes6502::ENGINE engine = nes6502::FUSED);
+  ~BatchRunner() = default;
+
+public:
+  struct JOB
+  {
+    std::string sRom;
+    uint32_t nFrames = 0;
+    // Controller 1 buttons for each frame, see Bus::controller. The
+    // last entry is held once the stream runs out, none means idle
+    std::vector<uint8_t> vInput;
+    // Likewise for controller 2
+    std::vector<uint8_t> vInput2;
+    // Snapshot to start from instead of powering up, see Bus::saveState()
+    std::vector<uint8_t> vState;
+    // Hash the job is expected to end with, if bCheckHash
+    bool bCheckHash = false;
+    uint64_t nExpectedHash = 0;
+  };
+
+  struct RESULT
+  {
+    bool bOk = false;// False if the ROM or the snapshot could not be loaded
+    std::string sError;
+    uint32_t nFrames = 0;// Frames actually run
+    uint64_t nCycles = 0;// CPU cycles and steps they took, see Bus::STATS
+    uint64_t nInstrs = 0;
+    uint64_t nHash = 0;// FNV-1a of the CPU registers and RAM at the end
+    bool bHashMatch = false;// Only meaningful if the job checks its hash
+    double fSeconds = 0.0;// Time spent running the frames
+    size_t nWorker = 0;
+  };
+
+  // Runs every job and returns their results in the same order
+  std::vector<RESULT> Run(const std::vector<JOB> &vJobs);
+
+  size_t Workers() const { return nWorkers; }
+  // Wall clock time of the last Run()
+  double Seconds() const { return fSeconds; }
+
+  // Reads a manifest of one job per line, blank lines and lines
+  // starting with '#' are skipped:
+  //   <rom path> <frames> [<input file>|-] [<expected hash>|-]
+  // The input file holds one byte of controller 1 buttons per frame,
+  // the hash is 16 hex digits as reported in the results
+  static bool LoadManifest(const std::string &sFile, std::vector<JOB> &vJobs, std::string &sError);
+
+  // FNV-1a of the CPU registers and RAM, as the jobs end with
+  static uint64_t HashState(Bus &nes);
+
+  // Results of a run, and the throughput overall and per job, as JSON
+  std::string ToJson(const std::vector<JOB> &vJobs, const std::vector<RESULT> &vResults) const;
+
+private:
+  size_t nWorkers = 0;
+  bool bPinCores = true;
+  nes6502::ENGINE engine = nes6502::FUSED;
+  double fSeconds = 0.0;
+};
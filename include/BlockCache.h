@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <bitset>
+
+class Bus;
+
+// Cache of pre-decoded basic blocks for the CACHED engine. A block is
+// a straight run of instrs starting at some pc and ending after the
+// first instr that can change the flow of control. Each instr is
+// stored with its opcode (which selects the fused handler) and
+// operand bytes, so executing from the cache skips both the bus reads
+// of the instr stream and its decoding.
+//
+// PRG ROM ($8000-$FFFF), PRG RAM ($6000-$7FFF) and system RAM
+// ($0000-$1FFF) are cached. ROM blocks stay within one 8KB bank slot
+// and remember the offset into PRG ROM of the bank they were decoded
+// from, so they miss once a different bank is switched in. The
+// offsets of the banks switched in are kept here, updated by the
+// cartridge's bank switch hook through BanksSwitched(). ROM never
+// changes, while writes to RAM holding cached code make the blocks
+// decoded from it stale.
+//
+// Blocks are looked up by the pc they start at, through an index of
+// every addr, so blocks never collide. They are taken from a pool in
+// turn, and once it has run out the whole cache starts over.
+class BlockCache
+{
+public:
+  BlockCache() = default;
+  ~BlockCache() = default;
+
+public:
+  static constexpr size_t nBlocks = 4096;
+  static constexpr size_t nMaxBlockInstrs = 16;
+
+  struct DECODED
+  {
+    uint8_t opcode = 0x00;
+    uint8_t length = 0;// Total bytes, including the opcode
+    uint16_t operand = 0x0000;
+  };
+
+  struct BLOCK
+  {
+    uint16_t start = 0x0000;
+    uint16_t end = 0x0000;// Addr following the last instr
+    uint32_t bank = 0;// PRG ROM offset of a ROM block's bank
+    uint32_t written = 0;// Write generation a RAM block was decoded in
+    uint8_t count = 0;// Number of instrs decoded so far
+    bool bOpen = false;// Whether more instrs may follow
+    std::array<DECODED, nMaxBlockInstrs> instrs;
+  };
+
+  struct STATS
+  {
+    uint64_t nHits = 0;// Block lookups served from the cache
+    uint64_t nMisses = 0;// Block lookups which had to decode
+    uint64_t nInvalidations = 0;// Writes to pages holding cached code
+    uint64_t nUncached = 0;// Instrs fetched from uncacheable memory
+    uint64_t nFlushes = 0;// Times the pool of blocks ran out
+  };
+
+  // Returns the decoded instr at pc, decoding its block on a miss.
+  // Returns nullptr if pc is outside cacheable memory
+  const DECODED *Fetch(uint16_t pc, Bus *bus)
+  {
+    // Falling through to the next instr of the current block is
+    // the common case and needs no lookup at all. Instrs are only
+    // decoded once they are first reached
+    if (pCurrent != nullptr && pc == nNextPC
+        && (nIndex < pCurrent->count || Extend(*pCurrent, bus))) {
+      const DECODED *d = &pCurrent->instrs[nIndex++];
+      nNextPC += d->length;
+      return d;
+    }
+
+    // Then a ROM block hit, which needs no checks beyond its bank
+    uint16_t n = vIndex[pc];
+    if (n > 0 && pc >= 0x8000) {
+      BLOCK &block = blocks[n - 1];
+      if (block.bank == vBankOffset[(pc >> 13) & 0x03] && block.count > 0) {
+        stats.nHits++;
+        pCurrent = &block;
+        nIndex = 1;
+        nNextPC = pc + block.instrs[0].length;
+        return &block.instrs[0];
+      }
+    }
+    return Lookup(pc, bus);
+  }
+
+  // Must see every CPU write so cached code stays coherent. Bank
+  // switches are not looked for here, see BanksSwitched()
+  void Write(uint16_t addr)
+  {
+    if (addr < 0x8000 && codePages[PhysicalPage(addr)])
+      Invalidate(PhysicalPage(addr));
+  }
+
+  // Takes the offsets of the banks the cartridge has switched in, and
+  // leaves the block being executed, as it may have been switched out
+  void BanksSwitched(const Bus *bus);
+
+  // Drops every block, e.g. when memory was changed behind the CPU's back
+  void Flush();
+  // Leaves the block being executed, so the next Fetch() looks its pc
+  // up afresh. For when the pc or the banks have been restored, which
+  // may match the next instr of the block by chance
+  void Leave()
+  {
+    pCurrent = nullptr;
+    nNextPC = 0x0000;
+  }
+
+  const STATS &Stats() const { return stats; }
+
+private:
+  // System RAM is mirrored every 2KB, so code in it is tracked by
+  // the page it physically lives in rather than the addr it ran at
+  static uint8_t PhysicalPage(uint16_t addr)
+  {
+    return (addr < 0x2000 ? (addr & 0x07FF) : addr) >> 8;
+  }
+
+  static bool Cacheable(uint16_t addr)
+  {
+    return addr < 0x2000 || addr >= 0x6000;
+  }
+
+  // Whether none of the RAM a block was decoded from has been written
+  // since. ROM blocks are told apart by their bank instead
+  bool Fresh(const BLOCK &block) const
+  {
+    return block.start >= 0x8000
+           || (vPageWritten[PhysicalPage(block.start)] <= block.written
+               && vPageWritten[PhysicalPage(block.end - 1)] <= block.written);
+  }
+
+  const DECODED *Lookup(uint16_t pc, Bus *bus);
+  // Starts a block at pc with its first instr, and decodes the instr
+  // following the block onto its end, if the block may go on
+  void Decode(BLOCK &block, uint16_t pc, Bus *bus);
+  bool Extend(BLOCK &block, Bus *bus);
+  void Invalidate(uint8_t page);
+
+private:
+  // Block starting at each addr plus one, 0 if there is none
+  std::array<uint16_t, 0x10000> vIndex = {};
+  std::array<BLOCK, nBlocks> blocks;
+  size_t nBlocksUsed = 0;
+  // Pages of RAM holding the code of at least one cached block, and the
+  // write generation each page was last written to in while it did
+  std::bitset<256> codePages;
+  std::array<uint32_t, 256> vPageWritten = {};
+  uint32_t nWriteGeneration = 0;
+  // PRG ROM offsets of the banks in the four slots from $8000
+  std::array<uint32_t, 4> vBankOffset = {};
+
+  // Block being executed and position of the next instr in it
+  BLOCK *pCurrent = nullptr;
+  uint8_t nIndex = 0;
+  uint16_t nNextPC = 0x0000;
+
+  STATS stats;
+};
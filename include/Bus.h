@@ -1,12 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
 #include <array>
 #include <memory>
 
 #include "nes6502.h"
 #include "nes2C02.h"
 #include "Cartridge.h"
+#include "Scheduler.h"
+#include "CowMemory.h"
 
 class Bus
 {
@@ -20,21 +23,169 @@ public:// Devices on the bus
 
   // The 2C02 PPU (picture processing unit)
   nes2C02 ppu;
-  // Fake RAM for now
-  std::array<uint8_t, 2048> cpuRam;
+  // 2KB of system RAM, shared page by page with forked machines
+  // until written. Writes from outside have to go through the bus,
+  // or through Write(), never through a page held on to
+  CowMemory<8> cpuRam;
+  // Buttons held on the two controllers, one bit each, A in bit 7
+  // down to Right in bit 0
+  uint8_t controller[2] = { 0x00, 0x00 };
 
 public:// Bus read/write
-  void cpuWrite(uint16_t addr, uint8_t data);
-  uint8_t cpuRead(uint16_t addr, bool bReadOnly = false);
+  // Pages backed by plain memory are accessed directly through the
+  // page table, the others go through the devices
+  void cpuWrite(uint16_t addr, uint8_t data)
+  {
+    uint8_t *page = vWritePages[addr >> 8];
+    if (page)
+      page[addr & 0x00FF] = data;
+    else
+      cpuWriteDevice(addr, data);
+  }
+
+  uint8_t cpuRead(uint16_t addr, bool bReadOnly = false)
+  {
+    const uint8_t *page = vReadPages[addr >> 8];
+    if (page)
+      return page[addr & 0x00FF];
+    return cpuReadDevice(addr, bReadOnly);
+  }
+
+  // Memory backing the page of addr for reading directly, or nullptr
+  // if reads of it have to go through cpuRead()
+  const uint8_t *ReadPage(uint16_t addr) const { return vReadPages[addr >> 8]; }
+
+  // A page of system RAM for code which accesses it directly, made
+  // this machine's own first
+  uint8_t *RamPage(uint8_t page)
+  {
+    if (!vWritePages[page]) {
+      cpuRam.WritePage(page);
+      MapRam();
+    }
+    return vWritePages[page];
+  }
+
+  // Bank generation of the inserted cartridge, see Mapper
+  uint32_t BankGeneration() const { return cart ? cart->BankGeneration() : 0; }
+  // Offset into PRG ROM of the bank mapped at addr, which code caches
+  // key ROM code on
+  uint32_t PRGBankOffset(uint16_t addr) const { return cart ? cart->PRGBankOffset(addr) : 0; }
 
 public:// System Interface
   void insertCartridge(const std::shared_ptr<Cartridge> &cartridge);
   void reset();
+  // Advances the system by one PPU dot, for stepping through it
   void clock();
 
+  // Runs the system up to the next scheduled event, handles it and
+  // returns it. The CPU runs whole instrs until the master clock has
+  // reached the event. The PPU is left behind and only catches up
+  // with the CPU when the CPU writes to a device, which may be one of
+  // its registers or a mapper switching its CHR banks, when the CPU
+  // reads its registers, and when the event is due
+  Scheduler::EVENT runToEvent();
+
+  // What a run of the system covered
+  struct STATS
+  {
+    uint64_t nCycles = 0;// CPU cycles
+    uint64_t nInstrs = 0;// CPU steps, whole blocks for the JIT engine
+    uint32_t nFrames = 0;// Frames the PPU completed
+    double fSeconds = 0.0;// Wall clock time
+  };
+
+  // Runs until the PPU completes the frame it is drawing, and clears
+  // ppu.frame_complete again
+  STATS runFrame();
+  // Runs for nCycles CPU cycles, finishing the instr the last of them
+  // falls in
+  STATS runCycles(uint64_t nCycles);
+
+  // Snapshots of the whole machine: the CPU with the latches of the
+  // instr it is in, RAM, the PPU's tables and beam, the cartridge's
+  // mapper and RAM, the scheduled events and the clocks. A snapshot
+  // has a fixed layout for the inserted cartridge and is copied field
+  // by field. Loading allocates nothing: memory still shared with the
+  // ROM's blank RAM or a forked machine is replaced by spares set aside
+  // when the cartridge was inserted or the machine forked. The PPU's
+  // screen is not part of it, and neither are the controllers'
+  // buttons, which the host sets
+
+  // Bytes a snapshot of the machine with its current cartridge takes
+  size_t StateSize();
+  // Returns the bytes written, 0 if nSize is too small for a snapshot
+  size_t saveState(uint8_t *pData, size_t nSize);
+  // Returns false, leaving the machine as it was, if the data is not
+  // a snapshot taken with the same cartridge
+  bool loadState(const uint8_t *pData, size_t nSize);
+
+  // Makes child an independent copy of this machine, as if it had
+  // been loaded with a snapshot of it, for exploring a branch of what
+  // it may do next. The child gets a cartridge of its own which shares
+  // the ROM, and shares RAM and VRAM until either machine writes to
+  // them, a page at a time. It runs on this machine's engine and
+  // accuracy, but keeps its own render setting. Forking into a child
+  // kept from an earlier branch saves constructing one, whose PPU
+  // screens are most of the cost
+  void fork(Bus &child);
+  std::unique_ptr<Bus> fork();
+
+  // Master clock, in PPU dots since the last reset
+  uint64_t Clock() const { return nMasterClock; }
+
+  // Moves the CPU on by one CPU cycle within the instr it is running.
+  // A cycle accurate CPU calls this before each of its bus accesses,
+  // so that the devices it reaches see the access at its own cycle
+  // rather than at the start of the instr
+  void cpuTick();
+
 private:
-  // count of how many clocks have passed
-  uint32_t nSystemClockCounter = 0;
+  // Page table of the CPU's address space, one entry per 256 bytes
+  // pointing at the memory backing the page, or nullptr if accesses
+  // to it have to be handled by a device: the I/O registers, and any
+  // cartridge space the mapper has to see. It is rebuilt when a
+  // cartridge is inserted, and the pages of a PRG slot when the
+  // mapper switches the bank in it, which the cartridge tells the bus
+  // of through its bank switch hook. PRG RAM is mapped for reading
+  // while the mapper enables it, and for writing as well once the
+  // cartridge does not share it with a forked one
+  std::array<const uint8_t *, 256> vReadPages{};
+  std::array<uint8_t *, 256> vWritePages{};
+  uint32_t nMappedGeneration = 0;
+  void MapPages();
+  void BanksSwitched(uint8_t nPRGSlots);
+  void ConnectBankSwitches();
+  // Maps the pages of RAM this machine owns, while those it shares
+  // are left to cpuWriteDevice() to copy on the first write
+  void MapRam();
+
+  void cpuWriteDevice(uint16_t addr, uint8_t data);
+  uint8_t cpuReadDevice(uint16_t addr, bool bReadOnly);
+
+  Scheduler scheduler;
+  void ScheduleFrameEnd();
+
+  // Dot of the bus access a cycle accurate CPU is making, which is
+  // ahead of the master clock while it is in the middle of an instr
+  uint64_t nCycleClock = 0;
+  uint64_t CpuClock() const { return std::max(nCycleClock, nMasterClock); }
+
+  // Controller buttons latched by the last write to $4016, shifted
+  // out a bit per read of $4016/$4017
+  uint8_t controller_state[2] = { 0x00, 0x00 };
+
+  // count of how many clocks have passed, in PPU dots
+  uint64_t nMasterClock = 0;
+  // CPU steps runToEvent() has made since the last reset
+  uint64_t nInstrs = 0;
+  // Runs to the first event of kind e, and counts what it took
+  STATS RunUntil(Scheduler::EVENT e);
+
+  // Passes the whole machine to the visitor, after a header which
+  // identifies a snapshot and the size it was taken at
+  void State(StateBuffer &s);
+  size_t nStateSize = 0;
   // Cartridge or "GamePak"
   std::shared_ptr<Cartridge> cart;
 };
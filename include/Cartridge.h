@@ -4,8 +4,15 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <variant>
+#include <functional>
 
 #include "Mapper_000.h"
+#include "Mapper_001.h"
+#include "Mapper_002.h"
+#include "Mapper_003.h"
+#include "Mapper_004.h"
+#include "RomImage.h"
 
 class Cartridge
 {
@@ -14,6 +21,8 @@ public:
   ~Cartridge() = default;
 
 public:
+  // False if the ROM did not load, needs a mapper that is not
+  // implemented, or is a board this machine can not run
   bool ImageValid();
 
   enum MIRROR {
@@ -24,22 +33,139 @@ public:
   } mirror = HORIZONTAL;
 
 private:
+  // Copy for Fork(), the mapper is copied along with the rest
+  Cartridge(const Cartridge &) = default;
+
   bool bImageValid;
-  std::vector<uint8_t> vPRGMemory;
-  std::vector<uint8_t> vCHRMemory;
+  // The ROM, read-only and shared with every cartridge of the same
+  // ROM in the process
+  std::shared_ptr<const RomImage> pImage;
+  // PRG RAM, if the cartridge has any, and CHR RAM, if it has no CHR
+  // ROM. Shared with other cartridges until either writes to it
+  std::shared_ptr<std::vector<uint8_t>> pPRGRam;
+  std::shared_ptr<std::vector<uint8_t>> pCHRRam;
+  // Spare buffers the size of the RAM, which Own() copies into rather
+  // than allocating, see ReserveRam()
+  std::shared_ptr<std::vector<uint8_t>> pPRGSpare;
+  std::shared_ptr<std::vector<uint8_t>> pCHRSpare;
+  // True if the RAM had to be copied, so the mapper's pointers into
+  // it are stale
+  bool Own(std::shared_ptr<std::vector<uint8_t>> &pRam, std::shared_ptr<std::vector<uint8_t>> &pSpare);
+
+  uint16_t nMapperID = 0;
+  uint16_t nPRGBanks = 0;
+  uint16_t nCHRBanks = 0;
 
-  uint8_t nMapperID = 0;
-  uint8_t nPRGBanks = 0;
-  uint8_t nCHRBanks = 0;
+  // Stands in for the mapper of a cartridge that could not be loaded
+  class NO_MAPPER final : public Mapper
+  {
+  public:
+    NO_MAPPER() : Mapper(0, 0) {}
+    bool cpuMapRead(uint16_t, uint32_t &) override { return false; }
+    bool cpuMapWrite(uint16_t, uint32_t &, uint8_t) override { return false; }
+    bool ppuMapRead(uint16_t, uint32_t &) override { return false; }
+    bool ppuMapWrite(uint16_t, uint32_t &) override { return false; }
+  };
 
-  std::shared_ptr<Mapper> pMapper;
+  // The mapper as its own type, chosen when the ROM is loaded. Every
+  // access std::visit()s it, which resolves to a jump on the index
+  // and direct calls the compiler can inline, where going through
+  // Mapper would be an indirect call per access that it can not
+  using MAPPER = std::variant<NO_MAPPER, Mapper_000, Mapper_001, Mapper_002, Mapper_003, Mapper_004>;
+  MAPPER mapper;
+
+  // Gives the mapper the memory its banks are in
+  void MapMemory();
+  // Takes the slots the mapper has switched, and nMoved, applies its
+  // mirroring and tells the hook
+  void BanksSwitched(uint8_t nMoved = 0);
+  // The PRG RAM backing the page at addr, nullptr if the mapper does
+  // not map any there
+  uint8_t *RamPage(uint16_t addr);
+  std::function<void(uint8_t, uint8_t)> OnBankSwitch;
 
 public:
   // Communications with the main bus
   bool cpuRead(uint16_t addr, uint8_t &data);
-  bool cpuWrite(uint16_t addr, uint8_t data);
+  // nCycle is the CPU cycle the write is made in
+  bool cpuWrite(uint16_t addr, uint8_t data, uint64_t nCycle);
+  // Memory backing the 256 byte page at addr under the current banks
+  // and PRG RAM, nullptr if the cartridge does not map the page
+  const uint8_t *cpuMapPage(uint16_t addr);
+  // Likewise for writes, which only go straight to PRG RAM that this
+  // cartridge does not share. The first write to shared RAM has to go
+  // through cpuWrite() to copy it
+  uint8_t *cpuMapWritePage(uint16_t addr);
 
   // Communications with the PPU bus
   bool ppuRead(uint16_t addr, uint8_t &data);
   bool ppuWrite(uint16_t addr, uint8_t data);
+
+  uint32_t BankGeneration() const
+  {
+    return std::visit([](const auto &m) { return m.BankGeneration(); }, mapper);
+  }
+  // Offset into PRG ROM of the bank mapped at addr, which stays the
+  // same for the same code whichever slot it was switched into
+  uint32_t PRGBankOffset(uint16_t addr) const
+  {
+    return std::visit([&](const auto &m) { return m.PRGBankOffset(addr); }, mapper);
+  }
+
+  // Called with a bit for each 8KB PRG slot ($8000 is bit 0) and 1KB
+  // CHR slot the mapper has switched, after the write or state load
+  // that switched them, for the bus to remap its pages. The PRG RAM
+  // is Mapper::nPRGRamSlot, switched when it is enabled, disabled or
+  // becomes this cartridge's own
+  void SetBankSwitchHook(std::function<void(uint8_t nPRGSlots, uint8_t nCHRSlots)> hook)
+  {
+    OnBankSwitch = std::move(hook);
+  }
+
+  // Cartridge for a forked machine, in the same state as this one. It
+  // shares the ROM, and any RAM until either cartridge writes to it.
+  // The bank switch hook is not copied, it belongs to this one's bus
+  std::shared_ptr<Cartridge> Fork() const;
+
+  // Sets aside a buffer for each RAM the cartridge still shares, with
+  // the ROM's blank RAM or a forked cartridge, so that making it its
+  // own, as loading a snapshot does, allocates nothing. The bus calls
+  // it when the cartridge is inserted and when the machine is forked
+  void ReserveRam();
+
+  // The ROM, for telling whether cartridges share it
+  const RomImage *Image() const { return pImage.get(); }
+
+  // Passes the mapper's registers and any PRG and CHR RAM to the
+  // visitor. The ROM is left out
+  void State(StateBuffer &s);
 };
+
+// The reads are defined here so that they inline into the CPU's and
+// PPU's handlers. They go straight through the mapper's bank pointers
+
+inline bool Cartridge::cpuRead(uint16_t addr, uint8_t &data)
+{
+  return std::visit([&](auto &m) {
+    uint32_t mapped_addr = 0;
+    if (pPRGRam && m.cpuMapRam(addr, mapped_addr)) {
+      data = (*pPRGRam)[mapped_addr & 0x1FFF];
+      return true;
+    } else if (const uint8_t *pBank = addr >= 0x8000 ? m.PRGBank(addr) : nullptr) {
+      data = pBank[addr & 0x1FFF];
+      return true;
+    } else
+      return false;
+  }, mapper);
+}
+
+inline bool Cartridge::ppuRead(uint16_t addr, uint8_t &data)
+{
+  return std::visit([&](auto &m) {
+    if (const uint8_t *pBank = addr <= 0x1FFF ? m.CHRBank(addr) : nullptr) {
+      data = pBank[addr & 0x03FF];
+      return true;
+    } else
+      return false;
+  }, mapper);
+}
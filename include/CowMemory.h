@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <memory>
+
+#include "StateBuffer.h"
+
+// Memory of nPages pages of 256 bytes, which a machine shares with
+// the machines forked from it until one of them writes to a page. The
+// writer then gets a copy of the page of its own, unless nobody else
+// holds it any more. A bit per page records which pages this instance
+// owns, so only the first write to a page after a fork looks further.
+// Fork() also sets aside a spare page for every page shared, which the
+// first write or load takes over, so that loading a snapshot into a
+// forked machine never allocates
+template <size_t nPages>
+class CowMemory
+{
+public:
+  using PAGE = std::array<uint8_t, 256>;
+
+  CowMemory()
+  {
+    for (auto &p : vPages)
+      p = std::make_shared<PAGE>();
+  }
+  ~CowMemory() = default;
+
+  // Copying would leave two owners of the same pages
+  CowMemory(const CowMemory &) = delete;
+  CowMemory &operator=(const CowMemory &) = delete;
+
+public:
+  static constexpr size_t nSize = nPages * 256;
+
+  uint8_t operator[](size_t addr) const { return (*vPages[addr >> 8])[addr & 0xFF]; }
+  void Write(size_t addr, uint8_t data) { WritePage(addr >> 8)[addr & 0xFF] = data; }
+  // Copies all nSize bytes out to p
+  void CopyTo(uint8_t *p) const
+  {
+    for (size_t i = 0; i < nPages; i++)
+      std::memcpy(p + i * 256, vPages[i]->data(), 256);
+  }
+  void Fill(uint8_t data)
+  {
+    for (size_t p = 0; p < nPages; p++)
+      std::memset(WritePage(p), data, 256);
+  }
+
+  bool Owned(size_t page) const { return (nOwned >> page) & 1; }
+  // The page for writing to directly, made this instance's own first.
+  // It stays valid until the next Fork()
+  uint8_t *WritePage(size_t page)
+  {
+    if (!Owned(page))
+      Own(page, true);
+    return vPages[page]->data();
+  }
+
+  // Shares every page with child, which drops its own. Both copy a
+  // page before they next write to it. The child keeps the pages it
+  // held alone as its spares, so forking into a kept child allocates
+  // only the spares this instance has used up since its last fork
+  void Fork(CowMemory &child)
+  {
+    for (size_t p = 0; p < nPages; p++) {
+      if (!child.vSpares[p] && child.vPages[p].use_count() == 1) {
+        // The other holder may have let go on another thread
+        std::atomic_thread_fence(std::memory_order_acquire);
+        child.vSpares[p] = std::move(child.vPages[p]);
+      }
+      if (!child.vSpares[p])
+        child.vSpares[p] = std::make_shared<PAGE>();
+      if (!vSpares[p])
+        vSpares[p] = std::make_shared<PAGE>();
+    }
+    child.vPages = vPages;
+    child.nOwned = 0;
+    nOwned = 0;
+  }
+
+  // Passes the pages to the visitor. Loading makes them all this
+  // instance's own, taking spares for those it still shares
+  void State(StateBuffer &s)
+  {
+    for (size_t p = 0; p < nPages; p++) {
+      if (s.Loading() && !Owned(p))
+        Own(p, false);
+      s.Bytes(vPages[p]->data(), 256);
+    }
+  }
+
+  bool operator==(const CowMemory &o) const
+  {
+    for (size_t p = 0; p < nPages; p++)
+      if (vPages[p] != o.vPages[p] && *vPages[p] != *o.vPages[p])
+        return false;
+    return true;
+  }
+
+private:
+  void Own(size_t page, bool bCopy)
+  {
+    if (vPages[page].use_count() > 1) {
+      if (vSpares[page]) {
+        if (bCopy)
+          *vSpares[page] = *vPages[page];
+        vPages[page] = std::move(vSpares[page]);
+      } else
+        vPages[page] = bCopy ? std::make_shared<PAGE>(*vPages[page]) : std::make_shared<PAGE>();
+    } else
+      // The last other holder may have just let go on another thread,
+      // its reads of the page have to be over before it is written
+      std::atomic_thread_fence(std::memory_order_acquire);
+    nOwned |= 1u << page;
+  }
+
+  static_assert(nPages <= 32, "one bit of nOwned per page");
+  std::array<std::shared_ptr<PAGE>, nPages> vPages;
+  // Held by this instance alone, see Fork()
+  std::array<std::shared_ptr<PAGE>, nPages> vSpares;
+  uint32_t nOwned = (uint32_t)((1ull << nPages) - 1);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class Bus;
+
+// Incremental disassembler for debugger views. Every addr has a fixed
+// size record in a flat table holding the instr decoded there, which
+// is only filled in once a view asks for that addr, so showing the
+// code around pc decodes a few dozen records rather than all of the
+// address space. Text is formatted into the caller's buffer on demand,
+// nothing is allocated per line.
+//
+// Records are dropped individually as the CPU writes over the bytes
+// they were decoded from, including through the mirrors of system
+// RAM. Records of cartridge space remember the bank generation they
+// were decoded under and are decoded again after a bank switch. The
+// I/O registers are never cached as their values change by themselves.
+class Disassembler
+{
+public:
+  Disassembler(Bus *bus);
+  ~Disassembler() = default;
+
+public:
+  // Room needed for the longest line Format() produces
+  static constexpr size_t nMaxText = 32;
+
+  struct LINE
+  {
+    uint8_t opcode = 0x00;
+    uint8_t length = 0;// Total bytes, 0 if the record is not decoded
+    uint16_t operand = 0x0000;
+    uint32_t generation = 0;// Bank generation the record was decoded in
+  };
+
+  // Decoded instr at addr, decoding it first if needed
+  const LINE &Line(uint16_t addr);
+
+  // Start addr of the instr following the one at addr
+  uint16_t Next(uint16_t addr) { return addr + Line(addr).length; }
+  // Start addr of the instr preceding the one at addr. Instrs can not
+  // be decoded backwards, so this resyncs from a little earlier
+  uint16_t Prev(uint16_t addr);
+
+  // Formats the instr at addr as "$C000: JMP $C5F5 {ABS}" into sText,
+  // which must hold nMaxText chars, and returns sText
+  const char *Format(uint16_t addr, char *sText);
+
+  // Must see every CPU write so stale records are dropped
+  void Write(uint16_t addr);
+
+  // Drops every record, e.g. when memory was changed behind the CPU's back
+  void Flush();
+
+private:
+  static bool IsIO(uint16_t addr) { return addr >= 0x2000 && addr < 0x4020; }
+
+private:
+  Bus *bus = nullptr;
+  std::vector<LINE> vLines;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Bus.h"
+
+// Harness for fuzzing the whole machine. The ROM is loaded and reset
+// once and a snapshot of it taken, so that an input only costs
+// restoring the snapshot and running what the input asks for, never
+// parsing the cartridge or resetting. An input is a series of records
+// of 3 bytes:
+//   $00-$7F p1 p2   hold buttons p1 on controller 1 and p2 on
+//                   controller 2 and run a slice of nSliceCycles
+//   $80-$FF lo v    write v to RAM at ((op & $07) << 8) | lo
+// Records after the nMaxSlices-th slice, and a trailing partial one,
+// are ignored. The CPU counts the instrs started at each address into
+// the coverage map given, see nes6502::SetCoverage(), which the caller
+// clears between inputs as it sees fit. A program with an entry point
+// for running without a PPU, like nestest's automation mode at $C000,
+// can have the snapshot taken with the CPU about to jump there
+class Fuzzer
+{
+public:
+  static constexpr size_t nCoverage = 0x10000;
+  static constexpr int32_t nResetVector = -1;
+
+  Fuzzer(const std::string &sRom, uint8_t *pCoverage, nes6502::ENGINE engine = nes6502::FUSED,
+    uint32_t nSliceCycles = 128, uint32_t nMaxSlices = 16, int32_t nEntry = nResetVector);
+  ~Fuzzer() = default;
+
+public:
+  // False if the ROM could not be loaded
+  bool Ok() const { return nes != nullptr; }
+
+  // Runs one input from the snapshot, returns the CPU cycles it ran
+  uint64_t Run(const uint8_t *pData, size_t nSize);
+
+  // Machine as the last input left it
+  Bus &Machine() { return *nes; }
+
+private:
+  std::unique_ptr<Bus> nes;
+  std::vector<uint8_t> vSnapshot;
+  uint32_t nSliceCycles;
+  uint32_t nMaxSlices;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+
+class nes6502;
+class Bus;
+
+// Dynamic recompiler for the JIT engine. Basic blocks of cartridge
+// PRG-ROM which have run often enough are translated into x86-64 code.
+// Register transfers, increments, flag changes, immediate mode loads,
+// logic and compares, zero page loads, stores and BIT, PHA, PLA, JSR,
+// RTS, jumps and branches are emitted inline; every other instr
+// becomes a direct call into the fused handler with its operand baked
+// in. A block runs on past branches which are not taken and leaves
+// through those which are. It runs as one unit and returns its exact
+// cycle count, including branch and page crossing penalties, so Bus
+// timing and interrupt delivery stay correct at block boundaries. A
+// block with nothing to emit inline is left to the interpreter.
+//
+// Code in RAM (which may modify itself) and instrs addressing I/O
+// registers directly are left to the interpreter. If a compiled block
+// writes into cartridge space, it exits right after that instr in
+// case the mapper switched banks. Blocks stay within one 8KB bank
+// slot and are keyed on the offset into PRG ROM of the bank they were
+// translated from, which never changes, so a block switched out and
+// back in runs again without being translated again. The offsets of
+// the banks switched in are kept here, updated by the cartridge's
+// bank switch hook through BanksSwitched().
+//
+// Slots are found through an index of every ROM addr, with the slots
+// of the different banks seen at an addr chained from it, so a lookup
+// never hashes and no slot is ever evicted by another, losing its
+// count of runs. Once the slots or the code arena run out everything
+// starts over. Only built for x86-64 Linux; elsewhere no block is
+// ever compiled and the engine behaves like FUSED.
+class Jit6502
+{
+public:
+  Jit6502(nes6502 *cpu);
+  ~Jit6502();
+
+  Jit6502(const Jit6502 &) = delete;
+  Jit6502 &operator=(const Jit6502 &) = delete;
+
+public:
+  static constexpr size_t nSlots = 8192;
+  static constexpr size_t nMaxBlockInstrs = 16;
+  static constexpr size_t nArenaSize = 1 << 20;
+  // Executions a block needs before it is worth translating
+  static constexpr uint16_t nHotThreshold = 4;
+
+  struct STATS
+  {
+    uint64_t nBlocksRun = 0;// Compiled blocks executed
+    uint64_t nBlocksCompiled = 0;
+    uint64_t nBlocksRejected = 0;// Blocks left to the interpreter
+    uint64_t nInterpreted = 0;// Instrs run by the interpreter instead
+    uint64_t nFlushes = 0;// Times the code arena filled up
+  };
+
+  // Runs the compiled block at the CPU's pc, translating it first if
+  // it just became hot. Returns the cycles taken, or 0 if there is no
+  // compiled block and the caller should interpret the next instr
+  uint8_t Run(uint16_t pc);
+
+  // Takes the offsets of the banks the cartridge has switched in
+  void BanksSwitched(const Bus *bus);
+
+  // Must see every CPU write that goes through nes6502::write(), to
+  // end a block which wrote to the cartridge. Inline stores to zero
+  // page and the stack never reach it, Run() accounts for those itself
+  void Write(uint16_t addr)
+  {
+    if (addr >= 0x4020)
+      bCartWritten = true;
+  }
+
+  void Flush();
+
+  const STATS &Stats() const { return stats; }
+
+private:
+  using BLOCKFN = uint32_t (*)(nes6502 *cpu, uint8_t *zp, uint8_t *stack);
+
+  struct SLOT
+  {
+    uint32_t bank = 0;
+    uint16_t nNext = 0;// Slot of the same addr in another bank, plus one
+    uint16_t nRuns = 0;
+    bool bRejected = false;
+    bool bStoresRam = false;// Has inline stores to RAM, see Run()
+    BLOCKFN fn = nullptr;
+  };
+
+  struct INSTR
+  {
+    uint16_t addr;
+    uint8_t opcode;
+    uint8_t length;
+    uint16_t operand;
+  };
+
+  // Counts a run of the block at pc which is not compiled, and
+  // compiles it once it is hot. n is its slot plus one, or 0 if the
+  // block has none yet. Returns the slot plus one once the block is
+  // compiled, or 0 to interpret it
+  uint16_t Warm(uint16_t pc, uint32_t bank, uint16_t n);
+  // Takes the next free slot for the block at pc in bank, starting
+  // everything over if there is none
+  uint16_t Allocate(uint16_t pc, uint32_t bank);
+  bool Decode(uint16_t pc, std::vector<INSTR> &block, uint16_t &end);
+  // nullptr if the code could not be made executable
+  BLOCKFN Compile(const std::vector<INSTR> &block);
+
+  // Called from generated code for instrs that are not emitted inline.
+  // The instr is packed as opcode | operand << 8 and pc is the addr
+  // following it. Returns the cycles taken, with bit 8 set if the
+  // instr wrote into cartridge space
+  static uint32_t Interpret(nes6502 *cpu, uint32_t instr, uint32_t pc);
+
+private:
+  nes6502 *cpu = nullptr;
+  // Slot of the block starting at each ROM addr plus one, 0 if none
+  std::array<uint16_t, 0x8000> vIndex = {};
+  std::array<SLOT, nSlots> slots;
+  size_t nSlotsUsed = 0;
+  // PRG ROM offsets of the banks in the four slots from $8000
+  std::array<uint32_t, 4> vBankOffset = {};
+
+  uint8_t *pArena = nullptr;
+  size_t nArenaUsed = 0;
+
+  bool bCartWritten = false;
+
+  STATS stats;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only contents of a file. Where the platform has mmap() the file
+// is mapped rather than read, so opening it copies nothing and every
+// mapping of the same file shares the same physical pages; elsewhere
+// it is read into memory
+class MappedFile
+{
+public:
+  // Data() is nullptr if the file could not be opened or is empty
+  MappedFile(const std::string &sFileName);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+public:
+  const uint8_t *Data() const { return pData; }
+  size_t Size() const { return nSize; }
+
+private:
+  const uint8_t *pData = nullptr;
+  size_t nSize = 0;
+  bool bMapped = false;
+  // The file, if it could not be mapped
+  std::vector<uint8_t> vData;
+};
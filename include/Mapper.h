@@ -2,19 +2,144 @@
 
 #include <cstdint>
 
+#include "StateBuffer.h"
+
+// Interface of the mappers. The cartridge holds its mapper as the
+// mapper's own type and calls it directly, see Cartridge::MAPPER, so
+// the interface is only virtual for code handling mappers generally.
+//
+// A mapper maps PRG ROM into $8000-$FFFF in four slots of 8KB and the
+// pattern memory into PPU $0000-$1FFF in eight slots of 1KB, with
+// MapPRG() and MapCHR(). Those keep a host pointer to the bank in
+// each slot, so they are only called when registers are written, and
+// reading through the slots costs no arithmetic at all
 class Mapper
 {
 public:
-  Mapper(uint8_t prgBanks, uint8_t chrBanks);
+  Mapper(uint16_t prgBanks, uint16_t chrBanks);
   ~Mapper() = default;
 
 public:
-  virtual bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr) = 0;
-  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) = 0;
-  virtual bool ppuMapRead(uint16_t addr, uint32_t &mapped_addr) = 0;
-  virtual bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) = 0;
+  virtual bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr);
+  // Writes to the mapper's range, which reach its registers if it has
+  // any; ROM itself is never written
+  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) = 0;
+  virtual bool ppuMapRead(uint16_t addr, uint32_t &mapped_addr);
+  virtual bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr);
+  // Offset into the cartridge's PRG RAM, if addr reaches it. The RAM
+  // is at least 8KB and the offset below that
+  virtual bool cpuMapRam(uint16_t, uint32_t &) { return false; }
+
+  // Host memory of the banks in the slots at addr, nullptr until the
+  // cartridge has given the mapper its memory
+  const uint8_t *PRGBank(uint16_t addr) const { return vPRGBank[(addr >> 13) & 0x03]; }
+  const uint8_t *CHRBank(uint16_t addr) const { return vCHRBank[(addr >> 10) & 0x07]; }
+  // Offset into PRG ROM of the bank in the slot at addr, which tells
+  // the banks apart. PRG ROM never changes, so code decoded from the
+  // same offset stays good however often its bank is switched
+  uint32_t PRGBankOffset(uint16_t addr) const { return vPRGOffset[(addr >> 13) & 0x03]; }
+
+  // The memory the banks are in, given by the cartridge once loaded
+  // and again whenever the CHR RAM has been copied
+  void SetMemory(const uint8_t *pPRG, const uint8_t *pCHR);
+
+  // CPU cycle of the write the next cpuMapWrite() handles, for mappers
+  // which react to when they are written
+  void SetWriteCycle(uint64_t nCycle) { nWriteCycle = nCycle; }
+
+  // Changes whenever the mapper switches PRG banks, so anything derived
+  // from the contents of mapped memory knows to throw it away
+  uint32_t BankGeneration() const { return nBankGeneration; }
+
+  // The PRG RAM at $6000-$7FFF has a bit of its own among the switched
+  // PRG slots, set when the mapper enables or disables it
+  static constexpr uint8_t nPRGRamSlot = 0x10;
+  // False while the mapper has its PRG RAM disabled, see EnableRam()
+  bool RamEnabled() const { return bRamEnabled; }
+
+  // Slots switched since the last call, a bit for each PRG and CHR slot
+  void TakeSwitches(uint8_t &nPRGSlots, uint8_t &nCHRSlots)
+  {
+    nPRGSlots = nPRGSwitched;
+    nCHRSlots = nCHRSwitched;
+    nPRGSwitched = 0;
+    nCHRSwitched = 0;
+  }
+
+  // Name table mirroring, if the mapper selects it rather than the
+  // cartridge's wiring
+  enum MIRROR {
+    HARDWIRED,
+    HORIZONTAL,
+    VERTICAL,
+    ONESCREEN_LO,
+    ONESCREEN_HI,
+  };
+  MIRROR Mirror() const { return mirror; }
+
+  // Passes the mapper's registers to the visitor. A mapper which
+  // switches banks has to map them again when loading its registers.
+  // The generation itself is never restored, it must only ever grow
+  virtual void State(StateBuffer &) {}
 
 protected:
-  uint8_t nPRGBanks = 0;
-  uint8_t nCHRBanks = 0;
+  // Puts the 8KB PRG bank nBank into slot nSlot ($8000 is slot 0),
+  // and the 1KB CHR bank nBank into nSlot ($0000 is slot 0). Banks
+  // beyond the memory wrap around modulo the number of banks. For the
+  // power of two sizes boards come in that is the upper bank lines
+  // not being connected, and NES 2.0 sizes need not be powers of two.
+  // Only register writes get here, never reads
+  void MapPRG(uint8_t nSlot, uint32_t nBank);
+  void MapCHR(uint8_t nSlot, uint32_t nBank);
+  // For mappers which can disable their PRG RAM, whose cpuMapRam()
+  // then has to honour RamEnabled()
+  void EnableRam(bool b);
+
+  uint16_t nPRGBanks = 0;
+  uint16_t nCHRBanks = 0;
+  uint32_t nBankGeneration = 0;
+  MIRROR mirror = HARDWIRED;
+  uint64_t nWriteCycle = 0;
+
+private:
+  const uint8_t *pPRGMemory = nullptr;
+  const uint8_t *pCHRMemory = nullptr;
+  uint32_t vPRGOffset[4] = {};
+  uint32_t vCHROffset[8] = {};
+  const uint8_t *vPRGBank[4] = {};
+  const uint8_t *vCHRBank[8] = {};
+  uint8_t nPRGSwitched = 0;
+  uint8_t nCHRSwitched = 0;
+  bool bRamEnabled = true;
 };
+
+inline bool Mapper::cpuMapRead(uint16_t addr, uint32_t &mapped_addr)
+{
+  if (addr >= 0x8000) {
+    mapped_addr = vPRGOffset[(addr >> 13) & 0x03] + (addr & 0x1FFF);
+    return true;
+  }
+
+  return false;
+}
+
+inline bool Mapper::ppuMapRead(uint16_t addr, uint32_t &mapped_addr)
+{
+  if (addr <= 0x1FFF) {
+    mapped_addr = vCHROffset[addr >> 10] + (addr & 0x03FF);
+    return true;
+  }
+
+  return false;
+}
+
+inline bool Mapper::ppuMapWrite(uint16_t addr, uint32_t &mapped_addr)
+{
+  // Without CHR ROM the pattern memory is RAM
+  if (addr <= 0x1FFF && nCHRBanks == 0) {
+    mapped_addr = vCHROffset[addr >> 10] + (addr & 0x03FF);
+    return true;
+  }
+
+  return false;
+}
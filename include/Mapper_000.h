@@ -3,15 +3,35 @@
 #include "Mapper.h"
 #include <cstdint>
 
-class Mapper_000 : public Mapper
+// NROM. The banks never change, so they are mapped once. The mapping
+// functions are defined here rather than in the .cpp so that the
+// cartridge, which holds the mapper as its own type, can have them
+// inlined into its callers; likewise for the other mappers
+class Mapper_000 final : public Mapper
 {
 public:
-  Mapper_000(uint8_t prgBanks, uint8_t chrBanks);
+  Mapper_000(uint16_t prgBanks, uint16_t chrBanks);
   ~Mapper_000() = default;
 
 public:
-  virtual bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr) override;
-  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
-  virtual bool ppuMapRead(uint16_t addr, uint32_t &mapped_addr) override;
-  virtual bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) override;
+  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) override;
+  virtual bool cpuMapRam(uint16_t addr, uint32_t &mapped_addr) override;
 };
+
+inline bool Mapper_000::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data)
+{
+  // Claimed, but there are no registers
+  (void)data;
+  return cpuMapRead(addr, mapped_addr);
+}
+
+inline bool Mapper_000::cpuMapRam(uint16_t addr, uint32_t &mapped_addr)
+{
+  // Family BASIC has RAM here, iNES images are given 8KB of it
+  if (addr >= 0x6000 && addr <= 0x7FFF) {
+    mapped_addr = addr & 0x1FFF;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Mapper.h"
+#include <cstdint>
+
+// MMC1. Registers are loaded a bit at a time through a shift register
+// written at $8000-$FFFF, the address of the fifth write selects which:
+//   $8000 control   mirroring, PRG bank mode, CHR bank mode
+//   $A000 CHR bank 0
+//   $C000 CHR bank 1
+//   $E000 PRG bank
+// Writing a value with bit 7 set resets the shift register. Of writes
+// on consecutive CPU cycles only the first is seen, which is how the
+// dummy write of a read-modify-write instr goes unnoticed
+class Mapper_001 final : public Mapper
+{
+public:
+  Mapper_001(uint16_t prgBanks, uint16_t chrBanks);
+  ~Mapper_001() = default;
+
+public:
+  // The register writes are only defined in the .cpp, they are rare
+  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) override;
+  virtual bool cpuMapRam(uint16_t addr, uint32_t &mapped_addr) override;
+  virtual void State(StateBuffer &s) override;
+
+private:
+  void MapBanks();
+
+  uint8_t nShift = 0x10;// Bit 4 marks the fifth write
+  uint8_t nControl = 0x0C;// Last bank fixed at $C000 on power up
+  uint8_t nCHRBank0 = 0x00;
+  uint8_t nCHRBank1 = 0x00;
+  uint8_t nPRGBank = 0x00;
+  uint64_t nLastWrite = ~0ull;// CPU cycle of the last write, ~0 before the first
+};
+
+inline bool Mapper_001::cpuMapRam(uint16_t addr, uint32_t &mapped_addr)
+{
+  if (addr >= 0x6000 && addr <= 0x7FFF && RamEnabled()) {
+    mapped_addr = addr & 0x1FFF;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Mapper.h"
+#include <cstdint>
+
+// UxROM. Any write to $8000-$FFFF selects the 16KB bank at $8000, the
+// last bank is fixed at $C000. The pattern memory is 8KB, usually RAM
+class Mapper_002 final : public Mapper
+{
+public:
+  Mapper_002(uint16_t prgBanks, uint16_t chrBanks);
+  ~Mapper_002() = default;
+
+public:
+  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) override;
+  virtual void State(StateBuffer &s) override;
+
+private:
+  void MapBanks();
+
+  uint8_t nPRGBank = 0x00;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Mapper.h"
+#include <cstdint>
+
+// CNROM. PRG ROM is mapped as on NROM, any write to $8000-$FFFF
+// selects the 8KB CHR bank
+class Mapper_003 final : public Mapper
+{
+public:
+  Mapper_003(uint16_t prgBanks, uint16_t chrBanks);
+  ~Mapper_003() = default;
+
+public:
+  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) override;
+  virtual void State(StateBuffer &s) override;
+
+private:
+  void MapBanks();
+
+  uint8_t nCHRBank = 0x00;
+};
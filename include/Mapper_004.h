@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Mapper.h"
+#include <cstdint>
+
+// MMC3. Registers sit at the even and odd addresses of each 8KB of
+// $8000-$FFFF:
+//   $8000 bank select   which of R0-R7 $8001 writes, PRG and CHR modes
+//   $8001 bank data
+//   $A000 mirroring     $A001 PRG RAM protect
+//   $C000 IRQ latch     $C001 IRQ reload
+//   $E000 IRQ disable   $E001 IRQ enable
+// R6 and R7 select 8KB PRG banks, R0 and R1 2KB CHR banks and R2-R5
+// 1KB CHR banks. The IRQ registers are kept, but nothing clocks the
+// scanline counter yet, as the PPU makes no pattern fetches to clock
+// it with
+class Mapper_004 final : public Mapper
+{
+public:
+  Mapper_004(uint16_t prgBanks, uint16_t chrBanks);
+  ~Mapper_004() = default;
+
+public:
+  virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data) override;
+  virtual bool cpuMapRam(uint16_t addr, uint32_t &mapped_addr) override;
+  virtual void State(StateBuffer &s) override;
+
+private:
+  void MapBanks();
+
+  uint8_t nSelect = 0x00;
+  uint8_t vRegister[8] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+  uint8_t nMirroring = 0x00;
+  uint8_t nRamProtect = 0x00;
+  uint8_t nIrqLatch = 0x00;
+  bool bIrqReload = false;
+  bool bIrqEnable = false;
+};
+
+inline bool Mapper_004::cpuMapRam(uint16_t addr, uint32_t &mapped_addr)
+{
+  // The protect register is not honoured, as MMC6 games rely on
+  // different bits and most emulators leave the RAM open
+  if (addr >= 0x6000 && addr <= 0x7FFF) {
+    mapped_addr = addr & 0x1FFF;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bus.h"
+#include "BatchRunner.h"
+
+// Recording of the buttons held on both controllers in each frame of
+// a run, with a snapshot of the machine taken every nKeyInterval
+// frames as a keyframe. Playing it back on the same ROM reproduces
+// the run bit for bit. Seeking restores the keyframe at or before the
+// frame and runs on from there without drawing, so it never takes
+// more than nKeyInterval frames however long the movie is. Each
+// keyframe also holds the hash of the machine, so the stretches
+// between keyframes can be checked independently of one another, on
+// every core at once. The movie keeps the CRC32 and SHA-1 of the
+// ROM's PRG and CHR ROM, as RomIndex has them, and will not load if
+// the ROM at its path no longer matches them
+class Movie
+{
+public:
+  Movie() = default;
+  ~Movie() = default;
+
+public:
+  // Starts recording a movie of the machine as it is now
+  void Start(Bus &nes, const std::string &sRom, uint32_t nKeyInterval = 600);
+  // Runs the next frame with the buttons given and records them
+  Bus::STATS RecordFrame(Bus &nes, uint8_t nPad1, uint8_t nPad2 = 0x00);
+
+  // Puts the machine where it was at the start of frame nFrame, so
+  // that PlayFrame() plays it next. Seeking to frame 0 is how a movie
+  // is played from the beginning. Returns false if nFrame is past the
+  // end of the movie or the keyframe does not fit the machine
+  bool Seek(Bus &nes, uint32_t nFrame);
+  // Plays the next frame, false if the movie has ended
+  bool PlayFrame(Bus &nes);
+
+  uint32_t Frames() const { return (uint32_t)vInput[0].size(); }
+  // Frame PlayFrame() plays next
+  uint32_t Position() const { return nPosition; }
+  const std::string &Rom() const { return sRom; }
+  uint32_t RomCrc32() const { return nRomCrc32; }
+  const uint8_t *RomSha1() const { return vRomSha1; }
+  // Hash of the machine at the end of the movie, see BatchRunner::HashState()
+  uint64_t EndHash() const { return nEndHash; }
+
+  bool Save(const std::string &sFile, std::string &sError) const;
+  // Leaves the movie as it was if the file is damaged or was recorded
+  // on another ROM than the one at its path now
+  bool Load(const std::string &sFile, std::string &sError);
+
+  // Runs every stretch between keyframes from its first keyframe on
+  // the batch runner's workers, checking it ends with the hash of the
+  // next keyframe, or of the end of the movie. Returns a result per
+  // stretch
+  std::vector<BatchRunner::RESULT> Verify(BatchRunner &runner) const;
+
+private:
+  struct KEYFRAME
+  {
+    uint32_t nFrame;// Taken at the start of it
+    uint64_t nHash;
+    std::vector<uint8_t> vState;
+  };
+
+  std::string sRom;
+  uint32_t nRomCrc32 = 0;
+  uint8_t vRomSha1[20] = {};
+  uint32_t nKeyInterval = 600;
+  // Buttons held on each controller, one byte per frame
+  std::vector<uint8_t> vInput[2];
+  std::vector<KEYFRAME> vKeyframes;
+  uint64_t nEndHash = 0;
+  uint32_t nPosition = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class Bus;
+
+// Rewind history of a machine, kept in a ring of a fixed number of
+// bytes. Push() is called once per frame before running it and adds a
+// snapshot of the machine, Back() puts the machine back to the last
+// snapshot and drops it. Every nKeyInterval-th snapshot is stored
+// whole as a keyframe, the others as the XOR of the snapshot with the
+// one before, with the runs of zero bytes RLE compressed. As XOR runs
+// both ways the newest snapshot is kept decoded, and stepping back one
+// frame only applies that frame's delta to it. When the ring is full
+// the oldest keyframe and the deltas up to the next one are dropped
+class Rewind
+{
+public:
+  Rewind(Bus &nes, size_t nBudgetBytes = 32 << 20, uint32_t nKeyInterval = 60);
+  ~Rewind() = default;
+
+public:
+  // Adds a snapshot of the machine as it is now
+  void Push();
+  // Puts the machine back to the newest snapshot and drops it.
+  // Returns false if there is none left
+  bool Back();
+  // Drops every snapshot, e.g. after another cartridge was inserted
+  void Clear();
+
+  // Snapshots held, the oldest being this many frames back
+  size_t Frames() const { return nCount; }
+  // Bytes the snapshots take up in the ring
+  size_t BytesUsed() const { return nBytesUsed; }
+  size_t Budget() const { return vRing.size(); }
+
+private:
+  struct RECORD
+  {
+    uint32_t nOffset;// Into the ring
+    uint32_t nSize;
+    bool bKey;
+  };
+
+  RECORD &Record(size_t i) { return vRecords[(nFirst + i) & (vRecords.size() - 1)]; }
+  // Finds room for a record of up to nSize bytes, dropping the oldest
+  // keyframe and its deltas until there is, and returns its offset
+  uint32_t Allocate(size_t nSize);
+  void DropOldestKey();
+
+  Bus &nes;
+  uint32_t nKeyInterval;
+
+  std::vector<uint8_t> vRing;
+  uint32_t nWrite = 0;// Where the next record goes
+  size_t nBytesUsed = 0;
+
+  // Ring of the records, oldest first, a power of two in size
+  std::vector<RECORD> vRecords;
+  size_t nFirst = 0;
+  size_t nCount = 0;
+  uint32_t nSinceKey = 0;// Deltas pushed since the newest keyframe
+
+  // The newest snapshot, and room to take the next one
+  std::vector<uint8_t> vHead;
+  std::vector<uint8_t> vNext;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Read-only image of an iNES or NES 2.0 ROM file, mapped where the
+// platform can, see MappedFile. PRG and CHR ROM are only pointers into
+// the image. NES 2.0 headers give the sizes beyond the 8 bit bank
+// counts of iNES, in exponent-multiplier notation too, and the upper
+// bits of the mapper number. Load() hands out one image per distinct
+// ROM to the whole process, however many machines run it, and only
+// its images have a hash and blank RAM
+class RomImage
+{
+public:
+  // Valid() is false if the file could not be opened, is not a ROM,
+  // or is shorter than its header says
+  RomImage(const std::string &sFileName);
+  // The image of the file from the process-wide cache, which is keyed
+  // by the hash of the contents, so that copies of a ROM under other
+  // names share it too. The cache does not keep images alive. Invalid
+  // images are never cached
+  static std::shared_ptr<const RomImage> Load(const std::string &sFileName);
+  ~RomImage() = default;
+
+  RomImage(const RomImage &) = delete;
+  RomImage &operator=(const RomImage &) = delete;
+
+public:
+  bool Valid() const { return bValid; }
+  bool Nes20() const { return bNes20; }
+
+  uint16_t MapperID() const { return nMapperID; }
+  bool VerticalMirror() const { return bVertical; }
+  // The board adds 2KB of VRAM for four nametables of their own, and
+  // the mirroring bit means nothing
+  bool FourScreen() const { return bFourScreen; }
+  // The PRG RAM keeps its contents with the power off
+  bool Battery() const { return bBattery; }
+
+  // NES 2.0 sizes need not come in whole banks, which Cartridge rejects
+  const uint8_t *PRG() const { return pPRG; }
+  size_t PRGSize() const { return nPRGSize; }
+  // nullptr with a size of 0 if the cartridge has CHR RAM instead
+  const uint8_t *CHR() const { return pCHR; }
+  size_t CHRSize() const { return nCHRSize; }
+
+  // RAM on the cartridge, as the header declares it or iNES implies
+  size_t PRGRamSize() const { return nPRGRamSize; }
+  size_t CHRRamSize() const { return nCHRRamSize; }
+  // The RAM as it powers up, zeroed, for cartridges to share until
+  // they write to it. Never less than 8KB, whatever the header says. Nobody writes to these, a cartridge copies one
+  // before its first write as the image holds a reference too
+  std::shared_ptr<std::vector<uint8_t>> BlankPRGRam() const { return pBlankPRGRam; }
+  std::shared_ptr<std::vector<uint8_t>> BlankCHRRam() const { return pBlankCHRRam; }
+
+  // Hash of the whole file, 0 unless the image came from Load()
+  uint64_t Hash() const { return nHash; }
+
+private:
+  bool Parse();
+  static uint64_t ContentHash(const uint8_t *p, size_t n);
+
+  MappedFile file;
+  const uint8_t *pData = nullptr;
+  size_t nSize = 0;
+
+  bool bValid = false;
+  bool bNes20 = false;
+  uint16_t nMapperID = 0;
+  bool bVertical = false;
+  bool bFourScreen = false;
+  bool bBattery = false;
+  const uint8_t *pPRG = nullptr;
+  size_t nPRGSize = 0;
+  const uint8_t *pCHR = nullptr;
+  size_t nCHRSize = 0;
+  size_t nPRGRamSize = 0;
+  size_t nCHRRamSize = 0;
+  std::shared_ptr<std::vector<uint8_t>> pBlankPRGRam;
+  std::shared_ptr<std::vector<uint8_t>> pBlankCHRRam;
+  uint64_t nHash = 0;
+};
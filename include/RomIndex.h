@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Index of a library of ROM files, for learning what a ROM is without
+// opening it. Scan() walks a directory tree for .nes files on a pool
+// of threads, parses their headers and hashes their PRG and CHR ROM
+// with CRC32 and SHA-1, as ROM databases identify dumps by. Save()
+// writes the index to a file, which Load() maps and uses in place, so
+// that loading costs nothing per entry. Scanning with an index loaded
+// only reads the files whose size or modification time has changed.
+class RomIndex
+{
+public:
+  RomIndex() = default;
+  ~RomIndex() = default;
+
+public:
+  enum FLAGS : uint8_t {
+    VALID = 0x01,// The header parsed and the file is long enough
+    NES20 = 0x02,
+    VERTICAL = 0x04,
+    BATTERY = 0x08,
+    FOUR_SCREEN = 0x10,
+  };
+
+  // An entry as it is laid out in the index file. The paths are
+  // relative to the scanned directory and kept in a table after the
+  // entries, which are sorted by them
+  struct ENTRY
+  {
+    uint64_t nFileSize;
+    int64_t nModified;// Ticks of the file system's clock
+    uint32_t nPath;// Offset and length in the path table
+    uint32_t nPathLength;
+    uint32_t nPRGSize;
+    uint32_t nCHRSize;
+    uint32_t nPRGRamSize;
+    uint32_t nCHRRamSize;
+    uint32_t nCrc32;// Of PRG and CHR ROM, without the header and trainer
+    uint8_t vSha1[20];// Likewise
+    uint16_t nMapperID;
+    uint8_t nFlags;
+    uint8_t vReserved[5];
+  };
+
+  struct STATS
+  {
+    size_t nFiles = 0;
+    size_t nUnchanged = 0;// Taken from the loaded index
+    size_t nRead = 0;
+    double fSeconds = 0.0;
+  };
+
+  // Maps an index file, false with a reason if it is missing or not
+  // an index of this version
+  bool Load(const std::string &sFile, std::string &sError);
+  // Writes to a temporary file which then replaces sFile, so processes
+  // which have the old index mapped keep seeing it whole
+  bool Save(const std::string &sFile, std::string &sError) const;
+
+  // Indexes the .nes files under sRoot. nThreads of 0 starts one per
+  // hardware thread
+  void Scan(const std::string &sRoot, size_t nThreads = 0);
+  const STATS &LastScan() const { return stats; }
+
+  size_t Size() const { return nEntries; }
+  const ENTRY &operator[](size_t i) const { return pEntries[i]; }
+  std::string Path(const ENTRY &e) const { return std::string(pPaths + e.nPath, e.nPathLength); }
+  // Entry of the file at sPath, relative to the scanned directory,
+  // nullptr if it is not indexed
+  const ENTRY *Find(const std::string &sPath) const;
+
+  // CRC-32 as zip and ROM databases use it, continuing from nCrc
+  static uint32_t Crc32(const uint8_t *p, size_t n, uint32_t nCrc = 0);
+  static void Sha1(const uint8_t *p, size_t n, uint8_t vDigest[20]);
+
+private:
+  // Either the mapped index file, or what Scan() found
+  std::unique_ptr<MappedFile> pFile;
+  std::vector<ENTRY> vEntries;
+  std::string sPaths;
+
+  const ENTRY *pEntries = nullptr;
+  const char *pPaths = nullptr;
+  size_t nEntries = 0;
+  size_t nPathsSize = 0;
+  STATS stats;
+};
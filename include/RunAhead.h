@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bus.h"
+
+// Runs a machine some frames ahead of what it shows, which hides as
+// many frames of a game's own input lag. Each host frame runs the
+// real frame without drawing it and snapshots the machine, then runs
+// nFrames more with the same input, drawing only the last if the host
+// draws at all, and puts the machine back to the snapshot. The screen keeps the frame drawn
+// furthest ahead. The hidden frames only pay off if a frame that is
+// not drawn costs well under 1/(nFrames+1) of a frame time
+class RunAhead
+{
+public:
+  RunAhead(Bus &nes, uint32_t nFrames = 1);
+  ~RunAhead() = default;
+
+public:
+  // Runs one host frame, returns the stats of the real frame in it
+  Bus::STATS runFrame();
+
+  void SetFrames(uint32_t n) { nFrames = n; }
+  uint32_t Frames() const { return nFrames; }
+  // Wall clock time the last runFrame() spent altogether, on the real
+  // frame, the frames ahead and the snapshot
+  double Seconds() const { return fSeconds; }
+
+private:
+  Bus &nes;
+  uint32_t nFrames;
+  double fSeconds = 0.0;
+  // Snapshot of the machine after the real frame, sized on first use
+  std::vector<uint8_t> vState;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+
+#include "StateBuffer.h"
+
+// Timestamped events on the system's master clock, which counts PPU
+// dots. Each kind of event is scheduled at most once at a time, by
+// the component it belongs to, and scheduling it again moves it. The
+// events are kept in a binary min-heap, entries made stale by moving
+// or cancelling an event are dropped when they reach the top. Events
+// due at the same time come out in the order of their kinds, so runs
+// are deterministic.
+class Scheduler
+{
+public:
+  // Room for every kind of event, so that restoring them from a
+  // snapshot does not allocate
+  Scheduler() { vHeap.reserve(nEvents); }
+  ~Scheduler() = default;
+
+public:
+  enum EVENT : uint8_t {
+    FRAME_END,// The PPU completes a frame
+    STOP,// The host asked to run the system until then
+    nEvents,
+  };
+
+  static constexpr uint64_t nNever = ~0ull;
+
+  void Schedule(EVENT e, uint64_t nTime);
+  void Cancel(EVENT e);
+  // Drops every event
+  void Clear();
+
+  // Time the event is due at, nNever if it is not scheduled
+  uint64_t Due(EVENT e) const { return vDue[e]; }
+
+  // Time of the earliest event, nNever if there are none
+  uint64_t NextTime();
+  // Removes the earliest event and returns it, there must be one
+  EVENT Pop();
+
+  // Passes when each event is due to the visitor, the heap is rebuilt
+  // from those on loading
+  void State(StateBuffer &s);
+
+private:
+  struct ENTRY
+  {
+    uint64_t nTime;
+    EVENT e;
+    bool operator>(const ENTRY &o) const { return nTime != o.nTime ? nTime > o.nTime : e > o.e; }
+  };
+
+  // Drops stale entries from the top of the heap
+  void Prune();
+
+  std::vector<ENTRY> vHeap;
+  std::array<uint64_t, nEvents> vDue = [] {
+    std::array<uint64_t, nEvents> due{};
+    due.fill(nNever);
+    return due;
+  }();
+};
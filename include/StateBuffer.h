@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Visitor copying the state of the machine to or from a flat buffer.
+// Each component has a State() method which passes its fields to the
+// visitor in a fixed order, so that one list of fields serves to
+// measure, save and load the state, and the layout of a snapshot
+// only depends on the cartridge. Nothing is allocated, every field
+// is a memcpy
+class StateBuffer
+{
+public:
+  enum MODE {
+    MEASURE,// Only counts the bytes
+    SAVE,
+    LOAD,
+  };
+
+  StateBuffer(MODE m, uint8_t *p = nullptr) : mode(m), pData(p) {}
+
+  template <typename T>
+  void operator()(T &v)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "state fields are copied as bytes");
+    Bytes(&v, sizeof(T));
+  }
+
+  void Bytes(void *p, size_t n)
+  {
+    if (mode == SAVE)
+      std::memcpy(pData + nSize, p, n);
+    else if (mode == LOAD)
+      std::memcpy(p, pData + nSize, n);
+    nSize += n;
+  }
+
+  bool Loading() const { return mode == LOAD; }
+  // Bytes visited so far
+  size_t Size() const { return nSize; }
+
+  // Snapshots of consecutive frames differ in few bytes. Encode()
+  // writes the XOR of a and b, or a alone if b is nullptr, as pairs of
+  // the length of a run of zero bytes and a run of literal bytes, and
+  // returns the bytes written to out, which has to have room for
+  // MaxEncoded(). Apply() XORs encoded data back into the nBytes at
+  // dst, it returns false if the data is damaged and runs past them
+  static size_t Encode(const uint8_t *a, const uint8_t *b, size_t nBytes, uint8_t *out);
+  static size_t MaxEncoded(size_t nBytes) { return nBytes + nBytes / 1024 + 16; }
+  static bool Apply(const uint8_t *in, size_t nSize, uint8_t *dst, size_t nBytes);
+
+private:
+  MODE mode;
+  uint8_t *pData;
+  size_t nSize = 0;
+};
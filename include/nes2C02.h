@@ -4,6 +4,8 @@
 #include <memory>
 
 #include "Cartridge.h"
+#include "StateBuffer.h"
+#include "CowMemory.h"
 #include "olcPixelGameEngine.h"
 
 class nes2C02
@@ -15,12 +17,13 @@ public:
 private:
   // VRAM - 2 kb butone full name table is 1kb
   // and NES has capability to store 2 whole name tables
-  // however it can address 4 whole name tables
-  uint8_t tblName[2][1024];
+  // however it can address 4 whole name tables. Shared
+  // page by page with forked PPUs until written
+  CowMemory<8> tblName;
   // RAM to store palette information (32 entries)
-  uint8_t tblPalette[32];
+  uint8_t tblPalette[32] = {};
   // normally in NES systems, this exists on cartridge
-  uint8_t tblPattern[2][4096];// TODO Future reminder
+  uint8_t tblPattern[2][4096] = {};// TODO Future reminder
 
 public:
   // Communications with the main bus
@@ -32,12 +35,40 @@ public:
   void ppuWrite(uint16_t addr, uint8_t data);
 
 private:
+  // Where in VRAM the name table byte at addr is, as the cartridge
+  // mirrors the 4 tables onto the 2 there are
+  uint16_t NameIndex(uint16_t addr) const;
+
   // Cartridge or "GamePak"
   std::shared_ptr<Cartridge> cart;
 
 public:// System Interface
   void ConnectCartridge(const std::shared_ptr<Cartridge> &cartridge);
+  // Renders a single dot, for stepping through the frame
   void clock();
+  // Renders every dot from the one the PPU is up to until it has run
+  // nDots since the reset, a scanline at a time. Does nothing if it
+  // is already there
+  void CatchUp(uint64_t nDots);
+  void reset();
+  // A reset leaves the name tables and palette as they were, this
+  // clears them too, as they are when the PPU is powered up
+  void PowerUp();
+
+  // Dots rendered since the reset
+  uint64_t Dot() const { return nDot; }
+
+  // With rendering off the PPU runs on without drawing to the screen,
+  // for frames nobody will see. Its state runs on exactly as it would
+  void SetRender(bool b) { bRender = b; }
+  bool GetRender() const { return bRender; }
+
+  // Passes the tables and the position of the beam to the visitor.
+  // The screen is left out, it is redrawn as the PPU runs on
+  void State(StateBuffer &s);
+  // Makes child's tables and beam those of this PPU, sharing the name
+  // tables until either writes to them. The screen is left out
+  void Fork(nes2C02 &child);
 
 private:
   olc::Pixel palScreen[0x40];
@@ -52,7 +83,29 @@ public:
   olc::Sprite &GetPatternTable(uint8_t i);
   bool frame_complete = false;
 
+  // Number of clock() calls until the current frame completes
+  uint32_t DotsToFrameEnd() const { return (260 - scanline) * 341 + (341 - cycle); }
+
 private:
   int16_t scanline = 0;// row on screen
   int16_t cycle = 0;// col on scrren
+  uint64_t nDot = 0;
+  bool bRender = true;
+
+  // State of the generator for the fake noise. Kept per PPU rather
+  // than using rand(), whose shared state serialises every PPU in a
+  // process and makes the frames depend on what else has run
+  uint32_t nNoise = 0x2C02;
+  uint32_t NextNoise()
+  {
+    nNoise ^= nNoise << 13;
+    nNoise ^= nNoise >> 17;
+    nNoise ^= nNoise << 5;
+    return nNoise;
+  }
+  // Moves the generator on by nSteps at once. Each step is linear over
+  // GF(2), so a long skip multiplies by the step's matrix raised to
+  // nSteps. Shorter ones just step
+  static constexpr uint64_t nNoiseDirectSteps = 512;
+  void SkipNoise(uint64_t nSteps);
 };
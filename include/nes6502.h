@@ -1,9 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <array>
 #include <string>
-#include <vector>
-#include <map>
+#include <string_view>
+#include <memory>
+
+#include "BlockCache.h"
+#include "Jit6502.h"
+#include "Disassembler.h"
+#include "StateBuffer.h"
 
 class Bus;
 
@@ -31,10 +37,83 @@ public:
   uint8_t y = 0x00;// Y register
   uint8_t stkp = 0x00;// Stack pointer (points to location on bus)
   uint16_t pc = 0x00;// Program counter
-  uint8_t status = 0x00;// Status register
+
+  // Status register. N and Z are evaluated lazily, so the register
+  // is only ever accessed as a whole through these
+  uint8_t GetStatus() const
+  {
+    return (status & ~(Z | N)) | (lazy_z == 0x00 ? Z : 0) | (lazy_n & N);
+  }
+  void SetStatus(uint8_t p)
+  {
+    status = p;
+    lazy_z = ~p & Z;
+    lazy_n = p;
+  }
 
   void ConnectBus(Bus *b) { bus = b; }
 
+  // Execution engines. LOOKUP is the reference interpreter which
+  // dispatches every instr through the addrmode and operate entries
+  // of the lookup table. FUSED decodes the operand bytes up front and
+  // then runs the opcode as a single handler picked by a dense switch,
+  // with the addressing mode inlined into the operation. CACHED runs
+  // the fused handlers on instrs pre-decoded into a BlockCache. JIT
+  // runs hot blocks of cartridge code as native x86-64, see Jit6502,
+  // and everything else like FUSED. Its step() covers a whole block
+  enum ENGINE {
+    LOOKUP,
+    FUSED,
+    CACHED,
+    JIT,
+  };
+
+  void SetEngine(ENGINE e);
+  ENGINE GetEngine() const { return engine; }
+
+  // Accuracy policy the fused handlers run under. PER_INSTR does all
+  // of an instr's bus accesses at once, when it starts. PER_CYCLE makes
+  // every access of the real 6502 including dummy reads and writes,
+  // each on its own cycle, and ticks the rest of the system through
+  // Bus::cpuTick() before it. PER_CYCLE applies to every engine but
+  // LOOKUP; CACHED and JIT then run the plain fused handlers
+  enum ACCURACY {
+    PER_INSTR,
+    PER_CYCLE,
+  };
+
+  void SetAccuracy(ACCURACY acc);
+  ACCURACY GetAccuracy() const { return accuracy; }
+
+  // Hit/miss counters of the block cache, all zero unless the CACHED
+  // engine has been selected
+  BlockCache::STATS CacheStats() const;
+  // Likewise for the JIT engine
+  Jit6502::STATS JitStats() const;
+
+  // Counters, one per address, which the CPU increments as an instr
+  // starts there, saturating at 255, or nullptr not to count. Of a
+  // compiled JIT block only the first instr is counted
+  void SetCoverage(uint8_t *pCounters) { pCoverage = pCounters; }
+
+  // Drops all cached and compiled code and the disassembly, for when
+  // memory has been changed without the CPU seeing the writes
+  void FlushCode();
+  // Drops only what was derived from system RAM and PRG RAM, for when
+  // they have been restored from a snapshot. Code in ROM stays cached
+  // and compiled, but the block cache leaves the block it was executing
+  void RamRestored();
+  // Called by the bus whenever the cartridge has switched PRG banks,
+  // so code cached by bank is looked up in the banks now switched in
+  void BanksSwitched();
+  // Called by the bus when the cartridge's PRG RAM was enabled,
+  // disabled or moved, drops what was cached from it
+  void PRGRamSwitched();
+
+  // Passes the registers and the latches of the instr in progress to
+  // the visitor, see Bus::saveState()
+  void State(StateBuffer &s);
+
   // clang-format off
   // Addressing modes
   uint8_t IMP();    uint8_t IMM();
@@ -64,6 +143,8 @@ public:
   uint8_t XXX();
 
   void clock();// Perform one clock cycle's worth of update
+  uint8_t step();// Perform one whole instr, returns the cycles it took
+  uint32_t run(uint32_t nCycleBudget);// Perform instrs until the budget is spent
   void reset();// Reset interrupt - Forces CPU into a known state
   void irq();// Interrupt request - Executes an instruction at a specific location
   void nmi();// Non-Maskable interrupt request - As above, but cannot be disabled
@@ -73,10 +154,9 @@ public:
   // clocking every cycle
   bool complete();
 
-  // Produces a map of strings, with keys equivalent to instr start
-  // locations in memory, for the specified addr range
-  std::map<uint16_t, std::string> disassemble(uint16_t nStart,
-    uint16_t nStop);
+  // Disassembly of memory as the CPU sees it, kept up to date with
+  // the CPU's writes. Created the first time it is asked for
+  Disassembler &disassembler();
 
 private:
   // Read location of data an come from memory addr
@@ -91,44 +171,162 @@ private:
   uint8_t opcode = 0x00;
   uint8_t cycles = 0;
 
+  ENGINE engine = LOOKUP;
+  ACCURACY accuracy = PER_INSTR;
+  // Only allocated once the CACHED engine is selected
+  std::unique_ptr<BlockCache> cache;
+  // Only allocated once the JIT engine is selected
+  std::unique_ptr<Jit6502> jit;
+  friend class Jit6502;
+  // Only allocated once a debugger view asks for it
+  std::unique_ptr<Disassembler> disasm;
+  uint8_t *pCoverage = nullptr;
+
+  // Fused engine, see nes6502_fused.cpp. Reads the operand bytes of
+  // the current opcode, advancing pc past them, then executes the
+  // opcode and returns the number of cycles it took. Both are
+  // compiled for each accuracy policy
+  template <ACCURACY A>
+  uint16_t fetchOperand();
+  template <ACCURACY A>
+  uint8_t executeFused(uint16_t operand);
+  // A whole instr on the fused handlers under PER_INSTR accuracy, with
+  // the opcode and operand fetch compiled into the same function, and
+  // the loop run() takes on the FUSED engine, which skips the engine
+  // selection of step()
+  uint8_t stepFused();
+  uint32_t runFused(uint32_t nCycleBudget);
+  // Likewise for the CACHED engine, taking instrs from the block cache,
+  // and for the JIT engine, running compiled blocks where it has them
+  uint32_t runCached(uint32_t nCycleBudget);
+  uint32_t runJit(uint32_t nCycleBudget);
+
+  // Bus accesses made under an accuracy policy
+  template <ACCURACY A>
+  uint8_t busRead(uint16_t addr);
+  template <ACCURACY A>
+  void busWrite(uint16_t addr, uint8_t data);
+
+  // Advances the rest of the system one CPU cycle, for PER_CYCLE accuracy
+  void tick();
+  uint8_t nTicks = 0;// Cycles ticked so far in the current instr
+
+  // Fetches and executes the instr at pc on the selected engine,
+  // returns the number of cycles it takes
+  uint8_t execute();
+
 private:
   Bus *bus = nullptr;
   uint8_t read(uint16_t a);
   void write(uint16_t a, uint8_t d);
+  // Tells the code caches and the disassembler of a write the CPU made
+  void Written(uint16_t addr)
+  {
+    if (cache)
+      cache->Write(addr);
+    if (jit)
+      jit->Write(addr);
+    if (disasm)
+      disasm->Write(addr);
+  }
+
+  // Status register, apart from N and Z. Nearly every instr sets
+  // those from a result that is overwritten before anything tests
+  // it, so only the result is stored: Z is set if lazy_z is zero and
+  // N is bit 7 of lazy_n. They are kept apart for BIT and PLP, which
+  // set the two flags independently
+  uint8_t status = 0x00;
+  uint8_t lazy_z = 0x01;
+  uint8_t lazy_n = 0x00;
+
+  // Sets N and Z from the result of an instr
+  void SetNZ(uint8_t v)
+  {
+    lazy_z = v;
+    lazy_n = v;
+  }
 
   // Convenience functions to access status register
   uint8_t GetFlag(FLAGS6502 f);
   void SetFlag(FLAGS6502 f, bool v);
 
 private:
+  // Handlers the reference engine dispatches through, indexed by opcode
   struct INSTRUCTION
   {
-    std::string name;
     uint8_t (nes6502::*operate)(void) = nullptr;
     uint8_t (nes6502::*addrmode)(void) = nullptr;
-    uint8_t cycles = 0;
   };
 
-  using n = nes6502;
-  std::vector<INSTRUCTION> lookup
-    // clang-format off
+  static const std::array<INSTRUCTION, 256> lookup;
+
+public:
+  enum class ADDRMODE : uint8_t {
+    IMP,
+    IMM,
+    ZP0,
+    ZPX,
+    ZPY,
+    REL,
+    ABS,
+    ABX,
+    ABY,
+    IND,
+    IZX,
+    IZY,
+  };
+
+  // Number of operand bytes that follow an opcode in a given mode
+  static constexpr uint8_t OperandBytes(ADDRMODE m)
+  {
+    switch (m) {
+    case ADDRMODE::IMP:
+      return 0;
+    case ADDRMODE::ABS:
+    case ADDRMODE::ABX:
+    case ADDRMODE::ABY:
+    case ADDRMODE::IND:
+      return 2;
+    default:
+      return 1;
+    }
+  }
+
+  // Static description of an opcode. page_cycle is 1 if the instr
+  // takes an additional cycle when indexing crosses a page boundary,
+  // branches add their own penalties
+  struct OPCODE
   {
-    { "BRK", &n::BRK, &n::IMM, 7 },{ "ORA", &n::ORA, &n::IZX, 6 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 3 },{ "ORA", &n::ORA, &n::ZP0, 3 },{ "ASL", &n::ASL, &n::ZP0, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "PHP", &n::PHP, &n::IMP, 3 },{ "ORA", &n::ORA, &n::IMM, 2 },{ "ASL", &n::ASL, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::NOP, &n::IMP, 4 },{ "ORA", &n::ORA, &n::ABS, 4 },{ "ASL", &n::ASL, &n::ABS, 6 },{ "???", &n::XXX, &n::IMP, 6 },
-    { "BPL", &n::BPL, &n::REL, 2 },{ "ORA", &n::ORA, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 4 },{ "ORA", &n::ORA, &n::ZPX, 4 },{ "ASL", &n::ASL, &n::ZPX, 6 },{ "???", &n::XXX, &n::IMP, 6 },{ "CLC", &n::CLC, &n::IMP, 2 },{ "ORA", &n::ORA, &n::ABY, 4 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 7 },{ "???", &n::NOP, &n::IMP, 4 },{ "ORA", &n::ORA, &n::ABX, 4 },{ "ASL", &n::ASL, &n::ABX, 7 },{ "???", &n::XXX, &n::IMP, 7 },
-    { "JSR", &n::JSR, &n::ABS, 6 },{ "AND", &n::AND, &n::IZX, 6 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "BIT", &n::BIT, &n::ZP0, 3 },{ "AND", &n::AND, &n::ZP0, 3 },{ "ROL", &n::ROL, &n::ZP0, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "PLP", &n::PLP, &n::IMP, 4 },{ "AND", &n::AND, &n::IMM, 2 },{ "ROL", &n::ROL, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "BIT", &n::BIT, &n::ABS, 4 },{ "AND", &n::AND, &n::ABS, 4 },{ "ROL", &n::ROL, &n::ABS, 6 },{ "???", &n::XXX, &n::IMP, 6 },
-    { "BMI", &n::BMI, &n::REL, 2 },{ "AND", &n::AND, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 4 },{ "AND", &n::AND, &n::ZPX, 4 },{ "ROL", &n::ROL, &n::ZPX, 6 },{ "???", &n::XXX, &n::IMP, 6 },{ "SEC", &n::SEC, &n::IMP, 2 },{ "AND", &n::AND, &n::ABY, 4 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 7 },{ "???", &n::NOP, &n::IMP, 4 },{ "AND", &n::AND, &n::ABX, 4 },{ "ROL", &n::ROL, &n::ABX, 7 },{ "???", &n::XXX, &n::IMP, 7 },
-    { "RTI", &n::RTI, &n::IMP, 6 },{ "EOR", &n::EOR, &n::IZX, 6 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 3 },{ "EOR", &n::EOR, &n::ZP0, 3 },{ "LSR", &n::LSR, &n::ZP0, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "PHA", &n::PHA, &n::IMP, 3 },{ "EOR", &n::EOR, &n::IMM, 2 },{ "LSR", &n::LSR, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "JMP", &n::JMP, &n::ABS, 3 },{ "EOR", &n::EOR, &n::ABS, 4 },{ "LSR", &n::LSR, &n::ABS, 6 },{ "???", &n::XXX, &n::IMP, 6 },
-    { "BVC", &n::BVC, &n::REL, 2 },{ "EOR", &n::EOR, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 4 },{ "EOR", &n::EOR, &n::ZPX, 4 },{ "LSR", &n::LSR, &n::ZPX, 6 },{ "???", &n::XXX, &n::IMP, 6 },{ "CLI", &n::CLI, &n::IMP, 2 },{ "EOR", &n::EOR, &n::ABY, 4 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 7 },{ "???", &n::NOP, &n::IMP, 4 },{ "EOR", &n::EOR, &n::ABX, 4 },{ "LSR", &n::LSR, &n::ABX, 7 },{ "???", &n::XXX, &n::IMP, 7 },
-    { "RTS", &n::RTS, &n::IMP, 6 },{ "ADC", &n::ADC, &n::IZX, 6 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 3 },{ "ADC", &n::ADC, &n::ZP0, 3 },{ "ROR", &n::ROR, &n::ZP0, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "PLA", &n::PLA, &n::IMP, 4 },{ "ADC", &n::ADC, &n::IMM, 2 },{ "ROR", &n::ROR, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "JMP", &n::JMP, &n::IND, 5 },{ "ADC", &n::ADC, &n::ABS, 4 },{ "ROR", &n::ROR, &n::ABS, 6 },{ "???", &n::XXX, &n::IMP, 6 },
-    { "BVS", &n::BVS, &n::REL, 2 },{ "ADC", &n::ADC, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 4 },{ "ADC", &n::ADC, &n::ZPX, 4 },{ "ROR", &n::ROR, &n::ZPX, 6 },{ "???", &n::XXX, &n::IMP, 6 },{ "SEI", &n::SEI, &n::IMP, 2 },{ "ADC", &n::ADC, &n::ABY, 4 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 7 },{ "???", &n::NOP, &n::IMP, 4 },{ "ADC", &n::ADC, &n::ABX, 4 },{ "ROR", &n::ROR, &n::ABX, 7 },{ "???", &n::XXX, &n::IMP, 7 },
-    { "???", &n::NOP, &n::IMP, 2 },{ "STA", &n::STA, &n::IZX, 6 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 6 },{ "STY", &n::STY, &n::ZP0, 3 },{ "STA", &n::STA, &n::ZP0, 3 },{ "STX", &n::STX, &n::ZP0, 3 },{ "???", &n::XXX, &n::IMP, 3 },{ "DEY", &n::DEY, &n::IMP, 2 },{ "???", &n::NOP, &n::IMP, 2 },{ "TXA", &n::TXA, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "STY", &n::STY, &n::ABS, 4 },{ "STA", &n::STA, &n::ABS, 4 },{ "STX", &n::STX, &n::ABS, 4 },{ "???", &n::XXX, &n::IMP, 4 },
-    { "BCC", &n::BCC, &n::REL, 2 },{ "STA", &n::STA, &n::IZY, 6 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 6 },{ "STY", &n::STY, &n::ZPX, 4 },{ "STA", &n::STA, &n::ZPX, 4 },{ "STX", &n::STX, &n::ZPY, 4 },{ "???", &n::XXX, &n::IMP, 4 },{ "TYA", &n::TYA, &n::IMP, 2 },{ "STA", &n::STA, &n::ABY, 5 },{ "TXS", &n::TXS, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 5 },{ "???", &n::NOP, &n::IMP, 5 },{ "STA", &n::STA, &n::ABX, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "???", &n::XXX, &n::IMP, 5 },
-    { "LDY", &n::LDY, &n::IMM, 2 },{ "LDA", &n::LDA, &n::IZX, 6 },{ "LDX", &n::LDX, &n::IMM, 2 },{ "???", &n::XXX, &n::IMP, 6 },{ "LDY", &n::LDY, &n::ZP0, 3 },{ "LDA", &n::LDA, &n::ZP0, 3 },{ "LDX", &n::LDX, &n::ZP0, 3 },{ "???", &n::XXX, &n::IMP, 3 },{ "TAY", &n::TAY, &n::IMP, 2 },{ "LDA", &n::LDA, &n::IMM, 2 },{ "TAX", &n::TAX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "LDY", &n::LDY, &n::ABS, 4 },{ "LDA", &n::LDA, &n::ABS, 4 },{ "LDX", &n::LDX, &n::ABS, 4 },{ "???", &n::XXX, &n::IMP, 4 },
-    { "BCS", &n::BCS, &n::REL, 2 },{ "LDA", &n::LDA, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 5 },{ "LDY", &n::LDY, &n::ZPX, 4 },{ "LDA", &n::LDA, &n::ZPX, 4 },{ "LDX", &n::LDX, &n::ZPY, 4 },{ "???", &n::XXX, &n::IMP, 4 },{ "CLV", &n::CLV, &n::IMP, 2 },{ "LDA", &n::LDA, &n::ABY, 4 },{ "TSX", &n::TSX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 4 },{ "LDY", &n::LDY, &n::ABX, 4 },{ "LDA", &n::LDA, &n::ABX, 4 },{ "LDX", &n::LDX, &n::ABY, 4 },{ "???", &n::XXX, &n::IMP, 4 },
-    { "CPY", &n::CPY, &n::IMM, 2 },{ "CMP", &n::CMP, &n::IZX, 6 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "CPY", &n::CPY, &n::ZP0, 3 },{ "CMP", &n::CMP, &n::ZP0, 3 },{ "DEC", &n::DEC, &n::ZP0, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "INY", &n::INY, &n::IMP, 2 },{ "CMP", &n::CMP, &n::IMM, 2 },{ "DEX", &n::DEX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 2 },{ "CPY", &n::CPY, &n::ABS, 4 },{ "CMP", &n::CMP, &n::ABS, 4 },{ "DEC", &n::DEC, &n::ABS, 6 },{ "???", &n::XXX, &n::IMP, 6 },
-    { "BNE", &n::BNE, &n::REL, 2 },{ "CMP", &n::CMP, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 4 },{ "CMP", &n::CMP, &n::ZPX, 4 },{ "DEC", &n::DEC, &n::ZPX, 6 },{ "???", &n::XXX, &n::IMP, 6 },{ "CLD", &n::CLD, &n::IMP, 2 },{ "CMP", &n::CMP, &n::ABY, 4 },{ "NOP", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 7 },{ "???", &n::NOP, &n::IMP, 4 },{ "CMP", &n::CMP, &n::ABX, 4 },{ "DEC", &n::DEC, &n::ABX, 7 },{ "???", &n::XXX, &n::IMP, 7 },
-    { "CPX", &n::CPX, &n::IMM, 2 },{ "SBC", &n::SBC, &n::IZX, 6 },{ "???", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "CPX", &n::CPX, &n::ZP0, 3 },{ "SBC", &n::SBC, &n::ZP0, 3 },{ "INC", &n::INC, &n::ZP0, 5 },{ "???", &n::XXX, &n::IMP, 5 },{ "INX", &n::INX, &n::IMP, 2 },{ "SBC", &n::SBC, &n::IMM, 2 },{ "NOP", &n::NOP, &n::IMP, 2 },{ "???", &n::SBC, &n::IMP, 2 },{ "CPX", &n::CPX, &n::ABS, 4 },{ "SBC", &n::SBC, &n::ABS, 4 },{ "INC", &n::INC, &n::ABS, 6 },{ "???", &n::XXX, &n::IMP, 6 },
-    { "BEQ", &n::BEQ, &n::REL, 2 },{ "SBC", &n::SBC, &n::IZY, 5 },{ "???", &n::XXX, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 8 },{ "???", &n::NOP, &n::IMP, 4 },{ "SBC", &n::SBC, &n::ZPX, 4 },{ "INC", &n::INC, &n::ZPX, 6 },{ "???", &n::XXX, &n::IMP, 6 },{ "SED", &n::SED, &n::IMP, 2 },{ "SBC", &n::SBC, &n::ABY, 4 },{ "NOP", &n::NOP, &n::IMP, 2 },{ "???", &n::XXX, &n::IMP, 7 },{ "???", &n::NOP, &n::IMP, 4 },{ "SBC", &n::SBC, &n::ABX, 4 },{ "INC", &n::INC, &n::ABX, 7 },{ "???", &n::XXX, &n::IMP, 7 },
+    std::string_view name;
+    ADDRMODE mode;
+    uint8_t cycles;
+    uint8_t page_cycle;
   };
+
+private:
+  using m = ADDRMODE;
+
+public:
+  // Opcode metadata shared by every instance and usable at compile time
+  static constexpr std::array<OPCODE, 256> opcodes
+    // clang-format off
+  { {
+    { "BRK", m::IMM, 7, 0 },{ "ORA", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 3, 0 },{ "ORA", m::ZP0, 3, 0 },{ "ASL", m::ZP0, 5, 0 },{ "???", m::IMP, 5, 0 },{ "PHP", m::IMP, 3, 0 },{ "ORA", m::IMM, 2, 0 },{ "ASL", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 4, 0 },{ "ORA", m::ABS, 4, 0 },{ "ASL", m::ABS, 6, 0 },{ "???", m::IMP, 6, 0 },
+    { "BPL", m::REL, 2, 0 },{ "ORA", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 4, 0 },{ "ORA", m::ZPX, 4, 0 },{ "ASL", m::ZPX, 6, 0 },{ "???", m::IMP, 6, 0 },{ "CLC", m::IMP, 2, 0 },{ "ORA", m::ABY, 4, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 7, 0 },{ "???", m::IMP, 4, 0 },{ "ORA", m::ABX, 4, 1 },{ "ASL", m::ABX, 7, 0 },{ "???", m::IMP, 7, 0 },
+    { "JSR", m::ABS, 6, 0 },{ "AND", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "BIT", m::ZP0, 3, 0 },{ "AND", m::ZP0, 3, 0 },{ "ROL", m::ZP0, 5, 0 },{ "???", m::IMP, 5, 0 },{ "PLP", m::IMP, 4, 0 },{ "AND", m::IMM, 2, 0 },{ "ROL", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "BIT", m::ABS, 4, 0 },{ "AND", m::ABS, 4, 0 },{ "ROL", m::ABS, 6, 0 },{ "???", m::IMP, 6, 0 },
+    { "BMI", m::REL, 2, 0 },{ "AND", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 4, 0 },{ "AND", m::ZPX, 4, 0 },{ "ROL", m::ZPX, 6, 0 },{ "???", m::IMP, 6, 0 },{ "SEC", m::IMP, 2, 0 },{ "AND", m::ABY, 4, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 7, 0 },{ "???", m::IMP, 4, 0 },{ "AND", m::ABX, 4, 1 },{ "ROL", m::ABX, 7, 0 },{ "???", m::IMP, 7, 0 },
+    { "RTI", m::IMP, 6, 0 },{ "EOR", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 3, 0 },{ "EOR", m::ZP0, 3, 0 },{ "LSR", m::ZP0, 5, 0 },{ "???", m::IMP, 5, 0 },{ "PHA", m::IMP, 3, 0 },{ "EOR", m::IMM, 2, 0 },{ "LSR", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "JMP", m::ABS, 3, 0 },{ "EOR", m::ABS, 4, 0 },{ "LSR", m::ABS, 6, 0 },{ "???", m::IMP, 6, 0 },
+    { "BVC", m::REL, 2, 0 },{ "EOR", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 4, 0 },{ "EOR", m::ZPX, 4, 0 },{ "LSR", m::ZPX, 6, 0 },{ "???", m::IMP, 6, 0 },{ "CLI", m::IMP, 2, 0 },{ "EOR", m::ABY, 4, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 7, 0 },{ "???", m::IMP, 4, 0 },{ "EOR", m::ABX, 4, 1 },{ "LSR", m::ABX, 7, 0 },{ "???", m::IMP, 7, 0 },
+    { "RTS", m::IMP, 6, 0 },{ "ADC", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 3, 0 },{ "ADC", m::ZP0, 3, 0 },{ "ROR", m::ZP0, 5, 0 },{ "???", m::IMP, 5, 0 },{ "PLA", m::IMP, 4, 0 },{ "ADC", m::IMM, 2, 0 },{ "ROR", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "JMP", m::IND, 5, 0 },{ "ADC", m::ABS, 4, 0 },{ "ROR", m::ABS, 6, 0 },{ "???", m::IMP, 6, 0 },
+    { "BVS", m::REL, 2, 0 },{ "ADC", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 4, 0 },{ "ADC", m::ZPX, 4, 0 },{ "ROR", m::ZPX, 6, 0 },{ "???", m::IMP, 6, 0 },{ "SEI", m::IMP, 2, 0 },{ "ADC", m::ABY, 4, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 7, 0 },{ "???", m::IMP, 4, 0 },{ "ADC", m::ABX, 4, 1 },{ "ROR", m::ABX, 7, 0 },{ "???", m::IMP, 7, 0 },
+    { "???", m::IMP, 2, 0 },{ "STA", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 6, 0 },{ "STY", m::ZP0, 3, 0 },{ "STA", m::ZP0, 3, 0 },{ "STX", m::ZP0, 3, 0 },{ "???", m::IMP, 3, 0 },{ "DEY", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "TXA", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "STY", m::ABS, 4, 0 },{ "STA", m::ABS, 4, 0 },{ "STX", m::ABS, 4, 0 },{ "???", m::IMP, 4, 0 },
+    { "BCC", m::REL, 2, 0 },{ "STA", m::IZY, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 6, 0 },{ "STY", m::ZPX, 4, 0 },{ "STA", m::ZPX, 4, 0 },{ "STX", m::ZPY, 4, 0 },{ "???", m::IMP, 4, 0 },{ "TYA", m::IMP, 2, 0 },{ "STA", m::ABY, 5, 0 },{ "TXS", m::IMP, 2, 0 },{ "???", m::IMP, 5, 0 },{ "???", m::IMP, 5, 0 },{ "STA", m::ABX, 5, 0 },{ "???", m::IMP, 5, 0 },{ "???", m::IMP, 5, 0 },
+    { "LDY", m::IMM, 2, 0 },{ "LDA", m::IZX, 6, 0 },{ "LDX", m::IMM, 2, 0 },{ "???", m::IMP, 6, 0 },{ "LDY", m::ZP0, 3, 0 },{ "LDA", m::ZP0, 3, 0 },{ "LDX", m::ZP0, 3, 0 },{ "???", m::IMP, 3, 0 },{ "TAY", m::IMP, 2, 0 },{ "LDA", m::IMM, 2, 0 },{ "TAX", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "LDY", m::ABS, 4, 0 },{ "LDA", m::ABS, 4, 0 },{ "LDX", m::ABS, 4, 0 },{ "???", m::IMP, 4, 0 },
+    { "BCS", m::REL, 2, 0 },{ "LDA", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 5, 0 },{ "LDY", m::ZPX, 4, 0 },{ "LDA", m::ZPX, 4, 0 },{ "LDX", m::ZPY, 4, 0 },{ "???", m::IMP, 4, 0 },{ "CLV", m::IMP, 2, 0 },{ "LDA", m::ABY, 4, 1 },{ "TSX", m::IMP, 2, 0 },{ "???", m::IMP, 4, 0 },{ "LDY", m::ABX, 4, 1 },{ "LDA", m::ABX, 4, 1 },{ "LDX", m::ABY, 4, 1 },{ "???", m::IMP, 4, 0 },
+    { "CPY", m::IMM, 2, 0 },{ "CMP", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "CPY", m::ZP0, 3, 0 },{ "CMP", m::ZP0, 3, 0 },{ "DEC", m::ZP0, 5, 0 },{ "???", m::IMP, 5, 0 },{ "INY", m::IMP, 2, 0 },{ "CMP", m::IMM, 2, 0 },{ "DEX", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "CPY", m::ABS, 4, 0 },{ "CMP", m::ABS, 4, 0 },{ "DEC", m::ABS, 6, 0 },{ "???", m::IMP, 6, 0 },
+    { "BNE", m::REL, 2, 0 },{ "CMP", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 4, 0 },{ "CMP", m::ZPX, 4, 0 },{ "DEC", m::ZPX, 6, 0 },{ "???", m::IMP, 6, 0 },{ "CLD", m::IMP, 2, 0 },{ "CMP", m::ABY, 4, 1 },{ "NOP", m::IMP, 2, 0 },{ "???", m::IMP, 7, 0 },{ "???", m::IMP, 4, 0 },{ "CMP", m::ABX, 4, 1 },{ "DEC", m::ABX, 7, 0 },{ "???", m::IMP, 7, 0 },
+    { "CPX", m::IMM, 2, 0 },{ "SBC", m::IZX, 6, 0 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "CPX", m::ZP0, 3, 0 },{ "SBC", m::ZP0, 3, 0 },{ "INC", m::ZP0, 5, 0 },{ "???", m::IMP, 5, 0 },{ "INX", m::IMP, 2, 0 },{ "SBC", m::IMM, 2, 0 },{ "NOP", m::IMP, 2, 0 },{ "???", m::IMP, 2, 0 },{ "CPX", m::ABS, 4, 0 },{ "SBC", m::ABS, 4, 0 },{ "INC", m::ABS, 6, 0 },{ "???", m::IMP, 6, 0 },
+    { "BEQ", m::REL, 2, 0 },{ "SBC", m::IZY, 5, 1 },{ "???", m::IMP, 2, 0 },{ "???", m::IMP, 8, 0 },{ "???", m::IMP, 4, 0 },{ "SBC", m::ZPX, 4, 0 },{ "INC", m::ZPX, 6, 0 },{ "???", m::IMP, 6, 0 },{ "SED", m::IMP, 2, 0 },{ "SBC", m::ABY, 4, 1 },{ "NOP", m::IMP, 2, 0 },{ "???", m::IMP, 7, 0 },{ "???", m::IMP, 4, 0 },{ "SBC", m::ABX, 4, 1 },{ "INC", m::ABX, 7, 0 },{ "???", m::IMP, 7, 0 },
+  } };
   // clang-format on
 };
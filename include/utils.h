@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 // converet variables into hex strings
@@ -10,3 +11,21 @@ inline std::string hex(uint32_t n, uint8_t d)
     s[i] = "0123456789ABCDEF"[n & 0xF];
   return s;
 }
+
+// Parses a decimal count of at most nMax. Unlike std::stoul, which
+// throws on junk and wraps "-1" around, anything but digits fails
+inline bool ParseCount(const std::string &s, uint64_t nMax, uint64_t &n)
+{
+  if (s.empty())
+    return false;
+  n = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9')
+      return false;
+    uint64_t d = c - '0';
+    if (d > nMax || n > (nMax - d) / 10)
+      return false;
+    n = n * 10 + d;
+  }
+  return true;
+}
@@ -0,0 +1,735 @@
+#include "Batch6502.h"
+#include "Cartridge.h"
+
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Lockstep engine, see Batch6502.h
+//
+// The handlers below are the fused ones of nes6502_fused.cpp with
+// every register access indexed by lane. They are compiled for two
+// kinds of lane set: all lanes, where each loop runs over contiguous
+// arrays and the compiler can vectorize it, and a list of lane
+// indices for the groups of a diverged step. Operands whose addr is
+// the same in every lane (immediate, zero page and absolute) come from
+// one row of the interleaved RAM, so with all lanes taking part the
+// ALU instrs on them run as explicit AVX2 kernels, 32 lanes at a time.
+
+using m = nes6502::ADDRMODE;
+
+static constexpr uint8_t C = nes6502::C;
+static constexpr uint8_t Z = nes6502::Z;
+static constexpr uint8_t I = nes6502::I;
+static constexpr uint8_t D = nes6502::D;
+static constexpr uint8_t B = nes6502::B;
+static constexpr uint8_t U = nes6502::U;
+static constexpr uint8_t V = nes6502::V;
+static constexpr uint8_t N = nes6502::N;
+
+// True if every lane is at the same pc
+static bool PcsAgree(const uint16_t *pc, size_t n)
+{
+  size_t l = 0;
+#ifdef __AVX2__
+  const __m256i first = _mm256_set1_epi16((short)pc[0]);
+  for (; l + 16 <= n; l += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(pc + l));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, first)) != -1)
+      return false;
+  }
+#endif
+  for (; l < n; l++)
+    if (pc[l] != pc[0])
+      return false;
+  return true;
+}
+
+// True if every lane has the same byte in a row of RAM
+static bool BytesAgree(const uint8_t *row, size_t n)
+{
+  size_t l = 0;
+#ifdef __AVX2__
+  const __m256i first = _mm256_set1_epi8((char)row[0]);
+  for (; l + 32 <= n; l += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(row + l));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, first)) != -1)
+      return false;
+  }
+#endif
+  for (; l < n; l++)
+    if (row[l] != row[0])
+      return false;
+  return true;
+}
+
+Batch6502::Batch6502(size_t n, const std::shared_ptr<Cartridge> &cart)
+  : a(n), x(n), y(n), stkp(n), pc(n), cycles(n), nLanes(n), vRam(0x0800 * n),
+    vPRG(0x8000), status(n), lazy_z(n, 0x01), lazy_n(n)
+{
+  vPending.reserve(n);
+  vGroup.reserve(n);
+  vRest.reserve(n);
+
+  for (size_t i = 0; i < vPRG.size(); i++)
+    cart->cpuRead((uint16_t)(0x8000 + i), vPRG[i]);
+
+  reset();
+}
+
+uint8_t Batch6502::GetStatus(size_t lane) const
+{
+  return (status[lane] & ~(Z | N)) | (lazy_z[lane] == 0x00 ? Z : 0) | (lazy_n[lane] & N);
+}
+
+void Batch6502::SetStatus(size_t lane, uint8_t p)
+{
+  status[lane] = p;
+  lazy_z[lane] = ~p & Z;
+  lazy_n[lane] = p;
+}
+
+uint8_t Batch6502::Read(size_t lane, uint16_t addr) const
+{
+  if (addr < 0x2000)
+    return vRam[(addr & 0x07FF) * nLanes + lane];
+  if (addr >= 0x8000)
+    return vPRG[addr & 0x7FFF];
+  return 0x00;
+}
+
+void Batch6502::Write(size_t lane, uint16_t addr, uint8_t data)
+{
+  if (addr < 0x2000)
+    vRam[(addr & 0x07FF) * nLanes + lane] = data;
+}
+
+void Batch6502::ClearRam()
+{
+  std::fill(vRam.begin(), vRam.end(), 0x00);
+}
+
+void Batch6502::reset()
+{
+  uint16_t lo = vPRG[0x7FFC];
+  uint16_t hi = vPRG[0x7FFD];
+
+  for (size_t l = 0; l < nLanes; l++) {
+    pc[l] = (hi << 8) | lo;
+    a[l] = 0;
+    x[l] = 0;
+    y[l] = 0;
+    stkp[l] = 0xFD;
+    SetStatus(l, 0x00 | U);
+    cycles[l] += 8;
+  }
+}
+
+void Batch6502::run(uint32_t nSteps)
+{
+  for (uint32_t i = 0; i < nSteps; i++)
+    step();
+}
+
+Batch6502::DECODED Batch6502::Decode(size_t lane) const
+{
+  DECODED d;
+  uint16_t addr = pc[lane];
+  d.opcode = Read(lane, addr);
+
+  uint8_t nBytes = nes6502::OperandBytes(nes6502::opcodes[d.opcode].mode);
+  if (nBytes > 0)
+    d.operand = Read(lane, addr + 1);
+  if (nBytes > 1)
+    d.operand |= Read(lane, addr + 2) << 8;
+  d.next = addr + 1 + nBytes;
+  return d;
+}
+
+void Batch6502::step()
+{
+  if (nLanes == 0)
+    return;
+
+  stats.nSteps++;
+  stats.nLaneInstrs += nLanes;
+
+  // With the lanes at the same pc they all execute one instr, as
+  // long as they have the same code there. Only RAM differs by lane
+  if (PcsAgree(pc.data(), nLanes)) {
+    DECODED d = Decode(0);
+    bool bUniform = true;
+    for (uint16_t addr = pc[0]; bUniform && addr != d.next; addr++)
+      bUniform = addr >= 0x2000 || BytesAgree(Row(addr), nLanes);
+
+    if (bUniform) {
+      stats.nUniformSteps++;
+      execute(ALL_LANES{ nLanes }, d);
+      return;
+    }
+  }
+
+  // Otherwise run the lanes in groups at the same pc. Code in RAM
+  // may differ between lanes at the same pc, so there a lane also
+  // has to decode the same instr to join the group
+  vPending.resize(nLanes);
+  std::iota(vPending.begin(), vPending.end(), 0);
+
+  while (!vPending.empty()) {
+    uint32_t nLead = vPending[0];
+    uint16_t at = pc[nLead];
+    DECODED d = Decode(nLead);
+
+    vGroup.clear();
+    vRest.clear();
+    for (uint32_t l : vPending) {
+      bool bJoin = pc[l] == at;
+      if (bJoin && at < 0x2000) {
+        DECODED e = Decode(l);
+        bJoin = e.opcode == d.opcode && e.operand == d.operand;
+      }
+      (bJoin ? vGroup : vRest).push_back(l);
+    }
+
+    stats.nGroups++;
+    execute(LANE_LIST{ vGroup.data(), vGroup.size() }, d);
+    std::swap(vPending, vRest);
+  }
+}
+
+void Batch6502::stepLane(size_t lane)
+{
+  uint32_t l = (uint32_t)lane;
+  stats.nLaneInstrs++;
+  execute(LANE_LIST{ &l, 1 }, Decode(lane));
+}
+
+Batch6502::SOURCE Batch6502::Source(ADDRMODE mode, uint16_t operand)
+{
+  SOURCE s;
+  if (mode == m::IMM)
+    s.value = operand & 0x00FF;
+  else if (mode == m::ZP0)
+    s.row = Row(operand & 0x00FF);
+  else if (operand < 0x2000)
+    s.row = Row(operand);
+  else
+    s.value = Read(0, operand);
+  return s;
+}
+
+// Effective addr of an instr in a lane. Indexed modes set crossed if
+// adding the index changed the page
+template <nes6502::ADDRMODE M>
+uint16_t Batch6502::Address(size_t l, uint16_t operand, uint8_t &crossed) const
+{
+  auto index = [&](uint16_t base, uint8_t i) -> uint16_t {
+    uint16_t ea = base + i;
+    crossed = (ea & 0xFF00) != (base & 0xFF00);
+    return ea;
+  };
+
+  if constexpr (M == m::ZP0)
+    return operand & 0x00FF;
+  else if constexpr (M == m::ZPX)
+    return (operand + x[l]) & 0x00FF;
+  else if constexpr (M == m::ZPY)
+    return (operand + y[l]) & 0x00FF;
+  else if constexpr (M == m::ABX)
+    return index(operand, x[l]);
+  else if constexpr (M == m::ABY)
+    return index(operand, y[l]);
+  else if constexpr (M == m::IZX) {
+    uint16_t lo = Read(l, (operand + x[l]) & 0x00FF);
+    uint16_t hi = Read(l, (operand + x[l] + 1) & 0x00FF);
+    return (hi << 8) | lo;
+  } else if constexpr (M == m::IZY) {
+    uint16_t lo = Read(l, operand & 0x00FF);
+    uint16_t hi = Read(l, (operand + 1) & 0x00FF);
+    return index((hi << 8) | lo, y[l]);
+  } else
+    return operand;
+}
+
+template <Batch6502::ALU OP>
+uint8_t *Batch6502::Reg()
+{
+  if constexpr (OP == LDX || OP == CPX)
+    return x.data();
+  else if constexpr (OP == LDY || OP == CPY)
+    return y.data();
+  else
+    return a.data();
+}
+
+template <Batch6502::ALU OP>
+void Batch6502::AluLane(size_t l, uint8_t v)
+{
+  uint8_t &r = Reg<OP>()[l];
+
+  if constexpr (OP == ORA)
+    r |= v;
+  else if constexpr (OP == AND)
+    r &= v;
+  else if constexpr (OP == EOR)
+    r ^= v;
+  else if constexpr (OP == ADC || OP == SBC) {
+    // Subtraction is addition of the inverted operand
+    if constexpr (OP == SBC)
+      v ^= 0xFF;
+    uint16_t t = (uint16_t)r + (uint16_t)v + (uint16_t)(status[l] & C);
+    uint8_t p = status[l] & ~(C | V);
+    p |= t > 255 ? C : 0;
+    p |= (~((uint16_t)r ^ (uint16_t)v) & ((uint16_t)r ^ t)) & 0x0080 ? V : 0;
+    status[l] = p;
+    r = t & 0x00FF;
+  } else if constexpr (OP == CMP || OP == CPX || OP == CPY) {
+    status[l] = (status[l] & ~C) | (r >= v ? C : 0);
+    SetNZ(l, (uint8_t)(r - v));
+    return;
+  } else if constexpr (OP == BIT) {
+    lazy_z[l] = r & v;
+    lazy_n[l] = v;
+    status[l] = (status[l] & ~V) | (v & V);
+    return;
+  } else
+    r = v;
+
+  SetNZ(l, r);
+}
+
+// An ALU instr run by every lane on an operand at the same addr
+template <Batch6502::ALU OP>
+void Batch6502::AluAll(const SOURCE &s)
+{
+  size_t l = 0;
+
+#ifdef __AVX2__
+  if constexpr (OP != BIT) {
+    uint8_t *r = Reg<OP>();
+    const __m256i mC = _mm256_set1_epi8(C);
+    const __m256i mV = _mm256_set1_epi8(V);
+
+    for (; l + 32 <= nLanes; l += 32) {
+      __m256i v = s.row ? _mm256_loadu_si256((const __m256i *)(s.row + l))
+                        : _mm256_set1_epi8((char)s.value);
+      __m256i reg = _mm256_loadu_si256((const __m256i *)(r + l));
+      __m256i res;
+
+      if constexpr (OP == ORA)
+        res = _mm256_or_si256(reg, v);
+      else if constexpr (OP == AND)
+        res = _mm256_and_si256(reg, v);
+      else if constexpr (OP == EOR)
+        res = _mm256_xor_si256(reg, v);
+      else if constexpr (OP == ADC || OP == SBC) {
+        if constexpr (OP == SBC)
+          v = _mm256_xor_si256(v, _mm256_set1_epi8(-1));
+        __m256i p = _mm256_loadu_si256((const __m256i *)(status.data() + l));
+        __m256i cin = _mm256_and_si256(p, mC);
+        __m256i t = _mm256_add_epi8(reg, v);
+        res = _mm256_add_epi8(t, cin);
+        // Neither add carried out if the saturating sums equal the wrapped ones
+        __m256i noCarry = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(reg, v), t),
+          _mm256_cmpeq_epi8(_mm256_adds_epu8(t, cin), res));
+        // Bit 7 of ovf is set on signed overflow, moved to bit 6 for V
+        __m256i ovf = _mm256_andnot_si256(_mm256_xor_si256(reg, v), _mm256_xor_si256(reg, res));
+        __m256i flags = _mm256_or_si256(_mm256_andnot_si256(noCarry, mC),
+          _mm256_and_si256(_mm256_srli_epi16(ovf, 1), mV));
+        p = _mm256_or_si256(_mm256_andnot_si256(_mm256_or_si256(mC, mV), p), flags);
+        _mm256_storeu_si256((__m256i *)(status.data() + l), p);
+      } else if constexpr (OP == CMP || OP == CPX || OP == CPY) {
+        __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(reg, v), reg);
+        __m256i p = _mm256_loadu_si256((const __m256i *)(status.data() + l));
+        p = _mm256_or_si256(_mm256_andnot_si256(mC, p), _mm256_and_si256(ge, mC));
+        _mm256_storeu_si256((__m256i *)(status.data() + l), p);
+        res = _mm256_sub_epi8(reg, v);
+      } else
+        res = v;
+
+      if constexpr (OP != CMP && OP != CPX && OP != CPY)
+        _mm256_storeu_si256((__m256i *)(r + l), res);
+      _mm256_storeu_si256((__m256i *)(lazy_z.data() + l), res);
+      _mm256_storeu_si256((__m256i *)(lazy_n.data() + l), res);
+    }
+  }
+#endif
+
+  for (; l < nLanes; l++)
+    AluLane<OP>(l, s.at(l));
+}
+
+template <Batch6502::ALU OP, nes6502::ADDRMODE M, typename LANES>
+void Batch6502::Alu(const LANES &lanes, uint16_t operand)
+{
+  if constexpr (M == m::IMM || M == m::ZP0 || M == m::ABS) {
+    SOURCE s = Source(M, operand);
+    if constexpr (std::is_same_v<LANES, ALL_LANES>)
+      AluAll<OP>(s);
+    else
+      lanes.ForEach([&](size_t l) { AluLane<OP>(l, s.at(l)); });
+  } else {
+    lanes.ForEach([&](size_t l) {
+      uint8_t crossed = 0;
+      uint16_t ea = Address<M>(l, operand, crossed);
+      AluLane<OP>(l, Read(l, ea));
+      cycles[l] += crossed;
+    });
+  }
+}
+
+template <Batch6502::RMW OP>
+uint8_t Batch6502::Modify(size_t l, uint8_t v)
+{
+  uint8_t r;
+  if constexpr (OP == ASL) {
+    status[l] = (status[l] & ~C) | (v >> 7);
+    r = v << 1;
+  } else if constexpr (OP == LSR) {
+    status[l] = (status[l] & ~C) | (v & 0x01);
+    r = v >> 1;
+  } else if constexpr (OP == ROL) {
+    r = (uint8_t)(v << 1) | (status[l] & C);
+    status[l] = (status[l] & ~C) | (v >> 7);
+  } else if constexpr (OP == ROR) {
+    r = (uint8_t)((status[l] & C) << 7) | (v >> 1);
+    status[l] = (status[l] & ~C) | (v & 0x01);
+  } else if constexpr (OP == INC)
+    r = v + 1;
+  else
+    r = v - 1;
+
+  SetNZ(l, r);
+  return r;
+}
+
+template <Batch6502::RMW OP, nes6502::ADDRMODE M, typename LANES>
+void Batch6502::Rmw(const LANES &lanes, uint16_t operand)
+{
+  if constexpr (M == m::IMP) {
+    lanes.ForEach([&](size_t l) { a[l] = Modify<OP>(l, a[l]); });
+  } else {
+    lanes.ForEach([&](size_t l) {
+      uint8_t crossed = 0;
+      uint16_t ea = Address<M>(l, operand, crossed);
+      Write(l, ea, Modify<OP>(l, Read(l, ea)));
+    });
+  }
+}
+
+template <nes6502::ADDRMODE M, typename LANES>
+void Batch6502::Store(const LANES &lanes, uint16_t operand, const uint8_t *reg)
+{
+  if constexpr (std::is_same_v<LANES, ALL_LANES> && (M == m::ZP0 || M == m::ABS)) {
+    uint16_t addr = M == m::ZP0 ? operand & 0x00FF : operand;
+    if (addr < 0x2000)
+      std::memcpy(Row(addr), reg, nLanes);
+  } else {
+    lanes.ForEach([&](size_t l) {
+      uint8_t crossed = 0;
+      Write(l, Address<M>(l, operand, crossed), reg[l]);
+    });
+  }
+}
+
+template <typename LANES>
+void Batch6502::execute(const LANES &lanes, const DECODED &d)
+{
+  uint16_t operand = d.operand;
+  lanes.ForEach([&](size_t l) { pc[l] = d.next; });
+
+  auto nz = [&](size_t l, uint8_t v) { SetNZ(l, v); };
+  auto flag = [&](uint8_t f, bool v) {
+    lanes.ForEach([&](size_t l) { status[l] = v ? status[l] | f : status[l] & ~f; });
+  };
+  auto push = [&](size_t l, uint8_t v) {
+    Row(0x0100 + stkp[l])[l] = v;
+    stkp[l]--;
+  };
+  auto pop = [&](size_t l) -> uint8_t {
+    stkp[l]++;
+    return Row(0x0100 + stkp[l])[l];
+  };
+
+  // Every lane at the same pc branches to the same target, only
+  // whether it is taken differs
+  auto branch = [&](auto cond) {
+    uint16_t target = d.next + (uint16_t)(int8_t)(operand & 0x00FF);
+    uint8_t extra = (target & 0xFF00) != (d.next & 0xFF00) ? 2 : 1;
+    lanes.ForEach([&](size_t l) {
+      if (cond(l)) {
+        pc[l] = target;
+        cycles[l] += extra;
+      }
+    });
+  };
+
+  uint8_t c;
+
+  // clang-format off
+  switch (d.opcode) {
+  // ADC - Add with carry in
+  case 0x69: Alu<ADC, m::IMM>(lanes, operand); c = 2; break;
+  case 0x65: Alu<ADC, m::ZP0>(lanes, operand); c = 3; break;
+  case 0x75: Alu<ADC, m::ZPX>(lanes, operand); c = 4; break;
+  case 0x6D: Alu<ADC, m::ABS>(lanes, operand); c = 4; break;
+  case 0x7D: Alu<ADC, m::ABX>(lanes, operand); c = 4; break;
+  case 0x79: Alu<ADC, m::ABY>(lanes, operand); c = 4; break;
+  case 0x61: Alu<ADC, m::IZX>(lanes, operand); c = 6; break;
+  case 0x71: Alu<ADC, m::IZY>(lanes, operand); c = 5; break;
+
+  // SBC - Subtract with borrow in
+  case 0xE9: Alu<SBC, m::IMM>(lanes, operand); c = 2; break;
+  case 0xE5: Alu<SBC, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xF5: Alu<SBC, m::ZPX>(lanes, operand); c = 4; break;
+  case 0xED: Alu<SBC, m::ABS>(lanes, operand); c = 4; break;
+  case 0xFD: Alu<SBC, m::ABX>(lanes, operand); c = 4; break;
+  case 0xF9: Alu<SBC, m::ABY>(lanes, operand); c = 4; break;
+  case 0xE1: Alu<SBC, m::IZX>(lanes, operand); c = 6; break;
+  case 0xF1: Alu<SBC, m::IZY>(lanes, operand); c = 5; break;
+  case 0xEB: lanes.ForEach([&](size_t l) { AluLane<SBC>(l, a[l]); }); c = 2; break;
+
+  // AND - Bitwise logic AND
+  case 0x29: Alu<AND, m::IMM>(lanes, operand); c = 2; break;
+  case 0x25: Alu<AND, m::ZP0>(lanes, operand); c = 3; break;
+  case 0x35: Alu<AND, m::ZPX>(lanes, operand); c = 4; break;
+  case 0x2D: Alu<AND, m::ABS>(lanes, operand); c = 4; break;
+  case 0x3D: Alu<AND, m::ABX>(lanes, operand); c = 4; break;
+  case 0x39: Alu<AND, m::ABY>(lanes, operand); c = 4; break;
+  case 0x21: Alu<AND, m::IZX>(lanes, operand); c = 6; break;
+  case 0x31: Alu<AND, m::IZY>(lanes, operand); c = 5; break;
+
+  // EOR - Bitwise logic XOR
+  case 0x49: Alu<EOR, m::IMM>(lanes, operand); c = 2; break;
+  case 0x45: Alu<EOR, m::ZP0>(lanes, operand); c = 3; break;
+  case 0x55: Alu<EOR, m::ZPX>(lanes, operand); c = 4; break;
+  case 0x4D: Alu<EOR, m::ABS>(lanes, operand); c = 4; break;
+  case 0x5D: Alu<EOR, m::ABX>(lanes, operand); c = 4; break;
+  case 0x59: Alu<EOR, m::ABY>(lanes, operand); c = 4; break;
+  case 0x41: Alu<EOR, m::IZX>(lanes, operand); c = 6; break;
+  case 0x51: Alu<EOR, m::IZY>(lanes, operand); c = 5; break;
+
+  // ORA - Bitwise logic OR
+  case 0x09: Alu<ORA, m::IMM>(lanes, operand); c = 2; break;
+  case 0x05: Alu<ORA, m::ZP0>(lanes, operand); c = 3; break;
+  case 0x15: Alu<ORA, m::ZPX>(lanes, operand); c = 4; break;
+  case 0x0D: Alu<ORA, m::ABS>(lanes, operand); c = 4; break;
+  case 0x1D: Alu<ORA, m::ABX>(lanes, operand); c = 4; break;
+  case 0x19: Alu<ORA, m::ABY>(lanes, operand); c = 4; break;
+  case 0x01: Alu<ORA, m::IZX>(lanes, operand); c = 6; break;
+  case 0x11: Alu<ORA, m::IZY>(lanes, operand); c = 5; break;
+
+  // CMP, CPX, CPY - Compare register with memory
+  case 0xC9: Alu<CMP, m::IMM>(lanes, operand); c = 2; break;
+  case 0xC5: Alu<CMP, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xD5: Alu<CMP, m::ZPX>(lanes, operand); c = 4; break;
+  case 0xCD: Alu<CMP, m::ABS>(lanes, operand); c = 4; break;
+  case 0xDD: Alu<CMP, m::ABX>(lanes, operand); c = 4; break;
+  case 0xD9: Alu<CMP, m::ABY>(lanes, operand); c = 4; break;
+  case 0xC1: Alu<CMP, m::IZX>(lanes, operand); c = 6; break;
+  case 0xD1: Alu<CMP, m::IZY>(lanes, operand); c = 5; break;
+  case 0xE0: Alu<CPX, m::IMM>(lanes, operand); c = 2; break;
+  case 0xE4: Alu<CPX, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xEC: Alu<CPX, m::ABS>(lanes, operand); c = 4; break;
+  case 0xC0: Alu<CPY, m::IMM>(lanes, operand); c = 2; break;
+  case 0xC4: Alu<CPY, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xCC: Alu<CPY, m::ABS>(lanes, operand); c = 4; break;
+
+  // BIT - Test bits in memory with accumulator
+  case 0x24: Alu<BIT, m::ZP0>(lanes, operand); c = 3; break;
+  case 0x2C: Alu<BIT, m::ABS>(lanes, operand); c = 4; break;
+
+  // LDA, LDX, LDY - Load register
+  case 0xA9: Alu<LDA, m::IMM>(lanes, operand); c = 2; break;
+  case 0xA5: Alu<LDA, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xB5: Alu<LDA, m::ZPX>(lanes, operand); c = 4; break;
+  case 0xAD: Alu<LDA, m::ABS>(lanes, operand); c = 4; break;
+  case 0xBD: Alu<LDA, m::ABX>(lanes, operand); c = 4; break;
+  case 0xB9: Alu<LDA, m::ABY>(lanes, operand); c = 4; break;
+  case 0xA1: Alu<LDA, m::IZX>(lanes, operand); c = 6; break;
+  case 0xB1: Alu<LDA, m::IZY>(lanes, operand); c = 5; break;
+  case 0xA2: Alu<LDX, m::IMM>(lanes, operand); c = 2; break;
+  case 0xA6: Alu<LDX, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xB6: Alu<LDX, m::ZPY>(lanes, operand); c = 4; break;
+  case 0xAE: Alu<LDX, m::ABS>(lanes, operand); c = 4; break;
+  case 0xBE: Alu<LDX, m::ABY>(lanes, operand); c = 4; break;
+  case 0xA0: Alu<LDY, m::IMM>(lanes, operand); c = 2; break;
+  case 0xA4: Alu<LDY, m::ZP0>(lanes, operand); c = 3; break;
+  case 0xB4: Alu<LDY, m::ZPX>(lanes, operand); c = 4; break;
+  case 0xAC: Alu<LDY, m::ABS>(lanes, operand); c = 4; break;
+  case 0xBC: Alu<LDY, m::ABX>(lanes, operand); c = 4; break;
+
+  // STA, STX, STY - Store register
+  case 0x85: Store<m::ZP0>(lanes, operand, a.data()); c = 3; break;
+  case 0x95: Store<m::ZPX>(lanes, operand, a.data()); c = 4; break;
+  case 0x8D: Store<m::ABS>(lanes, operand, a.data()); c = 4; break;
+  case 0x9D: Store<m::ABX>(lanes, operand, a.data()); c = 5; break;
+  case 0x99: Store<m::ABY>(lanes, operand, a.data()); c = 5; break;
+  case 0x81: Store<m::IZX>(lanes, operand, a.data()); c = 6; break;
+  case 0x91: Store<m::IZY>(lanes, operand, a.data()); c = 6; break;
+  case 0x86: Store<m::ZP0>(lanes, operand, x.data()); c = 3; break;
+  case 0x96: Store<m::ZPY>(lanes, operand, x.data()); c = 4; break;
+  case 0x8E: Store<m::ABS>(lanes, operand, x.data()); c = 4; break;
+  case 0x84: Store<m::ZP0>(lanes, operand, y.data()); c = 3; break;
+  case 0x94: Store<m::ZPX>(lanes, operand, y.data()); c = 4; break;
+  case 0x8C: Store<m::ABS>(lanes, operand, y.data()); c = 4; break;
+
+  // ASL, LSR, ROL, ROR - Shifts and rotates (accumulator or memory)
+  case 0x0A: Rmw<ASL, m::IMP>(lanes, operand); c = 2; break;
+  case 0x06: Rmw<ASL, m::ZP0>(lanes, operand); c = 5; break;
+  case 0x16: Rmw<ASL, m::ZPX>(lanes, operand); c = 6; break;
+  case 0x0E: Rmw<ASL, m::ABS>(lanes, operand); c = 6; break;
+  case 0x1E: Rmw<ASL, m::ABX>(lanes, operand); c = 7; break;
+  case 0x4A: Rmw<LSR, m::IMP>(lanes, operand); c = 2; break;
+  case 0x46: Rmw<LSR, m::ZP0>(lanes, operand); c = 5; break;
+  case 0x56: Rmw<LSR, m::ZPX>(lanes, operand); c = 6; break;
+  case 0x4E: Rmw<LSR, m::ABS>(lanes, operand); c = 6; break;
+  case 0x5E: Rmw<LSR, m::ABX>(lanes, operand); c = 7; break;
+  case 0x2A: Rmw<ROL, m::IMP>(lanes, operand); c = 2; break;
+  case 0x26: Rmw<ROL, m::ZP0>(lanes, operand); c = 5; break;
+  case 0x36: Rmw<ROL, m::ZPX>(lanes, operand); c = 6; break;
+  case 0x2E: Rmw<ROL, m::ABS>(lanes, operand); c = 6; break;
+  case 0x3E: Rmw<ROL, m::ABX>(lanes, operand); c = 7; break;
+  case 0x6A: Rmw<ROR, m::IMP>(lanes, operand); c = 2; break;
+  case 0x66: Rmw<ROR, m::ZP0>(lanes, operand); c = 5; break;
+  case 0x76: Rmw<ROR, m::ZPX>(lanes, operand); c = 6; break;
+  case 0x6E: Rmw<ROR, m::ABS>(lanes, operand); c = 6; break;
+  case 0x7E: Rmw<ROR, m::ABX>(lanes, operand); c = 7; break;
+
+  // DEC, INC - Decrement / increment memory
+  case 0xC6: Rmw<DEC, m::ZP0>(lanes, operand); c = 5; break;
+  case 0xD6: Rmw<DEC, m::ZPX>(lanes, operand); c = 6; break;
+  case 0xCE: Rmw<DEC, m::ABS>(lanes, operand); c = 6; break;
+  case 0xDE: Rmw<DEC, m::ABX>(lanes, operand); c = 7; break;
+  case 0xE6: Rmw<INC, m::ZP0>(lanes, operand); c = 5; break;
+  case 0xF6: Rmw<INC, m::ZPX>(lanes, operand); c = 6; break;
+  case 0xEE: Rmw<INC, m::ABS>(lanes, operand); c = 6; break;
+  case 0xFE: Rmw<INC, m::ABX>(lanes, operand); c = 7; break;
+
+  // DEX, DEY, INX, INY - Decrement / increment register
+  case 0xCA: lanes.ForEach([&](size_t l) { x[l]--; nz(l, x[l]); }); c = 2; break;
+  case 0x88: lanes.ForEach([&](size_t l) { y[l]--; nz(l, y[l]); }); c = 2; break;
+  case 0xE8: lanes.ForEach([&](size_t l) { x[l]++; nz(l, x[l]); }); c = 2; break;
+  case 0xC8: lanes.ForEach([&](size_t l) { y[l]++; nz(l, y[l]); }); c = 2; break;
+
+  // Register transfers
+  case 0xAA: lanes.ForEach([&](size_t l) { x[l] = a[l]; nz(l, x[l]); }); c = 2; break;
+  case 0xA8: lanes.ForEach([&](size_t l) { y[l] = a[l]; nz(l, y[l]); }); c = 2; break;
+  case 0x8A: lanes.ForEach([&](size_t l) { a[l] = x[l]; nz(l, a[l]); }); c = 2; break;
+  case 0x98: lanes.ForEach([&](size_t l) { a[l] = y[l]; nz(l, a[l]); }); c = 2; break;
+  case 0xBA: lanes.ForEach([&](size_t l) { x[l] = stkp[l]; nz(l, x[l]); }); c = 2; break;
+  case 0x9A: lanes.ForEach([&](size_t l) { stkp[l] = x[l]; }); c = 2; break;
+
+  // Branches
+  case 0x90: branch([&](size_t l) { return (status[l] & C) == 0; }); c = 2; break;
+  case 0xB0: branch([&](size_t l) { return (status[l] & C) != 0; }); c = 2; break;
+  case 0xD0: branch([&](size_t l) { return lazy_z[l] != 0x00; }); c = 2; break;
+  case 0xF0: branch([&](size_t l) { return lazy_z[l] == 0x00; }); c = 2; break;
+  case 0x10: branch([&](size_t l) { return (lazy_n[l] & N) == 0; }); c = 2; break;
+  case 0x30: branch([&](size_t l) { return (lazy_n[l] & N) != 0; }); c = 2; break;
+  case 0x50: branch([&](size_t l) { return (status[l] & V) == 0; }); c = 2; break;
+  case 0x70: branch([&](size_t l) { return (status[l] & V) != 0; }); c = 2; break;
+
+  // Flag set / clear
+  case 0x18: flag(C, false);         c = 2; break;
+  case 0x38: flag(C, true);          c = 2; break;
+  case 0x58: flag(I, false);         c = 2; break;
+  case 0x78: flag(I, true);          c = 2; break;
+  case 0xB8: flag(V, false);         c = 2; break;
+  case 0xD8: flag(D, false);         c = 2; break;
+  case 0xF8: flag(D, true);          c = 2; break;
+
+  // Stack
+  case 0x48:// PHA
+    lanes.ForEach([&](size_t l) { push(l, a[l]); });
+    c = 3;
+    break;
+  case 0x08:// PHP - break flag is set to 1 before push
+    lanes.ForEach([&](size_t l) {
+      push(l, GetStatus(l) | B | U);
+      status[l] &= ~(B | U);
+    });
+    c = 3;
+    break;
+  case 0x68:// PLA
+    lanes.ForEach([&](size_t l) {
+      a[l] = pop(l);
+      nz(l, a[l]);
+    });
+    c = 4;
+    break;
+  case 0x28:// PLP
+    lanes.ForEach([&](size_t l) {
+      SetStatus(l, pop(l));
+      status[l] |= U;
+    });
+    c = 4;
+    break;
+
+  // Jumps and subroutines
+  case 0x4C:// JMP abs
+    lanes.ForEach([&](size_t l) { pc[l] = operand; });
+    c = 3;
+    break;
+  case 0x6C:// JMP ind, including the page boundary hardware bug
+    lanes.ForEach([&](size_t l) {
+      uint16_t lo = Read(l, operand);
+      uint16_t hi = Read(l, (operand & 0x00FF) == 0x00FF ? (operand & 0xFF00) : operand + 1);
+      pc[l] = (hi << 8) | lo;
+    });
+    c = 5;
+    break;
+  case 0x20:// JSR
+    lanes.ForEach([&](size_t l) {
+      uint16_t ret = d.next - 1;
+      push(l, (ret >> 8) & 0x00FF);
+      push(l, ret & 0x00FF);
+      pc[l] = operand;
+    });
+    c = 6;
+    break;
+  case 0x60:// RTS
+    lanes.ForEach([&](size_t l) {
+      uint16_t lo = pop(l);
+      uint16_t hi = pop(l);
+      pc[l] = ((hi << 8) | lo) + 1;
+    });
+    c = 6;
+    break;
+  case 0x40:// RTI
+    lanes.ForEach([&](size_t l) {
+      SetStatus(l, pop(l));
+      status[l] &= ~(B | U);
+      uint16_t lo = pop(l);
+      uint16_t hi = pop(l);
+      pc[l] = (hi << 8) | lo;
+    });
+    c = 6;
+    break;
+  case 0x00:// BRK
+    lanes.ForEach([&](size_t l) {
+      uint16_t ret = d.next + 1;
+      status[l] |= I;
+      push(l, (ret >> 8) & 0x00FF);
+      push(l, ret & 0x00FF);
+      push(l, GetStatus(l) | B);
+      pc[l] = (vPRG[0x7FFF] << 8) | vPRG[0x7FFE];
+    });
+    c = 7;
+    break;
+
+  // Official NOP and the illegal opcodes, which only burn the cycles
+  // listed for them
+  default:
+    c = nes6502::opcodes[d.opcode].cycles;
+    break;
+  }
+  // clang-format on
+
+  lanes.ForEach([&](size_t l) { cycles[l] += c; });
+}
@@ -0,0 +1,278 @@
+#include "BatchRunner.h"
+#include "Bus.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+BatchRunner::BatchRunner(size_t n, bool bPin, nes6502::ENGINE e)
+  : nWorkers(n), bPinCores(bPin), engine(e)
+{
+  if (nWorkers == 0)
+    nWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// FNV-1a over everything the CPU can see of the machine. The PPU only
+// draws noise so far, so the screen is left out
+uint64_t BatchRunner::HashState(Bus &nes)
+{
+  uint64_t h = 0xCBF29CE484222325;
+  auto add = [&](uint8_t v) {
+    h ^= v;
+    h *= 0x100000001B3;
+  };
+
+  add(nes.cpu.a);
+  add(nes.cpu.x);
+  add(nes.cpu.y);
+  add(nes.cpu.stkp);
+  add(nes.cpu.GetStatus());
+  add(nes.cpu.pc & 0x00FF);
+  add(nes.cpu.pc >> 8);
+  for (size_t addr = 0; addr < nes.cpuRam.nSize; addr++)
+    add(nes.cpuRam[addr]);
+  return h;
+}
+
+// Powers the worker's NES up with the job's cartridge, as if it had
+// never run anything else, or restores the job's snapshot, and runs
+// the job's frames
+static BatchRunner::RESULT RunJob(Bus &nes, nes6502::ENGINE engine, const BatchRunner::JOB &job)
+{
+  BatchRunner::RESULT r;
+
+  auto cart = std::make_shared<Cartridge>(job.sRom);
+  if (!cart->ImageValid()) {
+    r.sError = "could not load " + job.sRom;
+    return r;
+  }
+
+  nes.cpuRam.Fill(0x00);
+  nes.ppu.PowerUp();
+  nes.controller[0] = 0x00;
+  nes.controller[1] = 0x00;
+  nes.insertCartridge(cart);
+  nes.cpu.SetEngine(engine);
+  // Nothing looks at the screen, the hash leaves it out
+  nes.ppu.SetRender(false);
+  nes.reset();
+  if (!job.vState.empty() && !nes.loadState(job.vState.data(), job.vState.size())) {
+    r.sError = "snapshot does not fit " + job.sRom;
+    return r;
+  }
+
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t f = 0; f < job.nFrames; f++) {
+    if (!job.vInput.empty())
+      nes.controller[0] = job.vInput[std::min<size_t>(f, job.vInput.size() - 1)];
+    if (!job.vInput2.empty())
+      nes.controller[1] = job.vInput2[std::min<size_t>(f, job.vInput2.size() - 1)];
+
+    Bus::STATS stats = nes.runFrame();
+    r.nCycles += stats.nCycles;
+    r.nInstrs += stats.nInstrs;
+  }
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+
+  r.bOk = true;
+  r.nFrames = job.nFrames;
+  r.fSeconds = tElapsed.count();
+  r.nHash = BatchRunner::HashState(nes);
+  r.bHashMatch = job.bCheckHash && r.nHash == job.nExpectedHash;
+  return r;
+}
+
+std::vector<BatchRunner::RESULT> BatchRunner::Run(const std::vector<JOB> &vJobs)
+{
+  std::vector<RESULT> vResults(vJobs.size());
+
+  // Each worker's own jobs, dealt out round robin. The owner takes
+  // from the back, thieves from the front
+  struct QUEUE
+  {
+    std::mutex mux;
+    std::deque<size_t> dqJobs;
+  };
+  std::vector<QUEUE> vQueues(nWorkers);
+  for (size_t i = 0; i < vJobs.size(); i++)
+    vQueues[i % nWorkers].dqJobs.push_back(i);
+
+  auto take = [&](size_t w, size_t &nJob) -> bool {
+    for (size_t k = 0; k < nWorkers; k++) {
+      QUEUE &q = vQueues[(w + k) % nWorkers];
+      std::lock_guard<std::mutex> lock(q.mux);
+      if (q.dqJobs.empty())
+        continue;
+      if (k == 0) {
+        nJob = q.dqJobs.back();
+        q.dqJobs.pop_back();
+      } else {
+        nJob = q.dqJobs.front();
+        q.dqJobs.pop_front();
+      }
+      return true;
+    }
+    return false;
+  };
+
+#ifdef __linux__
+  // Workers are pinned to the CPUs this process may run on, which a
+  // container or taskset may have narrowed down from all of them
+  std::vector<int> vCpus;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (bPinCores && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    for (int c = 0; c < CPU_SETSIZE; c++)
+      if (CPU_ISSET(c, &allowed))
+        vCpus.push_back(c);
+#endif
+
+  auto worker = [&](size_t w) {
+#ifdef __linux__
+    if (!vCpus.empty()) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(vCpus[w % vCpus.size()], &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+    // A Bus holds the PPU's frame buffers, so it is made once per
+    // worker and reset for each job rather than made per job
+    auto nes = std::make_unique<Bus>();
+    size_t nJob = 0;
+    while (take(w, nJob)) {
+      vResults[nJob] = RunJob(*nes, engine, vJobs[nJob]);
+      vResults[nJob].nWorker = w;
+    }
+  };
+
+  auto tStart = std::chrono::steady_clock::now();
+  std::vector<std::thread> vThreads;
+  for (size_t w = 0; w < nWorkers; w++)
+    vThreads.emplace_back(worker, w);
+  for (auto &t : vThreads)
+    t.join();
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+  fSeconds = tElapsed.count();
+
+  return vResults;
+}
+
+static std::string Hex64(uint64_t n)
+{
+  return hex((uint32_t)(n >> 32), 8) + hex((uint32_t)n, 8);
+}
+
+bool BatchRunner::LoadManifest(const std::string &sFile, std::vector<JOB> &vJobs, std::string &sError)
+{
+  std::ifstream ifs(sFile);
+  if (!ifs.is_open()) {
+    sError = "could not open " + sFile;
+    return false;
+  }
+
+  std::string sLine;
+  for (uint32_t nLine = 1; std::getline(ifs, sLine); nLine++) {
+    std::istringstream ss(sLine);
+    JOB job;
+    std::string sFrames, sInput = "-", sHash = "-";
+    if (!(ss >> job.sRom) || job.sRom[0] == '#')
+      continue;
+
+    ss >> sFrames >> sInput >> sHash;
+    uint64_t nFrames = 0;
+    bool bHashValid = sHash == "-"
+                      || (!sHash.empty() && sHash.size() <= 16
+                          && sHash.find_first_not_of("0123456789ABCDEFabcdef") == std::string::npos);
+    if (!ParseCount(sFrames, UINT32_MAX, nFrames) || !bHashValid) {
+      sError = sFile + ":" + std::to_string(nLine) + ": bad frame count or hash";
+      return false;
+    }
+    job.nFrames = (uint32_t)nFrames;
+    if (sHash != "-") {
+      job.nExpectedHash = std::stoull(sHash, nullptr, 16);
+      job.bCheckHash = true;
+    }
+
+    if (sInput != "-") {
+      std::ifstream ifsInput(sInput, std::ifstream::binary);
+      if (!ifsInput.is_open()) {
+        sError = sFile + ":" + std::to_string(nLine) + ": could not open " + sInput;
+        return false;
+      }
+      job.vInput.assign(std::istreambuf_iterator<char>(ifsInput), std::istreambuf_iterator<char>());
+    }
+
+    vJobs.push_back(std::move(job));
+  }
+
+  return true;
+}
+
+static std::string JsonString(const std::string &s)
+{
+  std::string sOut = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      sOut += '\\';
+    if ((unsigned char)c < 0x20)
+      sOut += "\\u00" + hex((uint8_t)c, 2);
+    else
+      sOut += c;
+  }
+  return sOut + "\"";
+}
+
+std::string BatchRunner::ToJson(const std::vector<JOB> &vJobs, const std::vector<RESULT> &vResults) const
+{
+  uint64_t nFrames = 0;
+  size_t nFailed = 0, nMismatched = 0;
+  for (size_t i = 0; i < vResults.size(); i++) {
+    nFrames += vResults[i].nFrames;
+    nFailed += !vResults[i].bOk;
+    nMismatched += vResults[i].bOk && vJobs[i].bCheckHash && !vResults[i].bHashMatch;
+  }
+
+  std::ostringstream ss;
+  ss << "{\n"
+     << "  \"workers\": " << nWorkers << ",\n"
+     << "  \"jobs\": " << vResults.size() << ",\n"
+     << "  \"failed\": " << nFailed << ",\n"
+     << "  \"mismatched\": " << nMismatched << ",\n"
+     << "  \"frames\": " << nFrames << ",\n"
+     << "  \"seconds\": " << fSeconds << ",\n"
+     << "  \"frames_per_second\": " << (fSeconds > 0.0 ? nFrames / fSeconds : 0.0) << ",\n"
+     << "  \"results\": [";
+
+  for (size_t i = 0; i < vResults.size(); i++) {
+    const RESULT &r = vResults[i];
+    ss << (i ? ",\n" : "\n") << "    { \"rom\": " << JsonString(vJobs[i].sRom)
+       << ", \"worker\": " << r.nWorker;
+    if (!r.bOk) {
+      ss << ", \"error\": " << JsonString(r.sError) << " }";
+      continue;
+    }
+
+    ss << ", \"frames\": " << r.nFrames << ", \"cycles\": " << r.nCycles
+       << ", \"instrs\": " << r.nInstrs << ", \"seconds\": " << r.fSeconds
+       << ", \"frames_per_second\": " << (r.fSeconds > 0.0 ? r.nFrames / r.fSeconds : 0.0)
+       << ", \"hash\": \"" << Hex64(r.nHash) << "\"";
+    if (vJobs[i].bCheckHash)
+      ss << ", \"match\": " << (r.bHashMatch ? "true" : "false");
+    ss << " }";
+  }
+
+  ss << "\n  ]\n}\n";
+  return ss.str();
+}
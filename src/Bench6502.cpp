@@ -0,0 +1,512 @@
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+
+#include "Bus.h"
+#include "Batch6502.h"
+#include "Rewind.h"
+#include "RunAhead.h"
+#include "nes6502.h"
+
+// The PPU's sprites live in the engine's implementation, so it has to be
+// compiled into one translation unit even though no window is opened
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+// Headless benchmark of the CPU execution engines and the system
+// around them. Times each engine on nestest.nes in automation mode
+// (pc = $C000, no PPU required) against the reference engine, the
+// code caching engines against the fused engine as well, and the
+// lockstep Batch6502 with its lanes either all in step or
+// staggered a few instrs apart. Then times
+// whole frames, clocked dot by dot and driven by events with the PPU
+// catching up, snapshots, the rewind history, run ahead, forking, the
+// ROM cache and mapper dispatch. The checks that all of these behave
+// live in tests/TestSystem.cpp, this only measures them. It exits with
+// 1 if the JIT turns out no faster than the fused engine, or a frame
+// not drawn no cheaper than one drawn.
+
+// Length of nestest's automated run (the number of lines in nestest.log)
+static constexpr uint32_t nNestestInstructions = 8991;
+
+static std::string EngineName(nes6502::ENGINE e, nes6502::ACCURACY acc = nes6502::PER_INSTR)
+{
+  if (acc == nes6502::PER_CYCLE)
+    return EngineName(e) + "/per-cycle";
+
+  switch (e) {
+  case nes6502::FUSED:
+    return "fused";
+  case nes6502::CACHED:
+    return "cached";
+  case nes6502::JIT:
+    return "jit";
+  default:
+    return "lookup";
+  }
+}
+
+// Power up a NES with the given engine and point it at the automated
+// entry of nestest
+static bool Boot(Bus &nes, const std::string &sRom, nes6502::ENGINE e,
+  nes6502::ACCURACY acc = nes6502::PER_INSTR)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return false;
+
+  nes.insertCartridge(cart);
+  nes.cpu.SetEngine(e);
+  nes.cpu.SetAccuracy(acc);
+  nes.reset();
+  nes.cpu.pc = 0xC000;
+  return true;
+}
+
+// Cycles the reference engine takes for nestest's automated run
+static uint32_t PassCycles(const std::string &sRom)
+{
+  Bus nes;
+  if (!Boot(nes, sRom, nes6502::LOOKUP))
+    return 0;
+
+  nes.cpu.step();
+  uint32_t nCycles = 0;
+  for (uint32_t i = 0; i < nNestestInstructions; i++)
+    nCycles += nes.cpu.step();
+  return nCycles;
+}
+
+// An engine under measurement, with the machine it runs on
+struct MEASURED
+{
+  nes6502::ENGINE e;
+  nes6502::ACCURACY acc;
+  std::unique_ptr<Bus> nes;
+  uint64_t nCycles = 0;
+  double fBest = 0.0;// Seconds per pass of the fastest round
+};
+
+// Times the engines on repeated passes over nestest's automated run,
+// and returns them with the seconds each pass takes. The engines take
+// turns, a round of passes at a time, and each keeps its fastest round,
+// so that a busy or throttled host slows them all alike rather than
+// whichever was running at the time
+static std::vector<MEASURED> Measure(const std::vector<std::pair<nes6502::ENGINE, nes6502::ACCURACY>> &vEngines,
+  uint32_t nPasses, uint32_t nPassCycles, const std::string &sRom)
+{
+  std::vector<MEASURED> vMeasured;
+  for (auto &ea : vEngines) {
+    vMeasured.push_back({ ea.first, ea.second, std::make_unique<Bus>() });
+    if (!Boot(*vMeasured.back().nes, sRom, ea.first, ea.second))
+      return {};
+  }
+
+  // Beyond the automated run nestest lands in a BRK/RTI loop, so
+  // time repeated passes over the automated run itself instead. The
+  // passes are cycle budgeted as the JIT does not step single instrs
+  uint32_t nRounds = std::min<uint32_t>(nPasses, 20);
+  for (uint32_t r = 0; r < nRounds; r++) {
+    for (MEASURED &m : vMeasured) {
+      Bus &nes = *m.nes;
+      uint32_t nRoundPasses = nPasses / nRounds;
+      auto tStart = std::chrono::steady_clock::now();
+      for (uint32_t p = 0; p < nRoundPasses; p++) {
+        nes.cpuRam.Fill(0x00);
+        nes.cpu.reset();
+        nes.cpu.pc = 0xC000;
+        nes.cpu.step();
+        m.nCycles += nes.cpu.run(nPassCycles);
+      }
+      std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+      double fPass = tElapsed.count() / nRoundPasses;
+      if (r == 0 || fPass < m.fBest)
+        m.fBest = fPass;
+    }
+  }
+
+  // The code caching engines are up against the fused engine they
+  // run the handlers of
+  const MEASURED *pFused = nullptr;
+  for (MEASURED &m : vMeasured)
+    if (m.e == nes6502::FUSED && m.acc == nes6502::PER_INSTR)
+      pFused = &m;
+
+  for (MEASURED &m : vMeasured) {
+    std::cout << EngineName(m.e, m.acc) << ": " << nRounds * (nPasses / nRounds) << " passes, "
+              << m.nCycles << " cycles, " << m.fBest * 1e6 << " us per pass ("
+              << nNestestInstructions / m.fBest / 1e6 << " M instrs/s";
+    if (&m != &vMeasured[0])
+      std::cout << ", " << vMeasured[0].fBest / m.fBest << "x " << EngineName(vMeasured[0].e, vMeasured[0].acc);
+    if (pFused && (m.e == nes6502::CACHED || m.e == nes6502::JIT))
+      std::cout << ", " << pFused->fBest / m.fBest << "x fused";
+    std::cout << ")\n";
+
+    if (m.e == nes6502::CACHED) {
+      BlockCache::STATS stats = m.nes->cpu.CacheStats();
+      uint64_t nLookups = stats.nHits + stats.nMisses;
+      std::cout << "  block cache: " << stats.nHits << " hits, " << stats.nMisses << " misses ("
+                << (nLookups ? 100.0 * stats.nHits / nLookups : 0.0) << "% hit), "
+                << stats.nInvalidations << " invalidations, " << stats.nUncached
+                << " uncached instrs, " << stats.nFlushes << " flushes\n";
+    }
+
+    if (m.e == nes6502::JIT) {
+      Jit6502::STATS stats = m.nes->cpu.JitStats();
+      std::cout << "  jit: " << stats.nBlocksCompiled << " blocks compiled, "
+                << stats.nBlocksRejected << " rejected, " << stats.nBlocksRun
+                << " blocks run, " << stats.nInterpreted << " instrs interpreted, "
+                << stats.nFlushes << " flushes\n";
+    }
+  }
+  return vMeasured;
+}
+
+// Creates a batch of lanes at nestest's automated entry, lane l having
+// already run l % nStagger instrs on its own so that the lanes diverge
+static std::unique_ptr<Batch6502> BootBatch(const std::shared_ptr<Cartridge> &cart,
+  size_t nLanes, uint32_t nStagger, std::vector<uint64_t> &vStart)
+{
+  auto batch = std::make_unique<Batch6502>(nLanes, cart);
+  batch->ClearRam();
+  batch->reset();
+  vStart = batch->cycles;
+  for (size_t l = 0; l < nLanes; l++) {
+    batch->pc[l] = 0xC000;
+    for (uint32_t i = 0; i < l % nStagger; i++)
+      batch->stepLane(l);
+  }
+  return batch;
+}
+
+static void MeasureBatch(size_t nLanes, uint32_t nStagger, uint32_t nPasses, const std::string &sRom)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return;
+
+  uint64_t nCycles = 0;
+  Batch6502::STATS stats;
+  std::chrono::duration<double> tElapsed{ 0 };
+  for (uint32_t p = 0; p < nPasses; p++) {
+    std::vector<uint64_t> vStart;
+    auto batch = BootBatch(cart, nLanes, nStagger, vStart);
+
+    auto tStart = std::chrono::steady_clock::now();
+    batch->run(nNestestInstructions - (nStagger - 1));
+    tElapsed += std::chrono::steady_clock::now() - tStart;
+
+    for (size_t l = 0; l < nLanes; l++)
+      nCycles += batch->cycles[l] - vStart[l];
+    Batch6502::STATS s = batch->Stats();
+    stats.nSteps += s.nSteps;
+    stats.nUniformSteps += s.nUniformSteps;
+    stats.nGroups += s.nGroups;
+    stats.nLaneInstrs += s.nLaneInstrs;
+  }
+
+  std::cout << "batch x" << nLanes << " (stagger " << nStagger << "): " << nPasses
+            << " passes, " << nCycles << " lane cycles in " << tElapsed.count() * 1000.0
+            << " ms (" << stats.nLaneInstrs / tElapsed.count() / 1e6 << " M lane instrs/s, "
+            << nCycles / tElapsed.count() / 1e6 << " M cycles/s)\n";
+
+  uint64_t nDiverged = stats.nSteps - stats.nUniformSteps;
+  std::cout << "  lanes: " << stats.nUniformSteps << " of " << stats.nSteps
+            << " steps uniform, " << (nDiverged ? (double)stats.nGroups / nDiverged : 0.0)
+            << " groups per diverged step\n";
+}
+
+// Times saving and loading a snapshot taken part way through a frame
+static void MeasureStates(nes6502::ACCURACY acc, uint32_t nRepeats, const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->cpu.SetAccuracy(acc);
+  nes->reset();
+
+  nes->runCycles(10 * 29781 + 12345);
+  std::vector<uint8_t> vState(nes->StateSize());
+
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nRepeats; i++)
+    nes->saveState(vState.data(), vState.size());
+  std::chrono::duration<double> tSave = std::chrono::steady_clock::now() - tStart;
+  tStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nRepeats; i++)
+    nes->loadState(vState.data(), vState.size());
+  std::chrono::duration<double> tLoad = std::chrono::steady_clock::now() - tStart;
+
+  std::cout << "snapshots of " << EngineName(nes6502::FUSED, acc) << ": "
+            << vState.size() << " bytes, save " << tSave.count() / nRepeats * 1e9
+            << " ns, load " << tLoad.count() / nRepeats * 1e9 << " ns\n";
+}
+
+// Times pushing nFrames into a rewind history and stepping all the
+// way back, and shows how much history its budget holds
+static void MeasureRewind(uint32_t nFrames, const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->reset();
+
+  Rewind rewind(*nes);
+  std::chrono::duration<double> tPush{ 0 }, tBack{ 0 };
+  for (uint32_t f = 0; f < nFrames; f++) {
+    auto tStart = std::chrono::steady_clock::now();
+    rewind.Push();
+    tPush += std::chrono::steady_clock::now() - tStart;
+    nes->runFrame();
+  }
+  size_t nBytes = rewind.BytesUsed();
+
+  for (uint32_t f = nFrames; f-- > 0;) {
+    auto tStart = std::chrono::steady_clock::now();
+    rewind.Back();
+    tBack += std::chrono::steady_clock::now() - tStart;
+  }
+
+  double fPerFrame = (double)nBytes / nFrames;
+  std::cout << "rewind: " << nFrames << " frames, " << fPerFrame
+            << " bytes per frame (" << rewind.Budget() / fPerFrame / 3600.0
+            << " minutes in " << (rewind.Budget() >> 20) << " MB), push "
+            << tPush.count() / nFrames * 1e6 << " us, back "
+            << tBack.count() / nFrames * 1e6 << " us\n";
+}
+
+static std::unique_ptr<Bus> BootFrames(const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return nullptr;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->reset();
+  return nes;
+}
+
+// Times frames drawn and not drawn, and host frames run ahead, which
+// shows what each frame ahead costs. Returns false if a frame that is
+// not drawn costs as much as one that is, when run ahead buys nothing
+static bool MeasureRunAhead(uint32_t nFrames, const std::string &sRom)
+{
+  double vSeconds[2] = {};
+  for (bool bRender : { true, false }) {
+    auto nes = BootFrames(sRom);
+    if (!nes)
+      return true;
+    nes->ppu.SetRender(bRender);
+    for (uint32_t f = 0; f < nFrames; f++)
+      vSeconds[bRender] += nes->runFrame().fSeconds;
+    vSeconds[bRender] /= nFrames;
+  }
+  std::cout << "frames: " << vSeconds[1] * 1e6 << " us drawn, " << vSeconds[0] * 1e6
+            << " us not drawn (" << vSeconds[1] / vSeconds[0] << "x)\n";
+
+  double fBase = 0.0;
+  for (uint32_t nAhead = 0; nAhead <= 3; nAhead++) {
+    auto nes = BootFrames(sRom);
+    RunAhead runAhead(*nes, nAhead);
+    double fSeconds = 0.0;
+    for (uint32_t f = 0; f < nFrames; f++) {
+      runAhead.runFrame();
+      fSeconds += runAhead.Seconds();
+    }
+    fSeconds /= nFrames;
+    if (nAhead == 0)
+      fBase = fSeconds;
+    std::cout << "run ahead " << nAhead << ": " << fSeconds * 1e6 << " us per host frame";
+    if (nAhead > 0)
+      std::cout << ", " << (fSeconds - fBase) / nAhead * 1e6 << " us per frame ahead";
+    std::cout << " (" << fSeconds * 60.0 * 100.0 << "% of a 60 Hz frame)\n";
+  }
+  return vSeconds[0] < vSeconds[1];
+}
+
+static void MeasureFork(uint32_t nRepeats, const std::string &sRom)
+{
+  auto parent = BootFrames(sRom);
+  if (!parent)
+    return;
+  for (uint32_t f = 0; f < 10; f++)
+    parent->runFrame();
+
+  // Into a child kept from the previous fork, and into a new one
+  auto child = parent->fork();
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nRepeats; i++)
+    parent->fork(*child);
+  std::chrono::duration<double> tReused = std::chrono::steady_clock::now() - tStart;
+
+  tStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nRepeats / 100 + 1; i++)
+    child = parent->fork();
+  std::chrono::duration<double> tNew = std::chrono::steady_clock::now() - tStart;
+
+  // The first frame of a fork copies the pages it writes to
+  double fFirst = 0.0, fSecond = 0.0;
+  for (uint32_t i = 0; i < nRepeats / 100 + 1; i++) {
+    parent->fork(*child);
+    fFirst += child->runFrame().fSeconds;
+    fSecond += child->runFrame().fSeconds;
+  }
+
+  std::cout << "fork: " << tReused.count() / nRepeats * 1e9 << " ns into a kept child, "
+            << tNew.count() / (nRepeats / 100 + 1) * 1e6 << " us into a new one, first frame "
+            << fFirst / (nRepeats / 100 + 1) * 1e6 << " us, second " << fSecond / (nRepeats / 100 + 1) * 1e6
+            << " us\n";
+}
+
+// Cartridges of one ROM share its image, however they are loaded, and
+// their RAM until they write to it
+static void MeasureRomCache(uint32_t nCartridges, const std::string &sRom)
+{
+  std::vector<std::shared_ptr<Cartridge>> vCarts;
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nCartridges; i++)
+    vCarts.push_back(std::make_shared<Cartridge>(sRom));
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+  if (!vCarts[0]->ImageValid())
+    return;
+
+  size_t nShared = std::count_if(vCarts.begin(), vCarts.end(),
+    [&](const std::shared_ptr<Cartridge> &c) { return c->Image() == vCarts[0]->Image(); });
+  std::cout << "rom cache: " << nCartridges << " cartridges in " << tElapsed.count() / nCartridges * 1e6
+            << " us each, " << nShared << " sharing one image of "
+            << (vCarts[0]->Image()->PRGSize() + vCarts[0]->Image()->CHRSize()) / 1024 << " KB\n";
+}
+
+// Pattern fetches the PPU makes through the cartridge, which calls its
+// mapper directly, against the same through a Mapper pointer whose
+// type the compiler can not know, as the cartridge used to
+static void MeasureMapper(uint32_t nPasses, const std::string &sRom)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid() || !cart->Image()->CHR())
+    return;
+  const RomImage &rom = *cart->Image();
+  Mapper_000 m((uint16_t)(rom.PRGSize() / 16384), (uint16_t)(rom.CHRSize() / 8192));
+  Mapper *volatile pLaundered = &m;
+  Mapper *pMapper = pLaundered;
+
+  uint32_t nSum = 0;
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t p = 0; p < nPasses; p++) {
+    for (uint16_t addr = 0x0000; addr < 0x2000; addr++) {
+      uint32_t mapped_addr = 0;
+      if (pMapper->ppuMapRead(addr, mapped_addr))
+        nSum += rom.CHR()[mapped_addr];
+    }
+  }
+  std::chrono::duration<double> tVirtual = std::chrono::steady_clock::now() - tStart;
+
+  tStart = std::chrono::steady_clock::now();
+  for (uint32_t p = 0; p < nPasses; p++) {
+    for (uint16_t addr = 0x0000; addr < 0x2000; addr++) {
+      uint8_t data = 0x00;
+      if (cart->ppuRead(addr, data))
+        nSum -= data;
+    }
+  }
+  std::chrono::duration<double> tDirect = std::chrono::steady_clock::now() - tStart;
+
+  double fReads = (double)nPasses * 0x2000;
+  std::cout << "mapper: " << tVirtual.count() / fReads * 1e9 << " ns per pattern read through Mapper, "
+            << tDirect.count() / fReads * 1e9 << " ns through the cartridge"
+            << (nSum == 0 ? "" : ", which read something else") << "\n";
+}
+
+static void MeasureFrames(bool bEvents, uint32_t nFrames, const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->reset();
+
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t f = 0; f < nFrames; f++) {
+    if (bEvents) {
+      nes->runFrame();
+    } else {
+      do {
+        nes->clock();
+      } while (!nes->ppu.frame_complete);
+      nes->ppu.frame_complete = false;
+    }
+  }
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+
+  std::cout << (bEvents ? "frames/catch-up: " : "frames/per-dot: ") << nFrames
+            << " frames in " << tElapsed.count() * 1000.0 << " ms ("
+            << nFrames / tElapsed.count() << " frames/s)\n";
+}
+
+int main(int argc, char *argv[])
+{
+  std::string sRom = argc > 1 ? argv[1] : "nestest.nes";
+  uint32_t nPasses = argc > 2 ? std::stoul(argv[2]) : 1000;
+
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid()) {
+    std::cout << "Could not load " << sRom << "\n";
+    return 1;
+  }
+
+  uint32_t nPassCycles = PassCycles(sRom);
+  auto vEngines = Measure({ { nes6502::LOOKUP, nes6502::PER_INSTR },
+                            { nes6502::FUSED, nes6502::PER_INSTR },
+                            { nes6502::CACHED, nes6502::PER_INSTR },
+                            { nes6502::JIT, nes6502::PER_INSTR },
+                            { nes6502::FUSED, nes6502::PER_CYCLE } },
+    nPasses, nPassCycles, sRom);
+  if (vEngines.empty())
+    return 1;
+
+  // Each pass runs every lane, so fewer passes cover as many instrs
+  for (size_t nLanes : { 64, 256 })
+    for (uint32_t nStagger : { 1, 4 })
+      MeasureBatch(nLanes, nStagger, std::max<uint32_t>(nPasses * 16 / nLanes, 1), sRom);
+
+  for (bool bEvents : { false, true })
+    MeasureFrames(bEvents, std::max<uint32_t>(nPasses / 5, 1), sRom);
+  for (auto acc : { nes6502::PER_INSTR, nes6502::PER_CYCLE })
+    MeasureStates(acc, nPasses * 100, sRom);
+  MeasureRewind(600, sRom);
+  bool bUndrawnCheaper = MeasureRunAhead(std::max<uint32_t>(nPasses / 5, 1), sRom);
+  MeasureFork(nPasses * 100, sRom);
+  MeasureRomCache(500, sRom);
+  MeasureMapper(nPasses * 10, sRom);
+
+  // The JIT has to earn its place over the fused engine it falls back
+  // on, wherever it compiles anything at all
+  const MEASURED &fused = vEngines[1], &jit = vEngines[3];
+  if (jit.nes->cpu.JitStats().nBlocksCompiled > 0) {
+    std::cout << "jit vs fused: " << fused.fBest / jit.fBest << "x\n";
+    if (jit.fBest >= fused.fBest) {
+      std::cout << "The JIT is not faster than the fused engine\n";
+      return 1;
+    }
+  }
+  if (!bUndrawnCheaper) {
+    std::cout << "A frame not drawn is no cheaper than one drawn\n";
+    return 1;
+  }
+  return 0;
+}
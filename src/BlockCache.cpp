@@ -0,0 +1,142 @@
+#include "BlockCache.h"
+#include "Bus.h"
+#include "nes6502.h"
+
+// Instrs which end a block as they may continue somewhere else
+static bool EndsBlock(uint8_t opcode)
+{
+  switch (opcode) {
+  case 0x00:// BRK
+  case 0x20:// JSR
+  case 0x40:// RTI
+  case 0x4C:// JMP abs
+  case 0x60:// RTS
+  case 0x6C:// JMP ind
+    return true;
+  default:
+    return nes6502::opcodes[opcode].mode == nes6502::ADDRMODE::REL;
+  }
+}
+
+const BlockCache::DECODED *BlockCache::Lookup(uint16_t pc, Bus *bus)
+{
+  pCurrent = nullptr;
+
+  if (!Cacheable(pc)) {
+    stats.nUncached++;
+    return nullptr;
+  }
+
+  uint32_t bank = pc >= 0x8000 ? vBankOffset[(pc >> 13) & 0x03] : 0;
+  uint16_t n = vIndex[pc];
+
+  if (n > 0 && blocks[n - 1].bank == bank && Fresh(blocks[n - 1])) {
+    stats.nHits += blocks[n - 1].count > 0;
+  } else {
+    stats.nMisses++;
+
+    // A block decoded from another bank or from code since written is
+    // replaced in place, anything else takes the next block of the pool
+    if (n == 0) {
+      if (nBlocksUsed == nBlocks) {
+        Flush();
+        stats.nFlushes++;
+      }
+      n = (uint16_t)++nBlocksUsed;
+    }
+
+    Decode(blocks[n - 1], pc, bus);
+    blocks[n - 1].bank = bank;
+    vIndex[pc] = n;
+  }
+
+  // The very first instr straddles the end of the region, it is
+  // fetched from the bus instead
+  BLOCK &block = blocks[n - 1];
+  if (block.count == 0) {
+    stats.nUncached++;
+    return nullptr;
+  }
+
+  pCurrent = &block;
+  nIndex = 1;
+  nNextPC = pc + block.instrs[0].length;
+  return &block.instrs[0];
+}
+
+void BlockCache::Decode(BLOCK &block, uint16_t pc, Bus *bus)
+{
+  block.start = pc;
+  block.end = pc;
+  block.written = nWriteGeneration;
+  block.count = 0;
+  block.bOpen = true;
+  Extend(block, bus);
+}
+
+bool BlockCache::Extend(BLOCK &block, Bus *bus)
+{
+  if (!block.bOpen)
+    return false;
+
+  // Blocks stay within the region they started in, so RAM and ROM
+  // code never mix and mirrors of RAM are tracked correctly. ROM
+  // blocks stay within their bank slot, which the mapper switches
+  // whole, and PRG RAM blocks within $6000-$7FFF alike
+  uint16_t addr = block.end;
+  uint8_t opcode = bus->cpuRead(addr, true);
+  uint8_t nBytes = nes6502::OperandBytes(nes6502::opcodes[opcode].mode);
+  uint16_t last = addr + nBytes;
+
+  // Stop short of an instr that runs out of the block's region,
+  // it will be fetched from the bus instead
+  if (last < addr || (block.start < 0x2000 ? last >= 0x2000 : ((last ^ block.start) & 0xE000) != 0)) {
+    block.bOpen = false;
+    return false;
+  }
+
+  DECODED &d = block.instrs[block.count++];
+  d.opcode = opcode;
+  d.length = 1 + nBytes;
+  d.operand = 0x0000;
+  if (nBytes > 0)
+    d.operand = bus->cpuRead(addr + 1, true);
+  if (nBytes > 1)
+    d.operand |= bus->cpuRead(addr + 2, true) << 8;
+
+  if (block.start < 0x8000) {
+    codePages[PhysicalPage(addr)] = true;
+    codePages[PhysicalPage(last)] = true;
+  }
+
+  block.end = addr + d.length;
+  block.bOpen = block.count < nMaxBlockInstrs && !EndsBlock(opcode);
+  return true;
+}
+
+void BlockCache::Invalidate(uint8_t page)
+{
+  // Every block decoded from the page so far is stale now, which
+  // Fetch() finds out when it looks one up rather than searching
+  // them all here
+  vPageWritten[page] = ++nWriteGeneration;
+  codePages[page] = false;
+  if (pCurrent != nullptr && !Fresh(*pCurrent))
+    pCurrent = nullptr;
+  stats.nInvalidations++;
+}
+
+void BlockCache::BanksSwitched(const Bus *bus)
+{
+  for (uint32_t nSlot = 0; nSlot < 4; nSlot++)
+    vBankOffset[nSlot] = bus->PRGBankOffset(0x8000 + nSlot * 0x2000);
+  pCurrent = nullptr;
+}
+
+void BlockCache::Flush()
+{
+  vIndex.fill(0);
+  nBlocksUsed = 0;
+  codePages.reset();
+  pCurrent = nullptr;
+}
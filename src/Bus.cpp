@@ -1,49 +1,131 @@
 #include "Bus.h"
 
+#include <chrono>
+#include <cstring>
+
 Bus::Bus()
 {
   // Clear RAM contents
-  for (auto &i : cpuRam) i = 0x00;
+  cpuRam.Fill(0x00);
 
   // Connect CPU to communication bus
   cpu.ConnectBus(this);
+
+  MapPages();
+  ScheduleFrameEnd();
 }
 
 Bus::~Bus()
 {
+  if (cart)
+    cart->SetBankSwitchHook(nullptr);
+}
+
+void Bus::MapRam()
+{
+  // System RAM, 2KB mirrored through $0000-$1FFF
+  for (uint32_t page = 0x00; page < 0x20; page++) {
+    uint8_t *p = cpuRam.Owned(page & 0x07) ? cpuRam.WritePage(page & 0x07) : nullptr;
+    vReadPages[page] = p;
+    vWritePages[page] = p;
+  }
+}
+
+void Bus::MapPages()
+{
+  MapRam();
+
+  // The PPU and APU/IO registers have handlers, and so does page $40
+  // which they share with the cartridge. Cartridge reads come straight
+  // from the banks the mapper has selected, while writes always reach
+  // the cartridge, they may be to mapper registers
+  for (uint32_t page = 0x20; page < 0x41; page++) {
+    vReadPages[page] = nullptr;
+    vWritePages[page] = nullptr;
+  }
+  for (uint32_t page = 0x41; page < 0x100; page++) {
+    vReadPages[page] = cart ? cart->cpuMapPage(page << 8) : nullptr;
+    vWritePages[page] = cart ? cart->cpuMapWritePage(page << 8) : nullptr;
+  }
+
+  nMappedGeneration = BankGeneration();
+  cpu.BanksSwitched();
+  cpu.PRGRamSwitched();
+}
+
+void Bus::BanksSwitched(uint8_t nPRGSlots)
+{
+  // Only the pages of the switched slots, 32 to each 8KB
+  for (uint32_t nSlot = 0; nSlot < 4; nSlot++) {
+    if (nPRGSlots & (1 << nSlot)) {
+      for (uint32_t page = 0x80 + nSlot * 0x20; page < 0xA0 + nSlot * 0x20; page++)
+        vReadPages[page] = cart->cpuMapPage(page << 8);
+    }
+  }
+
+  // PRG RAM is read and written directly while the mapper enables it,
+  // once the cartridge does not share it any more
+  if (nPRGSlots & Mapper::nPRGRamSlot) {
+    for (uint32_t page = 0x60; page < 0x80; page++) {
+      vReadPages[page] = cart->cpuMapPage(page << 8);
+      vWritePages[page] = cart->cpuMapWritePage(page << 8);
+    }
+    cpu.PRGRamSwitched();
+  }
+
+  nMappedGeneration = BankGeneration();
+  if (nPRGSlots & ~Mapper::nPRGRamSlot)
+    cpu.BanksSwitched();
+}
+
+void Bus::ConnectBankSwitches()
+{
+  if (cart)
+    cart->SetBankSwitchHook([this](uint8_t nPRGSlots, uint8_t) { BanksSwitched(nPRGSlots); });
 }
 
-void Bus::cpuWrite(uint16_t addr, uint8_t data)
+void Bus::cpuWriteDevice(uint16_t addr, uint8_t data)
 {
-  if (cart->cpuWrite(addr, data)) {
+  // The PPU has to have caught up with the CPU before the write can
+  // change what it draws
+  ppu.CatchUp(CpuClock());
+
+  if (cart && cart->cpuWrite(addr, data, CpuClock() / 3)) {
     // The cartridge "sees all" and has the facility to veto
     // the propagation of the bus transaction if it requires.
     // This allows the cartridge to map any address to some
     // other data, including the facility to divert transactions
     // with other physical devices. The NES does not do this
     // but I figured it might be quite a flexible way of adding
-    // "custom" hardware to the NES in the future!
+    // "custom" hardware to the NES in the future! Any banks
+    // the write switched have been remapped by BanksSwitched()
   }
   if (addr >= 0x0000 && addr <= 0x1FFF) {
     // System RAM Address Range. The range covers 8KB, though
     // there is only 2KB available. That 2KB is "mirrored"
     // through this address range. Using bitwise AND to mask
-    // the bottom 11 bits is the same as addr % 2048.
-    cpuRam[addr & 0x07FF] = data;
+    // the bottom 11 bits is the same as addr % 2048. The page
+    // is only unmapped if it is shared with a forked machine,
+    // and is this one's own once written
+    cpuRam.Write(addr & 0x07FF, data);
+    MapRam();
   } else if (addr >= 0x2000 && addr <= 0x3FFF) {
     // PPU Address range. The PPU only has 8 primary registers
     // and these are repeated throughout this range. We can
     // use bitwise AND operation to mask the bottom 3 bits,
     // which is the equivalent of addr % 8.
     ppu.cpuWrite(addr & 0x0007, data);
+  } else if (addr >= 0x4016 && addr <= 0x4017) {
+    // Controllers. Writing latches the buttons currently held
+    controller_state[addr & 0x0001] = controller[addr & 0x0001];
   }
 }
 
-uint8_t Bus::cpuRead(uint16_t addr, bool bReadOnly)
+uint8_t Bus::cpuReadDevice(uint16_t addr, bool bReadOnly)
 {
   uint8_t data = 0x00;
 
-  if (cart->cpuRead(addr, data)) {
+  if (cart && cart->cpuRead(addr, data)) {
     // Cartridge address range
   }
   if (addr >= 0x0000 && addr <= 0x1FFF) {
@@ -51,7 +133,13 @@ uint8_t Bus::cpuRead(uint16_t addr, bool bReadOnly)
     data = cpuRam[addr & 0x07FF];
   } else if (addr >= 0x2000 && addr <= 0x3FFF) {
     // PPU Address range, mirrored every 8
+    ppu.CatchUp(CpuClock());
     data = ppu.cpuRead(addr & 0x0007, bReadOnly);
+  } else if (addr >= 0x4016 && addr <= 0x4017) {
+    // Controllers. Each read returns the next latched button
+    data = (controller_state[addr & 0x0001] & 0x80) > 0;
+    if (!bReadOnly)
+      controller_state[addr & 0x0001] <<= 1;
   }
 
   return data;
@@ -60,14 +148,214 @@ uint8_t Bus::cpuRead(uint16_t addr, bool bReadOnly)
 void Bus::insertCartridge(const std::shared_ptr<Cartridge> &cartridge)
 {
   // Connects cartridge to both Main Bus and CPU Bus
+  if (cart)
+    cart->SetBankSwitchHook(nullptr);
   this->cart = cartridge;
+  if (cart)
+    cart->ReserveRam();
+  ConnectBankSwitches();
   ppu.ConnectCartridge(cartridge);
+  cpu.FlushCode();
+  MapPages();
 }
 
 void Bus::reset()
 {
   cpu.reset();
-  nSystemClockCounter = 0;
+  ppu.reset();
+  controller_state[0] = 0x00;
+  controller_state[1] = 0x00;
+  nMasterClock = 0;
+  nCycleClock = 0;
+  nInstrs = 0;
+  scheduler.Clear();
+  ScheduleFrameEnd();
+}
+
+void Bus::State(StateBuffer &s)
+{
+  uint32_t nMagic = 0x5345534E, nBytes = (uint32_t)nStateSize;// "NESS"
+  s(nMagic);
+  s(nBytes);
+
+  cpu.State(s);
+  cpuRam.State(s);
+  s(controller_state);
+  s(nMasterClock);
+  s(nCycleClock);
+  s(nInstrs);
+  scheduler.State(s);
+  ppu.State(s);
+  if (cart)
+    cart->State(s);
+}
+
+size_t Bus::StateSize()
+{
+  StateBuffer s(StateBuffer::MEASURE);
+  State(s);
+  nStateSize = s.Size();
+  return nStateSize;
+}
+
+size_t Bus::saveState(uint8_t *pData, size_t nSize)
+{
+  size_t nNeeded = StateSize();
+  if (nSize < nNeeded)
+    return 0;
+
+  StateBuffer s(StateBuffer::SAVE, pData);
+  State(s);
+  return nNeeded;
+}
+
+bool Bus::loadState(const uint8_t *pData, size_t nSize)
+{
+  // Check the header before anything is overwritten
+  uint32_t nMagic = 0, nBytes = 0;
+  size_t nNeeded = StateSize();
+  if (nSize < nNeeded)
+    return false;
+  std::memcpy(&nMagic, pData, sizeof(nMagic));
+  std::memcpy(&nBytes, pData + sizeof(nMagic), sizeof(nBytes));
+  if (nMagic != 0x5345534E || nBytes != nNeeded)
+    return false;
+
+  // Nothing is written through the buffer when loading
+  StateBuffer s(StateBuffer::LOAD, const_cast<uint8_t *>(pData));
+  State(s);
+
+  cpu.RamRestored();
+  if (BankGeneration() != nMappedGeneration)
+    MapPages();
+  else
+    MapRam();
+  return true;
+}
+
+void Bus::fork(Bus &child)
+{
+  // A fresh cartridge for the child, as the mapper's registers and
+  // any writes to its memory must not be shared. It maps the same
+  // memory as this one, so the page table can be copied as it is
+  if (child.cart)
+    child.cart->SetBankSwitchHook(nullptr);
+  child.cart = cart ? cart->Fork() : nullptr;
+  if (cart) {
+    cart->ReserveRam();
+    child.cart->ReserveRam();
+  }
+  child.ConnectBankSwitches();
+  child.ppu.ConnectCartridge(child.cart);
+  child.cpu.FlushCode();
+  child.vReadPages = vReadPages;
+  child.vWritePages = vWritePages;
+  child.nMappedGeneration = nMappedGeneration;
+  child.cpu.BanksSwitched();
+  child.cpu.SetEngine(cpu.GetEngine());
+  child.cpu.SetAccuracy(cpu.GetAccuracy());
+
+  // The CPU's fields go across through a snapshot of them alone,
+  // which takes a few dozen bytes
+  uint8_t vCpu[128];
+  StateBuffer save(StateBuffer::SAVE, vCpu);
+  cpu.State(save);
+  StateBuffer load(StateBuffer::LOAD, vCpu);
+  child.cpu.State(load);
+
+  cpuRam.Fork(child.cpuRam);
+  ppu.Fork(child.ppu);
+  child.scheduler = scheduler;
+  child.controller[0] = controller[0];
+  child.controller[1] = controller[1];
+  child.controller_state[0] = controller_state[0];
+  child.controller_state[1] = controller_state[1];
+  child.nMasterClock = nMasterClock;
+  child.nCycleClock = nCycleClock;
+  child.nInstrs = nInstrs;
+
+  // Every page of RAM is shared now, writes have to find that out,
+  // and so is the cartridge's RAM
+  MapRam();
+  child.MapRam();
+  for (uint32_t page = 0x60; page < 0x80; page++) {
+    vWritePages[page] = nullptr;
+    child.vWritePages[page] = nullptr;
+  }
+}
+
+std::unique_ptr<Bus> Bus::fork()
+{
+  auto child = std::make_unique<Bus>();
+  fork(*child);
+  return child;
+}
+
+void Bus::cpuTick()
+{
+  // The PPU runs 3 times faster than the cpu
+  nCycleClock = CpuClock() + 3;
+}
+
+void Bus::ScheduleFrameEnd()
+{
+  scheduler.Schedule(Scheduler::FRAME_END, ppu.Dot() + ppu.DotsToFrameEnd());
+}
+
+Scheduler::EVENT Bus::runToEvent()
+{
+  uint64_t nTime = scheduler.NextTime();
+
+  // Nothing but the PPU catching up happens in between, so the
+  // CPU runs instr after instr without looking at the rest
+  while (nMasterClock < nTime) {
+    nMasterClock += cpu.step() * 3;
+    nInstrs++;
+  }
+  ppu.CatchUp(nTime);
+
+  Scheduler::EVENT e = scheduler.Pop();
+  switch (e) {
+  case Scheduler::FRAME_END:
+    ScheduleFrameEnd();
+    break;
+  default:
+    break;
+  }
+  return e;
+}
+
+Bus::STATS Bus::RunUntil(Scheduler::EVENT e)
+{
+  STATS stats;
+  uint64_t nStartClock = nMasterClock, nStartInstrs = nInstrs;
+  auto tStart = std::chrono::steady_clock::now();
+
+  Scheduler::EVENT ran;
+  do {
+    ran = runToEvent();
+    stats.nFrames += ran == Scheduler::FRAME_END;
+  } while (ran != e);
+
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+  stats.nCycles = (nMasterClock - nStartClock) / 3;
+  stats.nInstrs = nInstrs - nStartInstrs;
+  stats.fSeconds = tElapsed.count();
+  return stats;
+}
+
+Bus::STATS Bus::runFrame()
+{
+  STATS stats = RunUntil(Scheduler::FRAME_END);
+  ppu.frame_complete = false;
+  return stats;
+}
+
+Bus::STATS Bus::runCycles(uint64_t nCycles)
+{
+  // From the end of the instr the CPU is in, if it is ahead
+  scheduler.Schedule(Scheduler::STOP, nMasterClock + nCycles * 3);
+  return RunUntil(Scheduler::STOP);
 }
 
 void Bus::clock()
@@ -80,11 +368,15 @@ void Bus::clock()
 
   // The fastest clock frequency the digital system cares
   // about is equivalent to the PPU clock. So the PPU is clocked
-  // each time this function is called.
-  ppu.clock();
+  // each time this function is called, unless it has already
+  // caught up this far with a cycle accurate CPU. It may also
+  // have been left behind by runToEvent().
+  ppu.CatchUp(nMasterClock);
+  if (ppu.Dot() == nMasterClock)
+    ppu.clock();
   // cpu clock runs 3 times slower than ppu
-  if (nSystemClockCounter % 3 == 0) {
+  if (nMasterClock % 3 == 0) {
     cpu.clock();
   }
-  nSystemClockCounter++;
+  nMasterClock++;
 }
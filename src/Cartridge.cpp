@@ -1,63 +1,51 @@
-#include <fstream>
+#include <atomic>
+#include <utility>
 
 #include "Cartridge.h"
 
-Cartridge::Cartridge(const std::string &sFileName)
+// Whether a cartridge can be made of the image at all. The PPU only has
+// the console's own 2KB of nametables, not the 4KB of four screen
+// boards, and the mappers switch whole 16KB PRG and 8KB CHR banks,
+// which NES 2.0 sizes need not come in
+static bool Supported(const RomImage &image)
 {
-  // iNES format header
-  struct sHeader
-  {
-    char name[4];
-    uint8_t prg_rom_chunks;
-    uint8_t chr_rom_chunks;
-    uint8_t mapper1;
-    uint8_t mapper2;
-    uint8_t prg_ram_size;
-    uint8_t tv_system1;
-    uint8_t tv_system2;
-    char unused[5];
-  } header;
+  return !image.FourScreen() && image.PRGSize() % 16384 == 0 && image.CHRSize() % 8192 == 0
+         && image.PRGSize() / 16384 <= UINT16_MAX && image.CHRSize() / 8192 <= UINT16_MAX;
+}
 
+Cartridge::Cartridge(const std::string &sFileName)
+{
   bImageValid = false;
 
-  std::ifstream ifs;
-  ifs.open(sFileName, std::ifstream::binary);
-  if (ifs.is_open()) {
-    // Read file header
-    ifs.read((char *)&header, sizeof(sHeader));
-    if (header.mapper1 & 0x04)
-      ifs.seekg(512, std::ios_base::cur);
-
-    // Determine mapper ID
-    nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
-
-    uint8_t nFileType = 1;
-
-    if (nFileType == 0) {
+  pImage = RomImage::Load(sFileName);
+  if (pImage->Valid() && Supported(*pImage)) {
+    nMapperID = pImage->MapperID();
+    nPRGBanks = (uint16_t)(pImage->PRGSize() / 16384);
+    nCHRBanks = (uint16_t)(pImage->CHRSize() / 8192);
+    mirror = pImage->VerticalMirror() ? VERTICAL : HORIZONTAL;
+
+    // The RAM starts out as the image's blank RAM, shared by every
+    // cartridge of the ROM until it writes to it, which is never less
+    // than the 8KB the mappers address. A header without CHR ROM that
+    // declares no CHR RAM still gets some
+    pPRGRam = pImage->BlankPRGRam();
+    if (nCHRBanks == 0) {
+      pCHRRam = pImage->BlankCHRRam();
+      if (!pCHRRam)
+        pCHRRam = std::make_shared<std::vector<uint8_t>>(8192, 0x00);
     }
 
-    if (nFileType == 1) {
-      nPRGBanks = header.prg_rom_chunks;
-      vPRGMemory.resize(nPRGBanks * 16384);
-      ifs.read((char *)vPRGMemory.data(), vPRGMemory.size());
-
-      nCHRBanks = header.prg_rom_chunks;
-      vCHRMemory.resize(nCHRBanks * 8192);
-      ifs.read((char *)vCHRMemory.data(), vCHRMemory.size());
-    }
-
-    if (nFileType == 2) {
-    }
-
-    // Load appropriate mapper
+    // Load appropriate mapper. Images needing a mapper that is not
+    // implemented keep NO_MAPPER and can not be run
     switch (nMapperID) {
-    case 0:
-      pMapper = std::make_shared<Mapper_000>(nPRGBanks, nCHRBanks);
-      break;
+    case 0: mapper.emplace<Mapper_000>(nPRGBanks, nCHRBanks); bImageValid = true; break;
+    case 1: mapper.emplace<Mapper_001>(nPRGBanks, nCHRBanks); bImageValid = true; break;
+    case 2: mapper.emplace<Mapper_002>(nPRGBanks, nCHRBanks); bImageValid = true; break;
+    case 3: mapper.emplace<Mapper_003>(nPRGBanks, nCHRBanks); bImageValid = true; break;
+    case 4: mapper.emplace<Mapper_004>(nPRGBanks, nCHRBanks); bImageValid = true; break;
     }
-
-    bImageValid = true;
-    ifs.close();
+    MapMemory();
+    BanksSwitched();
   }
 }
 
@@ -66,44 +54,153 @@ bool Cartridge::ImageValid()
   return bImageValid;
 }
 
-bool Cartridge::cpuRead(uint16_t addr, uint8_t &data)
+std::shared_ptr<Cartridge> Cartridge::Fork() const
 {
-  uint32_t mapped_addr = 0;
-  if (pMapper->cpuMapRead(addr, mapped_addr)) {
-    data = vPRGMemory[mapped_addr];
-    return true;
-  } else
-    return false;
+  std::shared_ptr<Cartridge> pCart(new Cartridge(*this));
+  pCart->OnBankSwitch = nullptr;
+  pCart->pPRGSpare = nullptr;
+  pCart->pCHRSpare = nullptr;
+  return pCart;
 }
 
-bool Cartridge::cpuWrite(uint16_t addr, uint8_t data)
+void Cartridge::ReserveRam()
 {
-  uint32_t mapped_addr = 0;
-  if (pMapper->cpuMapWrite(addr, mapped_addr)) {
-    vPRGMemory[mapped_addr] = data;
-    return true;
-  } else
-    return false;
+  for (auto [pRam, pSpare] : { std::pair(&pPRGRam, &pPRGSpare), std::pair(&pCHRRam, &pCHRSpare) }) {
+    if (*pRam && pRam->use_count() > 1 && !*pSpare)
+      *pSpare = std::make_shared<std::vector<uint8_t>>((*pRam)->size());
+  }
 }
 
-// Communications with the PPU bus
-bool Cartridge::ppuRead(uint16_t addr, uint8_t &data)
+bool Cartridge::Own(std::shared_ptr<std::vector<uint8_t>> &pRam, std::shared_ptr<std::vector<uint8_t>> &pSpare)
 {
-  uint32_t mapped_addr = 0;
-  if (pMapper->ppuMapRead(addr, mapped_addr)) {
-    data = vCHRMemory[mapped_addr];
+  if (pRam.use_count() > 1) {
+    if (pSpare && pSpare->size() == pRam->size()) {
+      *pSpare = *pRam;
+      pRam = std::move(pSpare);
+    } else
+      pRam = std::make_shared<std::vector<uint8_t>>(*pRam);
     return true;
-  } else
+  } else {
+    // Reads by a forked cartridge which has just let go of the RAM on
+    // another thread have to be over before it is written
+    std::atomic_thread_fence(std::memory_order_acquire);
     return false;
+  }
 }
 
-bool Cartridge::ppuWrite(uint16_t addr, uint8_t data)
+void Cartridge::MapMemory()
+{
+  // NO_MAPPER is never given memory, so nothing reads through it. Less
+  // than a bank of PRG ROM is not mapped at all
+  if (!bImageValid)
+    return;
+  const uint8_t *pPRG = nPRGBanks > 0 ? pImage->PRG() : nullptr;
+  const uint8_t *pCHR = pCHRRam ? pCHRRam->data() : pImage->CHR();
+  std::visit([&](auto &m) { m.SetMemory(pPRG, pCHR); }, mapper);
+}
+
+void Cartridge::BanksSwitched(uint8_t nMoved)
+{
+  uint8_t nPRGSlots = 0, nCHRSlots = 0;
+  Mapper::MIRROR mapperMirror = std::visit([&](auto &m) {
+    m.TakeSwitches(nPRGSlots, nCHRSlots);
+    return m.Mirror();
+  }, mapper);
+  nPRGSlots |= nMoved;
+
+  switch (mapperMirror) {
+  case Mapper::HORIZONTAL: mirror = HORIZONTAL; break;
+  case Mapper::VERTICAL: mirror = VERTICAL; break;
+  case Mapper::ONESCREEN_LO: mirror = ONESCREEN_LO; break;
+  case Mapper::ONESCREEN_HI: mirror = ONESCREEN_HI; break;
+  case Mapper::HARDWIRED: break;
+  }
+
+  if ((nPRGSlots || nCHRSlots) && OnBankSwitch)
+    OnBankSwitch(nPRGSlots, nCHRSlots);
+}
+
+uint8_t *Cartridge::RamPage(uint16_t addr)
 {
   uint32_t mapped_addr = 0;
-  if (pMapper->ppuMapWrite(addr, mapped_addr)) {
-    vCHRMemory[mapped_addr] = data;
+  if (!pPRGRam || !std::visit([&](auto &m) { return m.cpuMapRam(addr, mapped_addr); }, mapper))
+    return nullptr;
+  return pPRGRam->data() + (mapped_addr & 0x1F00);
+}
+
+const uint8_t *Cartridge::cpuMapPage(uint16_t addr)
+{
+  // Banks are never smaller than a page, so the whole page is mapped
+  // as its first byte is
+  if (addr < 0x8000)
+    return RamPage(addr);
+  const uint8_t *pBank = std::visit([&](auto &m) { return m.PRGBank(addr); }, mapper);
+  return pBank ? pBank + (addr & 0x1F00) : nullptr;
+}
+
+uint8_t *Cartridge::cpuMapWritePage(uint16_t addr)
+{
+  if (addr >= 0x8000 || pPRGRam.use_count() > 1)
+    return nullptr;
+  // As in Own(), reads by a forked cartridge which has just let go of
+  // the RAM have to be over before it is written
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return RamPage(addr);
+}
+
+bool Cartridge::cpuWrite(uint16_t addr, uint8_t data, uint64_t nCycle)
+{
+  return std::visit([&](auto &m) {
+    uint32_t mapped_addr = 0;
+    if (pPRGRam && m.cpuMapRam(addr, mapped_addr)) {
+      // The bus only writes here while it shares the RAM, which is
+      // this cartridge's own from now on and can be written directly
+      Own(pPRGRam, pPRGSpare);
+      (*pPRGRam)[mapped_addr & 0x1FFF] = data;
+      if (OnBankSwitch)
+        OnBankSwitch(Mapper::nPRGRamSlot, 0);
+      return true;
+    }
+    // PRG ROM is read-only. The mapper sees the write, which may be to
+    // one of its registers, but nothing is stored
+    m.SetWriteCycle(nCycle);
+    if (!m.cpuMapWrite(addr, mapped_addr, data))
+      return false;
+    BanksSwitched();
     return true;
-  } else
-    return false;
+  }, mapper);
 }
 
+void Cartridge::State(StateBuffer &s)
+{
+  std::visit([&](auto &m) { m.State(s); }, mapper);
+  uint8_t nMoved = 0;
+  for (auto [pRam, pSpare] : { std::pair(&pPRGRam, &pPRGSpare), std::pair(&pCHRRam, &pCHRSpare) }) {
+    if (*pRam) {
+      if (s.Loading() && Own(*pRam, *pSpare)) {
+        if (pRam == &pCHRRam)
+          MapMemory();
+        else
+          nMoved = Mapper::nPRGRamSlot;
+      }
+      s.Bytes((*pRam)->data(), (*pRam)->size());
+    }
+  }
+  if (s.Loading())
+    BanksSwitched(nMoved);
+}
+
+// Communications with the PPU bus
+bool Cartridge::ppuWrite(uint16_t addr, uint8_t data)
+{
+  return std::visit([&](auto &m) {
+    uint32_t mapped_addr = 0;
+    if (m.ppuMapWrite(addr, mapped_addr)) {
+      if (Own(pCHRRam, pCHRSpare))
+        MapMemory();
+      (*pCHRRam)[mapped_addr] = data;
+      return true;
+    } else
+      return false;
+  }, mapper);
+}
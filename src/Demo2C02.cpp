@@ -1,10 +1,10 @@
 #include <iostream>
 #include <sstream>
-#include <map>
 #include <cstdint>
 #include <string>
 
 #include "Bus.h"
+#include "Rewind.h"
 #include "nes6502.h"
 #include "utils.h"
 
@@ -22,11 +22,13 @@ private:
   std::shared_ptr<Cartridge> cart;
   bool bEmulationRun = false;
   float fResidualTime = 0.0f;
+  // What the last frame took
+  Bus::STATS frameStats;
+  // The last frames run, for rewinding while BACK is held
+  Rewind rewind{ nes };
 
 private:
   // Support Utilities
-  std::map<uint16_t, std::string> mapAsm;
-
   std::string hex(uint32_t n, uint8_t d)
   {
     std::string s(d, '0');
@@ -53,14 +55,14 @@ private:
   {
     std::string status = "STATUS: ";
     DrawString(x, y, "STATUS:", olc::WHITE);
-    DrawString(x + 64, y, "N", nes.cpu.status & nes6502::N ? olc::GREEN : olc::RED);
-    DrawString(x + 80, y, "V", nes.cpu.status & nes6502::V ? olc::GREEN : olc::RED);
-    DrawString(x + 96, y, "-", nes.cpu.status & nes6502::U ? olc::GREEN : olc::RED);
-    DrawString(x + 112, y, "B", nes.cpu.status & nes6502::B ? olc::GREEN : olc::RED);
-    DrawString(x + 128, y, "D", nes.cpu.status & nes6502::D ? olc::GREEN : olc::RED);
-    DrawString(x + 144, y, "I", nes.cpu.status & nes6502::I ? olc::GREEN : olc::RED);
-    DrawString(x + 160, y, "Z", nes.cpu.status & nes6502::Z ? olc::GREEN : olc::RED);
-    DrawString(x + 178, y, "C", nes.cpu.status & nes6502::C ? olc::GREEN : olc::RED);
+    DrawString(x + 64, y, "N", nes.cpu.GetStatus() & nes6502::N ? olc::GREEN : olc::RED);
+    DrawString(x + 80, y, "V", nes.cpu.GetStatus() & nes6502::V ? olc::GREEN : olc::RED);
+    DrawString(x + 96, y, "-", nes.cpu.GetStatus() & nes6502::U ? olc::GREEN : olc::RED);
+    DrawString(x + 112, y, "B", nes.cpu.GetStatus() & nes6502::B ? olc::GREEN : olc::RED);
+    DrawString(x + 128, y, "D", nes.cpu.GetStatus() & nes6502::D ? olc::GREEN : olc::RED);
+    DrawString(x + 144, y, "I", nes.cpu.GetStatus() & nes6502::I ? olc::GREEN : olc::RED);
+    DrawString(x + 160, y, "Z", nes.cpu.GetStatus() & nes6502::Z ? olc::GREEN : olc::RED);
+    DrawString(x + 178, y, "C", nes.cpu.GetStatus() & nes6502::C ? olc::GREEN : olc::RED);
     DrawString(x, y + 10, "PC: $" + hex(nes.cpu.pc, 4));
     DrawString(x, y + 20, "A: $" + hex(nes.cpu.a, 2) + "  [" + std::to_string(nes.cpu.a) + "]");
     DrawString(x, y + 30, "X: $" + hex(nes.cpu.x, 2) + "  [" + std::to_string(nes.cpu.x) + "]");
@@ -70,27 +72,27 @@ private:
 
   void DrawCode(int x, int y, int nLines)
   {
-    auto it_a = mapAsm.find(nes.cpu.pc);
+    Disassembler &disasm = nes.cpu.disassembler();
+    char sLine[Disassembler::nMaxText];
+
+    uint16_t addr = nes.cpu.pc;
     int nLineY = (nLines >> 1) * 10 + y;
-    if (it_a != mapAsm.end()) {
-      DrawString(x, nLineY, (*it_a).second, olc::CYAN);
-      while (nLineY < (nLines * 10) + y) {
-        nLineY += 10;
-        if (++it_a != mapAsm.end()) {
-          DrawString(x, nLineY, (*it_a).second);
-        }
-      }
+    DrawString(x, nLineY, disasm.Format(addr, sLine), olc::CYAN);
+    while (nLineY < (nLines * 10) + y) {
+      nLineY += 10;
+      uint16_t next = disasm.Next(addr);
+      if (next <= addr)
+        break;
+      addr = next;
+      DrawString(x, nLineY, disasm.Format(addr, sLine));
     }
 
-    it_a = mapAsm.find(nes.cpu.pc);
+    addr = nes.cpu.pc;
     nLineY = (nLines >> 1) * 10 + y;
-    if (it_a != mapAsm.end()) {
-      while (nLineY > y) {
-        nLineY -= 10;
-        if (--it_a != mapAsm.end()) {
-          DrawString(x, nLineY, (*it_a).second);
-        }
-      }
+    while (nLineY > y && addr > 0x0000) {
+      nLineY -= 10;
+      addr = disasm.Prev(addr);
+      DrawString(x, nLineY, disasm.Format(addr, sLine));
     }
   }
 
@@ -104,9 +106,6 @@ private:
     // Insert into NES
     nes.insertCartridge(cart);
 
-    // Extract dissassembly
-    mapAsm = nes.cpu.disassemble(0x0000, 0xFFFF);
-
     // Reset NES
     nes.reset();
     return true;
@@ -122,10 +121,11 @@ private:
         fResidualTime -= fElapsedTime;
       else {
         fResidualTime += (1.0f / 60.0f) - fElapsedTime;
-        do {
-          nes.clock();
-        } while (!nes.ppu.frame_complete);
-        nes.ppu.frame_complete = false;
+        // Rewinding goes back to the start of the last frame and runs
+        // it again to draw it, without keeping the snapshot after it
+        if (!(GetKey(olc::Key::BACK).bHeld && rewind.Back()))
+          rewind.Push();
+        frameStats = nes.runFrame();
       }
     } else {
       // Emulate code step-by-step
@@ -144,16 +144,9 @@ private:
 
       // Emulate one whole frame
       if (GetKey(olc::Key::F).bPressed) {
-        // Clock enough times to draw a single frame
-        do {
-          nes.clock();
-        } while (!nes.ppu.frame_complete);
-        // Use residual clock cycles to complete current instruction
-        do {
-          nes.clock();
-        } while (!nes.cpu.complete());
-        // Reset frame completion flag
-        nes.ppu.frame_complete = false;
+        // Runs until the frame is drawn, finishing the instruction
+        // the CPU is in at that point
+        frameStats = nes.runFrame();
       }
     }
 
@@ -163,6 +156,9 @@ private:
 
     DrawCpu(516, 2);
     DrawCode(516, 72, 26);
+    DrawString(516, 350, "Frame: " + std::to_string(frameStats.nCycles) + " cycles");
+    DrawString(516, 360, "       " + std::to_string(frameStats.nInstrs) + " instrs");
+    DrawString(516, 370, "       " + std::to_string((int)(frameStats.fSeconds * 1e6)) + " us");
 
     DrawSprite(0, 0, &nes.ppu.GetScreen(), 2);
     return true;
@@ -1,6 +1,5 @@
 #include <iostream>
 #include <sstream>
-#include <map>
 #include <cstdint>
 #include <string>
 
@@ -19,7 +18,6 @@ public:
 
   Bus bus;
 
-  std::map<uint16_t, std::string> mapAsm;
 
   void DrawRam(int x, int y, uint16_t nAddr, int nRows, int nCols)
   {
@@ -41,14 +39,14 @@ public:
   {
     std::string status = "STATUS";
     DrawString(x, y, "STATUS", olc::WHITE);
-    DrawString(x + 64, y, "N", bus.cpu.status & nes6502::N ? olc::GREEN : olc::RED);
-    DrawString(x + 80, y, "V", bus.cpu.status & nes6502::V ? olc::GREEN : olc::RED);
-    DrawString(x + 96, y, "-", bus.cpu.status & nes6502::U ? olc::GREEN : olc::RED);
-    DrawString(x + 112, y, "B", bus.cpu.status & nes6502::B ? olc::GREEN : olc::RED);
-    DrawString(x + 128, y, "D", bus.cpu.status & nes6502::D ? olc::GREEN : olc::RED);
-    DrawString(x + 144, y, "I", bus.cpu.status & nes6502::I ? olc::GREEN : olc::RED);
-    DrawString(x + 160, y, "Z", bus.cpu.status & nes6502::Z ? olc::GREEN : olc::RED);
-    DrawString(x + 178, y, "C", bus.cpu.status & nes6502::C ? olc::GREEN : olc::RED);
+    DrawString(x + 64, y, "N", bus.cpu.GetStatus() & nes6502::N ? olc::GREEN : olc::RED);
+    DrawString(x + 80, y, "V", bus.cpu.GetStatus() & nes6502::V ? olc::GREEN : olc::RED);
+    DrawString(x + 96, y, "-", bus.cpu.GetStatus() & nes6502::U ? olc::GREEN : olc::RED);
+    DrawString(x + 112, y, "B", bus.cpu.GetStatus() & nes6502::B ? olc::GREEN : olc::RED);
+    DrawString(x + 128, y, "D", bus.cpu.GetStatus() & nes6502::D ? olc::GREEN : olc::RED);
+    DrawString(x + 144, y, "I", bus.cpu.GetStatus() & nes6502::I ? olc::GREEN : olc::RED);
+    DrawString(x + 160, y, "Z", bus.cpu.GetStatus() & nes6502::Z ? olc::GREEN : olc::RED);
+    DrawString(x + 178, y, "C", bus.cpu.GetStatus() & nes6502::C ? olc::GREEN : olc::RED);
     DrawString(x, y + 10, "PC: $" + hex(bus.cpu.pc, 4));
     DrawString(x, y + 20, "A: $" + hex(bus.cpu.a, 2) + " [" + std::to_string(bus.cpu.a) + "]");
     DrawString(x, y + 30, "X: $" + hex(bus.cpu.x, 2) + " [" + std::to_string(bus.cpu.x) + "]");
@@ -58,27 +56,27 @@ public:
 
   void DrawCode(int x, int y, int nLines)
   {
-    auto it_a = mapAsm.find(bus.cpu.pc);
+    Disassembler &disasm = bus.cpu.disassembler();
+    char sLine[Disassembler::nMaxText];
+
+    uint16_t addr = bus.cpu.pc;
     int nLineY = (nLines >> 1) * 10 + y;
-    if (it_a != mapAsm.end()) {
-      DrawString(x, nLineY, (*it_a).second, olc::CYAN);
-      while (nLineY < (nLines * 10) + y) {
-        nLineY += 10;
-        if (++it_a != mapAsm.end()) {
-          DrawString(x, nLineY, (*it_a).second);
-        }
-      }
+    DrawString(x, nLineY, disasm.Format(addr, sLine), olc::CYAN);
+    while (nLineY < (nLines * 10) + y) {
+      nLineY += 10;
+      uint16_t next = disasm.Next(addr);
+      if (next <= addr)
+        break;
+      addr = next;
+      DrawString(x, nLineY, disasm.Format(addr, sLine));
     }
 
-    it_a = mapAsm.find(bus.cpu.pc);
+    addr = bus.cpu.pc;
     nLineY = (nLines >> 1) * 10 + y;
-    if (it_a != mapAsm.end()) {
-      while (nLineY > y) {
-        nLineY -= 10;
-        if (--it_a != mapAsm.end()) {
-          DrawString(x, nLineY, (*it_a).second);
-        }
-      }
+    while (nLineY > y && addr > 0x0000) {
+      nLineY -= 10;
+      addr = disasm.Prev(addr);
+      DrawString(x, nLineY, disasm.Format(addr, sLine));
     }
   }
 
@@ -112,15 +110,12 @@ public:
     while (!ss.eof()) {
       std::string b;
       ss >> b;
-      bus.cpuRam[nOffset++] = (uint8_t)std::stoul(b, nullptr, 16);
+      bus.cpuRam.Write(nOffset++ & 0x07FF, (uint8_t)std::stoul(b, nullptr, 16));
     }
 
     // Set reset vector
-    bus.cpuRam[0xFFFC] = 0x00;
-    bus.cpuRam[0xFFFD] = 0x80;
-
-    // Extract disassembly
-    mapAsm = bus.cpu.disassemble(0x0000, 0xFFFF);
+    bus.cpuRam.Write(0xFFFC & 0x07FF, 0x00);
+    bus.cpuRam.Write(0xFFFD & 0x07FF, 0x80);
 
     // Reset
     bus.cpu.reset();
@@ -131,11 +126,8 @@ public:
   {
     Clear(olc::DARK_BLUE);
 
-    if (GetKey(olc::Key::SPACE).bPressed) {
-      do {
-        bus.cpu.clock();
-      } while (!bus.cpu.complete());
-    }
+    if (GetKey(olc::Key::SPACE).bPressed)
+      bus.cpu.step();
 
     if (GetKey(olc::Key::R).bPressed)
       bus.cpu.reset();
@@ -0,0 +1,157 @@
+#include "Disassembler.h"
+#include "Bus.h"
+#include "nes6502.h"
+
+Disassembler::Disassembler(Bus *b) : bus(b), vLines(0x10000)
+{}
+
+const Disassembler::LINE &Disassembler::Line(uint16_t addr)
+{
+  LINE &line = vLines[addr];
+  uint32_t generation = addr >= 0x4020 ? bus->BankGeneration() : 0;
+
+  if (line.length != 0 && line.generation == generation && !IsIO(addr))
+    return line;
+
+  line.opcode = bus->cpuRead(addr, true);
+  line.length = 1 + nes6502::OperandBytes(nes6502::opcodes[line.opcode].mode);
+  line.operand = 0x0000;
+  if (line.length > 1)
+    line.operand = bus->cpuRead(addr + 1, true);
+  if (line.length > 2)
+    line.operand |= bus->cpuRead(addr + 2, true) << 8;
+  line.generation = generation;
+
+  // An instr running off the end of memory is cut short, so that
+  // stepping through lines always ends at $FFFF
+  if (addr + line.length > 0x10000)
+    line.length = 0x10000 - addr;
+  return line;
+}
+
+uint16_t Disassembler::Prev(uint16_t addr)
+{
+  if (addr == 0x0000)
+    return 0x0000;
+
+  // Sweep forward from up to 8 instrs back until one ends exactly at
+  // addr, starting later if the sweep was out of step with addr
+  uint32_t nStart = addr > 24 ? addr - 24 : 0;
+  for (uint32_t nTry = 0; nTry < 3 && nStart + nTry < addr; nTry++) {
+    uint32_t a = nStart + nTry;
+    uint32_t prev = a;
+    while (a < addr) {
+      prev = a;
+      a += Line(a).length;
+    }
+
+    if (a == addr)
+      return prev;
+  }
+
+  return addr - 1;
+}
+
+// Appends the n least significant hex digits of v
+static char *AppendHex(char *s, uint32_t v, int n)
+{
+  for (int i = n - 1; i >= 0; i--, v >>= 4)
+    s[i] = "0123456789ABCDEF"[v & 0xF];
+  return s + n;
+}
+
+static char *Append(char *s, const char *t)
+{
+  while (*t != '\0')
+    *s++ = *t++;
+  return s;
+}
+
+const char *Disassembler::Format(uint16_t addr, char *sText)
+{
+  const LINE &line = Line(addr);
+  const nes6502::OPCODE &op = nes6502::opcodes[line.opcode];
+  uint8_t lo = line.operand & 0x00FF;
+
+  char *s = sText;
+  *s++ = '$';
+  s = AppendHex(s, addr, 4);
+  s = Append(s, ": ");
+  for (char c : op.name)
+    *s++ = c;
+  *s++ = ' ';
+
+  switch (op.mode) {
+  case nes6502::ADDRMODE::IMP:
+    s = Append(s, " {IMP}");
+    break;
+  case nes6502::ADDRMODE::IMM:
+    s = AppendHex(Append(s, "#$"), lo, 2);
+    s = Append(s, " {IMM}");
+    break;
+  case nes6502::ADDRMODE::ZP0:
+    s = AppendHex(Append(s, "$"), lo, 2);
+    s = Append(s, " {ZP0}");
+    break;
+  case nes6502::ADDRMODE::ZPX:
+    s = AppendHex(Append(s, "$"), lo, 2);
+    s = Append(s, ", X {ZPX}");
+    break;
+  case nes6502::ADDRMODE::ZPY:
+    s = AppendHex(Append(s, "$"), lo, 2);
+    s = Append(s, ", Y {ZPY}");
+    break;
+  case nes6502::ADDRMODE::IZX:
+    s = AppendHex(Append(s, "($"), lo, 2);
+    s = Append(s, ", X) {IZX}");
+    break;
+  case nes6502::ADDRMODE::IZY:
+    s = AppendHex(Append(s, "($"), lo, 2);
+    s = Append(s, ", Y) {IZY}");
+    break;
+  case nes6502::ADDRMODE::ABS:
+    s = AppendHex(Append(s, "$"), line.operand, 4);
+    s = Append(s, " {ABS}");
+    break;
+  case nes6502::ADDRMODE::ABX:
+    s = AppendHex(Append(s, "$"), line.operand, 4);
+    s = Append(s, ", X {ABX}");
+    break;
+  case nes6502::ADDRMODE::ABY:
+    s = AppendHex(Append(s, "$"), line.operand, 4);
+    s = Append(s, ", Y {ABY}");
+    break;
+  case nes6502::ADDRMODE::IND:
+    s = AppendHex(Append(s, "($"), line.operand, 4);
+    s = Append(s, ") {IND}");
+    break;
+  case nes6502::ADDRMODE::REL:
+    s = AppendHex(Append(s, "$"), lo, 2);
+    s = AppendHex(Append(s, "[$"), addr + 2 + (int8_t)lo, 4);
+    s = Append(s, "] {REL}");
+    break;
+  }
+
+  *s = '\0';
+  return sText;
+}
+
+void Disassembler::Write(uint16_t addr)
+{
+  // The written byte may belong to the instr decoded at it or to
+  // either of the two before it. System RAM is mirrored every 2KB
+  if (addr < 0x2000) {
+    for (uint16_t mirror = addr & 0x07FF; mirror < 0x2000; mirror += 0x0800)
+      for (uint16_t a = mirror - 2; a != (uint16_t)(mirror + 1); a++)
+        vLines[a].length = 0;
+  } else if (addr >= 0x4020) {
+    for (uint16_t a = addr - 2; a != (uint16_t)(addr + 1); a++)
+      vLines[a].length = 0;
+  }
+}
+
+void Disassembler::Flush()
+{
+  for (auto &line : vLines)
+    line.length = 0;
+}
@@ -0,0 +1,47 @@
+#include "Fuzzer.h"
+
+Fuzzer::Fuzzer(const std::string &sRom, uint8_t *pCoverage, nes6502::ENGINE engine,
+  uint32_t nSlice, uint32_t nMax, int32_t nEntry)
+  : nSliceCycles(nSlice), nMaxSlices(nMax)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return;
+
+  nes = std::make_unique<Bus>();
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(engine);
+  // Nobody looks at the frames
+  nes->ppu.SetRender(false);
+  nes->reset();
+  if (nEntry != nResetVector)
+    nes->cpu.pc = (uint16_t)nEntry;
+
+  vSnapshot.resize(nes->StateSize());
+  nes->saveState(vSnapshot.data(), vSnapshot.size());
+  nes->cpu.SetCoverage(pCoverage);
+}
+
+uint64_t Fuzzer::Run(const uint8_t *pData, size_t nSize)
+{
+  nes->loadState(vSnapshot.data(), vSnapshot.size());
+  nes->controller[0] = 0x00;
+  nes->controller[1] = 0x00;
+
+  uint64_t nCycles = 0;
+  uint32_t nSlices = 0;
+  for (size_t i = 0; i + 3 <= nSize && nSlices < nMaxSlices; i += 3) {
+    uint8_t op = pData[i];
+    if (op & 0x80) {
+      nes->cpuWrite(((op & 0x07) << 8) | pData[i + 1], pData[i + 2]);
+      // Code the CPU cached from RAM may just have been overwritten
+      nes->cpu.RamRestored();
+    } else {
+      nes->controller[0] = pData[i + 1];
+      nes->controller[1] = pData[i + 2];
+      nCycles += nes->runCycles(nSliceCycles).nCycles;
+      nSlices++;
+    }
+  }
+  return nCycles;
+}
@@ -0,0 +1,538 @@
+#include "Jit6502.h"
+#include "Bus.h"
+#include "nes6502.h"
+
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X64 1
+#include <sys/mman.h>
+#endif
+
+// Instrs which end a block as they always continue somewhere else.
+// Branches leave it only when taken, so the block runs on past them
+static bool EndsBlock(uint8_t opcode)
+{
+  switch (opcode) {
+  case 0x00:// BRK
+  case 0x20:// JSR
+  case 0x40:// RTI
+  case 0x4C:// JMP abs
+  case 0x60:// RTS
+  case 0x6C:// JMP ind
+    return true;
+  default:
+    return false;
+  }
+}
+
+// An instr addressing the PPU or APU/IO registers directly. Their
+// state is only brought up to date between blocks, so such instrs
+// are always interpreted on their own
+static bool TouchesIO(uint8_t opcode, uint16_t operand)
+{
+  switch (nes6502::opcodes[opcode].mode) {
+  case nes6502::ADDRMODE::ABS:
+  case nes6502::ADDRMODE::ABX:
+  case nes6502::ADDRMODE::ABY:
+  case nes6502::ADDRMODE::IND:
+    return opcode != 0x20 && opcode != 0x4C && operand >= 0x2000 && operand < 0x4020;
+  default:
+    return false;
+  }
+}
+
+Jit6502::Jit6502(nes6502 *c) : cpu(c)
+{
+#ifdef JIT_X64
+  void *p = mmap(nullptr, nArenaSize, PROT_READ | PROT_EXEC,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p != MAP_FAILED)
+    pArena = (uint8_t *)p;
+#endif
+}
+
+Jit6502::~Jit6502()
+{
+#ifdef JIT_X64
+  if (pArena != nullptr)
+    munmap(pArena, nArenaSize);
+#endif
+}
+
+uint8_t Jit6502::Run(uint16_t pc)
+{
+  if (pc < 0x8000 || pArena == nullptr) {
+    stats.nInterpreted++;
+    return 0;
+  }
+
+  uint32_t bank = vBankOffset[(pc >> 13) & 0x03];
+  uint16_t n = vIndex[pc & 0x7FFF];
+  while (n > 0 && slots[n - 1].bank != bank)
+    n = slots[n - 1].nNext;
+
+  if (n == 0 || slots[n - 1].fn == nullptr) {
+    if (n > 0 && slots[n - 1].bRejected) {
+      stats.nInterpreted++;
+      return 0;
+    }
+    n = Warm(pc, bank, n);
+    if (n == 0)
+      return 0;
+  }
+
+  const SLOT &slot = slots[n - 1];
+  stats.nBlocksRun++;
+  uint8_t nCycles = (uint8_t)slot.fn(cpu, cpu->bus->RamPage(0x00), cpu->bus->RamPage(0x01));
+
+  // Stores to zero page and pushes are emitted as plain stores to RAM,
+  // which the disassembler does not see, so its records of both pages
+  // are dropped wholesale. It only exists while a debugger looks
+  if (slot.bStoresRam && cpu->disasm)
+    for (uint16_t addr = 0x0000; addr < 0x0200; addr++)
+      cpu->disasm->Write(addr);
+  return nCycles;
+}
+
+uint16_t Jit6502::Warm(uint16_t pc, uint32_t bank, uint16_t n)
+{
+  if (n == 0)
+    n = Allocate(pc, bank);
+
+  if (++slots[n - 1].nRuns < nHotThreshold) {
+    stats.nInterpreted++;
+    return 0;
+  }
+
+  std::vector<INSTR> block;
+  uint16_t end = 0x0000;
+  BLOCKFN fn = nullptr;
+  if (Decode(pc, block, end)) {
+    // A full arena starts everything over, the block then needs a
+    // slot again
+    uint64_t nFlushes = stats.nFlushes;
+    fn = Compile(block);
+    if (stats.nFlushes != nFlushes || nSlotsUsed == 0)
+      n = Allocate(pc, bank);
+  }
+
+  SLOT &slot = slots[n - 1];
+  if (fn == nullptr) {
+    slot.bRejected = true;
+    stats.nBlocksRejected++;
+    stats.nInterpreted++;
+    return 0;
+  }
+
+  slot.fn = fn;
+  slot.bStoresRam = false;
+  for (const INSTR &i : block)
+    slot.bStoresRam |= i.opcode == 0x84 || i.opcode == 0x85 || i.opcode == 0x86 || i.opcode == 0x20 || i.opcode == 0x48;
+  stats.nBlocksCompiled++;
+  return n;
+}
+
+uint16_t Jit6502::Allocate(uint16_t pc, uint32_t bank)
+{
+  if (nSlotsUsed == nSlots) {
+    Flush();
+    stats.nFlushes++;
+  }
+
+  SLOT &slot = slots[nSlotsUsed++];
+  slot = SLOT();
+  slot.bank = bank;
+  slot.nNext = vIndex[pc & 0x7FFF];
+  vIndex[pc & 0x7FFF] = (uint16_t)nSlotsUsed;
+  return (uint16_t)nSlotsUsed;
+}
+
+void Jit6502::BanksSwitched(const Bus *bus)
+{
+  for (uint32_t nSlot = 0; nSlot < 4; nSlot++)
+    vBankOffset[nSlot] = bus->PRGBankOffset(0x8000 + nSlot * 0x2000);
+}
+
+bool Jit6502::Decode(uint16_t pc, std::vector<INSTR> &block, uint16_t &end)
+{
+  uint16_t addr = pc;
+
+  while (block.size() < nMaxBlockInstrs) {
+    uint8_t opcode = cpu->bus->cpuRead(addr, true);
+    uint8_t nBytes = nes6502::OperandBytes(nes6502::opcodes[opcode].mode);
+    uint16_t last = addr + nBytes;
+
+    // Stay within the bank slot of pc, an instr running into the
+    // next one is left to the interpreter
+    if (((last ^ pc) & 0xE000) != 0)
+      break;
+
+    INSTR i;
+    i.addr = addr;
+    i.opcode = opcode;
+    i.length = 1 + nBytes;
+    i.operand = 0x0000;
+    if (nBytes > 0)
+      i.operand = cpu->bus->cpuRead(addr + 1, true);
+    if (nBytes > 1)
+      i.operand |= cpu->bus->cpuRead(addr + 2, true) << 8;
+
+    if (TouchesIO(opcode, i.operand))
+      break;
+
+    block.push_back(i);
+    addr += i.length;
+
+    if (EndsBlock(opcode))
+      break;
+  }
+
+  end = addr;
+  return !block.empty();
+}
+
+#ifdef JIT_X64
+
+// Minimal x86-64 encoder. Generated code keeps the CPU object in rbx,
+// zero page in r13, the stack page in r14 and the cycles which are only known at run time
+// (interpreted instrs and taken branches) in r12d; all 6502
+// registers stay in memory so the interpreter can run in between
+namespace
+{
+  struct Emitter
+  {
+    std::vector<uint8_t> code;
+
+    void b(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+    void d32(uint32_t v)
+    {
+      for (int i = 0; i < 4; i++)
+        code.push_back((v >> (i * 8)) & 0xFF);
+    }
+
+    // Operations on a byte at [rbx + disp32]
+    void LoadReg(uint32_t reg) { b({ 0x0F, 0xB6, 0x83 }); d32(reg); }// movzx eax, byte [rbx+reg]
+    void StoreReg(uint32_t reg) { b({ 0x88, 0x83 }); d32(reg); }// mov [rbx+reg], al
+    void StoreImm(uint32_t reg, uint8_t v) { b({ 0xC6, 0x83 }); d32(reg); b({ v }); }
+    void OrImm(uint32_t reg, uint8_t v) { b({ 0x80, 0x8B }); d32(reg); b({ v }); }
+    void AndImm(uint32_t reg, uint8_t v) { b({ 0x80, 0xA3 }); d32(reg); b({ v }); }
+    void OrReg(uint32_t reg) { b({ 0x08, 0x8B }); d32(reg); }// or [rbx+reg], cl
+    void StorePC(uint32_t reg, uint16_t v)
+    {
+      b({ 0x66, 0xC7, 0x83 }); d32(reg);
+      b({ (uint8_t)(v & 0xFF), (uint8_t)(v >> 8) });
+    }
+
+
+    // Zero page is always system RAM, addressed through r13
+    void LoadZP(uint8_t addr) { b({ 0x41, 0x0F, 0xB6, 0x85 }); d32(addr); }// movzx eax, byte [r13+addr]
+    void StoreZP(uint8_t addr) { b({ 0x41, 0x88, 0x85 }); d32(addr); }// mov [r13+addr], al
+
+    void TestImm(uint32_t reg, uint8_t v) { b({ 0xF6, 0x83 }); d32(reg); b({ v }); }
+    void CmpImm(uint32_t reg, uint8_t v) { b({ 0x80, 0xBB }); d32(reg); b({ v }); }
+    void AddCycles(uint8_t n) { b({ 0x41, 0x83, 0xC4, n }); }// add r12d, n
+
+    // The stack page is addressed through r14, indexed by rax
+    void LoadStack() { b({ 0x41, 0x0F, 0xB6, 0x04, 0x06 }); }// movzx eax, byte [r14+rax]
+    void StoreStack(uint8_t v) { b({ 0x41, 0xC6, 0x04, 0x06, v }); }// mov byte [r14+rax], v
+
+    // Pulls pc off the stack, with S in eax, and adds n to it
+    void PullPC(uint32_t s, uint32_t pc, uint8_t n)
+    {
+      b({ 0xFE, 0xC0 });// inc al
+      b({ 0x41, 0x0F, 0xB6, 0x0C, 0x06 });// movzx ecx, byte [r14+rax]
+      b({ 0xFE, 0xC0 });// inc al
+      b({ 0x41, 0x0F, 0xB6, 0x14, 0x06 });// movzx edx, byte [r14+rax]
+      StoreReg(s);
+      b({ 0xC1, 0xE2, 0x08, 0x09, 0xD1 });// shl edx, 8; or ecx, edx
+      b({ 0x66, 0x83, 0xC1, n });// add cx, n
+      b({ 0x66, 0x89, 0x8B }); d32(pc);// mov [rbx+pc], cx
+    }
+
+    void Prologue()
+    {
+      b({ 0x53 });// push rbx
+      b({ 0x41, 0x54 });// push r12
+      b({ 0x41, 0x55 });// push r13
+      b({ 0x41, 0x56 });// push r14
+      b({ 0x41, 0x57 });// push r15, only keeps calls aligned
+      b({ 0x48, 0x89, 0xFB });// mov rbx, rdi
+      b({ 0x49, 0x89, 0xF5 });// mov r13, rsi
+      b({ 0x49, 0x89, 0xD6 });// mov r14, rdx
+      b({ 0x45, 0x31, 0xE4 });// xor r12d, r12d
+    }
+
+    // Returns r12d plus the cycles known at compile time
+    void Exit(uint32_t nStaticCycles)
+    {
+      b({ 0x41, 0x8D, 0x84, 0x24 }); d32(nStaticCycles);// lea eax, [r12+n]
+      b({ 0x41, 0x5F });// pop r15
+      b({ 0x41, 0x5E });// pop r14
+      b({ 0x41, 0x5D });// pop r13
+      b({ 0x41, 0x5C });// pop r12
+      b({ 0x5B });// pop rbx
+      b({ 0xC3 });// ret
+    }
+
+    // fn(cpu, instr, pc), then adds the cycles it returns to r12d
+    void Call(uint64_t fn, uint32_t instr, uint16_t pc)
+    {
+      b({ 0x48, 0x89, 0xDF });// mov rdi, rbx
+      b({ 0xBE }); d32(instr);// mov esi, instr
+      b({ 0xBA }); d32(pc);// mov edx, pc
+      b({ 0x48, 0xB8 });// mov rax, fn
+      d32(fn & 0xFFFFFFFF);
+      d32(fn >> 32);
+      b({ 0xFF, 0xD0 });// call rax
+      b({ 0x0F, 0xB6, 0xC8 });// movzx ecx, al
+      b({ 0x41, 0x01, 0xCC });// add r12d, ecx
+    }
+  };
+}
+
+Jit6502::BLOCKFN Jit6502::Compile(const std::vector<INSTR> &block)
+{
+  auto offset = [&](const void *p) { return (uint32_t)((const uint8_t *)p - (const uint8_t *)cpu); };
+  const uint32_t A = offset(&cpu->a), X = offset(&cpu->x), Y = offset(&cpu->y);
+  const uint32_t S = offset(&cpu->stkp), P = offset(&cpu->status), PC = offset(&cpu->pc);
+  const uint32_t LZ = offset(&cpu->lazy_z), LN = offset(&cpu->lazy_n);
+
+  Emitter e;
+  // N and Z are set by storing the result they are evaluated from
+  auto NZ = [&]() {
+    e.StoreReg(LZ);
+    e.StoreReg(LN);
+  };
+  e.Prologue();
+
+  uint32_t nStaticCycles = 0;
+  bool bPCValid = true;
+  size_t nInline = 0;
+
+  for (size_t n = 0; n < block.size(); n++) {
+    const INSTR &i = block[n];
+    uint8_t imm = i.operand & 0xFF;
+    bool bInline = true;
+    bool bSetsPC = false;
+
+    switch (i.opcode) {
+    // clang-format off
+    case 0xAA: e.LoadReg(A); e.StoreReg(X); NZ(); break;// TAX
+    case 0xA8: e.LoadReg(A); e.StoreReg(Y); NZ(); break;// TAY
+    case 0x8A: e.LoadReg(X); e.StoreReg(A); NZ(); break;// TXA
+    case 0x98: e.LoadReg(Y); e.StoreReg(A); NZ(); break;// TYA
+    case 0xBA: e.LoadReg(S); e.StoreReg(X); NZ(); break;// TSX
+    case 0x9A: e.LoadReg(X); e.StoreReg(S); break;// TXS
+    case 0xE8: e.LoadReg(X); e.b({ 0xFE, 0xC0 }); e.StoreReg(X); NZ(); break;// INX
+    case 0xC8: e.LoadReg(Y); e.b({ 0xFE, 0xC0 }); e.StoreReg(Y); NZ(); break;// INY
+    case 0xCA: e.LoadReg(X); e.b({ 0xFE, 0xC8 }); e.StoreReg(X); NZ(); break;// DEX
+    case 0x88: e.LoadReg(Y); e.b({ 0xFE, 0xC8 }); e.StoreReg(Y); NZ(); break;// DEY
+    case 0x18: e.AndImm(P, (uint8_t)~nes6502::C); break;// CLC
+    case 0x38: e.OrImm(P, nes6502::C); break;// SEC
+    case 0x58: e.AndImm(P, (uint8_t)~nes6502::I); break;// CLI
+    case 0x78: e.OrImm(P, nes6502::I); break;// SEI
+    case 0xB8: e.AndImm(P, (uint8_t)~nes6502::V); break;// CLV
+    case 0xD8: e.AndImm(P, (uint8_t)~nes6502::D); break;// CLD
+    case 0xF8: e.OrImm(P, nes6502::D); break;// SED
+    case 0x29: e.LoadReg(A); e.b({ 0x24, imm }); e.StoreReg(A); NZ(); break;// AND #
+    case 0x09: e.LoadReg(A); e.b({ 0x0C, imm }); e.StoreReg(A); NZ(); break;// ORA #
+    case 0x49: e.LoadReg(A); e.b({ 0x34, imm }); e.StoreReg(A); NZ(); break;// EOR #
+    case 0xEA: break;// NOP
+    case 0xA5: e.LoadZP(imm); e.StoreReg(A); NZ(); break;// LDA zp
+    case 0xA6: e.LoadZP(imm); e.StoreReg(X); NZ(); break;// LDX zp
+    case 0xA4: e.LoadZP(imm); e.StoreReg(Y); NZ(); break;// LDY zp
+    case 0x85: e.LoadReg(A); e.StoreZP(imm); break;// STA zp
+    case 0x86: e.LoadReg(X); e.StoreZP(imm); break;// STX zp
+    case 0x84: e.LoadReg(Y); e.StoreZP(imm); break;// STY zp
+    case 0x4C: e.StorePC(PC, i.operand); bSetsPC = true; break;// JMP abs
+    case 0x68: e.LoadReg(S); e.b({ 0xFE, 0xC0 }); e.StoreReg(S); e.LoadStack(); e.StoreReg(A); NZ(); break;// PLA
+    // clang-format on
+    case 0x10: case 0x30:// BPL BMI
+    case 0x50: case 0x70:// BVC BVS
+    case 0x90: case 0xB0:// BCC BCS
+    case 0xD0: case 0xF0:// BNE BEQ
+    {
+      // Bits 7-6 of the opcode select the flag, bit 5 the condition.
+      // Either test leaves x86 ZF set when the 6502 flag is clear
+      uint16_t next = i.addr + i.length;
+      uint16_t target = next + (int8_t)imm;
+
+      switch (i.opcode >> 6) {
+      case 0: e.TestImm(LN, nes6502::N); break;
+      case 1: e.TestImm(P, nes6502::V); break;
+      case 2: e.TestImm(P, nes6502::C); break;
+      case 3: e.CmpImm(LZ, 0x00); e.b({ 0x0F, 0x94, 0xC0, 0x84, 0xC0 }); break;// sete al; test al, al
+      }
+      // A taken branch leaves the block, one not taken runs on in it
+      e.b({ (uint8_t)(i.opcode & 0x20 ? 0x74 : 0x75), 0x00 });// jz/jnz over the exit
+      size_t nPatch = e.code.size() - 1;
+      e.StorePC(PC, target);
+      e.Exit(nStaticCycles + 2 + ((target & 0xFF00) != (next & 0xFF00) ? 2 : 1));
+      e.code[nPatch] = (uint8_t)(e.code.size() - nPatch - 1);
+      break;
+    }
+    case 0xC9:// CMP #
+    case 0xE0:// CPX #
+    case 0xC0:// CPY #
+    {
+      e.LoadReg(i.opcode == 0xC9 ? A : i.opcode == 0xE0 ? X : Y);
+      e.b({ 0x2C, imm });// sub al, imm
+      e.b({ 0x0F, 0x93, 0xC1 });// setae cl, C is set unless it borrowed
+      NZ();
+      e.AndImm(P, (uint8_t)~nes6502::C);
+      e.OrReg(P);
+      break;
+    }
+    case 0x48:// PHA
+    {
+      e.LoadReg(S);
+      e.b({ 0x0F, 0xB6, 0x8B }); e.d32(A);// movzx ecx, byte [rbx+A]
+      e.b({ 0x41, 0x88, 0x0C, 0x06 });// mov [r14+rax], cl
+      e.b({ 0xFE, 0xC8 });// dec al
+      e.StoreReg(S);
+      break;
+    }
+    case 0x20:// JSR, pushing the addr of its last byte
+    {
+      uint16_t ret = i.addr + 2;
+      e.LoadReg(S);
+      e.StoreStack(ret >> 8);
+      e.b({ 0xFE, 0xC8 });// dec al
+      e.StoreStack(ret & 0xFF);
+      e.b({ 0xFE, 0xC8 });// dec al
+      e.StoreReg(S);
+      e.StorePC(PC, i.operand);
+      bSetsPC = true;
+      break;
+    }
+    case 0x40:// RTI
+    {
+      e.LoadReg(S);
+      e.b({ 0xFE, 0xC0 });// inc al
+      e.b({ 0x41, 0x0F, 0xB6, 0x0C, 0x06 });// movzx ecx, byte [r14+rax]
+      e.b({ 0x88, 0x8B }); e.d32(LN);// mov [rbx+LN], cl
+      e.b({ 0x89, 0xCA, 0x80, 0xE2, (uint8_t)~(nes6502::B | nes6502::U) });// mov edx, ecx; and dl, ~(B | U)
+      e.b({ 0x88, 0x93 }); e.d32(P);// mov [rbx+P], dl
+      e.b({ 0xF6, 0xD1, 0x80, 0xE1, nes6502::Z });// not cl; and cl, Z
+      e.b({ 0x88, 0x8B }); e.d32(LZ);// mov [rbx+LZ], cl
+      e.PullPC(S, PC, 0);
+      bSetsPC = true;
+      break;
+    }
+    case 0x60:// RTS
+      e.LoadReg(S);
+      e.PullPC(S, PC, 1);
+      bSetsPC = true;
+      break;
+    case 0x24:// BIT zp
+    {
+      e.LoadZP(imm);
+      e.StoreReg(LN);
+      e.b({ 0x89, 0xC1, 0x80, 0xE1, nes6502::V });// mov ecx, eax; and cl, V
+      e.AndImm(P, (uint8_t)~nes6502::V);
+      e.OrReg(P);
+      e.b({ 0x22, 0x83 }); e.d32(A);// and al, [rbx+A]
+      e.StoreReg(LZ);
+      break;
+    }
+    case 0xA9:// LDA #
+    case 0xA2:// LDX #
+    case 0xA0:// LDY #
+    {
+      e.StoreImm(i.opcode == 0xA9 ? A : i.opcode == 0xA2 ? X : Y, imm);
+      e.StoreImm(LZ, imm);
+      e.StoreImm(LN, imm);
+      break;
+    }
+    default:
+      bInline = false;
+      break;
+    }
+
+    if (bInline) {
+      nInline++;
+      nStaticCycles += nes6502::opcodes[i.opcode].cycles;
+      bPCValid = bSetsPC;
+      continue;
+    }
+
+    e.Call((uint64_t)&Jit6502::Interpret, i.opcode | (i.operand << 8), i.addr + i.length);
+    bPCValid = true;
+
+    // Anything written to the cartridge may have switched banks or
+    // overwritten this very block, so leave before running on
+    if (n + 1 < block.size()) {
+      e.b({ 0xA9 });// test eax, 0x100
+      e.d32(0x100);
+      e.b({ 0x74, 0x00 });// jz over the exit
+      size_t nPatch = e.code.size() - 1;
+      e.Exit(nStaticCycles);
+      e.code[nPatch] = (uint8_t)(e.code.size() - nPatch - 1);
+    }
+  }
+
+  // A block of nothing but calls into the interpreter would only be
+  // slower than the interpreter
+  if (nInline == 0)
+    return nullptr;
+
+  if (!bPCValid)
+    e.StorePC(PC, block.back().addr + block.back().length);
+  e.Exit(nStaticCycles);
+
+  if (nArenaUsed + e.code.size() > nArenaSize) {
+    Flush();
+    stats.nFlushes++;
+  }
+
+  // Code is never writable and executable at the same time, only the
+  // pages receiving the new block are opened up for writing
+  uint8_t *p = pArena + nArenaUsed;
+  uintptr_t nPage = 4096;
+  uint8_t *pFirst = (uint8_t *)((uintptr_t)p & ~(nPage - 1));
+  size_t nLength = p + e.code.size() - pFirst;
+  // The kernel may refuse either switch, e.g. SELinux without execmem.
+  // Blocks sharing the pages may then no longer be executable, so the
+  // arena is given up and everything is left to the interpreter
+  bool bWritable = mprotect(pFirst, nLength, PROT_READ | PROT_WRITE) == 0;
+  if (bWritable)
+    std::memcpy(p, e.code.data(), e.code.size());
+  if (!bWritable || mprotect(pFirst, nLength, PROT_READ | PROT_EXEC) != 0) {
+    Flush();
+    munmap(pArena, nArenaSize);
+    pArena = nullptr;
+    return nullptr;
+  }
+  nArenaUsed = (nArenaUsed + e.code.size() + 15) & ~(size_t)15;
+
+  return (BLOCKFN)p;
+}
+
+#else
+
+Jit6502::BLOCKFN Jit6502::Compile(const std::vector<INSTR> &)
+{
+  return nullptr;
+}
+
+#endif
+
+uint32_t Jit6502::Interpret(nes6502 *cpu, uint32_t instr, uint32_t pc)
+{
+  Jit6502 *jit = cpu->jit.get();
+  jit->bCartWritten = false;
+
+  cpu->pc = pc;
+  cpu->opcode = instr & 0xFF;
+  uint32_t nCycles = cpu->executeFused<nes6502::PER_INSTR>(instr >> 8);
+  return jit->bCartWritten ? nCycles | 0x100 : nCycles;
+}
+
+void Jit6502::Flush()
+{
+  vIndex.fill(0);
+  nSlotsUsed = 0;
+  nArenaUsed = 0;
+}
@@ -0,0 +1,48 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NES_MMAP 1
+#endif
+
+MappedFile::MappedFile(const std::string &sFileName)
+{
+#ifdef NES_MMAP
+  int fd = open(sFileName.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        pData = (const uint8_t *)p;
+        nSize = (size_t)st.st_size;
+        bMapped = true;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  if (!bMapped) {
+    std::ifstream ifs(sFileName, std::ifstream::binary);
+    if (ifs.is_open()) {
+      vData.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      pData = vData.empty() ? nullptr : vData.data();
+      nSize = vData.size();
+    }
+  }
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef NES_MMAP
+  if (bMapped)
+    munmap((void *)pData, nSize);
+#endif
+}
@@ -1,7 +1,50 @@
 #include "Mapper.h"
 
-Mapper::Mapper(uint8_t prgBanks, uint8_t chrBanks)
+Mapper::Mapper(uint16_t prgBanks, uint16_t chrBanks)
 {
     nPRGBanks = prgBanks;
     nCHRBanks = chrBanks;
 }
+
+void Mapper::SetMemory(const uint8_t *pPRG, const uint8_t *pCHR)
+{
+  pPRGMemory = pPRG;
+  pCHRMemory = pCHR;
+  for (int i = 0; i < 4; i++)
+    vPRGBank[i] = pPRGMemory ? pPRGMemory + vPRGOffset[i] : nullptr;
+  for (int i = 0; i < 8; i++)
+    vCHRBank[i] = pCHRMemory ? pCHRMemory + vCHROffset[i] : nullptr;
+}
+
+void Mapper::MapPRG(uint8_t nSlot, uint32_t nBank)
+{
+  uint32_t nBanks = nPRGBanks > 0 ? nPRGBanks * 2u : 1u;
+  uint32_t nOffset = (nBank % nBanks) * 0x2000;
+  if (nOffset != vPRGOffset[nSlot]) {
+    vPRGOffset[nSlot] = nOffset;
+    nPRGSwitched |= 1 << nSlot;
+    nBankGeneration++;
+  }
+  vPRGBank[nSlot] = pPRGMemory ? pPRGMemory + nOffset : nullptr;
+}
+
+void Mapper::MapCHR(uint8_t nSlot, uint32_t nBank)
+{
+  // CHR RAM is 8KB
+  uint32_t nBanks = nCHRBanks > 0 ? nCHRBanks * 8u : 8u;
+  uint32_t nOffset = (nBank % nBanks) * 0x0400;
+  if (nOffset != vCHROffset[nSlot]) {
+    vCHROffset[nSlot] = nOffset;
+    nCHRSwitched |= 1 << nSlot;
+  }
+  vCHRBank[nSlot] = pCHRMemory ? pCHRMemory + nOffset : nullptr;
+}
+
+void Mapper::EnableRam(bool b)
+{
+  if (b != bRamEnabled) {
+    bRamEnabled = b;
+    nPRGSwitched |= nPRGRamSlot;
+    nBankGeneration++;
+  }
+}
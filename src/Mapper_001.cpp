@@ -0,0 +1,104 @@
+#include "Mapper_001.h"
+
+Mapper_001::Mapper_001(uint16_t prgBanks, uint16_t chrBanks)
+  : Mapper(prgBanks, chrBanks)
+{
+  MapBanks();
+}
+
+bool Mapper_001::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data)
+{
+  if (addr < 0x8000)
+    return false;
+  mapped_addr = 0;
+
+  bool bConsecutive = nLastWrite != ~0ull && nWriteCycle - nLastWrite == 1;
+  nLastWrite = nWriteCycle;
+  if (bConsecutive)
+    return true;
+
+  if (data & 0x80) {
+    // Reset, which also fixes the last bank at $C000
+    nShift = 0x10;
+    nControl |= 0x0C;
+    MapBanks();
+    return true;
+  }
+
+  bool bFull = nShift & 0x01;
+  nShift = (nShift >> 1) | ((data & 0x01) << 4);
+  if (bFull) {
+    switch ((addr >> 13) & 0x03) {
+    case 0:
+      nControl = nShift;
+      break;
+    case 1:
+      nCHRBank0 = nShift;
+      break;
+    case 2:
+      nCHRBank1 = nShift;
+      break;
+    case 3:
+      nPRGBank = nShift;
+      break;
+    }
+    nShift = 0x10;
+    MapBanks();
+  }
+  return true;
+}
+
+void Mapper_001::MapBanks()
+{
+  static const MIRROR vMirror[4] = { ONESCREEN_LO, ONESCREEN_HI, VERTICAL, HORIZONTAL };
+  mirror = vMirror[nControl & 0x03];
+
+  // PRG banks are 16KB, two slots each
+  uint32_t nLast = nPRGBanks > 0 ? nPRGBanks - 1u : 0u;
+  uint32_t nBank = nPRGBank & 0x0F;
+  uint32_t nLow = 0, nHigh = 0;
+  switch ((nControl >> 2) & 0x03) {
+  case 0:
+  case 1:// 32KB at $8000
+    nLow = nBank & ~1u;
+    nHigh = nLow + 1;
+    break;
+  case 2:// First bank fixed at $8000
+    nLow = 0;
+    nHigh = nBank;
+    break;
+  case 3:// Last bank fixed at $C000
+    nLow = nBank;
+    nHigh = nLast;
+    break;
+  }
+  MapPRG(0, nLow * 2);
+  MapPRG(1, nLow * 2 + 1);
+  MapPRG(2, nHigh * 2);
+  MapPRG(3, nHigh * 2 + 1);
+  // Bit 4 of the PRG register disables the PRG RAM, on MMC1B and later
+  EnableRam(!(nPRGBank & 0x10));
+
+  // CHR banks are 4KB, or one of 8KB
+  if (nControl & 0x10) {
+    for (uint8_t i = 0; i < 4; i++) {
+      MapCHR(i, nCHRBank0 * 4u + i);
+      MapCHR(4 + i, nCHRBank1 * 4u + i);
+    }
+  } else {
+    for (uint8_t i = 0; i < 8; i++)
+      MapCHR(i, (nCHRBank0 & ~1u) * 4u + i);
+  }
+}
+
+void Mapper_001::State(StateBuffer &s)
+{
+  s(nShift);
+  s(nControl);
+  s(nCHRBank0);
+  s(nCHRBank1);
+  s(nPRGBank);
+  s(nLastWrite);
+  if (s.Loading())
+    MapBanks();
+}
@@ -0,0 +1,35 @@
+#include "Mapper_002.h"
+
+Mapper_002::Mapper_002(uint16_t prgBanks, uint16_t chrBanks)
+  : Mapper(prgBanks, chrBanks)
+{
+  uint32_t nLast = nPRGBanks > 0 ? nPRGBanks - 1u : 0u;
+  MapPRG(2, nLast * 2);
+  MapPRG(3, nLast * 2 + 1);
+  for (uint8_t nSlot = 0; nSlot < 8; nSlot++)
+    MapCHR(nSlot, nSlot);
+  MapBanks();
+}
+
+bool Mapper_002::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data)
+{
+  if (addr < 0x8000)
+    return false;
+  mapped_addr = 0;
+  nPRGBank = data;
+  MapBanks();
+  return true;
+}
+
+void Mapper_002::MapBanks()
+{
+  MapPRG(0, nPRGBank * 2u);
+  MapPRG(1, nPRGBank * 2u + 1);
+}
+
+void Mapper_002::State(StateBuffer &s)
+{
+  s(nPRGBank);
+  if (s.Loading())
+    MapBanks();
+}
@@ -0,0 +1,33 @@
+#include "Mapper_003.h"
+
+Mapper_003::Mapper_003(uint16_t prgBanks, uint16_t chrBanks)
+  : Mapper(prgBanks, chrBanks)
+{
+  // 16KB of PRG ROM is mirrored into $C000
+  for (uint8_t nSlot = 0; nSlot < 4; nSlot++)
+    MapPRG(nSlot, nSlot);
+  MapBanks();
+}
+
+bool Mapper_003::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data)
+{
+  if (addr < 0x8000)
+    return false;
+  mapped_addr = 0;
+  nCHRBank = data;
+  MapBanks();
+  return true;
+}
+
+void Mapper_003::MapBanks()
+{
+  for (uint8_t nSlot = 0; nSlot < 8; nSlot++)
+    MapCHR(nSlot, nCHRBank * 8u + nSlot);
+}
+
+void Mapper_003::State(StateBuffer &s)
+{
+  s(nCHRBank);
+  if (s.Loading())
+    MapBanks();
+}
@@ -0,0 +1,81 @@
+#include "Mapper_004.h"
+
+Mapper_004::Mapper_004(uint16_t prgBanks, uint16_t chrBanks)
+  : Mapper(prgBanks, chrBanks)
+{
+  MapBanks();
+}
+
+bool Mapper_004::cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data)
+{
+  if (addr < 0x8000)
+    return false;
+  mapped_addr = 0;
+
+  switch (addr & 0xE001) {
+  case 0x8000:
+    nSelect = data;
+    MapBanks();
+    break;
+  case 0x8001:
+    vRegister[nSelect & 0x07] = data;
+    MapBanks();
+    break;
+  case 0xA000:
+    nMirroring = data;
+    MapBanks();
+    break;
+  case 0xA001:
+    nRamProtect = data;
+    break;
+  case 0xC000:
+    nIrqLatch = data;
+    break;
+  case 0xC001:
+    bIrqReload = true;
+    break;
+  case 0xE000:
+    bIrqEnable = false;
+    break;
+  case 0xE001:
+    bIrqEnable = true;
+    break;
+  }
+  return true;
+}
+
+void Mapper_004::MapBanks()
+{
+  mirror = (nMirroring & 0x01) ? HORIZONTAL : VERTICAL;
+
+  // Bit 6 swaps the switchable bank at $8000 with the second to last
+  // one fixed at $C000
+  uint32_t nLast = nPRGBanks > 0 ? nPRGBanks * 2u - 1 : 0u;
+  uint8_t nSwap = (nSelect & 0x40) ? 2 : 0;
+  MapPRG(0 ^ nSwap, vRegister[6]);
+  MapPRG(2 ^ nSwap, nLast - 1);
+  MapPRG(1, vRegister[7]);
+  MapPRG(3, nLast);
+
+  // Bit 7 swaps the 2KB banks at $0000 with the 1KB ones at $1000
+  uint8_t nInvert = (nSelect & 0x80) ? 4 : 0;
+  MapCHR(0 ^ nInvert, vRegister[0] & 0xFE);
+  MapCHR(1 ^ nInvert, vRegister[0] | 0x01);
+  MapCHR(2 ^ nInvert, vRegister[1] & 0xFE);
+  MapCHR(3 ^ nInvert, vRegister[1] | 0x01);
+  for (uint8_t i = 0; i < 4; i++)
+    MapCHR((4 + i) ^ nInvert, vRegister[2 + i]);
+}
+
+void Mapper_004::State(StateBuffer &s)
+{
+  s(nSelect);
+  s(vRegister);
+  s(nMirroring);
+  s(nRamProtect);
+  s(nIrqLatch);
+  s(bIrqReload);
+  s(bIrqEnable);
+  if (s.Loading())
+    MapBanks();
+}
@@ -0,0 +1,260 @@
+#include "Movie.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "RomImage.h"
+#include "RomIndex.h"
+
+// Hashes the PRG and CHR ROM of the ROM at sRom as RomIndex does,
+// false if it does not load
+static bool HashRom(const std::string &sRom, uint32_t &nCrc32, uint8_t vSha1[20])
+{
+  std::shared_ptr<const RomImage> pImage = RomImage::Load(sRom);
+  if (!pImage->Valid())
+    return false;
+  // CHR ROM follows PRG ROM in the file
+  nCrc32 = RomIndex::Crc32(pImage->PRG(), pImage->PRGSize() + pImage->CHRSize());
+  RomIndex::Sha1(pImage->PRG(), pImage->PRGSize() + pImage->CHRSize(), vSha1);
+  return true;
+}
+
+void Movie::Start(Bus &nes, const std::string &sRomFile, uint32_t nKey)
+{
+  sRom = sRomFile;
+  nRomCrc32 = 0;
+  std::memset(vRomSha1, 0, sizeof(vRomSha1));
+  HashRom(sRom, nRomCrc32, vRomSha1);
+  nKeyInterval = std::max(nKey, 1u);
+  vInput[0].clear();
+  vInput[1].clear();
+  vKeyframes.clear();
+  nPosition = 0;
+
+  KEYFRAME key{ 0, BatchRunner::HashState(nes), std::vector<uint8_t>(nes.StateSize()) };
+  nes.saveState(key.vState.data(), key.vState.size());
+  vKeyframes.push_back(std::move(key));
+  nEndHash = vKeyframes.back().nHash;
+}
+
+Bus::STATS Movie::RecordFrame(Bus &nes, uint8_t nPad1, uint8_t nPad2)
+{
+  uint32_t nFrame = Frames();
+  if (nFrame > 0 && nFrame % nKeyInterval == 0) {
+    KEYFRAME key{ nFrame, BatchRunner::HashState(nes), std::vector<uint8_t>(nes.StateSize()) };
+    nes.saveState(key.vState.data(), key.vState.size());
+    vKeyframes.push_back(std::move(key));
+  }
+
+  nes.controller[0] = nPad1;
+  nes.controller[1] = nPad2;
+  Bus::STATS stats = nes.runFrame();
+  vInput[0].push_back(nPad1);
+  vInput[1].push_back(nPad2);
+  nEndHash = BatchRunner::HashState(nes);
+  nPosition = Frames();
+  return stats;
+}
+
+bool Movie::Seek(Bus &nes, uint32_t nFrame)
+{
+  if (nFrame > Frames() || vKeyframes.empty())
+    return false;
+
+  // Keyframes are taken every nKeyInterval frames from the start
+  const KEYFRAME &key = vKeyframes[std::min<size_t>(nFrame / nKeyInterval, vKeyframes.size() - 1)];
+  if (!nes.loadState(key.vState.data(), key.vState.size()))
+    return false;
+
+  // Only the frame before the one seeked to is drawn, if any are
+  bool bRender = nes.ppu.GetRender();
+  nes.ppu.SetRender(false);
+  for (nPosition = key.nFrame; nPosition < nFrame;) {
+    if (nPosition + 1 == nFrame)
+      nes.ppu.SetRender(bRender);
+    PlayFrame(nes);
+  }
+  nes.ppu.SetRender(bRender);
+  return true;
+}
+
+bool Movie::PlayFrame(Bus &nes)
+{
+  if (nPosition >= Frames())
+    return false;
+
+  nes.controller[0] = vInput[0][nPosition];
+  nes.controller[1] = vInput[1][nPosition];
+  nes.runFrame();
+  nPosition++;
+  return true;
+}
+
+std::vector<BatchRunner::RESULT> Movie::Verify(BatchRunner &runner) const
+{
+  std::vector<BatchRunner::JOB> vJobs;
+  for (size_t k = 0; k < vKeyframes.size(); k++) {
+    const KEYFRAME &key = vKeyframes[k];
+    uint32_t nEnd = k + 1 < vKeyframes.size() ? vKeyframes[k + 1].nFrame : Frames();
+
+    BatchRunner::JOB job;
+    job.sRom = sRom;
+    job.nFrames = nEnd - key.nFrame;
+    job.vInput.assign(vInput[0].begin() + key.nFrame, vInput[0].begin() + nEnd);
+    job.vInput2.assign(vInput[1].begin() + key.nFrame, vInput[1].begin() + nEnd);
+    job.vState = key.vState;
+    job.bCheckHash = true;
+    job.nExpectedHash = k + 1 < vKeyframes.size() ? vKeyframes[k + 1].nHash : nEndHash;
+    vJobs.push_back(std::move(job));
+  }
+  return runner.Run(vJobs);
+}
+
+// The file starts with a header, followed by the ROM's path and
+// hashes, the buttons as runs of frames holding the same ones, and the keyframes,
+// each as the XOR with the keyframe before as StateBuffer encodes it.
+// Numbers are in the host's byte order
+static const char sMagic[8] = { 'N', 'E', 'S', 'M', 'O', 'V', '2', 0 };
+
+template <typename T>
+static void Put(std::ostream &os, const T &v)
+{
+  os.write((const char *)&v, sizeof(T));
+}
+
+template <typename T>
+static bool Get(std::istream &is, T &v)
+{
+  return (bool)is.read((char *)&v, sizeof(T));
+}
+
+bool Movie::Save(const std::string &sFile, std::string &sError) const
+{
+  std::ofstream ofs(sFile, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    sError = "could not create " + sFile;
+    return false;
+  }
+
+  ofs.write(sMagic, sizeof(sMagic));
+  Put(ofs, nKeyInterval);
+  Put(ofs, Frames());
+  Put(ofs, nEndHash);
+  Put(ofs, (uint32_t)sRom.size());
+  ofs.write(sRom.data(), sRom.size());
+  Put(ofs, nRomCrc32);
+  ofs.write((const char *)vRomSha1, sizeof(vRomSha1));
+
+  // Buttons rarely change from one frame to the next
+  std::vector<uint32_t> vRuns;
+  for (uint32_t f = 0; f < Frames(); f++) {
+    if (f > 0 && vInput[0][f] == vInput[0][f - 1] && vInput[1][f] == vInput[1][f - 1])
+      vRuns.back()++;
+    else
+      vRuns.push_back(1);
+  }
+  Put(ofs, (uint32_t)vRuns.size());
+  for (uint32_t r = 0, f = 0; r < vRuns.size(); f += vRuns[r++]) {
+    Put(ofs, vRuns[r]);
+    Put(ofs, vInput[0][f]);
+    Put(ofs, vInput[1][f]);
+  }
+
+  Put(ofs, (uint32_t)vKeyframes.size());
+  std::vector<uint8_t> vEncoded;
+  for (size_t k = 0; k < vKeyframes.size(); k++) {
+    const KEYFRAME &key = vKeyframes[k];
+    const uint8_t *pPrev = k > 0 ? vKeyframes[k - 1].vState.data() : nullptr;
+    vEncoded.resize(StateBuffer::MaxEncoded(key.vState.size()));
+    uint32_t nEncoded = (uint32_t)StateBuffer::Encode(key.vState.data(), pPrev, key.vState.size(), vEncoded.data());
+    Put(ofs, key.nFrame);
+    Put(ofs, key.nHash);
+    Put(ofs, (uint32_t)key.vState.size());
+    Put(ofs, nEncoded);
+    ofs.write((const char *)vEncoded.data(), nEncoded);
+  }
+
+  if (!ofs) {
+    sError = "could not write " + sFile;
+    return false;
+  }
+  return true;
+}
+
+bool Movie::Load(const std::string &sFile, std::string &sError)
+{
+  std::ifstream ifs(sFile, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    sError = "could not open " + sFile;
+    return false;
+  }
+
+  auto fail = [&]() {
+    sError = sFile + " is not a movie or is damaged";
+    return false;
+  };
+
+  // Read into a movie of its own, which only replaces this one whole
+  Movie m;
+  char sFileMagic[sizeof(sMagic)];
+  uint32_t nFrames = 0, nRomLength = 0, nRuns = 0, nKeys = 0;
+  if (!ifs.read(sFileMagic, sizeof(sFileMagic)) || std::memcmp(sFileMagic, sMagic, sizeof(sMagic)) != 0
+      || !Get(ifs, m.nKeyInterval) || !Get(ifs, nFrames) || !Get(ifs, m.nEndHash)
+      || !Get(ifs, nRomLength) || m.nKeyInterval == 0)
+    return fail();
+  m.sRom.resize(nRomLength);
+  if (!ifs.read(&m.sRom[0], nRomLength) || !Get(ifs, m.nRomCrc32)
+      || !ifs.read((char *)m.vRomSha1, sizeof(m.vRomSha1)))
+    return fail();
+
+  if (!Get(ifs, nRuns))
+    return fail();
+  for (uint32_t r = 0; r < nRuns; r++) {
+    uint32_t nLength = 0;
+    uint8_t nPad1 = 0, nPad2 = 0;
+    if (!Get(ifs, nLength) || !Get(ifs, nPad1) || !Get(ifs, nPad2) || nLength > nFrames - m.vInput[0].size())
+      return fail();
+    m.vInput[0].insert(m.vInput[0].end(), nLength, nPad1);
+    m.vInput[1].insert(m.vInput[1].end(), nLength, nPad2);
+  }
+  if (m.vInput[0].size() != nFrames)
+    return fail();
+
+  if (!Get(ifs, nKeys) || nKeys == 0)
+    return fail();
+  std::vector<uint8_t> vEncoded;
+  for (uint32_t k = 0; k < nKeys; k++) {
+    KEYFRAME key;
+    uint32_t nSize = 0, nEncoded = 0;
+    if (!Get(ifs, key.nFrame) || !Get(ifs, key.nHash) || !Get(ifs, nSize) || !Get(ifs, nEncoded)
+        || key.nFrame != k * m.nKeyInterval || key.nFrame > nFrames)
+      return fail();
+    if (k > 0 && nSize == m.vKeyframes.back().vState.size())
+      key.vState = m.vKeyframes.back().vState;
+    else if (k > 0)
+      return fail();
+    else
+      key.vState.assign(nSize, 0x00);
+
+    vEncoded.resize(nEncoded);
+    if (!ifs.read((char *)vEncoded.data(), nEncoded)
+        || !StateBuffer::Apply(vEncoded.data(), nEncoded, key.vState.data(), key.vState.size()))
+      return fail();
+    m.vKeyframes.push_back(std::move(key));
+  }
+
+  uint32_t nCrc32 = 0;
+  uint8_t vSha1[20];
+  if (!HashRom(m.sRom, nCrc32, vSha1)) {
+    sError = "could not load " + m.sRom + ", which " + sFile + " was recorded on";
+    return false;
+  }
+  if (nCrc32 != m.nRomCrc32 || std::memcmp(vSha1, m.vRomSha1, sizeof(vSha1)) != 0) {
+    sError = sFile + " was recorded on another ROM than " + m.sRom;
+    return false;
+  }
+
+  *this = std::move(m);
+  return true;
+}
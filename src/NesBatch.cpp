@@ -0,0 +1,98 @@
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BatchRunner.h"
+#include "utils.h"
+
+// The PPU's sprites live in the engine's implementation, so it has to be
+// compiled into one translation unit even though no window is opened
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+// Command line front end of BatchRunner. Runs the jobs of a manifest
+// on all cores and writes the results as JSON, to stdout or a file.
+// Exits with 1 if a job failed or did not end with its expected hash.
+
+// More threads than this is surely a typo
+static constexpr uint64_t nMaxWorkers = 1024;
+
+static void Usage()
+{
+  std::cout << "usage: nesbatch <manifest> [-j workers] [-e lookup|fused|cached|jit]"
+               " [--no-pin] [-o results.json]\n";
+}
+
+int main(int argc, char *argv[])
+{
+  std::string sManifest, sOutput;
+  size_t nWorkers = 0;
+  bool bPin = true;
+  nes6502::ENGINE engine = nes6502::FUSED;
+
+  for (int i = 1; i < argc; i++) {
+    std::string sArg = argv[i];
+    bool bValue = i + 1 < argc;
+    if (sArg == "-j" && bValue) {
+      uint64_t n = 0;
+      if (!ParseCount(argv[++i], nMaxWorkers, n)) {
+        Usage();
+        return 2;
+      }
+      nWorkers = (size_t)n;
+    } else if (sArg == "-o" && bValue)
+      sOutput = argv[++i];
+    else if (sArg == "-e" && bValue) {
+      std::string sEngine = argv[++i];
+      if (sEngine == "lookup")
+        engine = nes6502::LOOKUP;
+      else if (sEngine == "fused")
+        engine = nes6502::FUSED;
+      else if (sEngine == "cached")
+        engine = nes6502::CACHED;
+      else if (sEngine == "jit")
+        engine = nes6502::JIT;
+      else {
+        Usage();
+        return 2;
+      }
+    } else if (sArg == "--no-pin")
+      bPin = false;
+    else if (sManifest.empty() && sArg[0] != '-')
+      sManifest = sArg;
+    else {
+      Usage();
+      return 2;
+    }
+  }
+
+  if (sManifest.empty()) {
+    Usage();
+    return 2;
+  }
+
+  std::vector<BatchRunner::JOB> vJobs;
+  std::string sError;
+  if (!BatchRunner::LoadManifest(sManifest, vJobs, sError)) {
+    std::cerr << sError << "\n";
+    return 2;
+  }
+
+  BatchRunner runner(nWorkers, bPin, engine);
+  std::vector<BatchRunner::RESULT> vResults = runner.Run(vJobs);
+  std::string sJson = runner.ToJson(vJobs, vResults);
+
+  if (sOutput.empty())
+    std::cout << sJson;
+  else {
+    std::ofstream ofs(sOutput);
+    ofs << sJson;
+  }
+
+  for (size_t i = 0; i < vResults.size(); i++)
+    if (!vResults[i].bOk || (vJobs[i].bCheckHash && !vResults[i].bHashMatch))
+      return 1;
+  return 0;
+}
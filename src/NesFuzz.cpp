@@ -0,0 +1,248 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Fuzzer.h"
+
+// The PPU's sprites live in the engine's implementation, so it has to be
+// compiled into one translation unit even though no window is opened
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+// Front ends of Fuzzer. Built with NES_LIBFUZZER defined this is a
+// libFuzzer target, which takes the ROM from $NESFUZZ_ROM, and the
+// hex entry point if any from $NESFUZZ_ENTRY, and sees the CPU's
+// coverage as extra counters of its own. Otherwise it is a small
+// standalone coverage guided fuzzer, which mutates a corpus of inputs
+// and keeps those reaching new addresses, or an address a new number
+// of times in AFL's buckets, and reports how many inputs it runs per
+// second.
+
+#ifdef NES_LIBFUZZER
+// libFuzzer clears these before each input and treats them as coverage
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t vCoverage[Fuzzer::nCoverage];
+
+#ifdef NES_LIBFUZZER
+
+static std::unique_ptr<Fuzzer> pFuzzer;
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***)
+{
+  const char *sRom = std::getenv("NESFUZZ_ROM");
+  const char *sEntry = std::getenv("NESFUZZ_ENTRY");
+  int32_t nEntry = sEntry ? (int32_t)std::strtoul(sEntry, nullptr, 16) : Fuzzer::nResetVector;
+  pFuzzer = std::make_unique<Fuzzer>(sRom ? sRom : "", vCoverage, nes6502::FUSED, 128, 16, nEntry);
+  if (!pFuzzer->Ok()) {
+    std::cerr << "set NESFUZZ_ROM to a ROM that can be loaded\n";
+    std::exit(2);
+  }
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t nSize)
+{
+  pFuzzer->Run(pData, nSize);
+  return 0;
+}
+
+#else
+
+static void Usage()
+{
+  std::cout << "usage: nesfuzz <rom> [-n inputs] [-t seconds] [-c cycles per slice]"
+               " [-m max slices] [-p entry] [-s seed] [-o corpus dir]\n"
+               "The entry is a hex address the CPU starts at instead of the reset vector\n";
+}
+
+// AFL's buckets of hit counts, as one bit each
+static uint8_t Bucket(uint8_t nCount)
+{
+  if (nCount <= 3)
+    return nCount == 0 ? 0x00 : 1 << (nCount - 1);
+  if (nCount <= 7)
+    return 0x08;
+  if (nCount <= 15)
+    return 0x10;
+  if (nCount <= 31)
+    return 0x20;
+  return nCount <= 127 ? 0x40 : 0x80;
+}
+
+// Folds the coverage of the last input into vSeen, true if it had any
+// that was not seen before
+static bool Merge(std::vector<uint8_t> &vSeen, size_t &nAddresses)
+{
+  bool bNew = false;
+  for (size_t i = 0; i < Fuzzer::nCoverage; i += 8) {
+    uint64_t nWord;
+    std::memcpy(&nWord, &vCoverage[i], sizeof(nWord));
+    if (nWord == 0)
+      continue;
+    for (size_t a = i; a < i + 8; a++) {
+      uint8_t nBucket = Bucket(vCoverage[a]);
+      if (nBucket & ~vSeen[a]) {
+        nAddresses += vSeen[a] == 0x00;
+        vSeen[a] |= nBucket;
+        bNew = true;
+      }
+    }
+  }
+  return bNew;
+}
+
+static void Mutate(std::vector<uint8_t> &vInput, const std::vector<std::vector<uint8_t>> &vCorpus,
+  size_t nMaxSize, std::mt19937 &rng)
+{
+  auto random = [&](size_t n) { return n ? (size_t)(rng() % n) : 0; };
+
+  uint32_t nMutations = 1 + random(4);
+  for (uint32_t m = 0; m < nMutations; m++) {
+    size_t nRecords = vInput.size() / 3;
+    size_t r = random(nRecords) * 3;
+    switch (random(6)) {
+    case 0:// Random byte
+      if (!vInput.empty())
+        vInput[random(vInput.size())] = (uint8_t)rng();
+      break;
+    case 1:// Flip a bit
+      if (!vInput.empty())
+        vInput[random(vInput.size())] ^= 1 << random(8);
+      break;
+    case 2:// Insert a random record
+      if (vInput.size() + 3 <= nMaxSize) {
+        uint8_t vRecord[3] = { (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng() };
+        vInput.insert(vInput.begin() + r, vRecord, vRecord + 3);
+      }
+      break;
+    case 3:// Drop a record
+      if (nRecords > 1)
+        vInput.erase(vInput.begin() + r, vInput.begin() + r + 3);
+      break;
+    case 4:// Repeat a record
+      if (nRecords > 0 && vInput.size() + 3 <= nMaxSize) {
+        std::vector<uint8_t> vRecord(vInput.begin() + r, vInput.begin() + r + 3);
+        vInput.insert(vInput.begin() + r, vRecord.begin(), vRecord.end());
+      }
+      break;
+    case 5: {// Splice the tail of another input on
+      const std::vector<uint8_t> &vOther = vCorpus[random(vCorpus.size())];
+      size_t o = random(vOther.size() / 3) * 3;
+      vInput.resize(r);
+      vInput.insert(vInput.end(), vOther.begin() + o, vOther.end());
+      vInput.resize(std::min(vInput.size(), nMaxSize));
+      break;
+    }
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  std::string sRom, sCorpus;
+  uint64_t nInputs = ~0ull;
+  double fSeconds = 10.0;
+  uint32_t nSliceCycles = 128, nMaxSlices = 16, nSeed = 1;
+  int32_t nEntry = Fuzzer::nResetVector;
+
+  for (int i = 1; i < argc; i++) {
+    std::string sArg = argv[i];
+    bool bValue = i + 1 < argc;
+    if (sArg == "-n" && bValue)
+      nInputs = std::stoull(argv[++i]);
+    else if (sArg == "-t" && bValue)
+      fSeconds = std::stod(argv[++i]);
+    else if (sArg == "-c" && bValue)
+      nSliceCycles = std::stoul(argv[++i]);
+    else if (sArg == "-m" && bValue)
+      nMaxSlices = std::stoul(argv[++i]);
+    else if (sArg == "-p" && bValue)
+      nEntry = (int32_t)std::stoul(argv[++i], nullptr, 16);
+    else if (sArg == "-s" && bValue)
+      nSeed = std::stoul(argv[++i]);
+    else if (sArg == "-o" && bValue)
+      sCorpus = argv[++i];
+    else if (sRom.empty() && sArg[0] != '-')
+      sRom = sArg;
+    else {
+      Usage();
+      return 2;
+    }
+  }
+  if (sRom.empty()) {
+    Usage();
+    return 2;
+  }
+
+  Fuzzer fuzzer(sRom, vCoverage, nes6502::FUSED, nSliceCycles, nMaxSlices, nEntry);
+  if (!fuzzer.Ok()) {
+    std::cerr << "could not load " << sRom << "\n";
+    return 2;
+  }
+
+  // Restoring the snapshot is all an empty input costs
+  auto tStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < 10000; i++)
+    fuzzer.Run(nullptr, 0);
+  std::chrono::duration<double> tRestore = std::chrono::steady_clock::now() - tStart;
+
+  // Records holding no buttons over a whole input to start from
+  size_t nMaxSize = (size_t)nMaxSlices * 3 * 2;
+  std::vector<std::vector<uint8_t>> vCorpus(1, std::vector<uint8_t>(nMaxSlices * 3, 0x00));
+  std::vector<uint8_t> vSeen(Fuzzer::nCoverage, 0x00), vInput;
+  size_t nAddresses = 0;
+  std::mt19937 rng(nSeed);
+
+  uint64_t nRun = 0, nCycles = 0;
+  tStart = std::chrono::steady_clock::now();
+  auto tReport = tStart;
+  std::chrono::duration<double> tElapsed(0.0);
+  while (nRun < nInputs && tElapsed.count() < fSeconds) {
+    vInput = nRun == 0 ? vCorpus[0] : vCorpus[rng() % vCorpus.size()];
+    if (nRun > 0)
+      Mutate(vInput, vCorpus, nMaxSize, rng);
+
+    std::memset(vCoverage, 0, sizeof(vCoverage));
+    nCycles += fuzzer.Run(vInput.data(), vInput.size());
+    nRun++;
+    if (Merge(vSeen, nAddresses) && nRun > 1)
+      vCorpus.push_back(vInput);
+
+    auto tNow = std::chrono::steady_clock::now();
+    tElapsed = tNow - tStart;
+    if (tNow - tReport >= std::chrono::seconds(1)) {
+      tReport = tNow;
+      std::cout << nRun << " inputs, " << nRun / tElapsed.count() << " inputs/s, " << nAddresses
+                << " addresses, corpus " << vCorpus.size() << "\n";
+    }
+  }
+
+  std::cout << nRun << " inputs in " << tElapsed.count() << " s (" << nRun / tElapsed.count()
+            << " inputs/s, " << nCycles / tElapsed.count() / 1e6 << " M cycles/s), "
+            << nAddresses << " addresses covered, corpus " << vCorpus.size() << ", restoring "
+            << tRestore.count() / 10000 * 1e9 << " ns per input\n";
+
+  if (!sCorpus.empty()) {
+    std::filesystem::create_directories(sCorpus);
+    for (size_t i = 0; i < vCorpus.size(); i++) {
+      std::ofstream ofs(sCorpus + "/" + std::to_string(i) + ".bin", std::ofstream::binary);
+      ofs.write((const char *)vCorpus[i].data(), vCorpus[i].size());
+      if (!ofs) {
+        std::cerr << "could not write the corpus to " << sCorpus << "\n";
+        return 2;
+      }
+    }
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "RomIndex.h"
+#include "utils.h"
+
+// Command line front end of RomIndex. Brings the index of a ROM
+// library up to date, rereading only the files changed since it was
+// last written, and lists it if asked to.
+
+static void Usage()
+{
+  std::cout << "usage: nesindex <rom dir> [-i index file] [-j threads] [-l]\n"
+               "The index file defaults to nesindex.idx in the ROM directory\n";
+}
+
+int main(int argc, char *argv[])
+{
+  std::string sRoot, sIndex;
+  size_t nThreads = 0;
+  bool bList = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string sArg = argv[i];
+    bool bValue = i + 1 < argc;
+    if (sArg == "-i" && bValue)
+      sIndex = argv[++i];
+    else if (sArg == "-j" && bValue)
+      nThreads = std::stoul(argv[++i]);
+    else if (sArg == "-l")
+      bList = true;
+    else if (sRoot.empty() && sArg[0] != '-')
+      sRoot = sArg;
+    else {
+      Usage();
+      return 2;
+    }
+  }
+  if (sRoot.empty()) {
+    Usage();
+    return 2;
+  }
+  if (sIndex.empty())
+    sIndex = (std::filesystem::path(sRoot) / "nesindex.idx").string();
+
+  RomIndex index;
+  std::string sError;
+  auto tStart = std::chrono::steady_clock::now();
+  if (index.Load(sIndex, sError)) {
+    std::chrono::duration<double> tLoad = std::chrono::steady_clock::now() - tStart;
+    std::cout << "loaded " << index.Size() << " entries in " << tLoad.count() * 1000.0 << " ms\n";
+  } else if (std::filesystem::exists(sIndex)) {
+    std::cerr << sError << ", rebuilding it\n";
+  }
+
+  index.Scan(sRoot, nThreads);
+  const RomIndex::STATS &stats = index.LastScan();
+  std::cout << "scanned " << stats.nFiles << " files in " << stats.fSeconds * 1000.0 << " ms, "
+            << stats.nUnchanged << " unchanged, " << stats.nRead << " read\n";
+
+  if (!index.Save(sIndex, sError)) {
+    std::cerr << sError << "\n";
+    return 2;
+  }
+
+  if (bList) {
+    for (size_t i = 0; i < index.Size(); i++) {
+      const RomIndex::ENTRY &e = index[i];
+      if (!(e.nFlags & RomIndex::VALID)) {
+        std::cout << "invalid " << index.Path(e) << "\n";
+        continue;
+      }
+      std::string sSha1;
+      for (uint8_t b : e.vSha1)
+        sSha1 += hex(b, 2);
+      std::cout << "mapper " << hex(e.nMapperID, 3) << " prg " << hex(e.nPRGSize / 1024, 4) << "K chr "
+                << hex(e.nCHRSize / 1024, 4) << "K " << hex(e.nCrc32, 8) << " " << sSha1 << " "
+                << index.Path(e) << "\n";
+    }
+  }
+  return 0;
+}
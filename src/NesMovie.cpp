@@ -0,0 +1,162 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bus.h"
+#include "Movie.h"
+#include "utils.h"
+
+// The PPU's sprites live in the engine's implementation, so it has to be
+// compiled into one translation unit even though no window is opened
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+// Command line front end of Movie. Records a movie of a ROM run with
+// the buttons of an input file, verifies a movie on all cores, or
+// seeks into one. Exits with 1 if a movie does not verify.
+
+static void Usage()
+{
+  std::cout << "usage: nesmovie record <rom> <frames> [-i input] [-k interval] -o <movie>\n"
+               "       nesmovie verify <movie> [-j workers]\n"
+               "       nesmovie seek <movie> <frame>\n"
+               "The input file holds one byte of controller 1 buttons per frame\n";
+}
+
+static std::string Hex64(uint64_t n)
+{
+  return hex((uint32_t)(n >> 32), 8) + hex((uint32_t)n, 8);
+}
+
+static int Record(const std::string &sRom, uint32_t nFrames, const std::string &sInput,
+  uint32_t nKeyInterval, const std::string &sMovie)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid()) {
+    std::cerr << "could not load " << sRom << "\n";
+    return 2;
+  }
+
+  std::vector<uint8_t> vInput;
+  if (!sInput.empty()) {
+    std::ifstream ifs(sInput, std::ifstream::binary);
+    if (!ifs.is_open()) {
+      std::cerr << "could not open " << sInput << "\n";
+      return 2;
+    }
+    vInput.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  }
+
+  auto nes = std::make_unique<Bus>();
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->ppu.SetRender(false);
+  nes->reset();
+
+  Movie movie;
+  movie.Start(*nes, sRom, nKeyInterval);
+  for (uint32_t f = 0; f < nFrames; f++)
+    movie.RecordFrame(*nes, vInput.empty() ? 0x00 : vInput[std::min<size_t>(f, vInput.size() - 1)]);
+
+  std::string sError;
+  if (!movie.Save(sMovie, sError)) {
+    std::cerr << sError << "\n";
+    return 2;
+  }
+  std::cout << "recorded " << nFrames << " frames, ending with " << Hex64(movie.EndHash()) << "\n";
+  return 0;
+}
+
+static int Verify(const Movie &movie, size_t nWorkers)
+{
+  BatchRunner runner(nWorkers);
+  std::vector<BatchRunner::RESULT> vResults = movie.Verify(runner);
+
+  size_t nFailed = 0;
+  for (size_t i = 0; i < vResults.size(); i++) {
+    if (vResults[i].bOk && vResults[i].bHashMatch)
+      continue;
+    nFailed++;
+    std::cout << "stretch " << i << ": "
+              << (vResults[i].bOk ? "ends with " + Hex64(vResults[i].nHash) : vResults[i].sError) << "\n";
+  }
+
+  std::cout << vResults.size() << " stretches, " << nFailed << " failed, " << movie.Frames()
+            << " frames in " << runner.Seconds() << " s on " << runner.Workers() << " workers ("
+            << movie.Frames() / runner.Seconds() << " frames/s)\n";
+  return nFailed ? 1 : 0;
+}
+
+static int Seek(Movie &movie, uint32_t nFrame)
+{
+  auto cart = std::make_shared<Cartridge>(movie.Rom());
+  if (!cart->ImageValid()) {
+    std::cerr << "could not load " << movie.Rom() << "\n";
+    return 2;
+  }
+  auto nes = std::make_unique<Bus>();
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->reset();
+
+  auto tStart = std::chrono::steady_clock::now();
+  if (!movie.Seek(*nes, nFrame)) {
+    std::cerr << "could not seek to frame " << nFrame << " of " << movie.Frames() << "\n";
+    return 2;
+  }
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+
+  std::cout << "seeked to frame " << nFrame << " in " << tElapsed.count() * 1000.0
+            << " ms, machine hash " << Hex64(BatchRunner::HashState(*nes)) << "\n";
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<std::string> vArgs;
+  std::string sInput, sOutput;
+  uint32_t nKeyInterval = 600;
+  size_t nWorkers = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string sArg = argv[i];
+    bool bValue = i + 1 < argc;
+    if (sArg == "-i" && bValue)
+      sInput = argv[++i];
+    else if (sArg == "-o" && bValue)
+      sOutput = argv[++i];
+    else if (sArg == "-k" && bValue)
+      nKeyInterval = std::stoul(argv[++i]);
+    else if (sArg == "-j" && bValue)
+      nWorkers = std::stoul(argv[++i]);
+    else if (sArg[0] != '-')
+      vArgs.push_back(sArg);
+    else {
+      Usage();
+      return 2;
+    }
+  }
+
+  if (vArgs.size() == 3 && vArgs[0] == "record" && !sOutput.empty())
+    return Record(vArgs[1], std::stoul(vArgs[2]), sInput, nKeyInterval, sOutput);
+
+  if ((vArgs.size() == 2 && vArgs[0] == "verify") || (vArgs.size() == 3 && vArgs[0] == "seek")) {
+    Movie movie;
+    std::string sError;
+    if (!movie.Load(vArgs[1], sError)) {
+      std::cerr << sError << "\n";
+      return 2;
+    }
+    if (vArgs[0] == "verify")
+      return Verify(movie, nWorkers);
+    return Seek(movie, std::stoul(vArgs[2]));
+  }
+
+  Usage();
+  return 2;
+}
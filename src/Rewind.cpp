@@ -0,0 +1,118 @@
+#include "Rewind.h"
+#include "Bus.h"
+
+#include <algorithm>
+
+Rewind::Rewind(Bus &n, size_t nBudgetBytes, uint32_t nKey)
+  : nes(n), nKeyInterval(std::max(nKey, 1u)), vRing(nBudgetBytes), vRecords(1024)
+{
+}
+
+void Rewind::Clear()
+{
+  nFirst = 0;
+  nCount = 0;
+  nWrite = 0;
+  nBytesUsed = 0;
+  nSinceKey = 0;
+}
+
+void Rewind::DropOldestKey()
+{
+  do {
+    nBytesUsed -= Record(0).nSize;
+    nFirst = (nFirst + 1) & (vRecords.size() - 1);
+    nCount--;
+  } while (nCount > 0 && !Record(0).bKey);
+}
+
+uint32_t Rewind::Allocate(size_t nSize)
+{
+  while (nCount > 0) {
+    // Records lie in the ring in the order they were pushed, so they
+    // have either not wrapped yet, leaving room after the newest and
+    // before the oldest, or they have, leaving room in between
+    uint32_t nTail = Record(0).nOffset;
+    bool bWrapped = Record(nCount - 1).nOffset < nTail;
+    if (!bWrapped) {
+      if (nWrite + nSize <= vRing.size())
+        return nWrite;
+      if (nSize <= nTail)
+        return 0;
+    } else if (nWrite + nSize <= nTail) {
+      return nWrite;
+    }
+    DropOldestKey();
+  }
+  return 0;
+}
+
+void Rewind::Push()
+{
+  size_t nState = nes.StateSize();
+  if (vHead.size() != nState) {
+    Clear();
+    vHead.assign(nState, 0x00);
+    vNext.assign(nState, 0x00);
+  }
+  // The budget has to hold at least a keyframe
+  size_t nMax = StateBuffer::MaxEncoded(nState);
+  if (nMax > vRing.size())
+    return;
+
+  nes.saveState(vNext.data(), vNext.size());
+
+  if (nCount == vRecords.size()) {
+    std::vector<RECORD> vGrown(vRecords.size() * 2);
+    for (size_t i = 0; i < nCount; i++)
+      vGrown[i] = Record(i);
+    vRecords.swap(vGrown);
+    nFirst = 0;
+  }
+
+  uint32_t nOffset = Allocate(nMax);
+  // Making room may have dropped what a delta would be against
+  bool bKey = nCount == 0 || nSinceKey + 1 >= nKeyInterval;
+  size_t nSize = StateBuffer::Encode(vNext.data(), bKey ? nullptr : vHead.data(), nState, &vRing[nOffset]);
+
+  Record(nCount++) = { nOffset, (uint32_t)nSize, bKey };
+  nWrite = nOffset + (uint32_t)nSize;
+  nBytesUsed += nSize;
+  nSinceKey = bKey ? 0 : nSinceKey + 1;
+  vHead.swap(vNext);
+}
+
+bool Rewind::Back()
+{
+  if (nCount == 0)
+    return false;
+  if (!nes.loadState(vHead.data(), vHead.size())) {
+    Clear();
+    return false;
+  }
+
+  RECORD r = Record(--nCount);
+  nBytesUsed -= r.nSize;
+  if (nCount == 0) {
+    Clear();
+    return true;
+  }
+
+  // The newest snapshot now is the one before, which is one delta
+  // away unless the dropped one was a keyframe. Then it is decoded
+  // forward from the keyframe before it
+  if (!r.bKey) {
+    StateBuffer::Apply(&vRing[r.nOffset], r.nSize, vHead.data(), vHead.size());
+    nSinceKey--;
+  } else {
+    size_t nKey = nCount - 1;
+    while (!Record(nKey).bKey)
+      nKey--;
+    std::fill(vHead.begin(), vHead.end(), 0x00);
+    for (size_t i = nKey; i < nCount; i++)
+      StateBuffer::Apply(&vRing[Record(i).nOffset], Record(i).nSize, vHead.data(), vHead.size());
+    nSinceKey = (uint32_t)(nCount - 1 - nKey);
+  }
+  nWrite = Record(nCount - 1).nOffset + Record(nCount - 1).nSize;
+  return true;
+}
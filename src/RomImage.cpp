@@ -0,0 +1,121 @@
+#include "RomImage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+RomImage::RomImage(const std::string &sFileName)
+  : file(sFileName)
+{
+  pData = file.Data();
+  nSize = file.Size();
+  bValid = pData != nullptr && Parse();
+}
+
+std::shared_ptr<const RomImage> RomImage::Load(const std::string &sFileName)
+{
+  static std::mutex mux;
+  static std::unordered_map<uint64_t, std::weak_ptr<const RomImage>> mapImages;
+
+  // The file has to be opened to be hashed. If it turns out to be
+  // cached this image is dropped again, which only unmaps it
+  auto pImage = std::make_shared<RomImage>(sFileName);
+  if (!pImage->Valid())
+    return pImage;
+  pImage->nHash = ContentHash(pImage->pData, pImage->nSize);
+
+  std::lock_guard<std::mutex> lock(mux);
+  std::weak_ptr<const RomImage> &wpCached = mapImages[pImage->Hash()];
+  std::shared_ptr<const RomImage> pCached = wpCached.lock();
+  // Two ROMs with the same hash are told apart, the later one then
+  // takes over the slot
+  if (pCached && pCached->nSize == pImage->nSize && std::memcmp(pCached->pData, pImage->pData, pImage->nSize) == 0)
+    return pCached;
+  // The mappers address the RAM in 8KB, the whole of $6000-$7FFF or a
+  // pattern memory, so less than that is rounded up to it
+  if (pImage->nPRGRamSize)
+    pImage->pBlankPRGRam = std::make_shared<std::vector<uint8_t>>(std::max<size_t>(pImage->nPRGRamSize, 8192), 0x00);
+  if (pImage->nCHRRamSize)
+    pImage->pBlankCHRRam = std::make_shared<std::vector<uint8_t>>(std::max<size_t>(pImage->nCHRRamSize, 8192), 0x00);
+  wpCached = pImage;
+
+  // Forget the images nobody runs any more
+  for (auto it = mapImages.begin(); it != mapImages.end();)
+    it = it->second.expired() ? mapImages.erase(it) : std::next(it);
+  return pImage;
+}
+
+// Hashes the file a word at a time, FNV-1a would take a byte
+uint64_t RomImage::ContentHash(const uint8_t *p, size_t n)
+{
+  uint64_t h = 0xCBF29CE484222325 ^ n;
+  auto add = [&](uint64_t w) {
+    h = (h ^ w) * 0x9E3779B97F4A7C15;
+    h ^= h >> 32;
+  };
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    std::memcpy(&w, p + i, sizeof(w));
+    add(w);
+  }
+  for (; i < n; i++)
+    add(p[i]);
+  return h;
+}
+
+// NES 2.0 sizes are 12 bit counts of units, unless the upper nibble is
+// $F, when the lower byte holds an exponent and an odd multiplier
+static size_t Nes20Size(uint8_t nLsb, uint8_t nMsb, size_t nUnit)
+{
+  if (nMsb == 0x0F)
+    return ((size_t)1 << (nLsb >> 2)) * ((nLsb & 0x03) * 2 + 1);
+  return (((size_t)nMsb << 8) | nLsb) * nUnit;
+}
+
+bool RomImage::Parse()
+{
+  // iNES format header
+  //   0-3  "NES" $1A
+  //   4    PRG ROM in 16KB units
+  //   5    CHR ROM in 8KB units, 0 for CHR RAM
+  //   6    mapper bits 0-3, four screen, trainer, battery, mirroring
+  //   7    mapper bits 4-7, NES 2.0 identifier
+  //   8-11 NES 2.0: mapper bits 8-11, size MSBs, PRG and CHR RAM
+  if (nSize < 16 || std::memcmp(pData, "NES\x1A", 4) != 0)
+    return false;
+  const uint8_t *h = pData;
+
+  bNes20 = (h[7] & 0x0C) == 0x08;
+  nMapperID = (h[7] & 0xF0) | (h[6] >> 4);
+  bVertical = h[6] & 0x01;
+  bBattery = h[6] & 0x02;
+  bFourScreen = h[6] & 0x08;
+  if (bNes20) {
+    nMapperID |= (h[8] & 0x0F) << 8;
+    nPRGSize = Nes20Size(h[4], h[9] & 0x0F, 16384);
+    nCHRSize = Nes20Size(h[5], h[9] >> 4, 8192);
+    // Shift counts of 64 bytes, battery backed or not
+    uint8_t nPRGRam = std::max(h[10] & 0x0F, h[10] >> 4);
+    uint8_t nCHRRam = std::max(h[11] & 0x0F, h[11] >> 4);
+    nPRGRamSize = nPRGRam ? (size_t)64 << nPRGRam : 0;
+    nCHRRamSize = nCHRRam ? (size_t)64 << nCHRRam : 0;
+  } else {
+    nPRGSize = (size_t)h[4] * 16384;
+    nCHRSize = (size_t)h[5] * 8192;
+    nPRGRamSize = 8192;
+    nCHRRamSize = nCHRSize ? 0 : 8192;
+  }
+
+  // A trainer of 512 bytes may sit between the header and PRG ROM
+  size_t nOffset = 16 + ((h[6] & 0x04) ? 512 : 0);
+  // Each size is checked on its own too, as exponents up to 63 could
+  // make the sum wrap around
+  if (nPRGSize > nSize || nCHRSize > nSize || nOffset + nPRGSize + nCHRSize > nSize)
+    return false;
+  pPRG = pData + nOffset;
+  pCHR = nCHRSize ? pPRG + nPRGSize : nullptr;
+  return true;
+}
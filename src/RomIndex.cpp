@@ -0,0 +1,355 @@
+#include "RomIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#ifdef __SHA__
+#include <immintrin.h>
+#endif
+
+#include "RomImage.h"
+
+// Index file layout: this header, the entries, then the path table
+struct INDEX_HEADER
+{
+  char sMagic[8];
+  uint32_t nEntrySize;// Also tells a file of the other byte order apart
+  uint32_t nEntries;
+  uint64_t nPathsSize;
+};
+
+static const char sMagic[8] = { 'N', 'E', 'S', 'I', 'D', 'X', '2', 0 };
+
+static_assert(sizeof(RomIndex::ENTRY) == 72, "index entries are laid out as in the file");
+static_assert(sizeof(INDEX_HEADER) % alignof(RomIndex::ENTRY) == 0, "entries follow the header aligned");
+
+bool RomIndex::Load(const std::string &sFile, std::string &sError)
+{
+  auto pNew = std::make_unique<MappedFile>(sFile);
+  if (!pNew->Data()) {
+    sError = "could not open " + sFile;
+    return false;
+  }
+
+  auto fail = [&]() {
+    sError = sFile + " is not a ROM index or is damaged";
+    return false;
+  };
+
+  INDEX_HEADER header;
+  if (pNew->Size() < sizeof(header))
+    return fail();
+  std::memcpy(&header, pNew->Data(), sizeof(header));
+  if (std::memcmp(header.sMagic, sMagic, sizeof(sMagic)) != 0 || header.nEntrySize != sizeof(ENTRY)
+      || pNew->Size() != sizeof(header) + (uint64_t)header.nEntries * sizeof(ENTRY) + header.nPathsSize)
+    return fail();
+
+  // The entries are used where they are mapped, only their paths are
+  // checked to be inside the table
+  const ENTRY *pNewEntries = (const ENTRY *)(pNew->Data() + sizeof(header));
+  for (size_t i = 0; i < header.nEntries; i++)
+    if ((uint64_t)pNewEntries[i].nPath + pNewEntries[i].nPathLength > header.nPathsSize)
+      return fail();
+
+  pFile = std::move(pNew);
+  vEntries.clear();
+  sPaths.clear();
+  pEntries = pNewEntries;
+  pPaths = (const char *)(pEntries + header.nEntries);
+  nEntries = header.nEntries;
+  nPathsSize = header.nPathsSize;
+  return true;
+}
+
+bool RomIndex::Save(const std::string &sFile, std::string &sError) const
+{
+  std::string sTemp = sFile + ".tmp";
+  {
+    std::ofstream ofs(sTemp, std::ofstream::binary);
+    if (!ofs.is_open()) {
+      sError = "could not create " + sTemp;
+      return false;
+    }
+
+    INDEX_HEADER header;
+    std::memcpy(header.sMagic, sMagic, sizeof(sMagic));
+    header.nEntrySize = sizeof(ENTRY);
+    header.nEntries = (uint32_t)nEntries;
+    header.nPathsSize = nPathsSize;
+    ofs.write((const char *)&header, sizeof(header));
+    ofs.write((const char *)pEntries, nEntries * sizeof(ENTRY));
+    ofs.write(pPaths, nPathsSize);
+    if (!ofs) {
+      sError = "could not write " + sTemp;
+      return false;
+    }
+  }
+
+  if (std::rename(sTemp.c_str(), sFile.c_str()) != 0) {
+    std::remove(sTemp.c_str());
+    sError = "could not replace " + sFile;
+    return false;
+  }
+  return true;
+}
+
+const RomIndex::ENTRY *RomIndex::Find(const std::string &sPath) const
+{
+  auto path = [&](const ENTRY &e) { return std::string_view(pPaths + e.nPath, e.nPathLength); };
+  const ENTRY *p = std::lower_bound(pEntries, pEntries + nEntries, sPath,
+    [&](const ENTRY &e, const std::string &s) { return path(e) < s; });
+  return p != pEntries + nEntries && path(*p) == sPath ? p : nullptr;
+}
+
+void RomIndex::Scan(const std::string &sRoot, size_t nThreads)
+{
+  namespace fs = std::filesystem;
+  auto tStart = std::chrono::steady_clock::now();
+
+  // Listing the tree is cheap next to looking at the files, which is
+  // left to the workers
+  std::vector<std::string> vFiles;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator it(sRoot, fs::directory_options::skip_permission_denied, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    std::string sExt = it->path().extension().string();
+    std::transform(sExt.begin(), sExt.end(), sExt.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (sExt == ".nes" && it->is_regular_file(ec))
+      vFiles.push_back(it->path().lexically_relative(sRoot).generic_string());
+  }
+  std::sort(vFiles.begin(), vFiles.end());
+
+  std::vector<ENTRY> vNew(vFiles.size());
+  std::atomic<size_t> nNext{ 0 }, nUnchanged{ 0 };
+  auto worker = [&]() {
+    for (size_t i; (i = nNext++) < vFiles.size();) {
+      ENTRY &e = vNew[i];
+      e = ENTRY{};
+      std::string sFile = (fs::path(sRoot) / vFiles[i]).string();
+      std::error_code ecFile;
+      e.nFileSize = fs::file_size(sFile, ecFile);
+      e.nModified = fs::last_write_time(sFile, ecFile).time_since_epoch().count();
+      if (ecFile)
+        continue;
+
+      // The loaded index stays as it is until the scan is over
+      const ENTRY *pOld = Find(vFiles[i]);
+      if (pOld && pOld->nFileSize == e.nFileSize && pOld->nModified == e.nModified) {
+        e = *pOld;
+        nUnchanged++;
+        continue;
+      }
+
+      RomImage rom(sFile);
+      if (!rom.Valid())
+        continue;
+      e.nFlags = VALID | (rom.Nes20() ? NES20 : 0) | (rom.VerticalMirror() ? VERTICAL : 0)
+                 | (rom.Battery() ? BATTERY : 0) | (rom.FourScreen() ? FOUR_SCREEN : 0);
+      e.nMapperID = rom.MapperID();
+      e.nPRGSize = (uint32_t)rom.PRGSize();
+      e.nCHRSize = (uint32_t)rom.CHRSize();
+      e.nPRGRamSize = (uint32_t)rom.PRGRamSize();
+      e.nCHRRamSize = (uint32_t)rom.CHRRamSize();
+      // CHR ROM follows PRG ROM in the file
+      e.nCrc32 = Crc32(rom.PRG(), rom.PRGSize() + rom.CHRSize());
+      Sha1(rom.PRG(), rom.PRGSize() + rom.CHRSize(), e.vSha1);
+    }
+  };
+
+  if (nThreads == 0)
+    nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  nThreads = std::min(nThreads, std::max<size_t>(vFiles.size(), 1));
+  std::vector<std::thread> vThreads;
+  for (size_t t = 0; t < nThreads; t++)
+    vThreads.emplace_back(worker);
+  for (auto &t : vThreads)
+    t.join();
+
+  std::string sNewPaths;
+  for (size_t i = 0; i < vFiles.size(); i++) {
+    vNew[i].nPath = (uint32_t)sNewPaths.size();
+    vNew[i].nPathLength = (uint32_t)vFiles[i].size();
+    sNewPaths += vFiles[i];
+  }
+
+  vEntries = std::move(vNew);
+  sPaths = std::move(sNewPaths);
+  pFile.reset();
+  pEntries = vEntries.data();
+  pPaths = sPaths.data();
+  nEntries = vEntries.size();
+  nPathsSize = sPaths.size();
+
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+  stats.nFiles = vFiles.size();
+  stats.nUnchanged = nUnchanged;
+  stats.nRead = stats.nFiles - stats.nUnchanged;
+  stats.fSeconds = tElapsed.count();
+}
+
+// Slicing by 8: eight tables let the CRC of eight bytes be looked up
+// at once rather than one byte after the other. Words are loaded
+// little endian
+struct CRC_TABLES
+{
+  uint32_t t[8][256];
+
+  CRC_TABLES()
+  {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+        c = (c >> 1) ^ (c & 1 ? 0xEDB88320 : 0);
+      t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+      for (int k = 1; k < 8; k++)
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+  }
+};
+
+static const CRC_TABLES crc;
+
+uint32_t RomIndex::Crc32(const uint8_t *p, size_t n, uint32_t nCrc)
+{
+  const auto &t = crc.t;
+  nCrc = ~nCrc;
+  for (; n >= 8; p += 8, n -= 8) {
+    uint32_t a, b;
+    std::memcpy(&a, p, 4);
+    std::memcpy(&b, p + 4, 4);
+    a ^= nCrc;
+    nCrc = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24]
+           ^ t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+  }
+  for (; n > 0; p++, n--)
+    nCrc = t[0][(nCrc ^ *p) & 0xFF] ^ (nCrc >> 8);
+  return ~nCrc;
+}
+
+#ifdef __SHA__
+
+// Four of the 80 rounds of a block with the SHA extensions, which
+// keep the message schedule four words ahead of the rounds. The
+// rounds alternate between the two E registers
+template <int g>
+static inline void Sha1Group(__m128i &abcd, __m128i (&e)[2], __m128i (&m)[4], const uint8_t *p, __m128i mask)
+{
+  __m128i &w = m[g % 4];
+  if constexpr (g < 4)
+    w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * g)), mask);
+  if constexpr (g == 0)
+    e[0] = _mm_add_epi32(e[0], w);
+  else
+    e[g % 2] = _mm_sha1nexte_epu32(e[g % 2], w);
+  e[(g + 1) % 2] = abcd;
+  if constexpr (g >= 3 && g <= 18)
+    m[(g + 1) % 4] = _mm_sha1msg2_epu32(m[(g + 1) % 4], w);
+  abcd = _mm_sha1rnds4_epu32(abcd, e[g % 2], g / 5);
+  if constexpr (g >= 1 && g <= 16)
+    m[(g + 3) % 4] = _mm_sha1msg1_epu32(m[(g + 3) % 4], w);
+  if constexpr (g >= 2 && g <= 17)
+    m[(g + 2) % 4] = _mm_xor_si128(m[(g + 2) % 4], w);
+}
+
+template <int... g>
+static inline void Sha1Groups(__m128i &abcd, __m128i (&e)[2], __m128i (&m)[4], const uint8_t *p, __m128i mask,
+  std::integer_sequence<int, g...>)
+{
+  (Sha1Group<g>(abcd, e, m, p, mask), ...);
+}
+
+static void Sha1Blocks(uint32_t h[5], const uint8_t *p, size_t nBlocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607, 0x08090A0B0C0D0E0F);
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1B);
+  __m128i e0 = _mm_set_epi32((int)h[4], 0, 0, 0);
+
+  for (; nBlocks > 0; nBlocks--, p += 64) {
+    __m128i abcdSaved = abcd;
+    __m128i e[2] = { e0, e0 }, m[4];
+    Sha1Groups(abcd, e, m, p, mask, std::make_integer_sequence<int, 20>());
+    e0 = _mm_sha1nexte_epu32(e[0], e0);
+    abcd = _mm_add_epi32(abcd, abcdSaved);
+  }
+
+  _mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1B));
+  h[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#else
+
+static void Sha1Blocks(uint32_t h[5], const uint8_t *p, size_t nBlocks)
+{
+  auto rol = [](uint32_t x, int s) { return (x << s) | (x >> (32 - s)); };
+
+  for (; nBlocks > 0; nBlocks--, p += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+      w[i] = ((uint32_t)p[4 * i] << 24) | (p[4 * i + 1] << 16) | (p[4 * i + 2] << 8) | p[4 * i + 3];
+    for (int i = 16; i < 80; i++)
+      w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+}
+
+#endif
+
+void RomIndex::Sha1(const uint8_t *p, size_t n, uint8_t vDigest[20])
+{
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  Sha1Blocks(h, p, n / 64);
+
+  // The last bytes, a 1 bit, and the length in bits, padded to one or
+  // two whole blocks
+  uint8_t vTail[128] = {};
+  size_t nRest = n % 64;
+  if (nRest)
+    std::memcpy(vTail, p + n - nRest, nRest);
+  vTail[nRest] = 0x80;
+  size_t nTail = nRest + 9 <= 64 ? 64 : 128;
+  uint64_t nBits = (uint64_t)n * 8;
+  for (int k = 0; k < 8; k++)
+    vTail[nTail - 1 - k] = (uint8_t)(nBits >> (8 * k));
+  Sha1Blocks(h, vTail, nTail / 64);
+
+  for (int k = 0; k < 20; k++)
+    vDigest[k] = (uint8_t)(h[k / 4] >> (24 - 8 * (k % 4)));
+}
@@ -0,0 +1,35 @@
+#include "RunAhead.h"
+
+#include <chrono>
+
+RunAhead::RunAhead(Bus &n, uint32_t nAhead)
+  : nes(n), nFrames(nAhead)
+{
+}
+
+Bus::STATS RunAhead::runFrame()
+{
+  if (nFrames == 0) {
+    Bus::STATS stats = nes.runFrame();
+    fSeconds = stats.fSeconds;
+    return stats;
+  }
+
+  auto tStart = std::chrono::steady_clock::now();
+  bool bRender = nes.ppu.GetRender();
+  nes.ppu.SetRender(false);
+  Bus::STATS stats = nes.runFrame();
+
+  vState.resize(nes.StateSize());
+  nes.saveState(vState.data(), vState.size());
+  for (uint32_t i = 1; i <= nFrames; i++) {
+    nes.ppu.SetRender(bRender && i == nFrames);
+    nes.runFrame();
+  }
+  nes.loadState(vState.data(), vState.size());
+  nes.ppu.SetRender(bRender);
+
+  std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tStart;
+  fSeconds = tElapsed.count();
+  return stats;
+}
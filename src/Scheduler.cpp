@@ -0,0 +1,59 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <functional>
+
+void Scheduler::Schedule(EVENT e, uint64_t nTime)
+{
+  vDue[e] = nTime;
+  vHeap.push_back({ nTime, e });
+  std::push_heap(vHeap.begin(), vHeap.end(), std::greater<ENTRY>());
+}
+
+void Scheduler::Cancel(EVENT e)
+{
+  vDue[e] = nNever;
+}
+
+void Scheduler::Clear()
+{
+  vHeap.clear();
+  vDue.fill(nNever);
+}
+
+void Scheduler::Prune()
+{
+  while (!vHeap.empty() && vHeap.front().nTime != vDue[vHeap.front().e]) {
+    std::pop_heap(vHeap.begin(), vHeap.end(), std::greater<ENTRY>());
+    vHeap.pop_back();
+  }
+}
+
+uint64_t Scheduler::NextTime()
+{
+  Prune();
+  return vHeap.empty() ? nNever : vHeap.front().nTime;
+}
+
+void Scheduler::State(StateBuffer &s)
+{
+  s(vDue);
+  if (s.Loading()) {
+    vHeap.clear();
+    for (uint8_t e = 0; e < nEvents; e++)
+      if (vDue[e] != nNever) {
+        vHeap.push_back({ vDue[e], (EVENT)e });
+        std::push_heap(vHeap.begin(), vHeap.end(), std::greater<ENTRY>());
+      }
+  }
+}
+
+Scheduler::EVENT Scheduler::Pop()
+{
+  Prune();
+  EVENT e = vHeap.front().e;
+  std::pop_heap(vHeap.begin(), vHeap.end(), std::greater<ENTRY>());
+  vHeap.pop_back();
+  vDue[e] = nNever;
+  return e;
+}
@@ -0,0 +1,76 @@
+#include "StateBuffer.h"
+
+static size_t PutVarint(uint8_t *out, size_t v)
+{
+  size_t o = 0;
+  for (; v >= 0x80; v >>= 7)
+    out[o++] = (uint8_t)(v | 0x80);
+  out[o++] = (uint8_t)v;
+  return o;
+}
+
+static bool GetVarint(const uint8_t *&in, const uint8_t *end, size_t &v)
+{
+  v = 0;
+  for (uint32_t shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t b = *in++;
+    v |= (size_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static uint64_t Load64(const uint8_t *p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+size_t StateBuffer::Encode(const uint8_t *a, const uint8_t *b, size_t nBytes, uint8_t *out)
+{
+  auto x = [&](size_t i) -> uint8_t { return b ? a[i] ^ b[i] : a[i]; };
+
+  size_t i = 0, o = 0;
+  while (i < nBytes) {
+    // Most of a frame's delta is zero, skip it a word at a time
+    size_t nZeroStart = i;
+    while (i + 8 <= nBytes && Load64(a + i) == (b ? Load64(b + i) : 0))
+      i += 8;
+    while (i < nBytes && x(i) == 0)
+      i++;
+    if (i == nBytes)
+      break;
+
+    // Literals run until three zero bytes in a row, which are cheaper
+    // to encode as a zero run
+    size_t nLitStart = i;
+    while (i < nBytes && !(i + 2 < nBytes && x(i) == 0 && x(i + 1) == 0 && x(i + 2) == 0))
+      i++;
+
+    o += PutVarint(out + o, nLitStart - nZeroStart);
+    o += PutVarint(out + o, i - nLitStart);
+    for (size_t k = nLitStart; k < i; k++)
+      out[o++] = x(k);
+  }
+  return o;
+}
+
+bool StateBuffer::Apply(const uint8_t *in, size_t nSize, uint8_t *dst, size_t nBytes)
+{
+  const uint8_t *end = in + nSize;
+  size_t nPos = 0;
+  while (in < end) {
+    size_t nZero = 0, nLit = 0;
+    if (!GetVarint(in, end, nZero) || !GetVarint(in, end, nLit)
+        || nLit > (size_t)(end - in) || nZero > nBytes - nPos || nLit > nBytes - nPos - nZero)
+      return false;
+    nPos += nZero;
+    for (size_t k = 0; k < nLit; k++)
+      dst[nPos + k] ^= in[k];
+    in += nLit;
+    nPos += nLit;
+  }
+  return true;
+}
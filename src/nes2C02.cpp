@@ -1,5 +1,9 @@
 #include "nes2C02.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+
 nes2C02::nes2C02()
 {
   palScreen[0x00] = olc::Pixel(84, 84, 84);
@@ -86,12 +90,96 @@ olc::Sprite &nes2C02::GetPatternTable(uint8_t i)
   return sprPatternTable[i];
 }
 
+void nes2C02::reset()
+{
+  scanline = 0;
+  cycle = 0;
+  frame_complete = false;
+  nDot = 0;
+  nNoise = 0x2C02;
+}
+
+void nes2C02::PowerUp()
+{
+  tblName.Fill(0x00);
+  std::memset(tblPalette, 0x00, sizeof(tblPalette));
+  reset();
+}
+
+void nes2C02::State(StateBuffer &s)
+{
+  // tblPattern is left out, the pattern tables are the cartridge's
+  tblName.State(s);
+  s(tblPalette);
+  s(scanline);
+  s(cycle);
+  s(nDot);
+  s(nNoise);
+  s(frame_complete);
+}
+
+void nes2C02::Fork(nes2C02 &child)
+{
+  tblName.Fork(child.tblName);
+  // The palette is smaller than a page, so it is simply copied
+  std::memcpy(child.tblPalette, tblPalette, sizeof(tblPalette));
+  child.scanline = scanline;
+  child.cycle = cycle;
+  child.nDot = nDot;
+  child.nNoise = nNoise;
+  child.frame_complete = frame_complete;
+}
+
+void nes2C02::SkipNoise(uint64_t nSteps)
+{
+  // A matrix step costs a pass over its 32 columns for every set bit
+  // of nSteps, which only beats stepping one at a time on long skips.
+  // The spans between instrs are a few dots
+  if (nSteps < nNoiseDirectSteps) {
+    while (nSteps--)
+      NextNoise();
+    return;
+  }
+
+  // A 32x32 bit matrix as the images of the 32 unit vectors
+  using MATRIX = std::array<uint32_t, 32>;
+  auto apply = [](const MATRIX &m, uint32_t v) {
+    uint32_t r = 0;
+    for (uint32_t j = 0; j < 32; j++)
+      r ^= m[j] & (0u - ((v >> j) & 1));
+    return r;
+  };
+
+  // The step's matrix raised to each power of two
+  static const std::array<MATRIX, 64> vPowers = [apply] {
+    std::array<MATRIX, 64> p;
+    for (uint32_t j = 0; j < 32; j++) {
+      uint32_t v = 1u << j;
+      v ^= v << 13;
+      v ^= v >> 17;
+      v ^= v << 5;
+      p[0][j] = v;
+    }
+    for (uint32_t i = 1; i < 64; i++)
+      for (uint32_t j = 0; j < 32; j++)
+        p[i][j] = apply(p[i - 1], p[i - 1][j]);
+    return p;
+  }();
+
+  for (uint32_t i = 0; nSteps; i++, nSteps >>= 1)
+    if (nSteps & 1)
+      nNoise = apply(vPowers[i], nNoise);
+}
+
 void nes2C02::clock()
 {
-  // Fake some noise for now
-  sprScreen.SetPixel(cycle - 1, scanline, palScreen[(rand() % 2) ? 0x3F : 0x30]);
+  // Fake some noise for now, from a xorshift generator
+  uint32_t nPixel = NextNoise();
+  if (bRender)
+    sprScreen.SetPixel(cycle - 1, scanline, palScreen[(nPixel & 1) ? 0x3F : 0x30]);
 
   // Advance renderer - it never stops
+  nDot++;
   cycle++;
   if (cycle >= 341) {
     cycle = 0;
@@ -103,6 +191,57 @@ void nes2C02::clock()
   }
 }
 
+void nes2C02::CatchUp(uint64_t nDots)
+{
+  if (!bRender) {
+    // Nothing is drawn, so the whole span is skipped at once. A frame
+    // is 262 scanlines from the pre-render line -1, and wrapping
+    // round to it completes the frame
+    if (nDots <= nDot)
+      return;
+    uint64_t nSpan = nDots - nDot;
+    uint64_t nPos = (uint64_t)(scanline + 1) * 341 + cycle + nSpan;
+    if (nPos >= 262 * 341)
+      frame_complete = true;
+    nPos %= 262 * 341;
+    scanline = (int16_t)(nPos / 341) - 1;
+    cycle = (int16_t)(nPos % 341);
+    nDot = nDots;
+    SkipNoise(nSpan);
+    return;
+  }
+
+  olc::Pixel *pScreen = sprScreen.GetData();
+  const olc::Pixel pOn = palScreen[0x3F], pOff = palScreen[0x30];
+
+  while (nDot < nDots) {
+    // Up to the end of the scanline, dot 1 to 256 of the visible ones
+    // being drawn at x = dot - 1. The noise runs on every dot
+    int16_t nEnd = (int16_t)std::min<uint64_t>(341, cycle + (nDots - nDot));
+    int16_t c = cycle;
+    if (scanline >= 0 && scanline < 240) {
+      olc::Pixel *pRow = pScreen + scanline * 256 - 1;
+      for (; c < nEnd && c < 1; c++)
+        NextNoise();
+      for (; c < nEnd && c <= 256; c++)
+        pRow[c] = (NextNoise() & 1) ? pOn : pOff;
+    }
+    for (; c < nEnd; c++)
+      NextNoise();
+
+    nDot += nEnd - cycle;
+    cycle = nEnd;
+    if (cycle >= 341) {
+      cycle = 0;
+      scanline++;
+      if (scanline >= 261) {
+        scanline = -1;
+        frame_complete = true;
+      }
+    }
+  }
+}
+
 uint8_t nes2C02::cpuRead(uint16_t addr, bool bReadOnly)
 {
   uint8_t data = 0x00;
@@ -158,6 +297,16 @@ uint8_t nes2C02::ppuRead(uint16_t addr, bool bReadOnly)
 
   if (cart->ppuRead(addr, data)) {
     // Cartridge address range
+  } else if (addr >= 0x2000 && addr <= 0x3EFF) {
+    // Name tables, mirrored up to $3EFF
+    data = tblName[NameIndex(addr)];
+  } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
+    // Palette, whose background entries of the sprite palettes
+    // are those of the background palettes
+    addr &= 0x001F;
+    if ((addr & 0x0013) == 0x0010)
+      addr &= 0x000F;
+    data = tblPalette[addr];
   }
   return data;
 }
@@ -167,7 +316,35 @@ void nes2C02::ppuWrite(uint16_t addr, uint8_t data)
   addr &= 0x3FFF;
   if (cart->ppuWrite(addr, data)) {
     // Cartridge address range
+  } else if (addr >= 0x2000 && addr <= 0x3EFF) {
+    tblName.Write(NameIndex(addr), data);
+  } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
+    addr &= 0x001F;
+    if ((addr & 0x0013) == 0x0010)
+      addr &= 0x000F;
+    tblPalette[addr] = data;
+  }
+}
+
+uint16_t nes2C02::NameIndex(uint16_t addr) const
+{
+  addr &= 0x0FFF;
+  uint16_t nTable = addr >> 10;
+  switch (cart->mirror) {
+  case Cartridge::VERTICAL:
+    nTable &= 0x01;
+    break;
+  case Cartridge::HORIZONTAL:
+    nTable >>= 1;
+    break;
+  case Cartridge::ONESCREEN_LO:
+    nTable = 0;
+    break;
+  case Cartridge::ONESCREEN_HI:
+    nTable = 1;
+    break;
   }
+  return (nTable << 10) | (addr & 0x03FF);
 }
 
 void nes2C02::ConnectCartridge(const std::shared_ptr<Cartridge> &cartridge)
@@ -1,6 +1,28 @@
 #include "nes6502.h"
 #include "Bus.h"
-#include "utils.h"
+
+// clang-format off
+using n = nes6502;
+const std::array<nes6502::INSTRUCTION, 256> nes6502::lookup
+{ {
+  { &n::BRK, &n::IMM },{ &n::ORA, &n::IZX },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ORA, &n::ZP0 },{ &n::ASL, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::PHP, &n::IMP },{ &n::ORA, &n::IMM },{ &n::ASL, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ORA, &n::ABS },{ &n::ASL, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BPL, &n::REL },{ &n::ORA, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ORA, &n::ZPX },{ &n::ASL, &n::ZPX },{ &n::XXX, &n::IMP },{ &n::CLC, &n::IMP },{ &n::ORA, &n::ABY },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ORA, &n::ABX },{ &n::ASL, &n::ABX },{ &n::XXX, &n::IMP },
+  { &n::JSR, &n::ABS },{ &n::AND, &n::IZX },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::BIT, &n::ZP0 },{ &n::AND, &n::ZP0 },{ &n::ROL, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::PLP, &n::IMP },{ &n::AND, &n::IMM },{ &n::ROL, &n::IMP },{ &n::XXX, &n::IMP },{ &n::BIT, &n::ABS },{ &n::AND, &n::ABS },{ &n::ROL, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BMI, &n::REL },{ &n::AND, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::AND, &n::ZPX },{ &n::ROL, &n::ZPX },{ &n::XXX, &n::IMP },{ &n::SEC, &n::IMP },{ &n::AND, &n::ABY },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::AND, &n::ABX },{ &n::ROL, &n::ABX },{ &n::XXX, &n::IMP },
+  { &n::RTI, &n::IMP },{ &n::EOR, &n::IZX },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::EOR, &n::ZP0 },{ &n::LSR, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::PHA, &n::IMP },{ &n::EOR, &n::IMM },{ &n::LSR, &n::IMP },{ &n::XXX, &n::IMP },{ &n::JMP, &n::ABS },{ &n::EOR, &n::ABS },{ &n::LSR, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BVC, &n::REL },{ &n::EOR, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::EOR, &n::ZPX },{ &n::LSR, &n::ZPX },{ &n::XXX, &n::IMP },{ &n::CLI, &n::IMP },{ &n::EOR, &n::ABY },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::EOR, &n::ABX },{ &n::LSR, &n::ABX },{ &n::XXX, &n::IMP },
+  { &n::RTS, &n::IMP },{ &n::ADC, &n::IZX },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ADC, &n::ZP0 },{ &n::ROR, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::PLA, &n::IMP },{ &n::ADC, &n::IMM },{ &n::ROR, &n::IMP },{ &n::XXX, &n::IMP },{ &n::JMP, &n::IND },{ &n::ADC, &n::ABS },{ &n::ROR, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BVS, &n::REL },{ &n::ADC, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ADC, &n::ZPX },{ &n::ROR, &n::ZPX },{ &n::XXX, &n::IMP },{ &n::SEI, &n::IMP },{ &n::ADC, &n::ABY },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::ADC, &n::ABX },{ &n::ROR, &n::ABX },{ &n::XXX, &n::IMP },
+  { &n::NOP, &n::IMP },{ &n::STA, &n::IZX },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::STY, &n::ZP0 },{ &n::STA, &n::ZP0 },{ &n::STX, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::DEY, &n::IMP },{ &n::NOP, &n::IMP },{ &n::TXA, &n::IMP },{ &n::XXX, &n::IMP },{ &n::STY, &n::ABS },{ &n::STA, &n::ABS },{ &n::STX, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BCC, &n::REL },{ &n::STA, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::STY, &n::ZPX },{ &n::STA, &n::ZPX },{ &n::STX, &n::ZPY },{ &n::XXX, &n::IMP },{ &n::TYA, &n::IMP },{ &n::STA, &n::ABY },{ &n::TXS, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::STA, &n::ABX },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },
+  { &n::LDY, &n::IMM },{ &n::LDA, &n::IZX },{ &n::LDX, &n::IMM },{ &n::XXX, &n::IMP },{ &n::LDY, &n::ZP0 },{ &n::LDA, &n::ZP0 },{ &n::LDX, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::TAY, &n::IMP },{ &n::LDA, &n::IMM },{ &n::TAX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::LDY, &n::ABS },{ &n::LDA, &n::ABS },{ &n::LDX, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BCS, &n::REL },{ &n::LDA, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::LDY, &n::ZPX },{ &n::LDA, &n::ZPX },{ &n::LDX, &n::ZPY },{ &n::XXX, &n::IMP },{ &n::CLV, &n::IMP },{ &n::LDA, &n::ABY },{ &n::TSX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::LDY, &n::ABX },{ &n::LDA, &n::ABX },{ &n::LDX, &n::ABY },{ &n::XXX, &n::IMP },
+  { &n::CPY, &n::IMM },{ &n::CMP, &n::IZX },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::CPY, &n::ZP0 },{ &n::CMP, &n::ZP0 },{ &n::DEC, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::INY, &n::IMP },{ &n::CMP, &n::IMM },{ &n::DEX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::CPY, &n::ABS },{ &n::CMP, &n::ABS },{ &n::DEC, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BNE, &n::REL },{ &n::CMP, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::CMP, &n::ZPX },{ &n::DEC, &n::ZPX },{ &n::XXX, &n::IMP },{ &n::CLD, &n::IMP },{ &n::CMP, &n::ABY },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::CMP, &n::ABX },{ &n::DEC, &n::ABX },{ &n::XXX, &n::IMP },
+  { &n::CPX, &n::IMM },{ &n::SBC, &n::IZX },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::CPX, &n::ZP0 },{ &n::SBC, &n::ZP0 },{ &n::INC, &n::ZP0 },{ &n::XXX, &n::IMP },{ &n::INX, &n::IMP },{ &n::SBC, &n::IMM },{ &n::NOP, &n::IMP },{ &n::SBC, &n::IMP },{ &n::CPX, &n::ABS },{ &n::SBC, &n::ABS },{ &n::INC, &n::ABS },{ &n::XXX, &n::IMP },
+  { &n::BEQ, &n::REL },{ &n::SBC, &n::IZY },{ &n::XXX, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::SBC, &n::ZPX },{ &n::INC, &n::ZPX },{ &n::XXX, &n::IMP },{ &n::SED, &n::IMP },{ &n::SBC, &n::ABY },{ &n::NOP, &n::IMP },{ &n::XXX, &n::IMP },{ &n::NOP, &n::IMP },{ &n::SBC, &n::ABX },{ &n::INC, &n::ABX },{ &n::XXX, &n::IMP },
+} };
+// clang-format on
 
 nes6502::nes6502() = default;
 
@@ -14,27 +36,214 @@ uint8_t nes6502::read(uint16_t addr)
 void nes6502::write(uint16_t addr, uint8_t data)
 {
   bus->cpuWrite(addr, data);
+  Written(addr);
 }
 
-void nes6502::clock()
+void nes6502::SetAccuracy(ACCURACY acc)
+{
+  accuracy = acc;
+}
+
+void nes6502::SetEngine(ENGINE e)
+{
+  engine = e;
+  if (engine == CACHED && !cache) {
+    cache = std::make_unique<BlockCache>();
+    BanksSwitched();
+  }
+  if (engine == JIT && !jit) {
+    jit = std::make_unique<Jit6502>(this);
+    BanksSwitched();
+  }
+}
+
+BlockCache::STATS nes6502::CacheStats() const
+{
+  return cache ? cache->Stats() : BlockCache::STATS();
+}
+
+Jit6502::STATS nes6502::JitStats() const
+{
+  return jit ? jit->Stats() : Jit6502::STATS();
+}
+
+void nes6502::FlushCode()
+{
+  if (cache)
+    cache->Flush();
+  if (jit)
+    jit->Flush();
+  if (disasm)
+    disasm->Flush();
+}
+
+void nes6502::RamRestored()
 {
-  if (cycles == 0) {
+  // The JIT only compiles cartridge ROM. A write to each page of RAM
+  // drops the blocks cached from it. The snapshot may have switched
+  // banks and put the pc anywhere, so the current block is left too
+  if (cache) {
+    for (uint16_t addr = 0x0000; addr < 0x0800; addr += 0x0100)
+      cache->Write(addr);
+    for (uint16_t addr = 0x6000; addr < 0x8000; addr += 0x0100)
+      cache->Write(addr);
+    cache->Leave();
+  }
+  if (disasm)
+    disasm->Flush();
+}
+
+void nes6502::BanksSwitched()
+{
+  if (cache && bus)
+    cache->BanksSwitched(bus);
+  if (jit && bus)
+    jit->BanksSwitched(bus);
+}
+
+void nes6502::PRGRamSwitched()
+{
+  // As a write to each of its pages would
+  if (cache)
+    for (uint16_t addr = 0x6000; addr < 0x8000; addr += 0x0100)
+      cache->Write(addr);
+}
+
+void nes6502::State(StateBuffer &s)
+{
+  s(a);
+  s(x);
+  s(y);
+  s(stkp);
+  s(pc);
+  s(status);
+  s(lazy_z);
+  s(lazy_n);
+  s(fetched);
+  s(temp);
+  s(addr_abs);
+  s(addr_rel);
+  s(opcode);
+  s(cycles);
+  s(nTicks);
+}
+
+uint8_t nes6502::execute()
+{
+  if (pCoverage) {
+    uint8_t &nCount = pCoverage[pc];
+    nCount += nCount != 0xFF;
+  }
+
+  if (engine == FUSED && accuracy == PER_INSTR) {
+    cycles = stepFused();
+    return cycles;
+  }
+
+  if (accuracy == PER_CYCLE && engine != LOOKUP) {
+    // Every access is made through the bus in its own cycle, so
+    // pre-decoded or compiled code cannot be used
+    nTicks = 0;
+    tick();
     opcode = read(pc);
     pc++;
+    uint16_t operand = fetchOperand<PER_CYCLE>();
+    cycles = executeFused<PER_CYCLE>(operand);
+
+    // Cycles spent without an access of their own still pass
+    while (nTicks < cycles)
+      tick();
+    return cycles;
+  }
 
+  if (engine == JIT) {
+    // A compiled block runs as a whole and reports all its cycles
+    uint8_t nCycles = jit->Run(pc);
+    if (nCycles > 0) {
+      cycles = nCycles;
+      return cycles;
+    }
+  }
+
+  if (engine == CACHED) {
+    // Pre-decoded instrs skip fetching from the bus entirely
+    const BlockCache::DECODED *d = cache->Fetch(pc, bus);
+    if (d != nullptr) {
+      opcode = d->opcode;
+      pc += d->length;
+      cycles = executeFused<PER_INSTR>(d->operand);
+      return cycles;
+    }
+  }
+
+  opcode = read(pc);
+  pc++;
+
+  if (engine != LOOKUP) {
+    uint16_t operand = fetchOperand<PER_INSTR>();
+    cycles = executeFused<PER_INSTR>(operand);
+  } else {
     // Get starting number of cycles
-    cycles = lookup[opcode].cycles;
+    cycles = opcodes[opcode].cycles;
 
     uint8_t additional_cycle1 = (this->*lookup[opcode].addrmode)();
 
-    uint8_t additional_cycle2 = (this->*lookup[opcode].operate)();
+    (this->*lookup[opcode].operate)();
 
-    cycles += (additional_cycle1 & additional_cycle2);
+    // The address mode reports whether indexing crossed a page, the
+    // table whether this instr pays a cycle for it
+    cycles += (additional_cycle1 & opcodes[opcode].page_cycle);
   }
 
+  return cycles;
+}
+
+void nes6502::clock()
+{
+  if (cycles == 0)
+    execute();
+
   cycles--;
 }
 
+// Runs a whole instr in one go rather than spreading it over
+// one clock() call per cycle. If clock() (or reset/irq/nmi) has
+// left cycles outstanding, those are retired instead, so step()
+// always returns at an instr boundary
+uint8_t nes6502::step()
+{
+  uint8_t nCycles = cycles;
+  if (nCycles == 0)
+    nCycles = execute();
+
+  cycles = 0;
+  return nCycles;
+}
+
+// Runs instrs until at least nCycleBudget cycles have elapsed.
+// Instrs are never split, so the last one may overshoot the
+// budget; the number of cycles actually run is returned so the
+// caller can carry the difference into the next slice
+uint32_t nes6502::run(uint32_t nCycleBudget)
+{
+  // The engines other than LOOKUP have loops of their own, unless
+  // coverage is counted
+  if (cycles == 0 && accuracy == PER_INSTR && !pCoverage) {
+    if (engine == FUSED)
+      return runFused(nCycleBudget);
+    if (engine == CACHED)
+      return runCached(nCycleBudget);
+    if (engine == JIT)
+      return runJit(nCycleBudget);
+  }
+
+  uint32_t nElapsed = 0;
+  while (nElapsed < nCycleBudget)
+    nElapsed += step();
+
+  return nElapsed;
+}
+
 // Forces the CPU into a known state.
 // Registers are set to 0x00, status register is cleared
 // except for unused bit. An absolute address is read from
@@ -51,12 +260,20 @@ void nes6502::reset()
   x = 0;
   y = 0;
   stkp = 0xFD;
-  status = 0x00 | U;
+  SetStatus(0x00 | U);
 
   addr_rel = 0x0000;
   addr_abs = 0x0000;
   fetched = 0x00;
 
+  // System RAM may have been reloaded before the reset. A new
+  // cartridge has flushed all code already, see Bus::insertCartridge()
+  if (cache) {
+    for (uint16_t addr = 0x0000; addr < 0x0800; addr += 0x0100)
+      cache->Write(addr);
+    cache->Leave();
+  }
+
   cycles = 8;
 }
 
@@ -78,7 +295,7 @@ void nes6502::irq()
     SetFlag(B, 0);
     SetFlag(U, 1);
     SetFlag(I, 1);
-    write(0x0100 + stkp, status);
+    write(0x0100 + stkp, GetStatus());
     stkp--;
 
     addr_abs = 0xFFFE;
@@ -102,7 +319,7 @@ void nes6502::nmi()
   SetFlag(B, 0);
   SetFlag(U, 1);
   SetFlag(I, 1);
-  write(0x0100 + stkp, status);
+  write(0x0100 + stkp, GetStatus());
   stkp--;
 
   addr_abs = 0xFFFE;
@@ -118,13 +335,17 @@ void nes6502::nmi()
 // Get the value of the given flag
 uint8_t nes6502::GetFlag(FLAGS6502 f)
 {
-  return ((status & f) > 0) ? 1 : 0;
+  return ((GetStatus() & f) > 0) ? 1 : 0;
 }
 
 // Set or clear thje value of the given flag
 void nes6502::SetFlag(FLAGS6502 f, bool v)
 {
-  if (v)
+  if (f == Z)
+    lazy_z = v ? 0x00 : 0x01;
+  else if (f == N)
+    lazy_n = v ? 0x80 : 0x00;
+  else if (v)
     status |= f;
   else
     status &= ~f;
@@ -311,7 +532,7 @@ uint8_t nes6502::IZY()
 // Function to source the data required by the instr
 uint8_t nes6502::fetch()
 {
-  if (!(lookup[opcode].addrmode == &nes6502::IMP))
+  if (opcodes[opcode].mode != ADDRMODE::IMP)
     fetched = read(addr_abs);
   return fetched;
 }
@@ -325,10 +546,10 @@ uint8_t nes6502::ADC()
   temp = (uint16_t)a + (uint16_t)fetched + (uint16_t)GetFlag(C);
   // carry flag out exists in the HI bit 0
   SetFlag(C, temp > 255);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
   // set the signed overflow flag
   SetFlag(V, (~((uint16_t)a ^ (uint16_t)fetched) & ((uint16_t)a ^ (uint16_t)temp)) & 0x0080);
-  SetFlag(N, temp & 0x80);
+  // zero and negative flags follow the result
+  SetNZ(temp & 0x00FF);
   // load the result into accumulator (8-bit)
   a = temp & 0x00FF;
 
@@ -340,10 +561,9 @@ uint8_t nes6502::SBC()
   fetch();
   uint16_t value = ((uint16_t)fetched) ^ 0x00FF;
   temp = (uint16_t)a + value + (uint16_t)GetFlag(C);
-  SetFlag(C, temp < 255);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
+  SetFlag(C, temp & 0xFF00);
   SetFlag(V, (temp ^ (uint16_t)a) & (temp ^ value) & 0x0080);
-  SetFlag(N, temp & 0x80);
+  SetNZ(temp & 0x00FF);
   a = temp & 0x00FF;
 
   return 1;
@@ -363,8 +583,7 @@ uint8_t nes6502::AND()
 {
   fetch();
   a = a & fetched;
-  SetFlag(Z, a == 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 1;
 }
 
@@ -374,8 +593,7 @@ uint8_t nes6502::EOR()
 {
   fetch();
   a = a ^ fetched;
-  SetFlag(Z, a == 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 1;
 }
 
@@ -385,8 +603,7 @@ uint8_t nes6502::ORA()
 {
   fetch();
   a = a | fetched;
-  SetFlag(Z, a == 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 1;
 }
 
@@ -530,13 +747,16 @@ uint8_t nes6502::BRK()
   write(0x0100 + stkp, (pc >> 8) & 0x00FF);
   stkp--;
   write(0x0100 + stkp, pc & 0x00FF);
+  stkp--;
 
   SetFlag(B, 1);
-  write(0x0100 + stkp, status);
+  write(0x0100 + stkp, GetStatus());
   stkp--;
   SetFlag(B, 0);
 
-  pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8);
+  uint16_t lo = read(0xFFFE);
+  uint16_t hi = read(0xFFFF);
+  pc = (hi << 8) | lo;
 
   return 0;
 }
@@ -576,9 +796,8 @@ uint8_t nes6502::CMP()
   fetch();
   temp = (uint16_t)a - (uint16_t)fetched;
   SetFlag(C, a >= fetched);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
-  SetFlag(N, temp & 0x0080);
-  return 0;
+  SetNZ(temp & 0x00FF);
+  return 1;
 }
 
 // Compare X register
@@ -588,8 +807,7 @@ uint8_t nes6502::CPX()
   fetch();
   temp = (uint16_t)x - (uint16_t)fetched;
   SetFlag(C, x >= fetched);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
-  SetFlag(N, temp & 0x0080);
+  SetNZ(temp & 0x00FF);
   return 0;
 }
 
@@ -600,8 +818,7 @@ uint8_t nes6502::CPY()
   fetch();
   temp = (uint16_t)y - (uint16_t)fetched;
   SetFlag(C, y >= fetched);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
-  SetFlag(N, temp & 0x0080);
+  SetNZ(temp & 0x00FF);
   return 0;
 }
 
@@ -612,8 +829,7 @@ uint8_t nes6502::DEC()
   fetch();
   temp = fetched - 1;
   write(addr_abs, temp & 0x00FF);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
-  SetFlag(N, temp & 0x0080);
+  SetNZ(temp & 0x00FF);
   return 0;
 }
 
@@ -622,8 +838,7 @@ uint8_t nes6502::DEC()
 uint8_t nes6502::DEX()
 {
   x--;
-  SetFlag(Z, x == 0x00);
-  SetFlag(N, temp & 0x80);
+  SetNZ(x);
   return 0;
 }
 
@@ -632,8 +847,7 @@ uint8_t nes6502::DEX()
 uint8_t nes6502::DEY()
 {
   y--;
-  SetFlag(Z, y == 0x00);
-  SetFlag(N, y & 0x80);
+  SetNZ(y);
   return 0;
 }
 
@@ -644,8 +858,7 @@ uint8_t nes6502::INC()
   fetch();
   temp = fetched + 1;
   write(addr_abs, temp & 0x00FF);
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
-  SetFlag(N, temp & 0x0080);
+  SetNZ(temp & 0x00FF);
   return 0;
 }
 
@@ -654,8 +867,7 @@ uint8_t nes6502::INC()
 uint8_t nes6502::INX()
 {
   x++;
-  SetFlag(Z, x == 0x00);
-  SetFlag(N, temp & 0x80);
+  SetNZ(x);
   return 0;
 }
 
@@ -664,8 +876,7 @@ uint8_t nes6502::INX()
 uint8_t nes6502::INY()
 {
   y++;
-  SetFlag(Z, y == 0x00);
-  SetFlag(N, y & 0x80);
+  SetNZ(y);
   return 0;
 }
 
@@ -697,8 +908,7 @@ uint8_t nes6502::LDA()
 {
   fetch();
   a = fetched;
-  SetFlag(Z, a == 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 1;
 }
 
@@ -708,8 +918,7 @@ uint8_t nes6502::LDX()
 {
   fetch();
   x = fetched;
-  SetFlag(Z, x == 0x00);
-  SetFlag(N, x & 0x80);
+  SetNZ(x);
   return 1;
 }
 
@@ -719,8 +928,7 @@ uint8_t nes6502::LDY()
 {
   fetch();
   y = fetched;
-  SetFlag(Z, y == 0x00);
-  SetFlag(N, y & 0x80);
+  SetNZ(y);
   return 1;
 }
 
@@ -731,9 +939,8 @@ uint8_t nes6502::ASL()
   fetch();
   temp = (uint16_t)fetched << 1;
   SetFlag(C, (temp & 0xFF00) > 0);
-  SetFlag(Z, (temp & 0x00FF) == 0x00);
-  SetFlag(N, temp & 0x80);
-  if (lookup[opcode].addrmode == &nes6502::IMP)
+  SetNZ(temp & 0x00FF);
+  if (opcodes[opcode].mode == ADDRMODE::IMP)
     a = temp & 0x00FF;
   else
     write(addr_abs, temp & 0x00FF);
@@ -747,10 +954,9 @@ uint8_t nes6502::LSR()
   fetch();
   SetFlag(C, fetched & 0x0001);
   temp = fetched >> 1;
-  SetFlag(Z, (temp & 0x00FF) == 0x0000);
-  SetFlag(N, temp & 0x0080);
+  SetNZ(temp & 0x00FF);
 
-  if (lookup[opcode].addrmode == &nes6502::IMP)
+  if (opcodes[opcode].mode == ADDRMODE::IMP)
     a = temp & 0x00FF;
   else
     write(addr_abs, temp & 0x00FF);
@@ -788,7 +994,7 @@ uint8_t nes6502::PHA()
 // Break flag is set to 1 before push
 uint8_t nes6502::PHP()
 {
-  write(0x0100 + stkp, status | B | U);
+  write(0x0100 + stkp, GetStatus() | B | U);
   SetFlag(B, 0);
   SetFlag(U, 0);
   stkp--;
@@ -801,8 +1007,7 @@ uint8_t nes6502::PLA()
 {
   stkp++;
   a = read(0x0100 + stkp);
-  SetFlag(Z, a = 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 0;
 }
 
@@ -810,7 +1015,7 @@ uint8_t nes6502::PLA()
 uint8_t nes6502::PLP()
 {
   stkp++;
-  status = read(0x0100 + stkp);
+  SetStatus(read(0x0100 + stkp));
   SetFlag(U, 1);
   return 0;
 }
@@ -820,10 +1025,9 @@ uint8_t nes6502::ROL()
 {
   fetch();
   temp = (uint16_t)(fetched << 1) | GetFlag(C);
-  SetFlag(C, temp & 0x01);
-  SetFlag(Z, (temp & 0x00FF) == 0x00);
-  SetFlag(N, temp & 0x0080);
-  if (lookup[opcode].addrmode == &nes6502::IMP)
+  SetFlag(C, temp & 0xFF00);
+  SetNZ(temp & 0x00FF);
+  if (opcodes[opcode].mode == ADDRMODE::IMP)
     a = temp & 0x00FF;
   else
     write(addr_abs, temp & 0x00FF);
@@ -835,11 +1039,10 @@ uint8_t nes6502::ROL()
 uint8_t nes6502::ROR()
 {
   fetch();
-  temp = (uint16_t)(GetFlag(C) << 7) | (fetched << 1);
+  temp = (uint16_t)(GetFlag(C) << 7) | (fetched >> 1);
   SetFlag(C, fetched & 0x01);
-  SetFlag(Z, (temp & 0x00FF) == 0x00);
-  SetFlag(N, temp & 0x0080);
-  if (lookup[opcode].addrmode == &nes6502::IMP)
+  SetNZ(temp & 0x00FF);
+  if (opcodes[opcode].mode == ADDRMODE::IMP)
     a = temp & 0x00FF;
   else
     write(addr_abs, temp & 0x00FF);
@@ -852,7 +1055,7 @@ uint8_t nes6502::RTI()
 {
 
   stkp++;
-  status = read(0x0100 + stkp);
+  SetStatus(read(0x0100 + stkp));
   status &= ~B;
   status &= ~U;
 
@@ -923,8 +1126,7 @@ uint8_t nes6502::STY()
 uint8_t nes6502::TAX()
 {
   x = a;
-  SetFlag(Z, x == 0x00);
-  SetFlag(N, x & 0x80);
+  SetNZ(x);
   return 0;
 }
 
@@ -933,8 +1135,7 @@ uint8_t nes6502::TAX()
 uint8_t nes6502::TAY()
 {
   y = a;
-  SetFlag(Z, y == 0x00);
-  SetFlag(N, y & 0x80);
+  SetNZ(y);
   return 0;
 }
 
@@ -943,8 +1144,7 @@ uint8_t nes6502::TAY()
 uint8_t nes6502::TXA()
 {
   a = x;
-  SetFlag(Z, a == 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 0;
 }
 
@@ -953,8 +1153,7 @@ uint8_t nes6502::TXA()
 uint8_t nes6502::TYA()
 {
   a = y;
-  SetFlag(Z, a == 0x00);
-  SetFlag(N, a & 0x80);
+  SetNZ(a);
   return 0;
 }
 
@@ -970,8 +1169,7 @@ uint8_t nes6502::TXS()
 uint8_t nes6502::TSX()
 {
   x = stkp;
-  SetFlag(Z, x == 0x00);
-  SetFlag(N, x & 0x80);
+  SetNZ(x);
   return 0;
 }
 
@@ -988,96 +1186,9 @@ bool nes6502::complete()
   return cycles == 0;
 }
 
-std::map<uint16_t, std::string> nes6502::disassemble(uint16_t nStart, uint16_t nStop)
-{
-  uint32_t addr = nStart;
-  uint8_t value = 0x00;
-  uint8_t lo = 0x00;
-  uint8_t hi = 0x00;
-  std::map<uint16_t, std::string> mapLines;
-  uint16_t line_addr = 0;
-
-  while (addr <= (uint32_t)nStop) {
-    line_addr = addr;
-
-    // Prefix line with instr addr
-    std::string sInst = "$" + hex(addr, 4) + ": ";
-
-    // read instr and get its readable name
-    uint8_t opcode = bus->cpuRead(addr, true);
-    addr++;
-    sInst += lookup[opcode].name + " ";
-
-    // get operands from desired locations, and form the
-    // instr based upon its addressing mode. These routines
-    // mimmick the actual fetch routine of the 6502 in
-    // order to get accurate data as part of the instr
-    if (lookup[opcode].addrmode == &nes6502::IMP) {
-      sInst += " {IMP}";
-    } else if (lookup[opcode].addrmode == &nes6502::IMM) {
-      value = bus->cpuRead(addr, true);
-      addr++;
-      sInst += "#$" + hex(value, 2) + " {IMM}";
-    } else if (lookup[opcode].addrmode == &nes6502::ZP0) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = 0x00;
-      sInst += "$" + hex(lo, 2) + " {ZP0}";
-    } else if (lookup[opcode].addrmode == &nes6502::ZPX) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = 0x00;
-      sInst += "$" + hex(lo, 2) + ", X {ZPX}";
-    } else if (lookup[opcode].addrmode == &nes6502::ZPY) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = 0x00;
-      sInst += "$" + hex(lo, 2) + ", Y {ZPY}";
-    } else if (lookup[opcode].addrmode == &nes6502::IZX) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = 0x00;
-      sInst += "($" + hex(lo, 2) + ", X) {IZX}";
-    } else if (lookup[opcode].addrmode == &nes6502::IZY) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = 0x00;
-      sInst += "($" + hex(lo, 2) + ", Y) {IZY}";
-    } else if (lookup[opcode].addrmode == &nes6502::ABS) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = bus->cpuRead(addr, true);
-      addr++;
-      sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + " {ABS}";
-    } else if (lookup[opcode].addrmode == &nes6502::ABX) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = bus->cpuRead(addr, true);
-      addr++;
-      sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + ", X {ABX}";
-    } else if (lookup[opcode].addrmode == &nes6502::ABY) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = bus->cpuRead(addr, true);
-      addr++;
-      sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + ", Y {ABY}";
-    } else if (lookup[opcode].addrmode == &nes6502::IND) {
-      lo = bus->cpuRead(addr, true);
-      addr++;
-      hi = bus->cpuRead(addr, true);
-      addr++;
-      sInst += "($" + hex((uint16_t)(hi << 8) | lo, 4) + ") {IND}";
-    } else if (lookup[opcode].addrmode == &nes6502::REL) {
-      value = bus->cpuRead(addr, true);
-      addr++;
-      sInst += "$" + hex(value, 2) + "[$" + hex(addr + (int8_t)value, 4) + "] {REL}";
-    }
-
-    // Add the formed string to the map using the instr's addr
-    // as the key for lookup later as the instrs as variable
-    // in length, so a straight up incremental index is not sufficient
-    mapLines[line_addr] = sInst;
-  }
-
-  return mapLines;
+Disassembler &nes6502::disassembler()
+{
+  if (!disasm)
+    disasm = std::make_unique<Disassembler>(bus);
+  return *disasm;
 }
@@ -0,0 +1,584 @@
+#include "nes6502.h"
+#include "Bus.h"
+
+// Fused execution engine
+//
+// The reference engine in nes6502.cpp splits every instr into an
+// addressing mode call and an operate call, both made through
+// pointer-to-member entries of the lookup table, and hands the
+// effective address and operand between them in member variables.
+// Here each opcode is a single case of a dense switch (which the
+// compiler lowers to one jump table) with its addressing mode inlined,
+// so an instr costs one indirect jump and its intermediates stay in
+// registers. Bus traffic, results and cycle counts match the reference
+// engine so the two can be compared instr by instr.
+//
+// The handlers are compiled twice, once per accuracy policy. With
+// PER_INSTR an instr makes only the accesses that matter to its
+// result, all at once. With PER_CYCLE it makes every access the real 6502
+// does, one per cycle and in order, including the dummy reads and
+// writes, and each access first ticks the rest of the system through
+// its cycle. The policy only changes what read(), write() and dummy()
+// below do, the handlers themselves are shared.
+
+// Number of operand bytes following each opcode, derived from the
+// opcode table at compile time
+static constexpr std::array<uint8_t, 256> nOperandBytes = []() {
+  std::array<uint8_t, 256> bytes{};
+  for (size_t i = 0; i < bytes.size(); i++)
+    bytes[i] = nes6502::OperandBytes(nes6502::opcodes[i].mode);
+  return bytes;
+}();
+
+// Bits of the two bytes after each opcode which are its operand
+static constexpr std::array<uint16_t, 256> nOperandMask = []() {
+  std::array<uint16_t, 256> mask{};
+  for (size_t i = 0; i < mask.size(); i++)
+    mask[i] = (uint16_t)((1u << (nOperandBytes[i] * 8)) - 1);
+  return mask;
+}();
+
+void nes6502::tick()
+{
+  bus->cpuTick();
+  nTicks++;
+}
+
+template <nes6502::ACCURACY A>
+uint8_t nes6502::busRead(uint16_t addr)
+{
+  if constexpr (A == PER_CYCLE)
+    tick();
+  return bus->cpuRead(addr, false);
+}
+
+template <nes6502::ACCURACY A>
+void nes6502::busWrite(uint16_t addr, uint8_t data)
+{
+  if constexpr (A == PER_CYCLE)
+    tick();
+  bus->cpuWrite(addr, data);
+  Written(addr);
+}
+
+template <nes6502::ACCURACY A>
+uint16_t nes6502::fetchOperand()
+{
+  auto read = [&](uint16_t addr) { return busRead<A>(addr); };
+  uint16_t operand = 0x0000;
+
+  switch (nOperandBytes[opcode]) {
+  case 1:
+    operand = read(pc);
+    pc++;
+    break;
+  case 2: {
+    uint16_t lo = read(pc);
+    pc++;
+    // JSR pushes the return addr before it reads the high byte of
+    // its target, which it then does itself, see executeFused()
+    if constexpr (A == PER_CYCLE) {
+      if (opcode == 0x20)
+        return lo;
+    }
+    uint16_t hi = read(pc);
+    pc++;
+    operand = (hi << 8) | lo;
+  } break;
+  }
+
+  return operand;
+}
+
+template <nes6502::ACCURACY A>
+uint8_t nes6502::executeFused(uint16_t operand)
+{
+  // Bus accesses of the accuracy policy. These hide the plain read
+  // and write so that every handler goes through them
+  auto read = [&](uint16_t addr) { return busRead<A>(addr); };
+  auto write = [&](uint16_t addr, uint8_t data) { busWrite<A>(addr, data); };
+  // Accesses whose result is thrown away, only made at all with PER_CYCLE
+  // accuracy as they can have side effects on I/O registers
+  auto dummy = [&](uint16_t addr) {
+    if constexpr (A == PER_CYCLE)
+      read(addr);
+  };
+  auto dummyWrite = [&](uint16_t addr, uint8_t data) {
+    if constexpr (A == PER_CYCLE)
+      write(addr, data);
+  };
+
+  // Every single byte instr reads the byte after it while decoding
+  if (nOperandBytes[opcode] == 0)
+    dummy(pc);
+
+  // Addressing modes, computed from the already decoded operand.
+  // Indexed modes set crossed if adding the index changed the page,
+  // which costs the instrs that can take it an additional cycle. The
+  // 6502 first reads from the addr before the page is fixed up, which
+  // stores and read-modify-writes always do
+  uint8_t crossed = 0;
+
+  auto index = [&](uint16_t base, uint8_t i, bool bAlwaysFixUp) -> uint16_t {
+    uint16_t ea = base + i;
+    crossed = (ea & 0xFF00) != (base & 0xFF00);
+    if (crossed || bAlwaysFixUp)
+      dummy((base & 0xFF00) | (ea & 0x00FF));
+    return ea;
+  };
+
+  auto zp0 = [&]() -> uint16_t { return operand & 0x00FF; };
+  auto zpx = [&]() -> uint16_t {
+    dummy(operand & 0x00FF);
+    return (operand + x) & 0x00FF;
+  };
+  auto zpy = [&]() -> uint16_t {
+    dummy(operand & 0x00FF);
+    return (operand + y) & 0x00FF;
+  };
+  auto abx = [&](bool bWrite = false) -> uint16_t { return index(operand, x, bWrite); };
+  auto aby = [&](bool bWrite = false) -> uint16_t { return index(operand, y, bWrite); };
+  auto izx = [&]() -> uint16_t {
+    dummy(operand & 0x00FF);
+    uint16_t lo = read((operand + x) & 0x00FF);
+    uint16_t hi = read((operand + x + 1) & 0x00FF);
+    return (hi << 8) | lo;
+  };
+  auto izy = [&](bool bWrite = false) -> uint16_t {
+    uint16_t lo = read(operand & 0x00FF);
+    uint16_t hi = read((operand + 1) & 0x00FF);
+    return index((hi << 8) | lo, y, bWrite);
+  };
+  auto imm = [&]() -> uint8_t { return operand & 0x00FF; };
+
+  // Operations. N and Z are only evaluated when they are tested,
+  // see SetNZ()
+  auto nz = [&](uint8_t v) { SetNZ(v); };
+  auto adc = [&](uint8_t v) {
+    uint16_t t = (uint16_t)a + (uint16_t)v + (uint16_t)GetFlag(C);
+    SetFlag(C, t > 255);
+    SetFlag(V, (~((uint16_t)a ^ (uint16_t)v) & ((uint16_t)a ^ t)) & 0x0080);
+    a = t & 0x00FF;
+    nz(a);
+  };
+  // Subtraction is addition of the inverted operand
+  auto sbc = [&](uint8_t v) { adc(v ^ 0xFF); };
+  auto cmp = [&](uint8_t r, uint8_t v) {
+    SetFlag(C, r >= v);
+    nz((uint8_t)(r - v));
+  };
+  auto bit = [&](uint8_t v) {
+    lazy_z = a & v;
+    lazy_n = v;
+    SetFlag(V, v & (1 << 6));
+  };
+  auto asl = [&](uint8_t v) -> uint8_t {
+    SetFlag(C, v & 0x80);
+    v <<= 1;
+    nz(v);
+    return v;
+  };
+  auto lsr = [&](uint8_t v) -> uint8_t {
+    SetFlag(C, v & 0x01);
+    v >>= 1;
+    nz(v);
+    return v;
+  };
+  auto rol = [&](uint8_t v) -> uint8_t {
+    uint8_t r = (uint8_t)(v << 1) | GetFlag(C);
+    SetFlag(C, v & 0x80);
+    nz(r);
+    return r;
+  };
+  auto ror = [&](uint8_t v) -> uint8_t {
+    uint8_t r = (uint8_t)(GetFlag(C) << 7) | (v >> 1);
+    SetFlag(C, v & 0x01);
+    nz(r);
+    return r;
+  };
+  auto dec = [&](uint8_t v) -> uint8_t {
+    v--;
+    nz(v);
+    return v;
+  };
+  auto inc = [&](uint8_t v) -> uint8_t {
+    v++;
+    nz(v);
+    return v;
+  };
+  // Read-modify-write of a memory location, which writes the
+  // unmodified value back first
+  auto rmw = [&](uint16_t ea, auto op) {
+    uint8_t v = read(ea);
+    dummyWrite(ea, v);
+    write(ea, op(v));
+  };
+
+  auto push = [&](uint8_t v) {
+    write(0x0100 + stkp, v);
+    stkp--;
+  };
+  auto pop = [&]() -> uint8_t {
+    stkp++;
+    return read(0x0100 + stkp);
+  };
+  // Pulling instrs spend a cycle reading the stack before stkp moves
+  auto peek = [&]() { dummy(0x0100 + stkp); };
+
+  // Branches take one more cycle if taken and another if the
+  // destination is on a different page
+  auto branch = [&](bool cond) -> uint8_t {
+    if (!cond)
+      return 2;
+    uint16_t target = pc + (uint16_t)(int8_t)(operand & 0x00FF);
+    dummy(pc);
+    uint8_t c = 3;
+    if ((target & 0xFF00) != (pc & 0xFF00)) {
+      dummy((pc & 0xFF00) | (target & 0x00FF));
+      c = 4;
+    }
+    pc = target;
+    return c;
+  };
+
+  // clang-format off
+  switch (opcode) {
+  // ADC - Add with carry in
+  case 0x69: adc(imm());             return 2;
+  case 0x65: adc(read(zp0()));       return 3;
+  case 0x75: adc(read(zpx()));       return 4;
+  case 0x6D: adc(read(operand));     return 4;
+  case 0x7D: adc(read(abx()));       return 4 + crossed;
+  case 0x79: adc(read(aby()));       return 4 + crossed;
+  case 0x61: adc(read(izx()));       return 6;
+  case 0x71: adc(read(izy()));       return 5 + crossed;
+
+  // SBC - Subtract with borrow in
+  case 0xE9: sbc(imm());             return 2;
+  case 0xE5: sbc(read(zp0()));       return 3;
+  case 0xF5: sbc(read(zpx()));       return 4;
+  case 0xED: sbc(read(operand));     return 4;
+  case 0xFD: sbc(read(abx()));       return 4 + crossed;
+  case 0xF9: sbc(read(aby()));       return 4 + crossed;
+  case 0xE1: sbc(read(izx()));       return 6;
+  case 0xF1: sbc(read(izy()));       return 5 + crossed;
+  case 0xEB: sbc(a);                 return 2;
+
+  // AND - Bitwise logic AND
+  case 0x29: a &= imm();             nz(a); return 2;
+  case 0x25: a &= read(zp0());       nz(a); return 3;
+  case 0x35: a &= read(zpx());       nz(a); return 4;
+  case 0x2D: a &= read(operand);     nz(a); return 4;
+  case 0x3D: a &= read(abx());       nz(a); return 4 + crossed;
+  case 0x39: a &= read(aby());       nz(a); return 4 + crossed;
+  case 0x21: a &= read(izx());       nz(a); return 6;
+  case 0x31: a &= read(izy());       nz(a); return 5 + crossed;
+
+  // EOR - Bitwise logic XOR
+  case 0x49: a ^= imm();             nz(a); return 2;
+  case 0x45: a ^= read(zp0());       nz(a); return 3;
+  case 0x55: a ^= read(zpx());       nz(a); return 4;
+  case 0x4D: a ^= read(operand);     nz(a); return 4;
+  case 0x5D: a ^= read(abx());       nz(a); return 4 + crossed;
+  case 0x59: a ^= read(aby());       nz(a); return 4 + crossed;
+  case 0x41: a ^= read(izx());       nz(a); return 6;
+  case 0x51: a ^= read(izy());       nz(a); return 5 + crossed;
+
+  // ORA - Bitwise logic OR
+  case 0x09: a |= imm();             nz(a); return 2;
+  case 0x05: a |= read(zp0());       nz(a); return 3;
+  case 0x15: a |= read(zpx());       nz(a); return 4;
+  case 0x0D: a |= read(operand);     nz(a); return 4;
+  case 0x1D: a |= read(abx());       nz(a); return 4 + crossed;
+  case 0x19: a |= read(aby());       nz(a); return 4 + crossed;
+  case 0x01: a |= read(izx());       nz(a); return 6;
+  case 0x11: a |= read(izy());       nz(a); return 5 + crossed;
+
+  // CMP, CPX, CPY - Compare register with memory
+  case 0xC9: cmp(a, imm());          return 2;
+  case 0xC5: cmp(a, read(zp0()));    return 3;
+  case 0xD5: cmp(a, read(zpx()));    return 4;
+  case 0xCD: cmp(a, read(operand));  return 4;
+  case 0xDD: cmp(a, read(abx()));    return 4 + crossed;
+  case 0xD9: cmp(a, read(aby()));    return 4 + crossed;
+  case 0xC1: cmp(a, read(izx()));    return 6;
+  case 0xD1: cmp(a, read(izy()));    return 5 + crossed;
+  case 0xE0: cmp(x, imm());          return 2;
+  case 0xE4: cmp(x, read(zp0()));    return 3;
+  case 0xEC: cmp(x, read(operand));  return 4;
+  case 0xC0: cmp(y, imm());          return 2;
+  case 0xC4: cmp(y, read(zp0()));    return 3;
+  case 0xCC: cmp(y, read(operand));  return 4;
+
+  // BIT - Test bits in memory with accumulator
+  case 0x24: bit(read(zp0()));       return 3;
+  case 0x2C: bit(read(operand));     return 4;
+
+  // LDA, LDX, LDY - Load register
+  case 0xA9: a = imm();              nz(a); return 2;
+  case 0xA5: a = read(zp0());        nz(a); return 3;
+  case 0xB5: a = read(zpx());        nz(a); return 4;
+  case 0xAD: a = read(operand);      nz(a); return 4;
+  case 0xBD: a = read(abx());        nz(a); return 4 + crossed;
+  case 0xB9: a = read(aby());        nz(a); return 4 + crossed;
+  case 0xA1: a = read(izx());        nz(a); return 6;
+  case 0xB1: a = read(izy());        nz(a); return 5 + crossed;
+  case 0xA2: x = imm();              nz(x); return 2;
+  case 0xA6: x = read(zp0());        nz(x); return 3;
+  case 0xB6: x = read(zpy());        nz(x); return 4;
+  case 0xAE: x = read(operand);      nz(x); return 4;
+  case 0xBE: x = read(aby());        nz(x); return 4 + crossed;
+  case 0xA0: y = imm();              nz(y); return 2;
+  case 0xA4: y = read(zp0());        nz(y); return 3;
+  case 0xB4: y = read(zpx());        nz(y); return 4;
+  case 0xAC: y = read(operand);      nz(y); return 4;
+  case 0xBC: y = read(abx());        nz(y); return 4 + crossed;
+
+  // STA, STX, STY - Store register
+  case 0x85: write(zp0(), a);        return 3;
+  case 0x95: write(zpx(), a);        return 4;
+  case 0x8D: write(operand, a);      return 4;
+  case 0x9D: write(abx(true), a);    return 5;
+  case 0x99: write(aby(true), a);    return 5;
+  case 0x81: write(izx(), a);        return 6;
+  case 0x91: write(izy(true), a);    return 6;
+  case 0x86: write(zp0(), x);        return 3;
+  case 0x96: write(zpy(), x);        return 4;
+  case 0x8E: write(operand, x);      return 4;
+  case 0x84: write(zp0(), y);        return 3;
+  case 0x94: write(zpx(), y);        return 4;
+  case 0x8C: write(operand, y);      return 4;
+
+  // ASL, LSR, ROL, ROR - Shifts and rotates (accumulator or memory)
+  case 0x0A: a = asl(a);             return 2;
+  case 0x06: rmw(zp0(), asl);        return 5;
+  case 0x16: rmw(zpx(), asl);        return 6;
+  case 0x0E: rmw(operand, asl);      return 6;
+  case 0x1E: rmw(abx(true), asl);    return 7;
+  case 0x4A: a = lsr(a);             return 2;
+  case 0x46: rmw(zp0(), lsr);        return 5;
+  case 0x56: rmw(zpx(), lsr);        return 6;
+  case 0x4E: rmw(operand, lsr);      return 6;
+  case 0x5E: rmw(abx(true), lsr);    return 7;
+  case 0x2A: a = rol(a);             return 2;
+  case 0x26: rmw(zp0(), rol);        return 5;
+  case 0x36: rmw(zpx(), rol);        return 6;
+  case 0x2E: rmw(operand, rol);      return 6;
+  case 0x3E: rmw(abx(true), rol);    return 7;
+  case 0x6A: a = ror(a);             return 2;
+  case 0x66: rmw(zp0(), ror);        return 5;
+  case 0x76: rmw(zpx(), ror);        return 6;
+  case 0x6E: rmw(operand, ror);      return 6;
+  case 0x7E: rmw(abx(true), ror);    return 7;
+
+  // DEC, INC - Decrement / increment memory
+  case 0xC6: rmw(zp0(), dec);        return 5;
+  case 0xD6: rmw(zpx(), dec);        return 6;
+  case 0xCE: rmw(operand, dec);      return 6;
+  case 0xDE: rmw(abx(true), dec);    return 7;
+  case 0xE6: rmw(zp0(), inc);        return 5;
+  case 0xF6: rmw(zpx(), inc);        return 6;
+  case 0xEE: rmw(operand, inc);      return 6;
+  case 0xFE: rmw(abx(true), inc);    return 7;
+
+  // DEX, DEY, INX, INY - Decrement / increment register
+  case 0xCA: x--;                    nz(x); return 2;
+  case 0x88: y--;                    nz(y); return 2;
+  case 0xE8: x++;                    nz(x); return 2;
+  case 0xC8: y++;                    nz(y); return 2;
+
+  // Register transfers
+  case 0xAA: x = a;                  nz(x); return 2;
+  case 0xA8: y = a;                  nz(y); return 2;
+  case 0x8A: a = x;                  nz(a); return 2;
+  case 0x98: a = y;                  nz(a); return 2;
+  case 0xBA: x = stkp;               nz(x); return 2;
+  case 0x9A: stkp = x;               return 2;
+
+  // Branches
+  case 0x90: return branch(GetFlag(C) == 0);
+  case 0xB0: return branch(GetFlag(C) == 1);
+  case 0xD0: return branch(lazy_z != 0x00);
+  case 0xF0: return branch(lazy_z == 0x00);
+  case 0x10: return branch((lazy_n & N) == 0);
+  case 0x30: return branch((lazy_n & N) != 0);
+  case 0x50: return branch(GetFlag(V) == 0);
+  case 0x70: return branch(GetFlag(V) == 1);
+
+  // Flag set / clear
+  case 0x18: SetFlag(C, false);      return 2;
+  case 0x38: SetFlag(C, true);       return 2;
+  case 0x58: SetFlag(I, false);      return 2;
+  case 0x78: SetFlag(I, true);       return 2;
+  case 0xB8: SetFlag(V, false);      return 2;
+  case 0xD8: SetFlag(D, false);      return 2;
+  case 0xF8: SetFlag(D, true);       return 2;
+
+  // Stack
+  case 0x48:// PHA
+    push(a);
+    return 3;
+  case 0x08:// PHP - break flag is set to 1 before push
+    write(0x0100 + stkp, GetStatus() | B | U);
+    SetFlag(B, 0);
+    SetFlag(U, 0);
+    stkp--;
+    return 3;
+  case 0x68:// PLA
+    peek();
+    a = pop();
+    nz(a);
+    return 4;
+  case 0x28:// PLP
+    peek();
+    SetStatus(pop());
+    SetFlag(U, 1);
+    return 4;
+
+  // Jumps and subroutines
+  case 0x4C:// JMP abs
+    pc = operand;
+    return 3;
+  case 0x6C: {// JMP ind, including the page boundary hardware bug
+    uint16_t lo = read(operand);
+    uint16_t hi = read((operand & 0x00FF) == 0x00FF ? (operand & 0xFF00) : operand + 1);
+    pc = (hi << 8) | lo;
+  }
+    return 5;
+  case 0x20: {// JSR, which reads the high byte of its target last
+    if constexpr (A == PER_INSTR)
+      pc--;
+    peek();
+    push((pc >> 8) & 0x00FF);
+    push(pc & 0x00FF);
+    uint16_t hi = operand >> 8;
+    if constexpr (A == PER_CYCLE)
+      hi = read(pc);
+    pc = (hi << 8) | (operand & 0x00FF);
+  }
+    return 6;
+  case 0x60: {// RTS
+    peek();
+    uint16_t lo = pop();
+    uint16_t hi = pop();
+    pc = (hi << 8) | lo;
+    dummy(pc);
+    pc++;
+  }
+    return 6;
+  case 0x40: {// RTI
+    peek();
+    SetStatus(pop());
+    status &= ~B;
+    status &= ~U;
+    uint16_t lo = pop();
+    uint16_t hi = pop();
+    pc = (hi << 8) | lo;
+  }
+    return 6;
+  case 0x00: {// BRK
+    pc++;
+    SetFlag(I, 1);
+    push((pc >> 8) & 0x00FF);
+    push(pc & 0x00FF);
+    SetFlag(B, 1);
+    push(GetStatus());
+    SetFlag(B, 0);
+    uint16_t lo = read(0xFFFE);
+    uint16_t hi = read(0xFFFF);
+    pc = (hi << 8) | lo;
+  }
+    return 7;
+
+  // Official NOP and the illegal opcodes, none of which do anything
+  // beyond burning cycles (their operands are not fetched either)
+  case 0xEA:
+  case 0x1A: case 0x3A: case 0x5A: case 0x7A: case 0xDA: case 0xFA:
+  case 0x80: case 0x82: case 0x89: case 0xC2: case 0xE2:
+  case 0x02: case 0x12: case 0x22: case 0x32: case 0x42: case 0x52:
+  case 0x62: case 0x72: case 0x92: case 0xB2: case 0xD2: case 0xF2:
+  case 0x0B: case 0x2B: case 0x4B: case 0x6B: case 0x8B: case 0xAB:
+  case 0xCB:
+    return 2;
+  case 0x04: case 0x44: case 0x64: case 0x87: case 0xA7:
+    return 3;
+  case 0x0C: case 0x14: case 0x1C: case 0x34: case 0x3C: case 0x54:
+  case 0x5C: case 0x74: case 0x7C: case 0xD4: case 0xDC: case 0xF4:
+  case 0xFC: case 0x8F: case 0x97: case 0xAF: case 0xB7: case 0xBB:
+  case 0xBF:
+    return 4;
+  case 0x9C: case 0x07: case 0x27: case 0x47: case 0x67: case 0x9B:
+  case 0x9E: case 0x9F: case 0xB3: case 0xC7: case 0xE7:
+    return 5;
+  case 0x0F: case 0x17: case 0x2F: case 0x37: case 0x4F: case 0x57:
+  case 0x6F: case 0x77: case 0x83: case 0x93: case 0xA3: case 0xCF:
+  case 0xD7: case 0xEF: case 0xF7:
+    return 6;
+  case 0x1B: case 0x1F: case 0x3B: case 0x3F: case 0x5B: case 0x5F:
+  case 0x7B: case 0x7F: case 0xDB: case 0xDF: case 0xFB: case 0xFF:
+    return 7;
+  default:// 0x03 0x13 ... 0xF3
+    return 8;
+  }
+  // clang-format on
+}
+
+uint8_t nes6502::stepFused()
+{
+  // Code runs from memory the page table maps, so unless the instr
+  // runs over the end of the page, the opcode and both bytes after it
+  // are taken from the page at once and whatever is not operand is
+  // masked off. Reading past the instr has no effect on plain memory
+  const uint8_t *page = bus->ReadPage(pc);
+  if (page && (pc & 0x00FF) < 0xFE) {
+    const uint8_t *p = page + (pc & 0x00FF);
+    opcode = p[0];
+    uint16_t operand = (uint16_t)(p[1] | (p[2] << 8)) & nOperandMask[opcode];
+    pc += 1 + nOperandBytes[opcode];
+    return executeFused<PER_INSTR>(operand);
+  }
+
+  opcode = busRead<PER_INSTR>(pc);
+  pc++;
+  return executeFused<PER_INSTR>(fetchOperand<PER_INSTR>());
+}
+
+uint32_t nes6502::runFused(uint32_t nCycleBudget)
+{
+  uint32_t nElapsed = 0;
+  while (nElapsed < nCycleBudget)
+    nElapsed += stepFused();
+  return nElapsed;
+}
+
+uint32_t nes6502::runCached(uint32_t nCycleBudget)
+{
+  BlockCache &c = *cache;
+  uint32_t nElapsed = 0;
+  while (nElapsed < nCycleBudget) {
+    const BlockCache::DECODED *d = c.Fetch(pc, bus);
+    if (d != nullptr) {
+      opcode = d->opcode;
+      pc += d->length;
+      nElapsed += executeFused<PER_INSTR>(d->operand);
+    } else
+      nElapsed += stepFused();
+  }
+  return nElapsed;
+}
+
+uint32_t nes6502::runJit(uint32_t nCycleBudget)
+{
+  Jit6502 &j = *jit;
+  uint32_t nElapsed = 0;
+  while (nElapsed < nCycleBudget) {
+    uint8_t nCycles = j.Run(pc);
+    nElapsed += nCycles > 0 ? nCycles : stepFused();
+  }
+  return nElapsed;
+}
+
+template uint16_t nes6502::fetchOperand<nes6502::PER_INSTR>();
+template uint16_t nes6502::fetchOperand<nes6502::PER_CYCLE>();
+template uint8_t nes6502::executeFused<nes6502::PER_INSTR>(uint16_t operand);
+template uint8_t nes6502::executeFused<nes6502::PER_CYCLE>(uint16_t operand);
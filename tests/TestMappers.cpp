@@ -0,0 +1,648 @@
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <iterator>
+
+#include "Bus.h"
+#include "Cartridge.h"
+#include "RomIndex.h"
+
+// The PPU's sprites live in the engine's implementation, so it has to be
+// compiled into one translation unit even though no window is opened
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+// Checks of the bank switching mappers, each run as its own test by
+// name. They run on synthetic ROMs written for the test, in which the
+// first byte of every 8KB PRG bank and of every 1KB CHR bank is the
+// number of the bank, so a read shows which bank a slot holds. Each
+// mapper has its registers written, with bank numbers beyond the ROM
+// which have to wrap around, and its mirroring checked. The bank
+// switch hook has to report exactly the PRG slots that were switched,
+// the bus has to read the switched banks, and a snapshot taken before
+// a bank switch has to bring the banks back when it is loaded. Code
+// called in a switched bank has to run from the bank switched in on
+// every CPU engine. PRG RAM has to be mapped while it is enabled, and
+// not be run from or shared by forked machines once it should not.
+// Cartridges of the same ROM have to share its image, and each have
+// RAM of its own. iNES and NES 2.0 headers have to parse to the sizes
+// they give, and boards the machine can not run have to be refused.
+// The CRC32 and SHA-1 that RomIndex identifies ROMs by have to give
+// the known answers, either side of SHA-1's padding boundaries too.
+
+// Reports a failed check, the tests return the result
+static bool Check(bool bOk, const std::string &sWhat)
+{
+  if (!bOk)
+    std::cout << "Failed: " << sWhat << "\n";
+  return bOk;
+}
+
+// Writes an iNES ROM with nPRG 16KB and nCHR 8KB banks. vCode is put
+// into the last PRG bank at $E001 and the reset vector points at it.
+// With bBankCode the other banks hold LDA #nBank, RTS there instead
+static std::string MakeRom(uint8_t nMapper, uint8_t nPRG, uint8_t nCHR, bool bVertical,
+  const std::vector<uint8_t> &vCode = {}, bool bBankCode = false)
+{
+  std::vector<uint8_t> vRom(16, 0x00);
+  vRom[0] = 'N';
+  vRom[1] = 'E';
+  vRom[2] = 'S';
+  vRom[3] = 0x1A;
+  vRom[4] = nPRG;
+  vRom[5] = nCHR;
+  vRom[6] = (uint8_t)((nMapper & 0x0F) << 4) | (bVertical ? 0x01 : 0x00);
+  vRom[7] = nMapper & 0xF0;
+
+  for (uint32_t nBank = 0; nBank < nPRG * 2u; nBank++) {
+    std::vector<uint8_t> vBank(0x2000, 0xEA);
+    vBank[0] = (uint8_t)nBank;
+    if (nBank == nPRG * 2u - 1) {
+      std::copy(vCode.begin(), vCode.end(), vBank.begin() + 1);
+      vBank[0x1FFC] = 0x01;
+      vBank[0x1FFD] = 0xE0;
+    } else if (bBankCode) {
+      vBank[1] = 0xA9;
+      vBank[2] = (uint8_t)nBank;
+      vBank[3] = 0x60;
+    }
+    vRom.insert(vRom.end(), vBank.begin(), vBank.end());
+  }
+  for (uint32_t nBank = 0; nBank < nCHR * 8u; nBank++) {
+    std::vector<uint8_t> vBank(0x0400, 0x00);
+    vBank[0] = (uint8_t)nBank;
+    vRom.insert(vRom.end(), vBank.begin(), vBank.end());
+  }
+
+  std::string sFile = "test_mappers_" + std::to_string(nMapper) + ".nes";
+  std::ofstream(sFile, std::ios::binary).write((const char *)vRom.data(), vRom.size());
+  return sFile;
+}
+
+// Machine with a cartridge of the ROM inserted
+static std::unique_ptr<Bus> Boot(const std::string &sRom, std::shared_ptr<Cartridge> &cart)
+{
+  cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return nullptr;
+  auto nes = std::make_unique<Bus>();
+  nes->insertCartridge(cart);
+  return nes;
+}
+
+// Numbers of the 8KB PRG banks in the four slots, as the bus reads them
+static std::vector<uint8_t> PRGBanks(Bus &nes)
+{
+  return { nes.cpuRead(0x8000), nes.cpuRead(0xA000), nes.cpuRead(0xC000), nes.cpuRead(0xE000) };
+}
+
+// Numbers of the 1KB CHR banks in the eight slots
+static std::vector<uint8_t> CHRBanks(Cartridge &cart)
+{
+  std::vector<uint8_t> vBanks;
+  for (uint16_t addr = 0x0000; addr < 0x2000; addr += 0x0400) {
+    uint8_t data = 0x00;
+    cart.ppuRead(addr, data);
+    vBanks.push_back(data);
+  }
+  return vBanks;
+}
+
+// PRG and CHR slots the hook reports the writes switching, on a
+// cartridge of its own. A write is a pair of addr and data
+static std::pair<uint8_t, uint8_t> Switched(const std::string &sRom,
+  const std::vector<std::pair<uint16_t, uint8_t>> &vSetup,
+  const std::vector<std::pair<uint16_t, uint8_t>> &vWrites)
+{
+  Cartridge cart(sRom);
+  uint64_t nCycle = 0;
+  for (auto &w : vSetup)
+    cart.cpuWrite(w.first, w.second, nCycle += 10);
+
+  uint8_t nPRG = 0, nCHR = 0;
+  cart.SetBankSwitchHook([&](uint8_t nPRGSlots, uint8_t nCHRSlots) {
+    nPRG |= nPRGSlots;
+    nCHR |= nCHRSlots;
+  });
+  for (auto &w : vWrites)
+    cart.cpuWrite(w.first, w.second, nCycle += 10);
+  return { nPRG, nCHR };
+}
+
+// Snapshots the machine, runs vWrites and loads the snapshot again,
+// which has to bring back the banks and the mirroring it was taken with
+static bool CheckRestore(Bus &nes, Cartridge &cart, const std::vector<std::pair<uint16_t, uint8_t>> &vWrites)
+{
+  std::vector<uint8_t> vPRG = PRGBanks(nes), vCHR = CHRBanks(cart);
+  auto mirror = cart.mirror;
+  std::vector<uint8_t> vState(nes.StateSize());
+  bool bOk = Check(nes.saveState(vState.data(), vState.size()) == vState.size(), "snapshot saved");
+
+  for (auto &w : vWrites)
+    nes.cpuWrite(w.first, w.second);
+  bOk &= Check(PRGBanks(nes) != vPRG || CHRBanks(cart) != vCHR, "writes after the snapshot switch banks");
+
+  bOk &= Check(nes.loadState(vState.data(), vState.size()), "snapshot loaded");
+  bOk &= Check(PRGBanks(nes) == vPRG, "PRG banks restored");
+  bOk &= Check(CHRBanks(cart) == vCHR, "CHR banks restored");
+  bOk &= Check(cart.mirror == mirror, "mirroring restored");
+  return bOk;
+}
+
+// Loads a register through the serial port, a bit per write
+static void WriteMMC1(Bus &nes, uint16_t addr, uint8_t data)
+{
+  for (int i = 0; i < 5; i++)
+    nes.cpuWrite(addr, (data >> i) & 0x01);
+}
+
+static bool TestMMC1()
+{
+  // 128KB PRG ROM, 8 banks of 16KB, and 32KB CHR ROM, 8 banks of 4KB
+  std::string sRom = MakeRom(1, 8, 4, false);
+  std::shared_ptr<Cartridge> cart;
+  auto nes = Boot(sRom, cart);
+  if (!Check(nes != nullptr, "MMC1 ROM loads"))
+    return false;
+
+  // Power up fixes the last bank at $C000
+  bool bOk = Check(PRGBanks(*nes) == std::vector<uint8_t>{ 0, 1, 14, 15 }, "MMC1 power up banks");
+
+  WriteMMC1(*nes, 0xE000, 0x03);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 6, 7, 14, 15 }, "MMC1 PRG bank at $8000");
+  WriteMMC1(*nes, 0xE000, 0x0B);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 6, 7, 14, 15 }, "MMC1 PRG bank 11 wraps to 3");
+
+  // Mode 2 fixes the first bank at $8000 instead, with 4KB CHR banks
+  // and vertical mirroring
+  WriteMMC1(*nes, 0x8000, 0x1A);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 0, 1, 6, 7 }, "MMC1 PRG mode 2");
+  bOk &= Check(cart->mirror == Cartridge::VERTICAL, "MMC1 vertical mirroring");
+  WriteMMC1(*nes, 0xA000, 0x02);
+  WriteMMC1(*nes, 0xC000, 0x1F);
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 8, 9, 10, 11, 28, 29, 30, 31 },
+    "MMC1 4KB CHR banks, 31 wrapping to 7");
+
+  // 32KB PRG mode ignores the low bit, 8KB CHR mode likewise
+  WriteMMC1(*nes, 0x8000, 0x03);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 4, 5, 6, 7 }, "MMC1 PRG mode 0");
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 8, 9, 10, 11, 12, 13, 14, 15 }, "MMC1 8KB CHR bank");
+  bOk &= Check(cart->mirror == Cartridge::HORIZONTAL, "MMC1 horizontal mirroring");
+  WriteMMC1(*nes, 0x8000, 0x00);
+  bOk &= Check(cart->mirror == Cartridge::ONESCREEN_LO, "MMC1 one screen mirroring");
+
+  // A write with bit 7 set resets the shift register and fixes the
+  // last bank at $C000 again
+  nes->cpuWrite(0x8000, 0x01);
+  nes->cpuWrite(0x8000, 0x80);
+  WriteMMC1(*nes, 0xE000, 0x02);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 4, 5, 14, 15 }, "MMC1 reset");
+
+  // The PRG register switches both halves. Going from mode 3 to mode
+  // 2 with bank 0 selected leaves bank 0 at $8000, so only the half at
+  // $C000 switches
+  auto sw = Switched(sRom, {}, { { 0xE000, 1 }, { 0xE000, 0 }, { 0xE000, 0 }, { 0xE000, 0 }, { 0xE000, 0 } });
+  bOk &= Check(sw.first == 0x03, "MMC1 PRG bank switches slots 0 and 1 only");
+  sw = Switched(sRom, {}, { { 0x8000, 0 }, { 0x8000, 1 }, { 0x8000, 0 }, { 0x8000, 1 }, { 0x8000, 0 } });
+  bOk &= Check(sw.first == 0x0C && sw.second == 0x00, "MMC1 PRG mode 2 switches slots 2 and 3 only");
+
+  // Of writes on consecutive cycles only the first counts
+  {
+    Cartridge c(sRom);
+    for (uint64_t nCycle : { 100, 101, 110, 120, 130, 140 })
+      c.cpuWrite(0xE000, 0x01, nCycle);
+    uint8_t data = 0x00;
+    c.cpuRead(0x8000, data);
+    bOk &= Check(data == 14, "MMC1 ignores a write on the cycle after another");
+  }
+
+  bOk &= CheckRestore(*nes, *cart, { { 0x8000, 0x80 }, { 0xE000, 1 }, { 0xE000, 1 }, { 0xE000, 0 },
+    { 0xE000, 0 }, { 0xE000, 0 } });
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+// INC $E000 under PER_CYCLE accuracy writes the value it read first,
+// and the incremented one on the next cycle, which MMC1 has to ignore
+static bool TestMMC1Dummy()
+{
+  std::vector<uint8_t> vCode = {
+    0x78,// SEI
+    0xEE, 0x00, 0xE0, 0xEE, 0x00, 0xE0, 0xEE, 0x00, 0xE0,// INC $E000 x5
+    0xEE, 0x00, 0xE0, 0xEE, 0x00, 0xE0,
+    0x4C, 0x11, 0xE0,// JMP $E011
+  };
+  std::string sRom = MakeRom(1, 8, 4, false, vCode);
+  bool bOk = true;
+  for (auto acc : { nes6502::PER_INSTR, nes6502::PER_CYCLE }) {
+    std::shared_ptr<Cartridge> cart;
+    auto nes = Boot(sRom, cart);
+    if (!Check(nes != nullptr, "MMC1 ROM loads"))
+      return false;
+    nes->cpu.SetEngine(nes6502::FUSED);
+    nes->cpu.SetAccuracy(acc);
+    nes->reset();
+    nes->runFrame();
+
+    // $E000 holds 15, the 16KB bank fixed there, in bank 31 of 8KB.
+    // Per instr only the incremented $20 is written, so 0 is shifted
+    // in five times; per cycle only the $1F of the dummy writes
+    uint8_t nExpected = acc == nes6502::PER_CYCLE ? 14 : 0;
+    bOk &= Check(nes->cpu.pc == 0xE011, "MMC1 INC program runs to its end");
+    bOk &= Check(nes->cpuRead(0x8000) == nExpected,
+      acc == nes6502::PER_CYCLE ? "MMC1 per cycle sees INC's first write only" : "MMC1 per instr sees INC's write");
+  }
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+static bool TestUxROM()
+{
+  // 128KB PRG ROM, 8 banks of 16KB, and CHR RAM
+  std::string sRom = MakeRom(2, 8, 0, true);
+  std::shared_ptr<Cartridge> cart;
+  auto nes = Boot(sRom, cart);
+  if (!Check(nes != nullptr, "UxROM ROM loads"))
+    return false;
+
+  bool bOk = Check(PRGBanks(*nes) == std::vector<uint8_t>{ 0, 1, 14, 15 }, "UxROM power up banks");
+  nes->cpuWrite(0x8000, 3);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 6, 7, 14, 15 }, "UxROM bank at $8000");
+  nes->cpuWrite(0xFFFF, 13);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 10, 11, 14, 15 }, "UxROM bank 13 wraps to 5");
+  bOk &= Check(cart->mirror == Cartridge::VERTICAL, "UxROM keeps the header's mirroring");
+
+  // CHR RAM is written and read back through the slots
+  cart->ppuWrite(0x1234, 0x5A);
+  uint8_t data = 0x00;
+  cart->ppuRead(0x1234, data);
+  bOk &= Check(data == 0x5A, "UxROM CHR RAM");
+
+  auto sw = Switched(sRom, {}, { { 0x8000, 2 } });
+  bOk &= Check(sw.first == 0x03 && sw.second == 0x00, "UxROM switches slots 0 and 1 only");
+  sw = Switched(sRom, { { 0x8000, 2 } }, { { 0x8000, 2 } });
+  bOk &= Check(sw.first == 0x00, "UxROM writing the same bank switches nothing");
+
+  bOk &= CheckRestore(*nes, *cart, { { 0x8000, 1 } });
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+// Calls into the bank at $8000 after switching each bank in turn, on
+// every engine. The code caching engines must not run code from the
+// bank that was there before
+static bool TestBankedCode()
+{
+  std::vector<uint8_t> vCode = {
+    0xA2, 0x00,// LDX #$00
+    0x8A,// TXA
+    0x29, 0x07,// AND #$07
+    0x8D, 0x00, 0xC0,// STA $C000
+    0x20, 0x01, 0x80,// JSR $8001
+    0x9D, 0x00, 0x02,// STA $0200,X
+    0xE8,// INX
+    0xD0, 0xF1,// BNE $E003
+    0x4C, 0x12, 0xE0,// JMP $E012
+  };
+  std::string sRom = MakeRom(2, 8, 0, true, vCode, true);
+  bool bOk = true;
+  static const std::pair<nes6502::ENGINE, std::string> vEngines[] = {
+    { nes6502::LOOKUP, "lookup" },
+    { nes6502::FUSED, "fused" },
+    { nes6502::CACHED, "cached" },
+    { nes6502::JIT, "jit" },
+  };
+  for (auto &[e, sEngine] : vEngines) {
+    std::shared_ptr<Cartridge> cart;
+    auto nes = Boot(sRom, cart);
+    if (!Check(nes != nullptr, "UxROM ROM loads"))
+      return false;
+    nes->cpu.SetEngine(e);
+    nes->reset();
+    nes->runFrame();
+
+    bOk &= Check(nes->cpu.pc == 0xE012, "banked code program runs to its end on " + sEngine);
+    bool bBanks = true;
+    for (uint16_t x = 0x00; x < 0x100; x++)
+      bBanks &= nes->cpuRead(0x0200 + x) == (x & 0x07) * 2;
+    bOk &= Check(bBanks, "banked code runs from the bank switched in on " + sEngine);
+  }
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+static bool TestCNROM()
+{
+  // 32KB PRG ROM and 32KB CHR ROM, 4 banks of 8KB
+  std::string sRom = MakeRom(3, 2, 4, false);
+  std::shared_ptr<Cartridge> cart;
+  auto nes = Boot(sRom, cart);
+  if (!Check(nes != nullptr, "CNROM ROM loads"))
+    return false;
+
+  bool bOk = Check(PRGBanks(*nes) == std::vector<uint8_t>{ 0, 1, 2, 3 }, "CNROM PRG banks");
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 0, 1, 2, 3, 4, 5, 6, 7 }, "CNROM power up CHR bank");
+  nes->cpuWrite(0x8000, 2);
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 16, 17, 18, 19, 20, 21, 22, 23 }, "CNROM CHR bank");
+  nes->cpuWrite(0xC000, 7);
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 24, 25, 26, 27, 28, 29, 30, 31 }, "CNROM CHR bank 7 wraps to 3");
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 0, 1, 2, 3 }, "CNROM PRG banks never switch");
+  bOk &= Check(cart->mirror == Cartridge::HORIZONTAL, "CNROM keeps the header's mirroring");
+
+  auto sw = Switched(sRom, {}, { { 0x8000, 1 } });
+  bOk &= Check(sw.first == 0x00 && sw.second == 0xFF, "CNROM switches CHR slots only");
+
+  bOk &= CheckRestore(*nes, *cart, { { 0x8000, 0 } });
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+static bool TestMMC3()
+{
+  // 128KB PRG ROM, 16 banks of 8KB, and 128KB CHR ROM, 128 banks of 1KB
+  std::string sRom = MakeRom(4, 8, 16, false);
+  std::shared_ptr<Cartridge> cart;
+  auto nes = Boot(sRom, cart);
+  if (!Check(nes != nullptr, "MMC3 ROM loads"))
+    return false;
+
+  bool bOk = Check(PRGBanks(*nes) == std::vector<uint8_t>{ 0, 1, 14, 15 }, "MMC3 power up PRG banks");
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 0, 1, 2, 3, 4, 5, 6, 7 }, "MMC3 power up CHR banks");
+
+  nes->cpuWrite(0x8000, 6);
+  nes->cpuWrite(0x8001, 5);
+  nes->cpuWrite(0x8000, 7);
+  nes->cpuWrite(0x8001, 9);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 5, 9, 14, 15 }, "MMC3 R6 and R7");
+  nes->cpuWrite(0x8000, 6);
+  nes->cpuWrite(0x8001, 0x25);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 5, 9, 14, 15 }, "MMC3 PRG bank 37 wraps to 5");
+
+  // Bit 6 swaps R6 with the second to last bank
+  nes->cpuWrite(0x8000, 0x46);
+  bOk &= Check(PRGBanks(*nes) == std::vector<uint8_t>{ 14, 9, 5, 15 }, "MMC3 PRG mode 1");
+
+  // R0 and R1 select 2KB banks, ignoring the low bit, R2-R5 1KB banks
+  nes->cpuWrite(0x8000, 0);
+  nes->cpuWrite(0x8001, 21);
+  nes->cpuWrite(0x8000, 2);
+  nes->cpuWrite(0x8001, 0xFF);
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 20, 21, 2, 3, 127, 5, 6, 7 },
+    "MMC3 CHR banks, 255 wrapping to 127");
+  // Bit 7 swaps the halves of the pattern memory
+  nes->cpuWrite(0x8000, 0x80);
+  bOk &= Check(CHRBanks(*cart) == std::vector<uint8_t>{ 127, 5, 6, 7, 20, 21, 2, 3 }, "MMC3 CHR inversion");
+
+  nes->cpuWrite(0xA000, 1);
+  bOk &= Check(cart->mirror == Cartridge::HORIZONTAL, "MMC3 horizontal mirroring");
+  nes->cpuWrite(0xA000, 0);
+  bOk &= Check(cart->mirror == Cartridge::VERTICAL, "MMC3 vertical mirroring");
+
+  // PRG RAM at $6000
+  nes->cpuWrite(0x6123, 0x42);
+  bOk &= Check(nes->cpuRead(0x6123) == 0x42, "MMC3 PRG RAM");
+
+  auto sw = Switched(sRom, {}, { { 0x8000, 7 }, { 0x8001, 3 } });
+  bOk &= Check(sw.first == 0x02 && sw.second == 0x00, "MMC3 R7 switches slot 1 only");
+  sw = Switched(sRom, { { 0x8000, 6 }, { 0x8001, 4 } }, { { 0x8000, 0x46 } });
+  bOk &= Check(sw.first == 0x05 && sw.second == 0x00, "MMC3 PRG mode switches slots 0 and 2 only");
+  sw = Switched(sRom, {}, { { 0x8000, 3 }, { 0x8001, 9 } });
+  bOk &= Check(sw.first == 0x00 && sw.second == 0x20, "MMC3 R3 switches CHR slot 5 only");
+
+  bOk &= CheckRestore(*nes, *cart, { { 0x8000, 6 }, { 0x8001, 1 }, { 0x8000, 0x02 }, { 0xA000, 1 } });
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+static bool TestPRGRam()
+{
+  // MMC1, whose PRG register can disable the RAM
+  std::string sRom = MakeRom(1, 8, 4, false);
+  bool bOk = true;
+  static const std::pair<nes6502::ENGINE, std::string> vEngines[] = {
+    { nes6502::FUSED, "fused" },
+    { nes6502::CACHED, "cached" },
+  };
+  for (auto &[e, sEngine] : vEngines) {
+    std::shared_ptr<Cartridge> cart;
+    auto nes = Boot(sRom, cart);
+    if (!Check(nes != nullptr, "MMC1 ROM loads"))
+      return false;
+    nes->cpu.SetEngine(e);
+
+    // LDA #$42 at $6000, run once so the block cache holds it
+    nes->cpuWrite(0x6000, 0xA9);
+    nes->cpuWrite(0x6001, 0x42);
+    bOk &= Check(nes->ReadPage(0x6000) != nullptr, "PRG RAM is read through the page table");
+    nes->cpu.pc = 0x6000;
+    nes->cpu.step();
+    bOk &= Check(nes->cpu.pc == 0x6002 && nes->cpu.a == 0x42, "code runs from PRG RAM on " + sEngine);
+
+    // Disabled, the RAM is neither mapped nor run from
+    WriteMMC1(*nes, 0xE000, 0x10);
+    bOk &= Check(nes->ReadPage(0x6000) == nullptr && nes->cpuRead(0x6000) != 0xA9, "MMC1 disables PRG RAM");
+    nes->cpu.pc = 0x6000;
+    nes->cpu.step();
+    bOk &= Check(nes->cpu.pc != 0x6002, "code is not run from disabled PRG RAM on " + sEngine);
+
+    WriteMMC1(*nes, 0xE000, 0x00);
+    bOk &= Check(nes->ReadPage(0x6000) != nullptr && nes->cpuRead(0x6001) == 0x42, "MMC1 enables PRG RAM again");
+
+    // A forked machine shares the RAM until either writes to it
+    auto child = nes->fork();
+    child->cpuWrite(0x6001, 0x11);
+    nes->cpuWrite(0x6001, 0x22);
+    child->cpuWrite(0x6002, 0x33);
+    bOk &= Check(nes->cpuRead(0x6001) == 0x22 && child->cpuRead(0x6001) == 0x11
+                   && nes->cpuRead(0x6002) != 0x33 && child->cpuRead(0x6002) == 0x33,
+      "forked machines write PRG RAM of their own on " + sEngine);
+  }
+
+  auto sw = Switched(sRom, {}, { { 0xE000, 0 }, { 0xE000, 0 }, { 0xE000, 0 }, { 0xE000, 0 }, { 0xE000, 1 } });
+  bOk &= Check(sw.first == Mapper::nPRGRamSlot, "MMC1 RAM disable switches the PRG RAM only");
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+// Two cartridges of an MMC1 ROM with CHR RAM, and one made after both
+// have written to their RAM, which has to power up blank
+static bool TestSharedImage()
+{
+  std::string sRom = MakeRom(1, 2, 0, false);
+  Cartridge cart(sRom), other(sRom);
+  if (!Check(cart.ImageValid() && other.ImageValid(), "MMC1 ROM with CHR RAM loads"))
+    return false;
+
+  bool bOk = Check(cart.Image() == other.Image(), "cartridges of the same ROM share its image");
+  uint8_t data = 0x00;
+  cart.ppuWrite(0x0010, 0x5A);
+  cart.cpuWrite(0x6000, 0xA5, 0);
+  bOk &= Check(cart.ppuRead(0x0010, data) && data == 0x5A, "CHR RAM keeps what was written");
+  bOk &= Check(other.ppuRead(0x0010, data) && data == 0x00, "CHR RAM write is not seen by the other cartridge");
+  other.ppuWrite(0x0010, 0x3C);
+  bOk &= Check(cart.ppuRead(0x0010, data) && data == 0x5A, "the other cartridge's CHR RAM write is not seen");
+  bOk &= Check(cart.cpuRead(0x6000, data) && data == 0xA5, "PRG RAM keeps what was written");
+  bOk &= Check(other.cpuRead(0x6000, data) && data == 0x00, "PRG RAM write is not seen by the other cartridge");
+
+  Cartridge blank(sRom);
+  bOk &= Check(blank.Image() == cart.Image() && blank.ppuRead(0x0010, data) && data == 0x00,
+    "a new cartridge's CHR RAM powers up blank");
+  bOk &= Check(blank.cpuRead(0x6000, data) && data == 0x00, "a new cartridge's PRG RAM powers up blank");
+
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+// Parses the headers of a ROM with some of their bytes changed, a pair
+// of offset and value each. Sizes not in whole banks and four screen
+// boards parse, but the cartridge refuses them. RAM smaller than the
+// 8KB the mappers address is rounded up
+static bool TestHeaders()
+{
+  std::string sRom = MakeRom(0, 2, 1, true);
+  std::vector<uint8_t> vBase;
+  {
+    std::ifstream ifs(sRom, std::ios::binary);
+    vBase.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  }
+  auto parse = [&](const std::vector<std::pair<size_t, uint8_t>> &vPatch, bool &bRuns) {
+    std::vector<uint8_t> vRom = vBase;
+    for (auto &p : vPatch)
+      vRom[p.first] = p.second;
+    std::ofstream(sRom, std::ios::binary).write((const char *)vRom.data(), vRom.size());
+    bRuns = Cartridge(sRom).ImageValid();
+    return std::make_unique<RomImage>(sRom);
+  };
+
+  bool bOk = true, bRuns = false;
+  auto rom = parse({}, bRuns);
+  bOk &= Check(rom->Valid() && !rom->Nes20() && rom->PRGSize() == 0x8000 && rom->CHRSize() == 0x2000
+                 && rom->VerticalMirror() && !rom->FourScreen() && rom->PRGRamSize() == 0x2000 && bRuns,
+    "iNES header gives its sizes");
+
+  rom = parse({ { 6, 0x09 } }, bRuns);
+  bOk &= Check(rom->Valid() && rom->FourScreen() && !bRuns, "four screen board parses and is refused");
+
+  rom = parse({ { 4, 0x03 } }, bRuns);
+  bOk &= Check(!rom->Valid() && !bRuns, "ROM shorter than its header is invalid");
+
+  rom = parse({ { 7, 0x08 }, { 5, 0x01 }, { 10, 0x07 }, { 11, 0x70 } }, bRuns);
+  bOk &= Check(rom->Valid() && rom->Nes20() && rom->PRGSize() == 0x8000 && rom->CHRSize() == 0x2000
+                 && rom->PRGRamSize() == 0x2000 && rom->CHRRamSize() == 0x2000 && bRuns,
+    "NES 2.0 header gives its sizes");
+
+  // Exponent-multiplier sizes, 2^12 * 1 bytes of CHR and 2^13 * 1 of PRG
+  rom = parse({ { 7, 0x08 }, { 5, 0x30 }, { 9, 0xF0 } }, bRuns);
+  bOk &= Check(rom->Valid() && rom->CHRSize() == 0x1000 && rom->CHR() && !bRuns,
+    "4KB of CHR ROM parses and is refused");
+  rom = parse({ { 7, 0x08 }, { 4, 0x34 }, { 9, 0x0F } }, bRuns);
+  bOk &= Check(rom->Valid() && rom->PRGSize() == 0x2000 && !bRuns, "8KB of PRG ROM parses and is refused");
+
+  // 2KB of PRG RAM, which the cartridge rounds up to the 8KB window
+  rom = parse({ { 7, 0x08 }, { 5, 0x01 }, { 10, 0x05 } }, bRuns);
+  Cartridge cart(sRom);
+  uint8_t nLow = 0x00, nHigh = 0x00;
+  cart.cpuWrite(0x6000, 0x11, 0);
+  cart.cpuWrite(0x7FFF, 0x22, 0);
+  bOk &= Check(rom->Valid() && rom->PRGRamSize() == 0x0800 && bRuns && cart.cpuRead(0x6000, nLow)
+                 && cart.cpuRead(0x7FFF, nHigh) && nLow == 0x11 && nHigh == 0x22,
+    "2KB of PRG RAM covers $6000-$7FFF");
+
+  rom = parse({ { 7, 0x08 }, { 8, 0x01 } }, bRuns);
+  bOk &= Check(rom->Valid() && rom->MapperID() == 0x100 && !bRuns, "NES 2.0 mapper 256 is not implemented");
+
+  std::remove(sRom.c_str());
+  return bOk;
+}
+
+static std::string HexDigest(const uint8_t *p, size_t n)
+{
+  static const char *sDigits = "0123456789abcdef";
+  std::string s;
+  for (size_t i = 0; i < n; i++) {
+    s += sDigits[p[i] >> 4];
+    s += sDigits[p[i] & 0x0F];
+  }
+  return s;
+}
+
+// Known answers of the CRC32 and SHA-1 RomIndex hashes with: the
+// FIPS 180 vectors, which end in one and two blocks, and a pattern
+// cut either side of where SHA-1's padding takes another block, and
+// long enough for many blocks. The CRC32 has to continue across a
+// split too
+static bool TestHashes()
+{
+  struct VECTOR
+  {
+    std::string sData;
+    uint32_t nCrc32;
+    const char *sSha1;
+  };
+  std::string sPattern;
+  for (uint32_t i = 0; i < 1000; i++)
+    sPattern += (char)(i * 7 % 251);
+  const VECTOR vVectors[] = {
+    { "", 0x00000000, "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+    { "abc", 0x352441C2, "a9993e364706816aba3e25717850c26c9cd0d89d" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 0x171A3F5F,
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+    { std::string(1000000, 'a'), 0xDC25BFBC, "34aa973cd4c4daa4f61eeb2bdbad27316534016f" },
+    { sPattern.substr(0, 55), 0x21CE4775, "a83f94113f5292bb7ed9d7df07178ad7d931341a" },
+    { sPattern.substr(0, 56), 0xF697826C, "372e1b20329e0b2862472089ac00c55505116275" },
+    { sPattern.substr(0, 63), 0x0BC208D7, "6944938dc131b6453b7d9637cfcbad8a3db28104" },
+    { sPattern.substr(0, 64), 0xE667F479, "aec4b7f13a2b75ec13bc0c3f13fa55caf97e621d" },
+    { sPattern.substr(0, 65), 0x103377DE, "29a20455c2f21fa85c66014ff3b75bfcce5aaba5" },
+    { sPattern, 0x04DA8651, "33f233c97a803d84a0db9f3dbc05b63ff2045d92" },
+  };
+
+  bool bOk = true;
+  for (auto &v : vVectors) {
+    const uint8_t *p = (const uint8_t *)v.sData.data();
+    size_t n = v.sData.size();
+    uint8_t vSha1[20];
+    RomIndex::Sha1(p, n, vSha1);
+    std::string sWhat = " of " + std::to_string(n) + " bytes";
+    bOk &= Check(RomIndex::Crc32(p, n) == v.nCrc32, "CRC32" + sWhat);
+    bOk &= Check(RomIndex::Crc32(p + n / 3, n - n / 3, RomIndex::Crc32(p, n / 3)) == v.nCrc32,
+      "CRC32 continued" + sWhat);
+    bOk &= Check(HexDigest(vSha1, sizeof(vSha1)) == v.sSha1, "SHA-1" + sWhat);
+  }
+  return bOk;
+}
+
+int main(int argc, char *argv[])
+{
+  static const std::pair<std::string, bool (*)()> vTests[] = {
+    { "mmc1", TestMMC1 },
+    { "mmc1_dummy", TestMMC1Dummy },
+    { "uxrom", TestUxROM },
+    { "banked_code", TestBankedCode },
+    { "cnrom", TestCNROM },
+    { "mmc3", TestMMC3 },
+    { "prg_ram", TestPRGRam },
+    { "shared_image", TestSharedImage },
+    { "headers", TestHeaders },
+    { "hashes", TestHashes },
+  };
+
+  std::string sTest = argc > 1 ? argv[1] : "";
+  for (auto &t : vTests) {
+    if (t.first == sTest) {
+      bool bOk = t.second();
+      std::cout << t.first << (bOk ? " passed\n" : " failed\n");
+      return bOk ? 0 : 1;
+    }
+  }
+
+  std::cout << "usage: test_mappers <test>\ntests:";
+  for (auto &t : vTests)
+    std::cout << " " << t.first;
+  std::cout << "\n";
+  return 2;
+}
@@ -0,0 +1,939 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "Bus.h"
+#include "Batch6502.h"
+#include "Rewind.h"
+#include "RunAhead.h"
+#include "Movie.h"
+#include "Fuzzer.h"
+#include "nes6502.h"
+#include "utils.h"
+
+// The PPU's sprites live in the engine's implementation, so it has to be
+// compiled into one translation unit even though no window is opened
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
+
+// Checks of the whole system on nestest.nes, each run as its own test
+// by name. The CPU engines run nestest in automation mode (pc = $C000,
+// no PPU required) side by side with the reference engine and have to
+// agree after every instr (or JIT block), and so does the lockstep
+// Batch6502 with its lanes either all in step or staggered a few
+// instrs apart. Indexed instrs have to take the page crossing cycle
+// the opcode table lists for them on every engine. The disassembler
+// has to read nestest's first instrs as nestest.log does. The rest run
+// nestest from its reset vector: a frame at a time, clocked dot by dot
+// and driven by events with the PPU catching up, which must draw the
+// same frames, stopped part way through frames, which must not move
+// their ends, a number of cycles at a time, which must end within an
+// instr of them, and from restored snapshots, which must run on
+// exactly as the machine they were taken from. The rewind history has
+// to give back every frame it was given. Run ahead has to show the
+// frames a plain run draws later while staying in step with it. A
+// movie saved to a file and loaded back has to play back, seek and
+// verify to the states it was recorded with, and must not load once
+// its ROM has changed. The fuzzer has to run an input the same every
+// time and fill the coverage map as it goes. A forked machine has to
+// run on as the one it was forked from, without either seeing what
+// the other writes.
+
+// Length of nestest's automated run (the number of lines in nestest.log)
+static constexpr uint32_t nNestestInstructions = 8991;
+
+static std::string EngineName(nes6502::ENGINE e, nes6502::ACCURACY acc = nes6502::PER_INSTR)
+{
+  if (acc == nes6502::PER_CYCLE)
+    return EngineName(e) + "/per-cycle";
+
+  switch (e) {
+  case nes6502::FUSED:
+    return "fused";
+  case nes6502::CACHED:
+    return "cached";
+  case nes6502::JIT:
+    return "jit";
+  default:
+    return "lookup";
+  }
+}
+
+// Power up a NES with the given engine and point it at the automated
+// entry of nestest
+static bool Boot(Bus &nes, const std::string &sRom, nes6502::ENGINE e,
+  nes6502::ACCURACY acc = nes6502::PER_INSTR)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return false;
+
+  nes.insertCartridge(cart);
+  nes.cpu.SetEngine(e);
+  nes.cpu.SetAccuracy(acc);
+  nes.reset();
+  nes.cpu.pc = 0xC000;
+  return true;
+}
+
+// Runs the engine under test against the reference engine and
+// checks they agree after every step. The JIT steps a whole block
+// at a time, so the reference is stepped until it has run the same
+// number of cycles, which must land on one of its instr boundaries
+static bool Compare(nes6502::ENGINE e, nes6502::ACCURACY acc, const std::string &sRom)
+{
+  Bus ref, test;
+  if (!Boot(ref, sRom, nes6502::LOOKUP) || !Boot(test, sRom, e, acc))
+    return false;
+
+  // Repeat the run so the JIT gets hot blocks to compile and then
+  // runs them compiled, its code stays cached across resets
+  uint32_t nPasses = e == nes6502::JIT ? 4 : 1;
+
+  for (uint32_t p = 0; p < nPasses; p++) {
+    for (Bus *nes : { &ref, &test }) {
+      nes->cpuRam.Fill(0x00);
+      nes->cpu.reset();
+      nes->cpu.pc = 0xC000;
+      // Drain the reset cycles
+      nes->cpu.step();
+    }
+
+    uint32_t i = 0;
+    while (i < nNestestInstructions) {
+      uint16_t pc = ref.cpu.pc;
+      uint32_t nTestCycles = test.cpu.step();
+      uint32_t nRefCycles = 0;
+      while (nRefCycles < nTestCycles) {
+        nRefCycles += ref.cpu.step();
+        i++;
+      }
+
+      bool bMatch = nRefCycles == nTestCycles
+                    && ref.cpu.a == test.cpu.a
+                    && ref.cpu.x == test.cpu.x
+                    && ref.cpu.y == test.cpu.y
+                    && ref.cpu.stkp == test.cpu.stkp
+                    && ref.cpu.pc == test.cpu.pc
+                    && ref.cpu.GetStatus() == test.cpu.GetStatus()
+                    && ref.cpuRam == test.cpuRam;
+
+      if (!bMatch) {
+        std::cout << "Mismatch in pass " << p << " before instr " << i << ", stepped from $" << hex(pc, 4)
+                  << " (opcode $" << hex(ref.cpuRead(pc, true), 2) << ")\n"
+                  << "  lookup: A:" << hex(ref.cpu.a, 2) << " X:" << hex(ref.cpu.x, 2)
+                  << " Y:" << hex(ref.cpu.y, 2) << " P:" << hex(ref.cpu.GetStatus(), 2)
+                  << " SP:" << hex(ref.cpu.stkp, 2) << " PC:" << hex(ref.cpu.pc, 4)
+                  << " CYC:" << nRefCycles << "\n"
+                  << "  " << EngineName(e, acc) << ": A:" << hex(test.cpu.a, 2) << " X:" << hex(test.cpu.x, 2)
+                  << " Y:" << hex(test.cpu.y, 2) << " P:" << hex(test.cpu.GetStatus(), 2)
+                  << " SP:" << hex(test.cpu.stkp, 2) << " PC:" << hex(test.cpu.pc, 4)
+                  << " CYC:" << nTestCycles << "\n";
+        return false;
+      }
+    }
+  }
+
+  std::cout << "lookup and " << EngineName(e, acc) << " agree over "
+            << nPasses << " x " << nNestestInstructions << " instrs\n";
+  return true;
+}
+
+// Runs every indexed opcode once from RAM on engine e, with X and Y
+// chosen so the effective address stays in its page and then so it
+// crosses into the next. The cycles taken have to be the base cycles
+// of the opcode table plus its page_cycle when the page was crossed
+static bool CompareOpcodes(nes6502::ENGINE e, nes6502::ACCURACY acc, const std::string &sRom)
+{
+  Bus nes;
+  if (!Boot(nes, sRom, e, acc))
+    return false;
+  nes.cpu.step();
+
+  uint32_t nChecked = 0;
+  for (uint32_t op = 0; op < 256; op++) {
+    const nes6502::OPCODE &o = nes6502::opcodes[op];
+    if (o.mode != nes6502::ADDRMODE::ABX && o.mode != nes6502::ADDRMODE::ABY
+        && o.mode != nes6502::ADDRMODE::IZY)
+      continue;
+
+    for (uint8_t crossed : { 0, 1 }) {
+      // $02F0 indexed, directly or through the pointer at $0010
+      nes.cpuWrite(0x0010, 0xF0);
+      nes.cpuWrite(0x0011, 0x02);
+      nes.cpuWrite(0x0300, (uint8_t)op);
+      nes.cpuWrite(0x0301, o.mode == nes6502::ADDRMODE::IZY ? 0x10 : 0xF0);
+      nes.cpuWrite(0x0302, 0x02);
+      nes.cpu.FlushCode();
+      nes.cpu.x = nes.cpu.y = crossed ? 0x20 : 0x01;
+      nes.cpu.pc = 0x0300;
+
+      uint32_t nCycles = nes.cpu.step();
+      uint32_t nExpected = o.cycles + (crossed & o.page_cycle);
+      if (nCycles != nExpected) {
+        std::cout << EngineName(e, acc) << " takes " << nCycles << " cycles for " << o.name
+                  << " ($" << hex(op, 2) << ")" << (crossed ? " crossing a page" : "")
+                  << ", the opcode table gives " << nExpected << "\n";
+        return false;
+      }
+      nChecked++;
+    }
+  }
+
+  std::cout << EngineName(e, acc) << " agrees with the opcode table on " << nChecked
+            << " indexed instrs\n";
+  return true;
+}
+
+// State of the reference engine after an instr of nestest's automated run
+struct TRACE
+{
+  uint8_t a, x, y, stkp, p;
+  uint16_t pc;
+  uint64_t nCycles;// Since the run started
+};
+
+// Creates a batch of lanes at nestest's automated entry, lane l having
+// already run l % nStagger instrs on its own so that the lanes diverge
+static std::unique_ptr<Batch6502> BootBatch(const std::shared_ptr<Cartridge> &cart,
+  size_t nLanes, uint32_t nStagger, std::vector<uint64_t> &vStart)
+{
+  auto batch = std::make_unique<Batch6502>(nLanes, cart);
+  batch->ClearRam();
+  batch->reset();
+  vStart = batch->cycles;
+  for (size_t l = 0; l < nLanes; l++) {
+    batch->pc[l] = 0xC000;
+    for (uint32_t i = 0; i < l % nStagger; i++)
+      batch->stepLane(l);
+  }
+  return batch;
+}
+
+// Steps a batch through nestest and checks every lane against a trace
+// of the reference engine after each step, and its RAM at the end
+static bool CompareBatch(size_t nLanes, uint32_t nStagger, const std::string &sRom)
+{
+  auto cart = std::make_shared<Cartridge>(sRom);
+  Bus ref;
+  if (!Boot(ref, sRom, nes6502::LOOKUP))
+    return false;
+
+  ref.cpuRam.Fill(0x00);
+  ref.cpu.step();
+  std::vector<TRACE> vTrace;
+  std::vector<std::array<uint8_t, 2048>> vFinalRam;
+  uint64_t nCycles = 0;
+  for (uint32_t i = 0; i <= nNestestInstructions; i++) {
+    vTrace.push_back({ ref.cpu.a, ref.cpu.x, ref.cpu.y, ref.cpu.stkp,
+      ref.cpu.GetStatus(), ref.cpu.pc, nCycles });
+    if (i + nStagger > nNestestInstructions) {
+      vFinalRam.emplace_back();
+      ref.cpuRam.CopyTo(vFinalRam.back().data());
+    }
+    if (i < nNestestInstructions)
+      nCycles += ref.cpu.step();
+  }
+
+  std::vector<uint64_t> vStart;
+  auto batch = BootBatch(cart, nLanes, nStagger, vStart);
+  uint32_t nSteps = nNestestInstructions - (nStagger - 1);
+  for (uint32_t i = 0; i <= nSteps; i++) {
+    if (i > 0)
+      batch->step();
+
+    for (size_t l = 0; l < nLanes; l++) {
+      const TRACE &t = vTrace[i + l % nStagger];
+      bool bMatch = batch->a[l] == t.a && batch->x[l] == t.x && batch->y[l] == t.y
+                    && batch->stkp[l] == t.stkp && batch->GetStatus(l) == t.p
+                    && batch->pc[l] == t.pc && batch->cycles[l] - vStart[l] == t.nCycles;
+
+      if (bMatch && i == nSteps) {
+        const auto &ram = vFinalRam[l % nStagger];
+        for (uint16_t addr = 0; addr < 0x0800 && bMatch; addr++)
+          bMatch = batch->Read(l, addr) == ram[addr];
+      }
+
+      if (!bMatch) {
+        std::cout << "Mismatch in lane " << l << " of " << nLanes << " after " << i
+                  << " steps\n"
+                  << "  lookup: A:" << hex(t.a, 2) << " X:" << hex(t.x, 2) << " Y:" << hex(t.y, 2)
+                  << " P:" << hex(t.p, 2) << " SP:" << hex(t.stkp, 2) << " PC:" << hex(t.pc, 4)
+                  << " CYC:" << t.nCycles << "\n"
+                  << "  batch: A:" << hex(batch->a[l], 2) << " X:" << hex(batch->x[l], 2)
+                  << " Y:" << hex(batch->y[l], 2) << " P:" << hex(batch->GetStatus(l), 2)
+                  << " SP:" << hex(batch->stkp[l], 2) << " PC:" << hex(batch->pc[l], 4)
+                  << " CYC:" << batch->cycles[l] - vStart[l] << "\n";
+        return false;
+      }
+    }
+  }
+
+  std::cout << "lookup and batch of " << nLanes << " lanes (stagger " << nStagger
+            << ") agree over " << nSteps << " steps\n";
+  return true;
+}
+
+// Powers up two NESes on the ROM and runs them for nFrames from the
+// reset vector, one clocked dot by dot and the other a frame event at
+// a time, checking that the screen and the CPU agree after every frame
+static bool CompareFrames(nes6502::ACCURACY acc, uint32_t nFrames, const std::string &sRom)
+{
+  auto dot = std::make_unique<Bus>(), ev = std::make_unique<Bus>();
+  for (Bus *nes : { dot.get(), ev.get() }) {
+    auto cart = std::make_shared<Cartridge>(sRom);
+    if (!cart->ImageValid())
+      return false;
+    nes->insertCartridge(cart);
+    nes->cpu.SetEngine(nes6502::FUSED);
+    nes->cpu.SetAccuracy(acc);
+    nes->reset();
+  }
+
+  olc::Sprite &sprDot = dot->ppu.GetScreen(), &sprEv = ev->ppu.GetScreen();
+  size_t nScreenBytes = (size_t)sprDot.width * sprDot.height * sizeof(olc::Pixel);
+  for (uint32_t f = 0; f < nFrames; f++) {
+    do {
+      dot->clock();
+    } while (!dot->ppu.frame_complete);
+    dot->ppu.frame_complete = false;
+    ev->runFrame();
+
+    bool bMatch = std::memcmp(sprDot.GetData(), sprEv.GetData(), nScreenBytes) == 0
+                  && dot->cpu.a == ev->cpu.a && dot->cpu.x == ev->cpu.x
+                  && dot->cpu.y == ev->cpu.y && dot->cpu.stkp == ev->cpu.stkp
+                  && dot->cpu.GetStatus() == ev->cpu.GetStatus()
+                  && dot->cpuRam == ev->cpuRam;
+    if (!bMatch) {
+      std::cout << "Per-dot and catch-up " << EngineName(nes6502::FUSED, acc)
+                << " runs differ after frame " << f << "\n";
+      return false;
+    }
+  }
+
+  std::cout << "per-dot and catch-up " << EngineName(nes6502::FUSED, acc)
+            << " agree over " << nFrames << " frames\n";
+  return true;
+}
+
+// Runs nestest a frame at a time on one machine, and on another stops
+// it part way through each frame with runCycles() first. The stops must
+// not move the frame ends, so both have to end every frame with the
+// same clock, screen, CPU and RAM
+static bool CompareStops(nes6502::ACCURACY acc, uint32_t nFrames, const std::string &sRom)
+{
+  auto plain = std::make_unique<Bus>(), stopped = std::make_unique<Bus>();
+  for (Bus *nes : { plain.get(), stopped.get() }) {
+    auto cart = std::make_shared<Cartridge>(sRom);
+    if (!cart->ImageValid())
+      return false;
+    nes->insertCartridge(cart);
+    nes->cpu.SetEngine(nes6502::FUSED);
+    nes->cpu.SetAccuracy(acc);
+    nes->reset();
+  }
+
+  olc::Sprite &sprPlain = plain->ppu.GetScreen(), &sprStopped = stopped->ppu.GetScreen();
+  size_t nScreenBytes = (size_t)sprPlain.width * sprPlain.height * sizeof(olc::Pixel);
+  for (uint32_t f = 0; f < nFrames; f++) {
+    // Somewhere from the start to near the end of the frame
+    uint64_t nStop = stopped->ppu.DotsToFrameEnd() / 3 * (f % 5) / 5 + 1;
+    Bus::STATS stats = stopped->runCycles(nStop);
+    plain->runFrame();
+    stopped->runFrame();
+
+    bool bMatch = stats.nFrames == 0 && plain->Clock() == stopped->Clock()
+                  && std::memcmp(sprPlain.GetData(), sprStopped.GetData(), nScreenBytes) == 0
+                  && plain->cpu.a == stopped->cpu.a && plain->cpu.x == stopped->cpu.x
+                  && plain->cpu.y == stopped->cpu.y && plain->cpu.stkp == stopped->cpu.stkp
+                  && plain->cpu.pc == stopped->cpu.pc
+                  && plain->cpu.GetStatus() == stopped->cpu.GetStatus()
+                  && plain->cpuRam == stopped->cpuRam;
+    if (!bMatch) {
+      std::cout << "Stopping " << nStop << " cycles into frame " << f << " on "
+                << EngineName(nes6502::FUSED, acc) << " moves its end\n";
+      return false;
+    }
+  }
+
+  std::cout << "stops part way through " << nFrames << " frames on " << EngineName(nes6502::FUSED, acc)
+            << " leave the frame ends where they were\n";
+  return true;
+}
+
+// Runs nestest for a number of cycles at a time, from a single cycle
+// to several frames. Each run has to report at least the cycles asked
+// for and end within the instr the last of them falls in, which takes
+// no more than 7 cycles
+static bool CompareRunCycles(nes6502::ACCURACY acc, const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return false;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->cpu.SetAccuracy(acc);
+  nes->reset();
+  // Past the 8 cycles of the reset, which are not an instr
+  nes->runFrame();
+
+  for (uint64_t nCycles : { 1, 2, 3, 5, 7, 100, 1234, 29781, 3 * 29781 + 5, 1, 1 }) {
+    uint64_t nStart = nes->Clock();
+    Bus::STATS stats = nes->runCycles(nCycles);
+    if (stats.nCycles < nCycles || stats.nCycles >= nCycles + 7 || stats.nCycles * 3 != nes->Clock() - nStart) {
+      std::cout << "runCycles(" << nCycles << ") on " << EngineName(nes6502::FUSED, acc) << " ran "
+                << stats.nCycles << " cycles, the clock moved " << (nes->Clock() - nStart) << " dots\n";
+      return false;
+    }
+  }
+
+  std::cout << "runCycles() on " << EngineName(nes6502::FUSED, acc) << " ends within an instr of its cycles\n";
+  return true;
+}
+
+// Snapshots the machine part way through a frame, runs on and then
+// runs on again from the snapshot, checking that both runs end with
+// the same screen, CPU, RAM and clock
+static bool CompareStates(nes6502::ACCURACY acc, const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return false;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->cpu.SetAccuracy(acc);
+  nes->reset();
+
+  nes->runCycles(10 * 29781 + 12345);
+  std::vector<uint8_t> vState(nes->StateSize());
+  if (nes->saveState(vState.data(), vState.size()) != vState.size())
+    return false;
+
+  struct END
+  {
+    std::vector<uint8_t> vScreen;
+    std::array<uint8_t, 2048> ram;
+    uint8_t a, x, y, stkp, p;
+    uint16_t pc;
+    uint64_t nClock;
+  } end[2];
+
+  olc::Sprite &spr = nes->ppu.GetScreen();
+  size_t nScreenBytes = (size_t)spr.width * spr.height * sizeof(olc::Pixel);
+  for (END &e : end) {
+    for (uint32_t f = 0; f < 5; f++)
+      nes->runFrame();
+    e.vScreen.assign((uint8_t *)spr.GetData(), (uint8_t *)spr.GetData() + nScreenBytes);
+    nes->cpuRam.CopyTo(e.ram.data());
+    e.a = nes->cpu.a;
+    e.x = nes->cpu.x;
+    e.y = nes->cpu.y;
+    e.stkp = nes->cpu.stkp;
+    e.p = nes->cpu.GetStatus();
+    e.pc = nes->cpu.pc;
+    e.nClock = nes->Clock();
+    if (!nes->loadState(vState.data(), vState.size()))
+      return false;
+  }
+
+  bool bMatch = end[0].vScreen == end[1].vScreen && end[0].ram == end[1].ram
+                && end[0].a == end[1].a && end[0].x == end[1].x && end[0].y == end[1].y
+                && end[0].stkp == end[1].stkp && end[0].p == end[1].p
+                && end[0].pc == end[1].pc && end[0].nClock == end[1].nClock;
+  if (!bMatch) {
+    std::cout << "Run from a " << EngineName(nes6502::FUSED, acc)
+              << " snapshot differs from the original run\n";
+    return false;
+  }
+
+  std::cout << "snapshots of " << EngineName(nes6502::FUSED, acc) << " run on identically, "
+            << vState.size() << " bytes\n";
+  return true;
+}
+
+// Pushes nFrames into a rewind history, then steps all the way back
+// checking each snapshot against the one taken when it was pushed
+static bool CompareRewind(uint32_t nFrames, const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return false;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->reset();
+
+  Rewind rewind(*nes);
+  size_t nState = nes->StateSize();
+  std::vector<uint8_t> vStates(nState * nFrames), vState(nState);
+  for (uint32_t f = 0; f < nFrames; f++) {
+    nes->saveState(&vStates[f * nState], nState);
+    rewind.Push();
+    nes->runFrame();
+  }
+
+  for (uint32_t f = nFrames; f-- > 0;) {
+    bool bBack = rewind.Back();
+    nes->saveState(vState.data(), nState);
+    if (!bBack || !std::equal(vState.begin(), vState.end(), vStates.begin() + f * nState)) {
+      std::cout << "Rewinding to frame " << f << " did not restore it\n";
+      return false;
+    }
+  }
+
+  std::cout << "rewind gives back " << nFrames << " frames\n";
+  return true;
+}
+
+static std::unique_ptr<Bus> BootFrames(const std::string &sRom)
+{
+  auto nes = std::make_unique<Bus>();
+  auto cart = std::make_shared<Cartridge>(sRom);
+  if (!cart->ImageValid())
+    return nullptr;
+  nes->insertCartridge(cart);
+  nes->cpu.SetEngine(nes6502::FUSED);
+  nes->reset();
+  return nes;
+}
+
+// Runs nFrames host frames nAhead frames ahead next to a plain run.
+// After each the machine has to be in the state the plain run was in
+// after the same frame, and show what it drew nAhead frames later
+static bool CompareRunAhead(uint32_t nAhead, uint32_t nFrames, const std::string &sRom)
+{
+  auto plain = BootFrames(sRom), ahead = BootFrames(sRom);
+  if (!plain || !ahead)
+    return false;
+
+  olc::Sprite &sprPlain = plain->ppu.GetScreen(), &sprAhead = ahead->ppu.GetScreen();
+  size_t nScreenBytes = (size_t)sprPlain.width * sprPlain.height * sizeof(olc::Pixel);
+  size_t nState = plain->StateSize();
+  std::vector<std::vector<uint8_t>> vScreens, vStates;
+  for (uint32_t f = 0; f < nFrames + nAhead; f++) {
+    plain->runFrame();
+    vScreens.emplace_back((uint8_t *)sprPlain.GetData(), (uint8_t *)sprPlain.GetData() + nScreenBytes);
+    vStates.emplace_back(nState);
+    plain->saveState(vStates.back().data(), nState);
+  }
+
+  RunAhead runAhead(*ahead, nAhead);
+  std::vector<uint8_t> vState(nState);
+  for (uint32_t f = 0; f < nFrames; f++) {
+    runAhead.runFrame();
+    ahead->saveState(vState.data(), nState);
+    if (vState != vStates[f]
+        || std::memcmp(sprAhead.GetData(), vScreens[f + nAhead].data(), nScreenBytes) != 0) {
+      std::cout << "Running " << nAhead << " ahead differs from a plain run after frame " << f << "\n";
+      return false;
+    }
+  }
+
+  std::cout << "running " << nAhead << " ahead agrees with a plain run over " << nFrames << " frames\n";
+  return true;
+}
+
+// Records nFrames of random buttons into a movie, saves and loads it,
+// and checks that it plays back through the recorded states, seeks
+// to them and verifies. A movie of a copy of the ROM must not load
+// once the copy has changed, and must leave the movie loaded before
+static bool CompareMovie(uint32_t nFrames, const std::string &sRom)
+{
+  auto nes = BootFrames(sRom);
+  if (!nes)
+    return false;
+
+  Movie movie;
+  uint32_t nKeyInterval = 60;
+  movie.Start(*nes, sRom, nKeyInterval);
+  std::vector<uint64_t> vHashes;
+  uint32_t nButtons = 0x2C02;
+  for (uint32_t f = 0; f < nFrames; f++) {
+    nButtons = nButtons * 1103515245 + 12345;
+    movie.RecordFrame(*nes, (uint8_t)(nButtons >> 16), (uint8_t)(nButtons >> 24));
+    vHashes.push_back(BatchRunner::HashState(*nes));
+  }
+
+  std::string sFile = "test_system.nesm", sError;
+  Movie loaded;
+  if (!movie.Save(sFile, sError) || !loaded.Load(sFile, sError)) {
+    std::cout << sError << "\n";
+    return false;
+  }
+  std::remove(sFile.c_str());
+
+  auto play = BootFrames(sRom);
+  loaded.Seek(*play, 0);
+  for (uint32_t f = 0; f < nFrames; f++) {
+    if (!loaded.PlayFrame(*play) || BatchRunner::HashState(*play) != vHashes[f]) {
+      std::cout << "Playing the movie back differs in frame " << f << "\n";
+      return false;
+    }
+  }
+
+  // Either side of keyframes, and the end
+  for (uint32_t nFrame : { 1u, nKeyInterval - 1, nKeyInterval, nKeyInterval + 1, nFrames / 2, nFrames }) {
+    if (!loaded.Seek(*play, nFrame) || BatchRunner::HashState(*play) != vHashes[nFrame - 1]) {
+      std::cout << "Seeking to frame " << nFrame << " of the movie differs\n";
+      return false;
+    }
+  }
+
+  BatchRunner runner(0, false);
+  std::vector<BatchRunner::RESULT> vResults = loaded.Verify(runner);
+  for (size_t i = 0; i < vResults.size(); i++) {
+    if (!vResults[i].bOk || !vResults[i].bHashMatch) {
+      std::cout << "Stretch " << i << " of the movie does not verify\n";
+      return false;
+    }
+  }
+
+  std::ifstream ifs(sRom, std::ifstream::binary);
+  std::vector<char> vRom((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  std::string sCopy = "test_system_movie.nes";
+  std::ofstream(sCopy, std::ofstream::binary).write(vRom.data(), vRom.size());
+  Movie copied;
+  copied.Start(*BootFrames(sCopy), sCopy, nKeyInterval);
+  bool bSaved = copied.Save(sFile, sError);
+  // A byte of PRG ROM, past the 16 byte header
+  vRom[0x10] ^= 0xFF;
+  std::ofstream(sCopy, std::ofstream::binary).write(vRom.data(), vRom.size());
+  bool bLoaded = loaded.Load(sFile, sError);
+  std::remove(sCopy.c_str());
+  std::remove(sFile.c_str());
+  if (!bSaved || bLoaded || loaded.Rom() != sRom || loaded.Frames() != nFrames) {
+    std::cout << "A movie loads on a ROM other than the one it was recorded on\n";
+    return false;
+  }
+
+  std::cout << "movie of " << nFrames << " frames plays back, seeks and verifies in "
+            << vResults.size() << " stretches\n";
+  return true;
+}
+
+// Runs a fixed input through the fuzzer on engine e, from nestest's
+// automation entry point. It has to run the same cycles to the same
+// machine and coverage again on the same fuzzer, after another input
+// has run, and on a second fuzzer, and the coverage has to hold the
+// instrs it ran
+static bool CompareFuzzer(nes6502::ENGINE e, const std::string &sRom)
+{
+  uint32_t nSliceCycles = 128, nMaxSlices = 16;
+  std::vector<uint8_t> vInput, vOther;
+  uint32_t nRand = 0x2C02;
+  for (uint32_t r = 0; r < nMaxSlices * 2; r++) {
+    nRand = nRand * 1103515245 + 12345;
+    // Every other record pokes the stack page, which nestest runs on
+    vInput.push_back((r & 1) ? 0x81 : 0x00);
+    vInput.push_back((uint8_t)(nRand >> 16));
+    vInput.push_back((uint8_t)(nRand >> 24));
+    vOther.push_back((uint8_t)(nRand >> 8) & 0x87);
+    vOther.push_back((uint8_t)(nRand >> 24));
+    vOther.push_back((uint8_t)(nRand >> 16));
+  }
+
+  std::vector<uint8_t> vCoverage[2] = { std::vector<uint8_t>(Fuzzer::nCoverage),
+                                        std::vector<uint8_t>(Fuzzer::nCoverage) };
+  Fuzzer fuzzer(sRom, vCoverage[0].data(), e, nSliceCycles, nMaxSlices, 0xC000);
+  Fuzzer second(sRom, vCoverage[1].data(), e, nSliceCycles, nMaxSlices, 0xC000);
+  if (!fuzzer.Ok() || !second.Ok())
+    return false;
+
+  uint64_t nCycles = fuzzer.Run(vInput.data(), vInput.size());
+  uint64_t nHash = BatchRunner::HashState(fuzzer.Machine());
+  std::vector<uint8_t> vFirst = vCoverage[0];
+  size_t nCovered = Fuzzer::nCoverage - std::count(vFirst.begin(), vFirst.end(), 0);
+  if (nCycles < (uint64_t)nSliceCycles * nMaxSlices || !vFirst[0xC000] || nCovered < 16) {
+    std::cout << "Fuzzing on " << EngineName(e) << " ran " << nCycles << " cycles over " << nCovered
+              << " addresses\n";
+    return false;
+  }
+
+  second.Run(vOther.data(), vOther.size());
+  fuzzer.Run(vOther.data(), vOther.size());
+  for (int i = 0; i < 2; i++)
+    std::fill(vCoverage[i].begin(), vCoverage[i].end(), 0);
+  Fuzzer *vFuzzers[2] = { &fuzzer, &second };
+  for (int i = 0; i < 2; i++) {
+    if (vFuzzers[i]->Run(vInput.data(), vInput.size()) != nCycles
+        || BatchRunner::HashState(vFuzzers[i]->Machine()) != nHash || vCoverage[i] != vFirst) {
+      std::cout << "Fuzzing on " << EngineName(e) << " runs the same input differently "
+                << (i ? "on another fuzzer" : "the second time") << "\n";
+      return false;
+    }
+  }
+
+  std::cout << "fuzzing on " << EngineName(e) << " runs an input the same every time, " << nCycles
+            << " cycles over " << nCovered << " addresses\n";
+  return true;
+}
+
+// Forks a machine on engine e after a few frames and scribbles over
+// the child's RAM, VRAM and palette. The parent has to run on as a
+// machine restored from a snapshot taken at the fork, and forking into
+// the child again has to make it the same as the parent
+static bool CompareFork(nes6502::ENGINE e, uint32_t nFrames, const std::string &sRom)
+{
+  auto parent = BootFrames(sRom), ref = BootFrames(sRom);
+  if (!parent || !ref)
+    return false;
+  parent->cpu.SetEngine(e);
+  ref->cpu.SetEngine(e);
+  for (uint32_t f = 0; f < 10; f++)
+    parent->runFrame();
+
+  size_t nState = parent->StateSize();
+  std::vector<uint8_t> vParent(nState), vRef(nState), vChild(nState);
+  parent->saveState(vParent.data(), nState);
+  ref->loadState(vParent.data(), nState);
+
+  auto child = parent->fork();
+  for (uint32_t f = 0; f < nFrames; f++) {
+    for (uint16_t addr = 0x0000; addr < 0x0800; addr++)
+      child->cpuWrite(addr, (uint8_t)(addr * 7 + f));
+    for (uint16_t addr = 0x2000; addr < 0x3F20; addr++)
+      child->ppu.ppuWrite(addr, (uint8_t)(addr * 3 + f));
+    child->runFrame();
+    parent->runFrame();
+    ref->runFrame();
+    parent->saveState(vParent.data(), nState);
+    ref->saveState(vRef.data(), nState);
+    if (vParent != vRef) {
+      std::cout << "Machine forked on " << EngineName(e) << " differs in frame " << f << "\n";
+      return false;
+    }
+  }
+
+  parent->fork(*child);
+  child->saveState(vChild.data(), nState);
+  if (vChild != vParent) {
+    std::cout << "Forking on " << EngineName(e) << " into a child kept from before differs\n";
+    return false;
+  }
+
+  std::cout << "machine forked on " << EngineName(e) << " runs on unaffected by its child over "
+            << nFrames << " frames\n";
+  return true;
+}
+
+// Disassembles the first instrs of nestest's automated run as the
+// reference engine reaches them, which have to read as they do in
+// nestest.log. An instr in RAM has to be decoded again once the CPU
+// writes over it
+static bool CompareDisasm(const std::string &sRom)
+{
+  static const char *vExpected[] = {
+    "$C000: JMP $C5F5 {ABS}",
+    "$C5F5: LDX #$00 {IMM}",
+    "$C5F7: STX $00 {ZP0}",
+    "$C5F9: STX $10 {ZP0}",
+    "$C5FB: STX $11 {ZP0}",
+    "$C5FD: JSR $C72D {ABS}",
+    "$C72D: NOP  {IMP}",
+    "$C72E: SEC  {IMP}",
+    "$C72F: BCS $04[$C735] {REL}",
+    "$C735: NOP  {IMP}",
+    "$C736: CLC  {IMP}",
+    "$C737: BCS $03[$C73C] {REL}",
+    "$C739: JMP $C740 {ABS}",
+    "$C740: NOP  {IMP}",
+    "$C741: SEC  {IMP}",
+    "$C742: BCC $03[$C747] {REL}",
+  };
+
+  Bus nes;
+  if (!Boot(nes, sRom, nes6502::LOOKUP))
+    return false;
+  nes.cpu.step();
+
+  Disassembler &disasm = nes.cpu.disassembler();
+  char sText[Disassembler::nMaxText];
+  for (const char *sExpected : vExpected) {
+    disasm.Format(nes.cpu.pc, sText);
+    if (std::strcmp(sText, sExpected) != 0) {
+      std::cout << "Disassembled \"" << sText << "\", expected \"" << sExpected << "\"\n";
+      return false;
+    }
+    nes.cpu.step();
+  }
+
+  // LDA #$A9; STA $0300 run by the CPU turns the NOP at $0300 into
+  // LDA #$42
+  uint16_t addr = 0x0200;
+  for (uint8_t v : { 0xA9, 0xA9, 0x8D, 0x00, 0x03 })
+    nes.cpuWrite(addr++, v);
+  nes.cpuWrite(0x0300, 0xEA);
+  nes.cpuWrite(0x0301, 0x42);
+  std::string sBefore = disasm.Format(0x0300, sText);
+  nes.cpu.pc = 0x0200;
+  nes.cpu.step();
+  nes.cpu.step();
+  std::string sAfter = disasm.Format(0x0300, sText);
+  if (sBefore != "$0300: NOP  {IMP}" || sAfter != "$0300: LDA #$42 {IMM}") {
+    std::cout << "Disassembled \"" << sBefore << "\" and then \"" << sAfter << "\" from RAM written over\n";
+    return false;
+  }
+
+  std::cout << "first " << std::size(vExpected) << " instrs of nestest disassemble as in nestest.log\n";
+  return true;
+}
+
+static bool TestFused(const std::string &sRom)
+{
+  return Compare(nes6502::FUSED, nes6502::PER_INSTR, sRom);
+}
+
+static bool TestCached(const std::string &sRom)
+{
+  return Compare(nes6502::CACHED, nes6502::PER_INSTR, sRom);
+}
+
+static bool TestJit(const std::string &sRom)
+{
+  return Compare(nes6502::JIT, nes6502::PER_INSTR, sRom);
+}
+
+static bool TestPerCycle(const std::string &sRom)
+{
+  // The other engines run the same handlers as FUSED per cycle
+  return Compare(nes6502::FUSED, nes6502::PER_CYCLE, sRom);
+}
+
+static bool TestOpcodes(const std::string &sRom)
+{
+  for (auto e : { nes6502::LOOKUP, nes6502::FUSED, nes6502::CACHED })
+    if (!CompareOpcodes(e, nes6502::PER_INSTR, sRom))
+      return false;
+  return CompareOpcodes(nes6502::FUSED, nes6502::PER_CYCLE, sRom);
+}
+
+static bool TestDisasm(const std::string &sRom)
+{
+  return CompareDisasm(sRom);
+}
+
+static bool TestBatch(const std::string &sRom)
+{
+  for (uint32_t nStagger : { 1, 4 })
+    if (!CompareBatch(64, nStagger, sRom))
+      return false;
+  return true;
+}
+
+static bool TestFrames(const std::string &sRom)
+{
+  for (auto acc : { nes6502::PER_INSTR, nes6502::PER_CYCLE })
+    if (!CompareFrames(acc, 60, sRom))
+      return false;
+  return true;
+}
+
+static bool TestStops(const std::string &sRom)
+{
+  for (auto acc : { nes6502::PER_INSTR, nes6502::PER_CYCLE })
+    if (!CompareStops(acc, 60, sRom))
+      return false;
+  return true;
+}
+
+static bool TestRunCycles(const std::string &sRom)
+{
+  for (auto acc : { nes6502::PER_INSTR, nes6502::PER_CYCLE })
+    if (!CompareRunCycles(acc, sRom))
+      return false;
+  return true;
+}
+
+static bool TestStates(const std::string &sRom)
+{
+  for (auto acc : { nes6502::PER_INSTR, nes6502::PER_CYCLE })
+    if (!CompareStates(acc, sRom))
+      return false;
+  return true;
+}
+
+static bool TestRewind(const std::string &sRom)
+{
+  return CompareRewind(600, sRom);
+}
+
+static bool TestRunAhead(const std::string &sRom)
+{
+  for (uint32_t nAhead : { 1, 2 })
+    if (!CompareRunAhead(nAhead, 30, sRom))
+      return false;
+  return true;
+}
+
+static bool TestMovie(const std::string &sRom)
+{
+  return CompareMovie(300, sRom);
+}
+
+static bool TestFuzzer(const std::string &sRom)
+{
+  for (auto e : { nes6502::FUSED, nes6502::CACHED, nes6502::JIT })
+    if (!CompareFuzzer(e, sRom))
+      return false;
+  return true;
+}
+
+static bool TestFork(const std::string &sRom)
+{
+  for (auto e : { nes6502::FUSED, nes6502::CACHED, nes6502::JIT })
+    if (!CompareFork(e, 30, sRom))
+      return false;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  static const std::pair<std::string, bool (*)(const std::string &)> vTests[] = {
+    { "fused", TestFused },
+    { "cached", TestCached },
+    { "jit", TestJit },
+    { "per_cycle", TestPerCycle },
+    { "opcodes", TestOpcodes },
+    { "disasm", TestDisasm },
+    { "batch", TestBatch },
+    { "frames", TestFrames },
+    { "stops", TestStops },
+    { "run_cycles", TestRunCycles },
+    { "states", TestStates },
+    { "rewind", TestRewind },
+    { "runahead", TestRunAhead },
+    { "movie", TestMovie },
+    { "fuzzer", TestFuzzer },
+    { "fork", TestFork },
+  };
+
+  std::string sTest = argc > 1 ? argv[1] : "";
+  std::string sRom = argc > 2 ? argv[2] : "nestest.nes";
+  for (auto &t : vTests) {
+    if (t.first != sTest)
+      continue;
+    auto cart = std::make_shared<Cartridge>(sRom);
+    if (!cart->ImageValid()) {
+      std::cout << "Could not load " << sRom << "\n";
+      return 1;
+    }
+    return t.second(sRom) ? 0 : 1;
+  }
+
+  std::cout << "usage: test_system <test> [rom]\ntests:";
+  for (auto &t : vTests)
+    std::cout << " " << t.first;
+  std::cout << "\n";
+  return 2;
+}